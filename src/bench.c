@@ -0,0 +1,559 @@
+/**
+ * @filename bench.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for the serial port
+ * benchmark.
+ *
+ * The port's transmit and receive lines must be connected together. For
+ * each combination of buffer size and read timeouts, the port is opened
+ * afresh, a second's worth of data is sent and read back to measure
+ * throughput, then single bytes are bounced to measure latency. Reads are
+ * made the way a connected port makes them with the same timeouts, so the
+ * results carry over to a profile using those settings.
+ *
+ * The sweep takes about half a minute, so it runs on its own thread. It
+ * posts TWM_BENCHSTEP before each run and TWM_BENCHDONE at the end, and
+ * can be cancelled between runs.
+ */
+#include "bench.h"
+
+/* Driver buffer sizes tried, for both directions; 0 is the largest */
+static const DWORD kBenchQueues[] = { 1024, 4096, 16384, 0 };
+
+/* Read timeouts tried: waiting for characters and taking what is there,
+   returning as soon as anything arrives, and gathering input until the
+   line goes quiet for 1ms or 10ms */
+static const COMMTIMEOUTS kBenchTimeouts[] = {
+    { MAXDWORD, 0, 0, 0, 0 },
+    { MAXDWORD, MAXDWORD, 100, 0, 0 },
+    { 1, 0, 100, 0, 0 },
+    { 10, 0, 100, 0, 0 }
+};
+
+#define BENCH_QUEUES (sizeof(kBenchQueues) / sizeof(kBenchQueues[0]))
+#define BENCH_SETTINGS (sizeof(kBenchTimeouts) / sizeof(kBenchTimeouts[0]))
+
+/**
+ * The BenchResult structure contains the measurements of one run.
+ *
+ * @member DWORD rate       The bytes read back per second
+ * @member DWORD median     The median round trip time in microseconds
+ * @member DWORD worst      The 99th percentile round trip time
+ * @member DWORD errors     The bytes lost or read back wrong
+ */
+typedef struct _BenchResult {
+    DWORD rate;
+    DWORD median;
+    DWORD worst;
+    DWORD errors;
+} BenchResult;
+
+/**
+ * Waits for an overlapped operation on the port, giving up after
+ * BENCH_TIMEOUT. An operation that is given up on is cancelled.
+ *
+ * @param HANDLE hDev           The serial port device.
+ * @param OVERLAPPED* ov        The overlapped context of the operation.
+ * @param LPDWORD transferred   Receives the number of bytes transferred.
+ * @returns 0 if the operation finished, 1 if it timed out, 2 on error.
+ */
+static int BenchWait(HANDLE hDev, OVERLAPPED* ov, LPDWORD transferred) {
+    if (GetLastError() != ERROR_IO_PENDING) {
+        return 2;
+    }
+
+    if (WaitForSingleObject(ov->hEvent, BENCH_TIMEOUT) != WAIT_OBJECT_0) {
+        CancelIo(hDev);
+        GetOverlappedResult(hDev, ov, transferred, TRUE);
+        return 1;
+    }
+
+    if (!GetOverlappedResult(hDev, ov, transferred, FALSE)) {
+        return 2;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads from the port the way a connected port does with the given timeouts.
+ *
+ * @param HANDLE hDev           The serial port device.
+ * @param OVERLAPPED* ov        The overlapped context for reads.
+ * @param COMMTIMEOUTS* to      The timeouts set on the port.
+ * @param BYTE* buf             Receives the data.
+ * @param DWORD len             The most bytes to read.
+ * @param LPDWORD read          Receives the number of bytes read.
+ * @returns 0 on success, 1 if nothing arrived in time, 2 on error.
+ */
+static int BenchRead(HANDLE hDev, OVERLAPPED* ov, const COMMTIMEOUTS* to,
+        BYTE* buf, DWORD len, LPDWORD read) {
+    int ret = 0;
+
+    *read = 0;
+
+    if (to->ReadIntervalTimeout == MAXDWORD &&
+            to->ReadTotalTimeoutMultiplier == 0 &&
+            to->ReadTotalTimeoutConstant == 0) {
+        DWORD dwEvtMask = 0;
+        DWORD errors = 0;
+        COMSTAT cstat;
+
+        ClearCommError(hDev, &errors, &cstat);
+        if (cstat.cbInQue == 0) {
+            if (!WaitCommEvent(hDev, &dwEvtMask, ov) &&
+                    (ret = BenchWait(hDev, ov, read)) != 0) {
+                return ret;
+            }
+            ClearCommError(hDev, &errors, &cstat);
+        }
+
+        if (cstat.cbInQue < len) {
+            len = cstat.cbInQue;
+        }
+        if (len == 0) {
+            return 0;
+        }
+    }
+
+    if (!ReadFile(hDev, buf, len, read, ov)) {
+        return BenchWait(hDev, ov, read);
+    }
+
+    return 0;
+}
+
+/**
+ * Sends data out the port and waits for it to be handed to the driver.
+ *
+ * @param HANDLE hDev           The serial port device.
+ * @param OVERLAPPED* ov        The overlapped context for writes.
+ * @param BYTE* buf             The data to send.
+ * @param DWORD len             The number of bytes to send.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static int BenchWrite(HANDLE hDev, OVERLAPPED* ov, BYTE* buf, DWORD len) {
+    DWORD written = 0;
+
+    if (!WriteFile(hDev, buf, len, &written, ov) &&
+            BenchWait(hDev, ov, &written) != 0) {
+        return 1;
+    }
+
+    return (written == len) ? 0 : 2;
+}
+
+/**
+ * Opens the port with one combination of settings and measures it.
+ *
+ * @param LPCTSTR port          The name of the serial port.
+ * @param DCB* dcb              The line settings.
+ * @param DWORD queue           The driver buffer size, 0 for the largest.
+ * @param COMMTIMEOUTS* to      The timeouts.
+ * @param BYTE* data            The data for the throughput run.
+ * @param BYTE* back            Receives the data read back.
+ * @param DWORD len             The size of the throughput run.
+ * @param BenchResult* result   Receives the measurements.
+ * @returns 0 on success, greater than 0 if the port could not be set up.
+ */
+static int BenchRun(LPCTSTR port, const DCB* dcb, DWORD queue,
+        const COMMTIMEOUTS* to, BYTE* data, BYTE* back, DWORD len,
+        BenchResult* result) {
+    HANDLE hDev = INVALID_HANDLE_VALUE;
+    OVERLAPPED rov;
+    OVERLAPPED wov;
+    COMMPROP cprops;
+    DCB settings = *dcb;
+    COMMTIMEOUTS timeouts = *to;
+    PortStats ps;
+    LARGE_INTEGER start;
+    LARGE_INTEGER end;
+    DWORD received = 0;
+    DWORD written = 0;
+    DWORD last = 0;
+    DWORD i = 0;
+    int ret = 0;
+
+    ZeroMemory(result, sizeof(BenchResult));
+    StatsReset(&ps);
+    ZeroMemory(&rov, sizeof(OVERLAPPED));
+    ZeroMemory(&wov, sizeof(OVERLAPPED));
+
+    hDev = CreateFile(port, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+            OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+    if (hDev == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+
+    rov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    wov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    if (!rov.hEvent || !wov.hEvent ||
+            !GetCommProperties(hDev, &cprops) ||
+            !SetupComm(hDev, queue ? queue : cprops.dwMaxRxQueue,
+                queue ? queue : cprops.dwMaxTxQueue) ||
+            !SetCommState(hDev, &settings) ||
+            !SetCommTimeouts(hDev, &timeouts) ||
+            !SetCommMask(hDev, EV_RXCHAR) ||
+            !PurgeComm(hDev, PURGE_RXCLEAR | PURGE_TXCLEAR)) {
+        ret = 2;
+    }
+
+    if (ret == 0) {
+        /* Throughput: start the whole write, and read while it goes out */
+        QueryPerformanceCounter(&start);
+        if (!WriteFile(hDev, data, len, &written, &wov) &&
+                GetLastError() != ERROR_IO_PENDING) {
+            ret = 3;
+        }
+
+        last = GetTickCount();
+        while (ret == 0 && received < len) {
+            DWORD read = 0;
+
+            if (BenchRead(hDev, &rov, to, back + received, len - received,
+                    &read) != 0) {
+                break;
+            }
+
+            /* A read can time out empty, so give up if the data stops */
+            if (read > 0) {
+                last = GetTickCount();
+            } else if (GetTickCount() - last > BENCH_TIMEOUT) {
+                break;
+            }
+            received += read;
+        }
+        QueryPerformanceCounter(&end);
+
+        if (ret == 0 && !GetOverlappedResult(hDev, &wov, &written, FALSE)) {
+            CancelIo(hDev);
+            GetOverlappedResult(hDev, &wov, &written, TRUE);
+        }
+
+        if (end.QuadPart > start.QuadPart) {
+            result->rate = (DWORD)(((LONGLONG)received * ps.frequency) /
+                    (end.QuadPart - start.QuadPart));
+        }
+
+        result->errors = len - received;
+        for (i = 0; i < received; i++) {
+            if (back[i] != data[i]) {
+                result->errors++;
+            }
+        }
+    }
+
+    /* Latency: bounce single bytes and time each round trip */
+    for (i = 0; ret == 0 && i < BENCH_PINGS; i++) {
+        BYTE ping = (BYTE)i;
+        BYTE pong = 0;
+        DWORD read = 0;
+
+        PurgeComm(hDev, PURGE_RXCLEAR);
+        QueryPerformanceCounter(&start);
+        if (BenchWrite(hDev, &wov, &ping, 1) != 0) {
+            result->errors++;
+            continue;
+        }
+
+        last = GetTickCount();
+        do {
+            if (BenchRead(hDev, &rov, to, &pong, 1, &read) != 0) {
+                break;
+            }
+        } while (read == 0 && GetTickCount() - last <= BENCH_TIMEOUT);
+        QueryPerformanceCounter(&end);
+
+        if (read == 0 || pong != ping) {
+            result->errors++;
+            continue;
+        }
+        StatsLatency(&ps, end.QuadPart - start.QuadPart);
+    }
+
+    if (ret == 0) {
+        result->median = StatsPercentile(&ps, 50);
+        result->worst = StatsPercentile(&ps, 99);
+    }
+
+    if (rov.hEvent) {
+        CloseHandle(rov.hEvent);
+    }
+    if (wov.hEvent) {
+        CloseHandle(wov.hEvent);
+    }
+    CloseHandle(hDev);
+
+    return ret;
+}
+
+/**
+ * Describes a read timeout value, where MAXDWORD is shown as "max".
+ *
+ * @param DWORD value       The timeout.
+ * @param LPTSTR text       Receives the description.
+ * @returns none
+ */
+static void BenchTimeout(DWORD value, LPTSTR text) {
+    if (value == MAXDWORD) {
+        StringCchCopy(text, 16, TEXT("max"));
+    } else {
+        StringCchPrintf(text, 16, TEXT("%lu"), value);
+    }
+}
+
+/**
+ * Appends text to a file as ANSI characters.
+ *
+ * @param LPCTSTR path      The file to append to.
+ * @param LPCTSTR text      The text.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static int BenchAppend(LPCTSTR path, LPCTSTR text) {
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    CHAR data[4096];
+    DWORD len = 0;
+    DWORD written = 0;
+
+#ifdef UNICODE
+    len = WideCharToMultiByte(CP_ACP, 0, text, -1, data, 4096, NULL, NULL);
+    if (len == 0) {
+        return 1;
+    }
+    len--;
+#else
+    StringCchCopyA(data, 4096, text);
+    len = (DWORD)strlen(data);
+#endif
+
+    hFile = CreateFile(path, FILE_APPEND_DATA, FILE_SHARE_READ, NULL,
+            OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return 2;
+    }
+
+    if (!WriteFile(hFile, data, len, &written, NULL) || written != len) {
+        CloseHandle(hFile);
+        return 3;
+    }
+
+    CloseHandle(hFile);
+    return 0;
+}
+
+/**
+ * Benchmarks a looped-back serial port with every combination of buffer
+ * size and read timeouts, and appends a table of the results to a file,
+ * with the settings to use in a profile for the best throughput and the
+ * best latency. The port must not be open. TWM_BENCHSTEP is posted to the
+ * window before each run.
+ *
+ * @param Bench* b          The benchmark.
+ * @returns 0 on success, 4 if it was cancelled, greater than 0 otherwise.
+ */
+static int BenchSweep(Bench* b) {
+    BenchResult results[BENCH_QUEUES][BENCH_SETTINGS];
+    LPCTSTR port = b->port;
+    const DCB* dcb = &b->dcb;
+    TCHAR text[4096];
+    TCHAR interval[16];
+    TCHAR multiplier[16];
+    SYSTEMTIME now;
+    BYTE* data = NULL;
+    BYTE* back = NULL;
+    DWORD len = dcb->BaudRate / 10;
+    DWORD fastest = 0;
+    DWORD quickest = 0;
+    DWORD q = 0;
+    DWORD t = 0;
+    size_t used = 0;
+    int ret = 0;
+
+    if (len < BENCH_MIN_BYTES) {
+        len = BENCH_MIN_BYTES;
+    } else if (len > BENCH_MAX_BYTES) {
+        len = BENCH_MAX_BYTES;
+    }
+
+    data = (BYTE*)malloc(len);
+    back = (BYTE*)malloc(len);
+    if (data == NULL || back == NULL) {
+        free(data);
+        free(back);
+        return 1;
+    }
+
+    for (q = 0; q < len; q++) {
+        data[q] = (BYTE)(q * 7 + (q >> 8));
+    }
+
+    for (q = 0; q < BENCH_QUEUES && ret == 0; q++) {
+        for (t = 0; t < BENCH_SETTINGS && ret == 0; t++) {
+            if (b->cancel) {
+                ret = 4;
+                break;
+            }
+
+            PostMessage(b->hwnd, TWM_BENCHSTEP, q * BENCH_SETTINGS + t + 1,
+                    BENCH_QUEUES * BENCH_SETTINGS);
+
+            if (BenchRun(port, dcb, kBenchQueues[q], &kBenchTimeouts[t],
+                    data, back, len, &results[q][t]) != 0) {
+                ret = 2;
+            }
+        }
+    }
+
+    free(data);
+    free(back);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    GetLocalTime(&now);
+    StringCchPrintf(text, 4096,
+            TEXT("%04u-%02u-%02u %02u:%02u:%02u %s at %lu baud, %lu bytes per run\r\n")
+            TEXT("RxBuffer TxBuffer ReadInterval ReadMultiplier ReadConstant")
+            TEXT("  bytes/sec  50%% us  99%% us  errors\r\n"),
+            now.wYear, now.wMonth, now.wDay, now.wHour, now.wMinute,
+            now.wSecond, port, dcb->BaudRate, len);
+
+    for (q = 0; q < BENCH_QUEUES; q++) {
+        for (t = 0; t < BENCH_SETTINGS; t++) {
+            BenchResult* r = &results[q][t];
+
+            BenchTimeout(kBenchTimeouts[t].ReadIntervalTimeout, interval);
+            BenchTimeout(kBenchTimeouts[t].ReadTotalTimeoutMultiplier, multiplier);
+
+            StringCchLength(text, 4096, &used);
+            StringCchPrintf(text + used, 4096 - used,
+                    TEXT("%8lu %8lu %12s %14s %12lu %10lu %7lu %7lu %7lu\r\n"),
+                    kBenchQueues[q], kBenchQueues[q], interval, multiplier,
+                    kBenchTimeouts[t].ReadTotalTimeoutConstant,
+                    r->rate, r->median, r->worst, r->errors);
+
+            /* Only error-free runs are recommended */
+            if (r->errors == 0) {
+                BenchResult* f = &results[fastest / BENCH_SETTINGS][fastest % BENCH_SETTINGS];
+                BenchResult* l = &results[quickest / BENCH_SETTINGS][quickest % BENCH_SETTINGS];
+
+                if (f->errors != 0 || r->rate > f->rate) {
+                    fastest = q * BENCH_SETTINGS + t;
+                }
+                if (l->errors != 0 || r->median < l->median) {
+                    quickest = q * BENCH_SETTINGS + t;
+                }
+            }
+        }
+    }
+
+    q = fastest / BENCH_SETTINGS;
+    t = fastest % BENCH_SETTINGS;
+    BenchTimeout(kBenchTimeouts[t].ReadIntervalTimeout, interval);
+    BenchTimeout(kBenchTimeouts[t].ReadTotalTimeoutMultiplier, multiplier);
+    StringCchLength(text, 4096, &used);
+    StringCchPrintf(text + used, 4096 - used,
+            TEXT("Best throughput: RxBuffer=%lu TxBuffer=%lu ReadInterval=%s ")
+            TEXT("ReadMultiplier=%s ReadConstant=%lu\r\n"),
+            kBenchQueues[q], kBenchQueues[q], interval, multiplier,
+            kBenchTimeouts[t].ReadTotalTimeoutConstant);
+
+    q = quickest / BENCH_SETTINGS;
+    t = quickest % BENCH_SETTINGS;
+    BenchTimeout(kBenchTimeouts[t].ReadIntervalTimeout, interval);
+    BenchTimeout(kBenchTimeouts[t].ReadTotalTimeoutMultiplier, multiplier);
+    StringCchLength(text, 4096, &used);
+    StringCchPrintf(text + used, 4096 - used,
+            TEXT("Best latency: RxBuffer=%lu TxBuffer=%lu ReadInterval=%s ")
+            TEXT("ReadMultiplier=%s ReadConstant=%lu\r\n\r\n"),
+            kBenchQueues[q], kBenchQueues[q], interval, multiplier,
+            kBenchTimeouts[t].ReadTotalTimeoutConstant);
+
+    if (BenchAppend(b->path, text) != 0) {
+        return 3;
+    }
+
+    return 0;
+}
+
+/**
+ * The thread procedure of the benchmark. Runs the sweep and posts the
+ * result to the window.
+ *
+ * @param LPVOID lpParameter    Pointer to the Bench
+ * @returns 0 if the thread exited successfully.
+ */
+static DWORD WINAPI BenchLoop(LPVOID lpParameter) {
+    Bench* b = (Bench*)lpParameter;
+    int ret = BenchSweep(b);
+    DWORD dwError = (ret != 0) ? GetLastError() : 0;
+
+    PostMessage(b->hwnd, TWM_BENCHDONE, (WPARAM)ret, (LPARAM)dwError);
+
+    return 0;
+}
+
+/**
+ * Starts benchmarking a looped-back serial port on a thread of its own.
+ * The window is posted TWM_BENCHSTEP as each run starts and TWM_BENCHDONE
+ * when the benchmark ends, after which BenchStop must be called.
+ *
+ * @param Bench* b          The benchmark, which must not be running.
+ * @param LPCTSTR port      The name of the serial port, which must not be open.
+ * @param DCB* dcb          The line settings to run at.
+ * @param LPCTSTR path      The file to append the results to.
+ * @param HWND hwnd         The window to report to.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int BenchStart(Bench* b, LPCTSTR port, const DCB* dcb, LPCTSTR path, HWND hwnd) {
+    if (FAILED(StringCchCopy(b->port, BENCH_NAME, port)) ||
+            FAILED(StringCchCopy(b->path, MAX_PATH, path))) {
+        SetLastError(ERROR_BUFFER_OVERFLOW);
+        return 1;
+    }
+
+    b->hwnd = hwnd;
+    b->dcb = *dcb;
+    b->cancel = 0;
+
+    b->hThread = CreateThread(NULL, 0, &BenchLoop, (LPVOID)b, 0, 0);
+    if (b->hThread == NULL) {
+        return 2;
+    }
+
+    return 0;
+}
+
+/**
+ * Waits for the benchmark thread to finish. A benchmark still running is
+ * cancelled, which takes until the end of the current run.
+ *
+ * @param Bench* b          The benchmark.
+ * @returns none
+ */
+void BenchStop(Bench* b) {
+    if (b->hThread == NULL) {
+        return;
+    }
+
+    InterlockedExchange(&b->cancel, 1);
+    WaitForSingleObject(b->hThread, INFINITE);
+    CloseHandle(b->hThread);
+    b->hThread = NULL;
+}
+
+/**
+ * Tells whether a benchmark has been started and not stopped.
+ *
+ * @param Bench* b          The benchmark.
+ * @returns TRUE if BenchStart succeeded and BenchStop has not been called.
+ */
+BOOLEAN BenchRunning(Bench* b) {
+    return b->hThread != NULL;
+}
@@ -0,0 +1,71 @@
+/**
+ * @filename bench.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the serial port
+ * benchmark, which measures throughput and latency on a looped-back port
+ * for a range of driver buffer sizes and read timeouts. The benchmark runs
+ * on a thread of its own and reports to a window with messages.
+ */
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+#include "defines.h"
+#include "stats.h"
+
+/* Bytes sent in each throughput run: a second's worth, within these bounds */
+#define BENCH_MIN_BYTES 1024
+#define BENCH_MAX_BYTES 262144
+/* Single byte round trips timed in each latency run */
+#define BENCH_PINGS 50
+/* Longest wait (ms) for looped-back data before a run gives up */
+#define BENCH_TIMEOUT 5000
+
+/* The longest port name benchmarked; room for any COM port's device
+   name, as SERIAL_DEVICE */
+#define BENCH_NAME 20
+
+/**
+ * The Bench structure contains a benchmark running on its own thread.
+ *
+ * @member HANDLE hThread   The benchmark thread, NULL if none was started
+ * @member HWND hwnd        The window sent progress and the result
+ * @member TCHAR port[]     The name of the serial port
+ * @member DCB dcb          The line settings to run at
+ * @member TCHAR path[]     The file the results are appended to
+ * @member LONG cancel      Set to stop the benchmark after the current run
+ */
+typedef struct _Bench {
+    HANDLE hThread;
+    HWND hwnd;
+    TCHAR port[BENCH_NAME];
+    DCB dcb;
+    TCHAR path[MAX_PATH];
+    volatile LONG cancel;
+} Bench;
+
+/**
+ * Starts benchmarking a looped-back serial port on a thread of its own.
+ * @implementation bench.c
+ */
+int BenchStart(Bench* b, LPCTSTR port, const DCB* dcb, LPCTSTR path, HWND hwnd);
+
+/**
+ * Waits for the benchmark thread to finish, cancelling it first.
+ * @implementation bench.c
+ */
+void BenchStop(Bench* b);
+
+/**
+ * Tells whether a benchmark has been started and not stopped.
+ * @implementation bench.c
+ */
+BOOLEAN BenchRunning(Bench* b);
+
+#endif
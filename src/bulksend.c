@@ -0,0 +1,217 @@
+/**
+ * @filename bulksend.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 28
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for sending files and
+ * clipboard pastes out the serial port in bulk.
+ *
+ * Files are read through a mapped view that slides along the file, so a
+ * file of any size is sent without copying it into memory first. Data is
+ * moved into the transmit queue only as fast as the queue drains: the
+ * first chunk is queued when the send starts, and more is queued each time
+ * the transmit thread reports a completed write with TWM_TXDONE. Flow
+ * control is left to the port's DCB, which holds the queue back while the
+ * device is not ready.
+ */
+#include "bulksend.h"
+
+/**
+ * Maps the next window of the file being sent.
+ *
+ * @param BulkSend* bs  The bulk send state.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static int MapNextView(BulkSend* bs) {
+    if (bs->view != NULL) {
+        UnmapViewOfFile(bs->view);
+        bs->view = NULL;
+    }
+
+    /* Views always start on a BULKSEND_VIEW boundary */
+    bs->viewbase = bs->sent - (bs->sent % BULKSEND_VIEW);
+    bs->viewlen = (bs->size - bs->viewbase > BULKSEND_VIEW)
+            ? BULKSEND_VIEW : (DWORD)(bs->size - bs->viewbase);
+
+    bs->view = (BYTE*)MapViewOfFile(bs->hMap, FILE_MAP_READ,
+            (DWORD)(bs->viewbase >> 32), (DWORD)bs->viewbase, bs->viewlen);
+    if (bs->view == NULL) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Starts sending a file. Nothing is queued until BulkSendPump is called.
+ *
+ * @param BulkSend* bs  The bulk send state.
+ * @param LPCTSTR path  The path of the file to send.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int BulkSendFile(BulkSend* bs, LPCTSTR path) {
+    LARGE_INTEGER size;
+
+    BulkSendStop(bs);
+
+    bs->hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (bs->hFile == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+
+    if (!GetFileSizeEx(bs->hFile, &size)) {
+        BulkSendStop(bs);
+        return 2;
+    }
+
+    if (size.QuadPart == 0) {
+        /* Nothing to send; a mapping of an empty file would fail */
+        BulkSendStop(bs);
+        return 0;
+    }
+
+    bs->hMap = CreateFileMapping(bs->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (bs->hMap == NULL) {
+        BulkSendStop(bs);
+        return 3;
+    }
+
+    bs->size = (ULONGLONG)size.QuadPart;
+    bs->sent = 0;
+    bs->viewbase = 0;
+    bs->viewlen = 0;
+    bs->start = GetTickCount();
+    bs->lastreport = bs->start;
+    bs->active = TRUE;
+
+    return 0;
+}
+
+/**
+ * Starts sending a block of text, such as a clipboard paste. The text is
+ * copied, so the caller may free it straight away.
+ *
+ * @param BulkSend* bs  The bulk send state.
+ * @param LPCSTR text   The text to send.
+ * @param DWORD len     The number of bytes of text.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int BulkSendText(BulkSend* bs, LPCSTR text, DWORD len) {
+    BulkSendStop(bs);
+
+    if (len == 0) {
+        return 0;
+    }
+
+    bs->view = (BYTE*)malloc(len);
+    if (bs->view == NULL) {
+        return 1;
+    }
+    memcpy(bs->view, text, len);
+
+    bs->size = len;
+    bs->sent = 0;
+    bs->viewbase = 0;
+    bs->viewlen = len;
+    bs->start = GetTickCount();
+    bs->lastreport = bs->start;
+    bs->active = TRUE;
+
+    return 0;
+}
+
+/**
+ * Moves as much pending data as will fit into the transmit queue without
+ * waiting. Call this when the send starts and on every TWM_TXDONE.
+ *
+ * @param BulkSend* bs      The bulk send state.
+ * @param SerialPort* sp    The serial port to send on.
+ * @returns 0 on success, greater than 0 if the file could not be read.
+ */
+int BulkSendPump(BulkSend* bs, SerialPort* sp) {
+    while (bs->active && bs->sent < bs->size) {
+        DWORD offset = 0;
+        DWORD queued = 0;
+
+        if (bs->sent >= bs->viewbase + bs->viewlen) {
+            /* Only a file has more data past the end of its view */
+            if (bs->hMap == NULL || MapNextView(bs) != 0) {
+                BulkSendStop(bs);
+                return 1;
+            }
+        }
+
+        offset = (DWORD)(bs->sent - bs->viewbase);
+        queued = QueueData(sp, bs->view + offset, bs->viewlen - offset);
+        bs->sent += queued;
+
+        if (queued == 0) {
+            /* The queue is full; wait for the next TWM_TXDONE */
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Describes the progress and throughput of the current send. Bytes still
+ * in the transmit queue are not counted as sent, so the rate reported once
+ * the queue drains is the sustained rate of the whole transfer.
+ *
+ * @param BulkSend* bs  The bulk send state.
+ * @param DWORD queued  The number of bytes still in the transmit queue.
+ * @param LPTSTR text   Receives the description.
+ * @param size_t len    The size of text in characters.
+ * @returns none
+ */
+void BulkSendStatus(BulkSend* bs, DWORD queued, LPTSTR text, size_t len) {
+    ULONGLONG done = (bs->sent > queued) ? bs->sent - queued : 0;
+    DWORD elapsed = GetTickCount() - bs->start;
+    ULONGLONG rate = 0;
+
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+    rate = (done * 1000) / elapsed;
+
+    if (done >= bs->size) {
+        StringCchPrintf(text, len,
+                TEXT("Sent %I64u bytes in %lu.%03lu s (%I64u bytes/sec)"),
+                bs->size, elapsed / 1000, elapsed % 1000, rate);
+    } else {
+        StringCchPrintf(text, len,
+                TEXT("Sending %I64u of %I64u bytes (%I64u bytes/sec)"),
+                done, bs->size, rate);
+    }
+}
+
+/**
+ * Stops the current send and releases the file or text. Data already in
+ * the transmit queue is still sent.
+ *
+ * @param BulkSend* bs  The bulk send state.
+ * @returns none
+ */
+void BulkSendStop(BulkSend* bs) {
+    if (bs->hMap != NULL) {
+        if (bs->view != NULL) {
+            UnmapViewOfFile(bs->view);
+        }
+        CloseHandle(bs->hMap);
+        bs->hMap = NULL;
+    } else {
+        free(bs->view);
+    }
+    bs->view = NULL;
+
+    if (bs->hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(bs->hFile);
+        bs->hFile = INVALID_HANDLE_VALUE;
+    }
+
+    bs->active = FALSE;
+}
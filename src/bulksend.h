@@ -0,0 +1,83 @@
+/**
+ * @filename bulksend.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 28
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for sending files and
+ * clipboard pastes out the serial port in bulk.
+ */
+#ifndef _BULKSEND_H_
+#define _BULKSEND_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+#include "defines.h"
+#include "serial.h"
+
+/* Size of each mapped view of a file being sent (a multiple of 64K) */
+#define BULKSEND_VIEW 0x100000
+/* Milliseconds between progress reports */
+#define BULKSEND_REPORT 500
+
+/**
+ * The BulkSend structure contains the state of a file or paste being
+ * streamed into the transmit queue.
+ *
+ * @member HANDLE hFile         The file being sent, or INVALID_HANDLE_VALUE
+ * @member HANDLE hMap          The file mapping of hFile
+ * @member BYTE* view           The mapped view, or the pasted text
+ * @member ULONGLONG viewbase   The file offset of the start of the view
+ * @member DWORD viewlen        The number of bytes in the view
+ * @member ULONGLONG size       The total number of bytes to send
+ * @member ULONGLONG sent       The number of bytes handed to the queue
+ * @member DWORD start          The tick count when sending started
+ * @member DWORD lastreport     The tick count of the last progress report
+ * @member BOOLEAN active       TRUE while a send is in progress
+ */
+typedef struct _BulkSend {
+    HANDLE hFile;
+    HANDLE hMap;
+    BYTE* view;
+    ULONGLONG viewbase;
+    DWORD viewlen;
+    ULONGLONG size;
+    ULONGLONG sent;
+    DWORD start;
+    DWORD lastreport;
+    BOOLEAN active;
+} BulkSend;
+
+/**
+ * Starts sending a file.
+ * @implementation bulksend.c
+ */
+int BulkSendFile(BulkSend* bs, LPCTSTR path);
+
+/**
+ * Starts sending a block of text.
+ * @implementation bulksend.c
+ */
+int BulkSendText(BulkSend* bs, LPCSTR text, DWORD len);
+
+/**
+ * Moves as much pending data as will fit into the transmit queue.
+ * @implementation bulksend.c
+ */
+int BulkSendPump(BulkSend* bs, SerialPort* sp);
+
+/**
+ * Describes the progress and throughput of the current send.
+ * @implementation bulksend.c
+ */
+void BulkSendStatus(BulkSend* bs, DWORD queued, LPTSTR text, size_t len);
+
+/**
+ * Stops the current send and releases the file or text.
+ * @implementation bulksend.c
+ */
+void BulkSendStop(BulkSend* bs);
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * @filename capture.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for capturing received
+ * data to a file.
+ *
+ * A capture is a stage at the front of the receive pipeline, so it records
+ * the data exactly as it came off the port, file transfers included, and
+ * lets all of it through untouched.
+ */
+#include "capture.h"
+
+/**
+ * Sets up a capture that is not capturing.
+ *
+ * @param Capture* cap  The capture.
+ * @returns none
+ */
+void CaptureInit(Capture* cap) {
+    cap->hFile = INVALID_HANDLE_VALUE;
+    cap->written = 0;
+}
+
+/**
+ * Starts capturing to the end of a file, creating it if need be. A capture
+ * already in progress is stopped first.
+ *
+ * @param Capture* cap  The capture.
+ * @param LPCTSTR path  The path of the file.
+ * @returns 0 on success, >0 otherwise
+ */
+int CaptureStart(Capture* cap, LPCTSTR path) {
+    CaptureStop(cap);
+
+    cap->hFile = CreateFile(path, FILE_APPEND_DATA, FILE_SHARE_READ, NULL,
+            OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (cap->hFile == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+
+    cap->written = 0;
+    return 0;
+}
+
+/**
+ * Stops capturing and closes the file.
+ *
+ * @param Capture* cap  The capture.
+ * @returns none
+ */
+void CaptureStop(Capture* cap) {
+    if (cap->hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(cap->hFile);
+        cap->hFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+/**
+ * The receive pipeline stage of a capture. The data is appended to the
+ * capture file and passed on as it is. If the write fails, the data still
+ * goes on to the emulator.
+ *
+ * @param LPVOID data   The Capture.
+ * @param RxSlice* in   The received data.
+ * @param RxSlice* out  Receives the same data.
+ * @param DWORD max     The room in out.
+ * @returns 1
+ */
+DWORD CaptureStage(LPVOID data, RxSlice* in, RxSlice* out, DWORD max) {
+    Capture* cap = (Capture*)data;
+    DWORD written = 0;
+
+    if (cap->hFile != INVALID_HANDLE_VALUE &&
+            WriteFile(cap->hFile, in->data, in->len, &written, NULL)) {
+        cap->written += written;
+    }
+
+    out[0] = *in;
+    return 1;
+}
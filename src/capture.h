@@ -0,0 +1,53 @@
+/**
+ * @filename capture.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for capturing the data
+ * received in a session to a file.
+ */
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include "pipeline.h"
+
+/**
+ * The Capture structure contains a capture file.
+ *
+ * @member HANDLE hFile         The capture file, or INVALID_HANDLE_VALUE
+ * @member ULONGLONG written    The number of bytes captured
+ */
+typedef struct _Capture {
+    HANDLE hFile;
+    ULONGLONG written;
+} Capture;
+
+/**
+ * Sets up a capture that is not capturing.
+ * @implementation capture.c
+ */
+void CaptureInit(Capture* cap);
+
+/**
+ * Starts capturing to the end of a file.
+ * @implementation capture.c
+ */
+int CaptureStart(Capture* cap, LPCTSTR path);
+
+/**
+ * Stops capturing and closes the file.
+ * @implementation capture.c
+ */
+void CaptureStop(Capture* cap);
+
+/**
+ * The receive pipeline stage of a capture.
+ * @implementation capture.c
+ */
+DWORD CaptureStage(LPVOID data, RxSlice* in, RxSlice* out, DWORD max);
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * @filename crc.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 29
+ * @project Terminal Emulator
+ *
+ * This file contains the implementations of the checksums used by the file
+ * transfer protocols. Both are table driven; CRC-32 uses the slicing-by-8
+ * method, which folds eight input bytes per step through eight tables
+ * instead of one byte per table lookup.
+ *
+ * The tables are built the first time either function is called.
+ */
+#include "crc.h"
+
+static WORD crc16_table[256];
+static DWORD crc32_table[8][256];
+static BOOLEAN crc_ready = FALSE;
+
+/**
+ * Builds the lookup tables.
+ *
+ * @returns none
+ */
+static void CrcInit(void) {
+    DWORD i = 0;
+    DWORD j = 0;
+
+    for (i = 0; i < 256; i++) {
+        WORD c16 = (WORD)(i << 8);
+        DWORD c32 = i;
+
+        for (j = 0; j < 8; j++) {
+            c16 = (c16 & 0x8000) ? (WORD)((c16 << 1) ^ 0x1021) : (WORD)(c16 << 1);
+            c32 = (c32 & 1) ? (c32 >> 1) ^ 0xEDB88320UL : (c32 >> 1);
+        }
+
+        crc16_table[i] = c16;
+        crc32_table[0][i] = c32;
+    }
+
+    /* Each table advances the previous one by a further zero byte */
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 8; j++) {
+            DWORD c = crc32_table[j - 1][i];
+            crc32_table[j][i] = (c >> 8) ^ crc32_table[0][c & 0xFF];
+        }
+    }
+
+    crc_ready = TRUE;
+}
+
+/**
+ * Computes the CRC-16/XMODEM (CCITT polynomial 0x1021, no reflection, no
+ * final XOR) of a block of data.
+ *
+ * @param WORD crc          The CRC of the preceding data, or 0 to start.
+ * @param const BYTE* data  The data.
+ * @param DWORD len         The number of bytes of data.
+ * @returns The updated CRC.
+ */
+WORD Crc16(WORD crc, const BYTE* data, DWORD len) {
+    if (!crc_ready) {
+        CrcInit();
+    }
+
+    while (len-- > 0) {
+        crc = (WORD)((crc << 8) ^ crc16_table[((crc >> 8) ^ *data++) & 0xFF]);
+    }
+
+    return crc;
+}
+
+/**
+ * Computes the CRC-32 (IEEE 802.3, as used by ZMODEM and zip) of a block of
+ * data. Calls can be chained by passing the result of one as the crc of
+ * the next.
+ *
+ * The eight-byte steps read the input as little-endian DWORDs.
+ *
+ * @param DWORD crc         The CRC of the preceding data, or 0 to start.
+ * @param const BYTE* data  The data.
+ * @param DWORD len         The number of bytes of data.
+ * @returns The updated CRC.
+ */
+DWORD Crc32(DWORD crc, const BYTE* data, DWORD len) {
+    if (!crc_ready) {
+        CrcInit();
+    }
+
+    crc = ~crc;
+
+    /* Bring the data up to a DWORD boundary */
+    while (len > 0 && ((ULONG_PTR)data & 3) != 0) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *data++) & 0xFF];
+        len--;
+    }
+
+    while (len >= 8) {
+        DWORD one = *(const DWORD*)data ^ crc;
+        DWORD two = *(const DWORD*)(data + 4);
+
+        crc = crc32_table[7][one & 0xFF] ^
+              crc32_table[6][(one >> 8) & 0xFF] ^
+              crc32_table[5][(one >> 16) & 0xFF] ^
+              crc32_table[4][one >> 24] ^
+              crc32_table[3][two & 0xFF] ^
+              crc32_table[2][(two >> 8) & 0xFF] ^
+              crc32_table[1][(two >> 16) & 0xFF] ^
+              crc32_table[0][two >> 24];
+
+        data += 8;
+        len -= 8;
+    }
+
+    while (len-- > 0) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *data++) & 0xFF];
+    }
+
+    return ~crc;
+}
@@ -0,0 +1,40 @@
+/**
+ * @filename crc.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 29
+ * @project Terminal Emulator
+ *
+ * This file contains the prototypes for the checksums used by the file
+ * transfer protocols.
+ */
+#ifndef _CRC_H_
+#define _CRC_H_
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+/* The checksums are plain C, so their tests also build and run off Windows */
+#include <stddef.h>
+typedef unsigned char BYTE;
+typedef unsigned char BOOLEAN;
+typedef unsigned short WORD;
+typedef unsigned int DWORD;
+typedef size_t ULONG_PTR;
+#define TRUE 1
+#define FALSE 0
+#endif
+
+/**
+ * Computes the CRC-16/XMODEM (CCITT polynomial 0x1021) of a block of data.
+ * @implementation crc.c
+ */
+WORD Crc16(WORD crc, const BYTE* data, DWORD len);
+
+/**
+ * Computes the CRC-32 (IEEE 802.3) of a block of data.
+ * @implementation crc.c
+ */
+DWORD Crc32(DWORD crc, const BYTE* data, DWORD len);
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * @filename decoder.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the interface of a decoder plugin. A decoder is run
+ * by the plugin host (tools\pluginhost), in a process of its own, and
+ * turns the data received in a session into what the emulator is shown. It
+ * may take as long as it likes, or crash, without holding up the terminal.
+ */
+#ifndef _DECODER_H_
+#define _DECODER_H_
+
+#include <Windows.h>
+
+/* The version of the Decoder structure */
+#define DECODER_VERSION 1
+/* Most data passed to decode at once */
+#define DECODER_CHUNK 4096
+/* Room for the output of decode, as a multiple of its input */
+#define DECODER_EXPAND 4
+
+/**
+ * The Decoder structure contains the functions of a decoder plugin.
+ *
+ * @member DWORD dwVersion  DECODER_VERSION
+ * @member create           Makes the decoder's state. Returns NULL on error.
+ * @member decode           Decodes len bytes of in, at most DECODER_CHUNK,
+ *                          into out, which has room for DECODER_EXPAND
+ *                          times as much. Returns the length of the output.
+ * @member destroy          Frees the decoder's state.
+ */
+typedef struct _Decoder {
+    DWORD dwVersion;
+    LPVOID (*create)(void);
+    DWORD (*decode)(LPVOID data, const BYTE* in, DWORD len, BYTE* out);
+    void (*destroy)(LPVOID data);
+} Decoder;
+
+/* Exports the decoder from its DLL, for the host to find */
+#define DECODER_EXPORT(decoder) \
+    __declspec(dllexport) Decoder* get_decoder(void) { \
+        return &decoder; \
+    }
+
+/* The exported function, as the host calls it */
+typedef Decoder* (*get_decoder_func)(void);
+
+#endif
@@ -1,22 +1,42 @@
-/**
- * @filename defines.h
- * @author Darryl Pogue
- * @designer Darryl Pogue
- * @date 2010 10 20
- * @project Terminal Emulator
- *
- * This file contains the definitions needed by all layers of the terminal.
- */
-#ifndef _DEFINES_H_
-#define _DEFINES_H_
-
-#define APPNAME TEXT("Terminal Emulator")
-
-/* APPLICATION MESSAGE ID DEFINES */
-#define TWM_RXDATA (WM_APP + 1)
-#define TWM_TXDATA (WM_APP + 2)
-
-typedef struct _emulator Emulator;
-typedef struct _TermInfo TermInfo;
-
-#endif
+/**
+ * @filename defines.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 10 20
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions needed by all layers of the terminal.
+ */
+#ifndef _DEFINES_H_
+#define _DEFINES_H_
+
+#define APPNAME TEXT("Terminal Emulator")
+
+/* APPLICATION MESSAGE ID DEFINES */
+#define TWM_RXDATA (WM_APP + 1)
+#define TWM_TXDATA (WM_APP + 2)
+/* wParam = new baud rate, or 0 to query; lParam = window posted TWM_BAUDDONE.
+   Returns the previous rate, 0 on failure */
+#define TWM_SETBAUD (WM_APP + 3)
+/* Posted after each write; wParam = bytes written, lParam = bytes still queued */
+#define TWM_TXDONE (WM_APP + 4)
+/* Posted by the I/O pool when the port fails */
+#define TWM_PORTLOST (WM_APP + 5)
+/* Posted when an emulator has reported damage that has not been painted */
+#define TWM_PAINT (WM_APP + 6)
+/* Posted by a plugin host's watch thread; wParam = malloc'd decoded data, lParam = length */
+#define TWM_HOSTDATA (WM_APP + 7)
+/* Posted when a plugin host exits or is killed for hanging */
+#define TWM_HOSTLOST (WM_APP + 8)
+/* Posted by the benchmark before each run; wParam = run, lParam = runs in all */
+#define TWM_BENCHSTEP (WM_APP + 9)
+/* Posted when the benchmark ends; wParam = 0 on success, lParam = error code */
+#define TWM_BENCHDONE (WM_APP + 10)
+/* Posted when a TWM_SETBAUD change is made; wParam = the new rate, 0 on failure */
+#define TWM_BAUDDONE (WM_APP + 11)
+
+typedef struct _emulator Emulator;
+typedef struct _TermInfo TermInfo;
+typedef struct _FrameInfo FrameInfo;
+
+#endif
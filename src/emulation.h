@@ -1,61 +1,112 @@
-/**
- * @filename emulation.h
- * @author Darryl Pogue
- * @designer Darryl Pogue
- * @date 2010 11 10
- * @project Terminal Emulator
- *
- * This file contains the definition of the emulation plugin interface.
- */
-#ifndef _EMULATION_H_
-#define _EMULATION_H_
-
-#include <Windows.h>
-#include <tchar.h>
-
-typedef struct _emulator {
-    DWORD dwVersion;
-
-    /* @since 1 */
-    LPVOID emulator_data;
-
-    /* @since 1 */
-    LPCTSTR (*emulation_name)(void);
-
-    /* @since 1 */
-    LPCSTR (*escape_input)(LPVOID data, DWORD input);
-
-    /* @since 1 */
-    DWORD (*receive)(LPVOID data, BYTE* rx, DWORD len);
-
-    /* @since 2 */
-    DWORD (*paint)(HWND hwnd, LPVOID data, HDC hdc, BOOLEAN force);
-
-    /* @since 2 */
-    DWORD (*on_connect)(LPVOID data);
-
-    /* @since 3 */
-    DWORD (*on_disconnect)(LPVOID data);
-
-    /* @since 3 */
-    BOOLEAN (*wnd_proc_override)(LPVOID data, LPMSG msg);
-
-    /* @since 3 */
-    HMENU (*emulator_menu)(void);
-} Emulator;
-
-#define EMULATOR_HAS_FUNC(emu, func) \
-    ((emu != NULL) && (emu->func != NULL))
-
-#define EMULATOR_INIT_PLUGIN(initfunc) \
-    __declspec(dllexport) BOOLEAN emulator_init_plugin(HWND hwnd, Emulator** e) { \
-        *e = initfunc(hwnd); \
-        if (*e == NULL) return FALSE; \
-        if ((*e)->dwVersion <= 0) return FALSE; \
-        if ((*e)->emulation_name == NULL) return FALSE; \
-        if ((*e)->receive == NULL) return FALSE; \
-        if ((*e)->paint == NULL) return FALSE; \
-        return TRUE; \
-    }
-
-#endif
+/**
+ * @filename emulation.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 10
+ * @project Terminal Emulator
+ *
+ * This file contains the definition of the emulation plugin interface.
+ */
+#ifndef _EMULATION_H_
+#define _EMULATION_H_
+
+#include <Windows.h>
+#include <tchar.h>
+
+/* The newest version of the Emulator structure */
+#define EMULATOR_VERSION 7
+/* From this version on, each call to a plugin's init function makes a new
+   instance, which its free function frees; older plugins have only one */
+#define EMULATOR_VERSION_INSTANCES 5
+
+/* EmulatorDamage flags */
+#define DAMAGE_ROWS (1 << 0)    /* The rows in 'rows' have changed */
+#define DAMAGE_ALL (1 << 1)     /* The whole screen must be redrawn */
+#define DAMAGE_CURSOR (1 << 2)  /* The cursor has moved */
+#define DAMAGE_BELL (1 << 3)    /* The bell was rung */
+
+/**
+ * What a block of received data changed on the screen, filled in by
+ * receive_damage. The host zeroes it before each call.
+ *
+ * @since 4
+ */
+typedef struct _emulator_damage {
+    DWORD dwFlags;
+    DWORD rows;         /* Bit n is set if row n changed */
+    DWORD left;         /* The changed columns, from left up to right */
+    DWORD right;
+    DWORD cursor_x;     /* Where the cursor is now */
+    DWORD cursor_y;
+    DWORD bells;        /* How many times the bell was rung */
+} EmulatorDamage;
+
+typedef struct _emulator {
+    DWORD dwVersion;
+
+    /* @since 1 */
+    LPVOID emulator_data;
+
+    /* @since 1 */
+    LPCTSTR (*emulation_name)(void);
+
+    /* @since 1 */
+    LPCSTR (*escape_input)(LPVOID data, DWORD input);
+
+    /* @since 1 */
+    DWORD (*receive)(LPVOID data, BYTE* rx, DWORD len);
+
+    /* @since 2 */
+    DWORD (*paint)(HWND hwnd, LPVOID data, HDC hdc, BOOLEAN force);
+
+    /* @since 2 */
+    DWORD (*on_connect)(LPVOID data);
+
+    /* @since 3 */
+    DWORD (*on_disconnect)(LPVOID data);
+
+    /* @since 3 */
+    BOOLEAN (*wnd_proc_override)(LPVOID data, LPMSG msg);
+
+    /* @since 3 */
+    HMENU (*emulator_menu)(void);
+
+    /* @since 4 */
+    DWORD (*receive_damage)(LPVOID data, BYTE* rx, DWORD len,
+            EmulatorDamage* damage);
+
+    /* @since 6 */
+    DWORD (*replay)(LPVOID data, BYTE* rx, DWORD len);
+
+    /* @since 7 */
+    DWORD (*paint_damage)(HWND hwnd, LPVOID data, HDC hdc,
+            const EmulatorDamage* damage);
+} Emulator;
+
+#define EMULATOR_HAS_FUNC(emu, func) \
+    ((emu != NULL) && (emu->func != NULL))
+
+/* Plugins built for an older version have no room for newer functions */
+#define EMULATOR_HAS_FUNC_SINCE(emu, func, version) \
+    ((emu != NULL) && (emu->dwVersion >= version) && (emu->func != NULL))
+
+#define EMULATOR_INIT_PLUGIN(initfunc) \
+    __declspec(dllexport) BOOLEAN emulator_init_plugin(HWND hwnd, Emulator** e) { \
+        *e = initfunc(hwnd); \
+        if (*e == NULL) return FALSE; \
+        if ((*e)->dwVersion <= 0) return FALSE; \
+        if ((*e)->emulation_name == NULL) return FALSE; \
+        if ((*e)->receive == NULL && \
+                !EMULATOR_HAS_FUNC_SINCE((*e), receive_damage, 4)) return FALSE; \
+        if ((*e)->paint == NULL) return FALSE; \
+        return TRUE; \
+    }
+
+/* Optional: exports a function called before the plugin is unloaded, and,
+   from version 5, to free each instance */
+#define EMULATOR_FREE_PLUGIN(freefunc) \
+    __declspec(dllexport) void emulator_free_plugin(Emulator* e) { \
+        freefunc(e); \
+    }
+
+#endif
@@ -1,29 +1,31 @@
-//{{NO_DEPENDENCIES}}
-// Microsoft Visual C++ generated include file.
-// Used by rfid.rc
-//
-#include <Windows.h>
-
-#define RFID_BUTTON                     1000
-#define RFID_LED1                       1001
-#define RFID_LED2                       1002
-#define RFID_BUZZER                     1003
-#define RFID_ISO_14443A                 1004
-#define RFID_ISO_14443B                 1005
-#define RFID_ISO_15693                  1006
-#define RFID_TAG_IT_HF                  1007
-#define RFID_LF_DST                     1008
-#define RFIDDIALOG                      5000
-#define RFID_TAGFIELD                   5001
-#define RFID_CONNSTATUS                 5002
-
-// Next default values for new objects
-// 
-#ifdef APSTUDIO_INVOKED
-#ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NEXT_RESOURCE_VALUE        101
-#define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1005
-#define _APS_NEXT_SYMED_VALUE           101
-#endif
-#endif
+//{{NO_DEPENDENCIES}}
+// Microsoft Visual C++ generated include file.
+// Used by rfid.rc
+//
+#include <Windows.h>
+
+#define RFID_BUTTON                     1000
+#define RFID_LED1                       1001
+#define RFID_LED2                       1002
+#define RFID_BUZZER                     1003
+#define RFID_ISO_14443A                 1004
+#define RFID_ISO_14443B                 1005
+#define RFID_ISO_15693                  1006
+#define RFID_TAG_IT_HF                  1007
+#define RFID_LF_DST                     1008
+#define RFIDDIALOG                      5000
+#define RFID_TAGFIELD                   5001
+#define RFID_CONNSTATUS                 5002
+#define RFID_CACHESTATS                 5003
+#define RFID_SINKSTATS                  5004
+
+// Next default values for new objects
+// 
+#ifdef APSTUDIO_INVOKED
+#ifndef APSTUDIO_READONLY_SYMBOLS
+#define _APS_NEXT_RESOURCE_VALUE        101
+#define _APS_NEXT_COMMAND_VALUE         40001
+#define _APS_NEXT_CONTROL_VALUE         1005
+#define _APS_NEXT_SYMED_VALUE           101
+#endif
+#endif
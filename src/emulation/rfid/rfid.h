@@ -1,96 +1,339 @@
-/**
- * @filename rfid.h
- * @author Darryl Pogue & Joel Stewart
- * @designer Darryl Pogue, Terence Stenvold, Joel Stewart
- * @date 2010 11 10
- * @project Terminal Emulator: RFID Plugin
- *
- * This file contains all of the function prototypes and enum declarations
- * for the RFID plugin.
- */
-#ifndef _RFID_H_
-#define _RFID_H_
-
-#include <Windows.h>
-#include <tchar.h>
-#include <strsafe.h>
-#include "../../defines.h"
-#include "../../emulation.h"
-#include "resource.h"
-
-#include "rfid_structures.h"
-
-/* Prefix these with RFID because some conflict with Windows constants! */
-enum RFID_StatusCodes {
-    RFIDERROR_NONE = 0x00,
-    RFIDERROR_TOKEN_NOT_PRESENT = 0x01,
-    RFIDERROR_INVALID_RF_FORMAT = 0x05,
-    RFIDERROR_DEVICE_ID_INVALID = 0x0E,
-    RFIDERROR_ILLEGAL_ACTION = 0x10,
-    RFIDERROR_WRONG_DOWNLOAD_STATE = 0x11,
-    RFIDERROR_WRITE_FAILED = 0x12,
-    RFIDERROR_INVALID_ADDRESS = 0x13
-};
-
-enum RFID_Baud {
-    RFID_BAUD_9600    = 0,
-    RFID_BAUD_19200   = 1,
-    RFID_BAUD_57600   = 2,
-    RFID_BAUD_115200  = 3,
-    RFID_BAUD_38400   = 4
-};
-
-typedef struct _rfid_data {
-    HWND console;
-    HWND dialog;
-    TCHAR screen[24][81];
-    BYTE screenrow;
-} RFID_Data;
-
-/**
- * @implementation rfid_util.c
- */
-LPCTSTR rfid_entity_name(BYTE entity);
-
-/**
- * @implementation rfid_util.c
- */
-RFID_BCC rfid_calc_bcc(LPVOID message, WORD size);
-
-/**
- * @implementation rfid_util.c
- */
-void rfid_getversion_request(RFID_A2D_GetVersion** msg);
-
-/**
- * @implementation rfid_util.c
- */
-void rfid_findtoken_request(RFID_A2D_FindToken** msg);
-
-/**
- * @implementation rfid_util.c
- */
-void rfid_setdriver_request(RFID_A2D_SetDriver** msg, BYTE drivers);
-
-/**
- * @implementation rfid_util.c
- */
-void rfid_setbaud_request(RFID_A2D_SetBaud** msg, BYTE baud);
-
-/**
- * @implementation rfid_util.c
- */
-void rfid_transon_request(RFID_A2D_TransOn** msg, BYTE entity);
-
-/**
- * @implementation rfid_util.c
- */
-void rfid_transoff_request(RFID_A2D_TransOff** msg, BYTE entity);
-
-/**
- * @implementation rfid_dlg.c
- */
-BOOL CALLBACK rfid_wnd_proc(HWND hwnd, UINT msg, WPARAM wParam,
-        LPARAM lParam);
-
-#endif
+/**
+ * @filename rfid.h
+ * @author Darryl Pogue & Joel Stewart
+ * @designer Darryl Pogue, Terence Stenvold, Joel Stewart
+ * @date 2010 11 10
+ * @project Terminal Emulator: RFID Plugin
+ *
+ * This file contains all of the function prototypes and enum declarations
+ * for the RFID plugin.
+ */
+#ifndef _RFID_H_
+#define _RFID_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+#include "../../defines.h"
+#include "../../emulation.h"
+#include "resource.h"
+
+#include "rfid_structures.h"
+
+/* Prefix these with RFID because some conflict with Windows constants! */
+enum RFID_StatusCodes {
+    RFIDERROR_NONE = 0x00,
+    RFIDERROR_TOKEN_NOT_PRESENT = 0x01,
+    RFIDERROR_INVALID_RF_FORMAT = 0x05,
+    RFIDERROR_DEVICE_ID_INVALID = 0x0E,
+    RFIDERROR_ILLEGAL_ACTION = 0x10,
+    RFIDERROR_WRONG_DOWNLOAD_STATE = 0x11,
+    RFIDERROR_WRITE_FAILED = 0x12,
+    RFIDERROR_INVALID_ADDRESS = 0x13
+};
+
+enum RFID_Baud {
+    RFID_BAUD_9600    = 0,
+    RFID_BAUD_19200   = 1,
+    RFID_BAUD_57600   = 2,
+    RFID_BAUD_115200  = 3,
+    RFID_BAUD_38400   = 4
+};
+
+#define RFID_MAX_UID 32
+#define RFID_CACHE_NIL 0xFFFF
+#define RFID_CACHE_WINDOW 1500
+#define RFID_CACHE_SIZE 64
+/* Most tags the cache can be configured to remember */
+#define RFID_CACHE_MAX 0x4000
+#define RFID_STATS_TIMER 1
+
+/**
+ * A single tag remembered by the recent-tag cache. Entries live in a fixed
+ * pool and are linked by index into a hash chain and an LRU list.
+ */
+typedef struct _rfid_tag_entry {
+    BYTE entity;
+    BYTE uidlen;
+    BYTE uid[RFID_MAX_UID];
+    DWORD hash;
+    DWORD lastseen;
+    WORD chain;
+    WORD prev;
+    WORD next;
+} RFID_TagEntry;
+
+/**
+ * The recent-tag cache suppresses repeated reads of a tag that is sitting
+ * on the antenna. A tag is only reported again once it has gone unread for
+ * longer than the suppression window.
+ *
+ * @member DWORD window     The suppression window in milliseconds (0 = off)
+ * @member WORD capacity    The number of entries in the pool
+ * @member WORD nbuckets    The number of hash buckets (a power of two)
+ * @member WORD used        The number of pool entries in use
+ * @member WORD head        The most recently seen entry
+ * @member WORD tail        The least recently seen entry
+ * @member DWORD hits       Reads suppressed by the cache
+ * @member DWORD misses     Reads passed through as new or re-appearing tags
+ * @member DWORD evictions  Entries dropped to make room for new tags
+ */
+typedef struct _rfid_tag_cache {
+    DWORD window;
+    WORD capacity;
+    WORD nbuckets;
+    WORD used;
+    WORD head;
+    WORD tail;
+    WORD* buckets;
+    RFID_TagEntry* entries;
+    DWORD hits;
+    DWORD misses;
+    DWORD evictions;
+} RFID_TagCache;
+
+#define RFID_SINK_BUFFER 65536
+#define RFID_SINK_INTERVAL 1000
+#define RFID_SINK_RECORD 160
+
+enum RFID_SinkFormat {
+    kSinkCsv = 0,
+    kSinkJsonl = 1,
+    kSinkBinary = 2
+};
+
+/**
+ * The tag event sink batches structured tag read events in memory and
+ * writes them to a file or pipe in a single call once the buffer fills or
+ * the flush interval passes.
+ *
+ * @member HANDLE hFile     The output file or pipe, or INVALID_HANDLE_VALUE
+ * @member BYTE format      The record format (see RFID_SinkFormat)
+ * @member BYTE* buffer     The pending, unwritten records
+ * @member DWORD used       The number of bytes pending in the buffer
+ * @member DWORD size       The size of the buffer
+ * @member DWORD interval   The longest time (ms) an event may stay buffered
+ * @member DWORD lastflush  The tick count of the last flush
+ * @member DWORD events     The number of events recorded
+ * @member DWORD pending    The number of events pending in the buffer
+ * @member DWORD flushes    The number of writes made to the output
+ * @member DWORD dropped    The number of events lost to write failures
+ */
+typedef struct _rfid_event_sink {
+    HANDLE hFile;
+    BYTE format;
+    BYTE* buffer;
+    DWORD used;
+    DWORD size;
+    DWORD interval;
+    DWORD lastflush;
+    DWORD events;
+    DWORD pending;
+    DWORD flushes;
+    DWORD dropped;
+} RFID_EventSink;
+
+#define RFID_BAUD_TIMER 2
+#define RFID_BAUD_TIMEOUT 500
+
+enum RFID_BaudState {
+    kBaudIdle = 0,      /* Not negotiating; polling for tags */
+    kBaudProbe = 1,     /* Waiting for the first GetVersion reply */
+    kBaudRequest = 2,   /* Waiting for the reader to accept a SetBaud */
+    kBaudVerify = 3,    /* Host switched; waiting for GetVersion at new rate */
+    kBaudRecover = 4    /* Lost the reader; scanning host rates for it */
+};
+
+#define RFID_ROWS 24
+#define RFID_COLS 80
+/* Longest frame; its length is one byte of the header */
+#define RFID_FRAME_MAX 255
+
+/**
+ * @member BOOLEAN resync   Discard any partly received frame (set when the
+ *                          link rate changes)
+ * @member BYTE* frame      The frame being received, or NULL between frames
+ * @member WORD framelen    The bytes of the frame received so far
+ * @member WORD framesize   The length of the frame, from its header
+ * @member BYTE baudstate   The baud negotiation state (see RFID_BaudState)
+ * @member BYTE baudidx     The candidate rate being tried
+ * @member DWORD baudrate   The last rate known to work on both ends
+ * @member DWORD baudmax    The fastest rate to negotiate (0 = don't)
+ * @member TCHAR screen[][] The screen lines, used as a ring: display row r
+ *                          is stored at screen[(screentop + r) % RFID_ROWS]
+ * @member BYTE screentop   The ring index of the top display row
+ * @member BYTE screenrow   The display row the next line is written to
+ * @member BYTE scrolls     Lines scrolled since the window was last updated
+ * @member DWORD dirty      Bit mask of display rows changed since the window
+ *                          was last updated
+ * @member INT lineheight   The height of a row in pixels (0 until painted)
+ */
+typedef struct _rfid_data {
+    HWND console;
+    HWND dialog;
+    TCHAR screen[RFID_ROWS][RFID_COLS + 1];
+    BYTE screentop;
+    BYTE screenrow;
+    BYTE scrolls;
+    DWORD dirty;
+    INT lineheight;
+    BOOLEAN resync;
+    BYTE* frame;
+    WORD framelen;
+    WORD framesize;
+    BYTE baudstate;
+    BYTE baudidx;
+    DWORD baudrate;
+    DWORD baudmax;
+    RFID_TagCache cache;
+    RFID_EventSink sink;
+} RFID_Data;
+
+/* The plugin's own module, for its dialog and for finding rfid.ini */
+extern HINSTANCE rfid_module;
+
+/**
+ * @implementation rfid_util.c
+ */
+LPCTSTR rfid_entity_name(BYTE entity);
+
+/**
+ * @implementation rfid_util.c
+ */
+INT rfid_config_int(LPCTSTR section, LPCTSTR key, INT def);
+
+/**
+ * @implementation rfid_util.c
+ */
+void rfid_config_string(LPCTSTR section, LPCTSTR key, LPCTSTR def,
+        LPTSTR value, DWORD size);
+
+/**
+ * @implementation rfid_util.c
+ */
+RFID_BCC rfid_calc_bcc(LPVOID message, WORD size);
+
+/**
+ * @implementation rfid_util.c
+ */
+void rfid_getversion_request(RFID_A2D_GetVersion** msg);
+
+/**
+ * @implementation rfid_util.c
+ */
+void rfid_findtoken_request(RFID_A2D_FindToken** msg);
+
+/**
+ * @implementation rfid_util.c
+ */
+void rfid_setdriver_request(RFID_A2D_SetDriver** msg, BYTE drivers);
+
+/**
+ * @implementation rfid_util.c
+ */
+void rfid_setbaud_request(RFID_A2D_SetBaud** msg, BYTE baud);
+
+/**
+ * @implementation rfid_util.c
+ */
+void rfid_transon_request(RFID_A2D_TransOn** msg, BYTE entity);
+
+/**
+ * @implementation rfid_util.c
+ */
+void rfid_transoff_request(RFID_A2D_TransOff** msg, BYTE entity);
+
+/**
+ * @implementation rfid_cache.c
+ */
+BOOLEAN rfid_cache_init(RFID_TagCache* cache, DWORD window, WORD capacity);
+
+/**
+ * @implementation rfid_cache.c
+ */
+void rfid_cache_clear(RFID_TagCache* cache);
+
+/**
+ * @implementation rfid_cache.c
+ */
+BOOLEAN rfid_cache_seen(RFID_TagCache* cache, BYTE entity, BYTE* uid,
+        BYTE uidlen, DWORD now);
+
+/**
+ * @implementation rfid_cache.c
+ */
+void rfid_cache_free(RFID_TagCache* cache);
+
+/**
+ * @implementation rfid_baud.c
+ */
+void rfid_baud_start(RFID_Data* dat);
+
+/**
+ * @implementation rfid_baud.c
+ */
+BOOLEAN rfid_baud_version(RFID_Data* dat);
+
+/**
+ * @implementation rfid_baud.c
+ */
+void rfid_baud_response(RFID_Data* dat, BYTE status);
+
+/**
+ * @implementation rfid_baud.c
+ */
+void rfid_baud_timeout(RFID_Data* dat);
+
+/**
+ * @implementation rfid_baud.c
+ */
+void rfid_baud_done(RFID_Data* dat, DWORD rate);
+
+/**
+ * @implementation rfid_screen.c
+ */
+void rfid_screen_clear(RFID_Data* dat);
+
+/**
+ * @implementation rfid_screen.c
+ */
+void rfid_screen_append(RFID_Data* dat, LPCTSTR text);
+
+/**
+ * @implementation rfid_screen.c
+ */
+LPCTSTR rfid_screen_line(RFID_Data* dat, BYTE row);
+
+/**
+ * @implementation rfid_screen.c
+ */
+void rfid_screen_update(RFID_Data* dat);
+
+/**
+ * @implementation rfid_sink.c
+ */
+DWORD rfid_sink_open(RFID_EventSink* sink);
+
+/**
+ * @implementation rfid_sink.c
+ */
+DWORD rfid_sink_event(RFID_EventSink* sink, BYTE entity, BYTE status,
+        BYTE* uid, BYTE uidlen);
+
+/**
+ * @implementation rfid_sink.c
+ */
+DWORD rfid_sink_flush(RFID_EventSink* sink);
+
+/**
+ * @implementation rfid_sink.c
+ */
+void rfid_sink_close(RFID_EventSink* sink);
+
+/**
+ * @implementation rfid_dlg.c
+ */
+BOOL CALLBACK rfid_wnd_proc(HWND hwnd, UINT msg, WPARAM wParam,
+        LPARAM lParam);
+
+#endif
@@ -0,0 +1,296 @@
+/**
+ * @filename rfid_baud.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 26
+ * @project Terminal Emulator: RFID Plugin
+ *
+ * This file contains the baud rate negotiation for the RFID plugin. Once the
+ * reader answers GetVersion, it is asked to switch to the fastest rate it
+ * accepts; the host port is then switched to match and the link is checked
+ * with another GetVersion. If the reader is lost, the host scans the known
+ * rates until it answers again.
+ *
+ * Negotiation is controlled by the [Baud] section of rfid.ini:
+ *  Negotiate   0 to leave the link at the rate chosen when connecting
+ *  MaxRate     The fastest rate to try (default 115200)
+ */
+#include "rfid.h"
+
+typedef struct _rfid_rate {
+    BYTE code;
+    DWORD rate;
+} RFID_Rate;
+
+/* Candidate rates, fastest first */
+static const RFID_Rate rfid_rates[] = {
+    { RFID_BAUD_115200, 115200 },
+    { RFID_BAUD_57600,  57600 },
+    { RFID_BAUD_38400,  38400 },
+    { RFID_BAUD_19200,  19200 },
+    { RFID_BAUD_9600,   9600 }
+};
+
+#define RFID_RATE_COUNT (sizeof(rfid_rates) / sizeof(RFID_Rate))
+
+/**
+ * Sends a GetVersion request to the reader.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @returns none
+ */
+static void rfid_baud_send_version(RFID_Data* dat) {
+    RFID_A2D_GetVersion* msg = NULL;
+
+    rfid_getversion_request(&msg);
+    SendMessage(dat->console, TWM_TXDATA, (WPARAM)msg, msg->header.length);
+}
+
+/**
+ * Switches the host end of the link to a new rate. Any partly received
+ * frame is dropped, since it arrived at the old rate. The port switches
+ * once what is already queued has been sent, without waiting here, so
+ * requests sent after this go at the new rate. The dialog is posted
+ * TWM_BAUDDONE when the switch is made (see rfid_baud_done).
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @param DWORD rate        The new baud rate
+ * @returns TRUE if the switch was started, FALSE otherwise.
+ */
+static BOOLEAN rfid_baud_set_host(RFID_Data* dat, DWORD rate) {
+    dat->resync = TRUE;
+    return SendMessage(dat->console, TWM_SETBAUD, (WPARAM)rate,
+            (LPARAM)dat->dialog) != 0;
+}
+
+/**
+ * Shows the negotiated link rate on the screen and in the dialog.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @param BOOLEAN ok        FALSE if negotiation failed.
+ * @returns none
+ */
+static void rfid_baud_report(RFID_Data* dat, BOOLEAN ok) {
+    TCHAR text[64];
+
+    StringCchPrintf(text, 64, ok ? TEXT("Link running at %lu baud")
+            : TEXT("Baud negotiation failed, staying at %lu baud"), dat->baudrate);
+    rfid_screen_append(dat, text);
+    rfid_screen_update(dat);
+
+    StringCchPrintf(text, 64, TEXT("Connected (%lu baud)"), dat->baudrate);
+    SetDlgItemText(dat->dialog, RFID_CONNSTATUS, text);
+}
+
+/**
+ * Ends negotiation outside of a GetVersion reply and starts polling for
+ * tags.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @param BOOLEAN ok        FALSE if negotiation failed.
+ * @returns none
+ */
+static void rfid_baud_finish(RFID_Data* dat, BOOLEAN ok) {
+    RFID_A2D_FindToken* msg = NULL;
+
+    dat->baudstate = kBaudIdle;
+    rfid_baud_report(dat, ok);
+
+    rfid_findtoken_request(&msg);
+    SendMessage(dat->console, TWM_TXDATA, (WPARAM)msg, msg->header.length);
+}
+
+/**
+ * Asks the reader to switch to the next candidate rate that is faster than
+ * the current one.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @returns TRUE if a request was sent, FALSE if there is nothing left to try.
+ */
+static BOOLEAN rfid_baud_next(RFID_Data* dat) {
+    RFID_A2D_SetBaud* msg = NULL;
+
+    while (dat->baudidx < RFID_RATE_COUNT &&
+            rfid_rates[dat->baudidx].rate > dat->baudmax) {
+        dat->baudidx++;
+    }
+
+    if (dat->baudidx >= RFID_RATE_COUNT ||
+            rfid_rates[dat->baudidx].rate <= dat->baudrate) {
+        return FALSE;
+    }
+
+    dat->baudstate = kBaudRequest;
+    rfid_setbaud_request(&msg, rfid_rates[dat->baudidx].code);
+    SendMessage(dat->console, TWM_TXDATA, (WPARAM)msg, msg->header.length);
+    SetTimer(dat->dialog, RFID_BAUD_TIMER, RFID_BAUD_TIMEOUT, NULL);
+
+    return TRUE;
+}
+
+/**
+ * Tries the next host rate while looking for a reader that stopped
+ * answering. Gives up and returns to the last good rate once every
+ * candidate has been tried.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @returns none
+ */
+static void rfid_baud_scan(RFID_Data* dat) {
+    if (dat->baudidx >= RFID_RATE_COUNT) {
+        rfid_baud_set_host(dat, dat->baudrate);
+        rfid_baud_finish(dat, FALSE);
+        return;
+    }
+
+    dat->baudstate = kBaudRecover;
+    rfid_baud_set_host(dat, rfid_rates[dat->baudidx].rate);
+    rfid_baud_send_version(dat);
+    SetTimer(dat->dialog, RFID_BAUD_TIMER, RFID_BAUD_TIMEOUT, NULL);
+}
+
+/**
+ * Prepares for negotiation when connecting. Must be called before the first
+ * GetVersion request is sent.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @returns none
+ */
+void rfid_baud_start(RFID_Data* dat) {
+    dat->baudidx = 0;
+    dat->baudmax = rfid_config_int(TEXT("Baud"), TEXT("MaxRate"), 115200);
+    dat->baudrate = (DWORD)SendMessage(dat->console, TWM_SETBAUD, 0, 0);
+
+    if (rfid_config_int(TEXT("Baud"), TEXT("Negotiate"), 1) == 0) {
+        dat->baudmax = 0;
+    }
+
+    dat->baudstate = (dat->baudmax != 0 && dat->baudrate != 0)
+            ? kBaudProbe : kBaudIdle;
+}
+
+/**
+ * Handles a GetVersion reply during negotiation.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @returns TRUE if negotiation is over and tag polling should start,
+ *          FALSE otherwise.
+ */
+BOOLEAN rfid_baud_version(RFID_Data* dat) {
+    switch (dat->baudstate) {
+    case kBaudProbe:
+        if (rfid_baud_next(dat)) {
+            return FALSE;
+        }
+        dat->baudstate = kBaudIdle;
+        rfid_baud_report(dat, TRUE);
+        return TRUE;
+    case kBaudVerify:
+    case kBaudRecover:
+        KillTimer(dat->dialog, RFID_BAUD_TIMER);
+        dat->baudrate = rfid_rates[dat->baudidx].rate;
+        dat->baudstate = kBaudIdle;
+        rfid_baud_report(dat, TRUE);
+        return TRUE;
+    case kBaudRequest:
+        return FALSE;
+    default:
+        return TRUE;
+    }
+}
+
+/**
+ * Handles the reader's reply to a SetBaud request.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @param BYTE status       The status code of the reply.
+ * @returns none
+ */
+void rfid_baud_response(RFID_Data* dat, BYTE status) {
+    if (dat->baudstate != kBaudRequest) {
+        return;
+    }
+
+    KillTimer(dat->dialog, RFID_BAUD_TIMER);
+
+    if (status != RFIDERROR_NONE) {
+        /* Rate not supported by the reader; try the next slower one */
+        dat->baudidx++;
+        if (!rfid_baud_next(dat)) {
+            rfid_baud_finish(dat, TRUE);
+        }
+        return;
+    }
+
+    if (!rfid_baud_set_host(dat, rfid_rates[dat->baudidx].rate)) {
+        /* The reader has switched but the host port can't follow */
+        dat->baudidx = 0;
+        rfid_baud_scan(dat);
+        return;
+    }
+
+    dat->baudstate = kBaudVerify;
+    rfid_baud_send_version(dat);
+    SetTimer(dat->dialog, RFID_BAUD_TIMER, RFID_BAUD_TIMEOUT, NULL);
+}
+
+/**
+ * Handles a reply that did not arrive in time.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @returns none
+ */
+void rfid_baud_timeout(RFID_Data* dat) {
+    KillTimer(dat->dialog, RFID_BAUD_TIMER);
+
+    switch (dat->baudstate) {
+    case kBaudRequest:
+        /* No reply at all; treat the rate as unsupported */
+        dat->baudidx++;
+        if (!rfid_baud_next(dat)) {
+            rfid_baud_finish(dat, TRUE);
+        }
+        break;
+    case kBaudVerify:
+        dat->baudidx = 0;
+        rfid_baud_scan(dat);
+        break;
+    case kBaudRecover:
+        dat->baudidx++;
+        rfid_baud_scan(dat);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Handles the end of a switch of the host port's rate. If the port could
+ * not be switched, the GetVersion sent after it went at the old rate, so
+ * the step is treated as failed without waiting for its timeout.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @param DWORD rate        The new rate, or 0 if the switch failed
+ * @returns none
+ */
+void rfid_baud_done(RFID_Data* dat, DWORD rate) {
+    if (rate != 0) {
+        return;
+    }
+
+    switch (dat->baudstate) {
+    case kBaudVerify:
+        /* The reader has switched but the host port can't follow */
+        KillTimer(dat->dialog, RFID_BAUD_TIMER);
+        dat->baudidx = 0;
+        rfid_baud_scan(dat);
+        break;
+    case kBaudRecover:
+        KillTimer(dat->dialog, RFID_BAUD_TIMER);
+        dat->baudidx++;
+        rfid_baud_scan(dat);
+        break;
+    default:
+        break;
+    }
+}
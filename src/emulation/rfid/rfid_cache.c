@@ -0,0 +1,246 @@
+/**
+ * @filename rfid_cache.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 24
+ * @project Terminal Emulator: RFID Plugin
+ *
+ * This file contains the implementation of the recent-tag cache, which
+ * suppresses repeated reads of a tag that stays on the antenna.
+ */
+#include "rfid.h"
+
+/**
+ * Hashes a tag identity using FNV-1a over the entity and UID bytes.
+ *
+ * @param BYTE entity   The entity (tag type) that read the tag.
+ * @param BYTE* uid     The UID bytes of the tag.
+ * @param BYTE uidlen   The number of UID bytes.
+ * @returns The 32-bit hash of the tag.
+ */
+static DWORD rfid_cache_hash(BYTE entity, BYTE* uid, BYTE uidlen) {
+    DWORD hash = 2166136261UL;
+    BYTE i = 0;
+
+    hash = (hash ^ entity) * 16777619UL;
+    for (i = 0; i < uidlen; i++) {
+        hash = (hash ^ uid[i]) * 16777619UL;
+    }
+
+    return hash;
+}
+
+/**
+ * Removes an entry from the LRU list.
+ *
+ * @param RFID_TagCache* cache  The tag cache.
+ * @param WORD idx              The index of the entry to unlink.
+ * @returns none
+ */
+static void rfid_cache_unlink(RFID_TagCache* cache, WORD idx) {
+    RFID_TagEntry* e = &cache->entries[idx];
+
+    if (e->prev != RFID_CACHE_NIL) {
+        cache->entries[e->prev].next = e->next;
+    } else {
+        cache->head = e->next;
+    }
+
+    if (e->next != RFID_CACHE_NIL) {
+        cache->entries[e->next].prev = e->prev;
+    } else {
+        cache->tail = e->prev;
+    }
+
+    e->prev = RFID_CACHE_NIL;
+    e->next = RFID_CACHE_NIL;
+}
+
+/**
+ * Places an entry at the front (most recently seen end) of the LRU list.
+ *
+ * @param RFID_TagCache* cache  The tag cache.
+ * @param WORD idx              The index of the entry to link.
+ * @returns none
+ */
+static void rfid_cache_push_front(RFID_TagCache* cache, WORD idx) {
+    RFID_TagEntry* e = &cache->entries[idx];
+
+    e->prev = RFID_CACHE_NIL;
+    e->next = cache->head;
+
+    if (cache->head != RFID_CACHE_NIL) {
+        cache->entries[cache->head].prev = idx;
+    }
+    cache->head = idx;
+
+    if (cache->tail == RFID_CACHE_NIL) {
+        cache->tail = idx;
+    }
+}
+
+/**
+ * Removes an entry from its hash chain.
+ *
+ * @param RFID_TagCache* cache  The tag cache.
+ * @param WORD idx              The index of the entry to remove.
+ * @returns none
+ */
+static void rfid_cache_unchain(RFID_TagCache* cache, WORD idx) {
+    WORD* link = &cache->buckets[cache->entries[idx].hash & (cache->nbuckets - 1)];
+
+    while (*link != RFID_CACHE_NIL) {
+        if (*link == idx) {
+            *link = cache->entries[idx].chain;
+            break;
+        }
+        link = &cache->entries[*link].chain;
+    }
+
+    cache->entries[idx].chain = RFID_CACHE_NIL;
+}
+
+/**
+ * Initialises the recent-tag cache.
+ *
+ * @param RFID_TagCache* cache  The tag cache to initialise.
+ * @param DWORD window          The suppression window in milliseconds.
+ *                              A window of 0 disables suppression.
+ * @param WORD capacity         The maximum number of tags to remember,
+ *                              up to RFID_CACHE_MAX; 0 for RFID_CACHE_SIZE.
+ * @returns TRUE if the cache was allocated, FALSE otherwise.
+ */
+BOOLEAN rfid_cache_init(RFID_TagCache* cache, DWORD window, WORD capacity) {
+    cache->window = window;
+    cache->capacity = (capacity == 0 || capacity > RFID_CACHE_MAX)
+            ? RFID_CACHE_SIZE : capacity;
+
+    /* Keep the load factor at or below one half */
+    cache->nbuckets = 1;
+    while (cache->nbuckets < cache->capacity * 2) {
+        cache->nbuckets <<= 1;
+    }
+
+    cache->buckets = (WORD*)malloc(sizeof(WORD) * cache->nbuckets);
+    cache->entries = (RFID_TagEntry*)malloc(sizeof(RFID_TagEntry) * cache->capacity);
+
+    if (cache->buckets == NULL || cache->entries == NULL) {
+        rfid_cache_free(cache);
+        return FALSE;
+    }
+
+    rfid_cache_clear(cache);
+
+    return TRUE;
+}
+
+/**
+ * Forgets every tag in the cache and resets the statistics.
+ *
+ * @param RFID_TagCache* cache  The tag cache.
+ * @returns none
+ */
+void rfid_cache_clear(RFID_TagCache* cache) {
+    WORD i = 0;
+
+    if (cache->buckets == NULL) {
+        return;
+    }
+
+    for (i = 0; i < cache->nbuckets; i++) {
+        cache->buckets[i] = RFID_CACHE_NIL;
+    }
+
+    cache->used = 0;
+    cache->head = RFID_CACHE_NIL;
+    cache->tail = RFID_CACHE_NIL;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+}
+
+/**
+ * Records a tag read and decides whether it should be reported.
+ *
+ * @param RFID_TagCache* cache  The tag cache.
+ * @param BYTE entity           The entity (tag type) that read the tag.
+ * @param BYTE* uid             The UID bytes of the tag.
+ * @param BYTE uidlen           The number of UID bytes.
+ * @param DWORD now             The current tick count in milliseconds.
+ * @returns TRUE if the tag was seen within the suppression window and
+ *          should not be reported again, FALSE otherwise.
+ */
+BOOLEAN rfid_cache_seen(RFID_TagCache* cache, BYTE entity, BYTE* uid,
+        BYTE uidlen, DWORD now) {
+    DWORD hash = 0;
+    WORD idx = RFID_CACHE_NIL;
+    WORD bucket = 0;
+    RFID_TagEntry* e = NULL;
+
+    if (cache->buckets == NULL || cache->window == 0 || uidlen > RFID_MAX_UID) {
+        cache->misses++;
+        return FALSE;
+    }
+
+    hash = rfid_cache_hash(entity, uid, uidlen);
+    bucket = (WORD)(hash & (cache->nbuckets - 1));
+
+    for (idx = cache->buckets[bucket]; idx != RFID_CACHE_NIL;
+            idx = cache->entries[idx].chain) {
+        e = &cache->entries[idx];
+        if (e->hash == hash && e->entity == entity && e->uidlen == uidlen
+                && memcmp(e->uid, uid, uidlen) == 0) {
+            BOOLEAN recent = (now - e->lastseen) <= cache->window;
+
+            e->lastseen = now;
+            rfid_cache_unlink(cache, idx);
+            rfid_cache_push_front(cache, idx);
+
+            if (recent) {
+                cache->hits++;
+                return TRUE;
+            }
+
+            /* The tag left the field and has come back */
+            cache->misses++;
+            return FALSE;
+        }
+    }
+
+    if (cache->used < cache->capacity) {
+        idx = cache->used++;
+    } else {
+        /* Reuse the least recently seen entry */
+        idx = cache->tail;
+        rfid_cache_unlink(cache, idx);
+        rfid_cache_unchain(cache, idx);
+        cache->evictions++;
+    }
+
+    e = &cache->entries[idx];
+    e->entity = entity;
+    e->uidlen = uidlen;
+    memcpy(e->uid, uid, uidlen);
+    e->hash = hash;
+    e->lastseen = now;
+    e->chain = cache->buckets[bucket];
+    cache->buckets[bucket] = idx;
+    rfid_cache_push_front(cache, idx);
+
+    cache->misses++;
+    return FALSE;
+}
+
+/**
+ * Frees the memory used by the cache.
+ *
+ * @param RFID_TagCache* cache  The tag cache.
+ * @returns none
+ */
+void rfid_cache_free(RFID_TagCache* cache) {
+    free(cache->buckets);
+    free(cache->entries);
+    cache->buckets = NULL;
+    cache->entries = NULL;
+    cache->used = 0;
+}
@@ -0,0 +1,109 @@
+/**
+ * @filename rfid_screen.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 25
+ * @project Terminal Emulator: RFID Plugin
+ *
+ * This file contains the implementation of the RFID screen log. Lines are
+ * kept in a ring so appending to a full screen moves the top index instead
+ * of copying every row, and only the rows that changed are repainted.
+ */
+#include "rfid.h"
+
+/**
+ * Clears the screen and moves the write position to the top.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @returns none
+ */
+void rfid_screen_clear(RFID_Data* dat) {
+    DWORD x = 0;
+    DWORD y = 0;
+
+    for (y = 0; y < RFID_ROWS; y++) {
+        for (x = 0; x <= RFID_COLS; x++) {
+            dat->screen[y][x] = (x == RFID_COLS) ? '\0' : ' ';
+        }
+    }
+
+    dat->screentop = 0;
+    dat->screenrow = 0;
+    dat->scrolls = 0;
+    dat->dirty = (1UL << RFID_ROWS) - 1;
+}
+
+/**
+ * Appends a line to the bottom of the screen, scrolling if it is full.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @param LPCTSTR text      The line to append (truncated to RFID_COLS)
+ * @returns none
+ */
+void rfid_screen_append(RFID_Data* dat, LPCTSTR text) {
+    if (dat->screenrow >= RFID_ROWS) {
+        /* The oldest line becomes the new bottom line */
+        dat->screentop = (dat->screentop + 1) % RFID_ROWS;
+        dat->screenrow = RFID_ROWS - 1;
+        dat->dirty >>= 1;
+
+        if (dat->scrolls < RFID_ROWS) {
+            dat->scrolls++;
+        }
+    }
+
+    StringCchCopy(dat->screen[(dat->screentop + dat->screenrow) % RFID_ROWS],
+            RFID_COLS + 1, text);
+    dat->dirty |= (1UL << dat->screenrow);
+    dat->screenrow++;
+}
+
+/**
+ * Gets the text of a display row.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @param BYTE row          The display row (0 is the top of the window)
+ * @returns The text of the row.
+ */
+LPCTSTR rfid_screen_line(RFID_Data* dat, BYTE row) {
+    return dat->screen[(dat->screentop + row) % RFID_ROWS];
+}
+
+/**
+ * Brings the console window up to date with the screen: pixels for lines
+ * that scrolled are moved with ScrollWindowEx, and only the rows that
+ * changed are invalidated. The background is not erased; rfid_paint fills
+ * each row it draws.
+ *
+ * @param RFID_Data* dat    The emulation mode data
+ * @returns none
+ */
+void rfid_screen_update(RFID_Data* dat) {
+    BYTE y = 0;
+
+    if (dat->lineheight == 0 || dat->scrolls >= RFID_ROWS) {
+        /* Nothing has been drawn yet, or every row has changed */
+        InvalidateRect(dat->console, NULL, FALSE);
+    } else {
+        RECT rows;
+
+        GetClientRect(dat->console, &rows);
+        rows.bottom = RFID_ROWS * dat->lineheight;
+
+        if (dat->scrolls > 0) {
+            ScrollWindowEx(dat->console, 0, -(dat->scrolls * dat->lineheight),
+                    &rows, &rows, NULL, NULL, SW_INVALIDATE);
+        }
+
+        for (y = 0; y < RFID_ROWS; y++) {
+            if (dat->dirty & (1UL << y)) {
+                rows.top = y * dat->lineheight;
+                rows.bottom = rows.top + dat->lineheight;
+                InvalidateRect(dat->console, &rows, FALSE);
+            }
+        }
+    }
+
+    dat->scrolls = 0;
+    dat->dirty = 0;
+}
@@ -0,0 +1,288 @@
+/**
+ * @filename rfid_sink.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 24
+ * @project Terminal Emulator: RFID Plugin
+ *
+ * This file contains the implementation of the tag event sink, which writes
+ * structured tag read events to a file or pipe in batches.
+ *
+ * Each event carries a timestamp (milliseconds since 1970-01-01 UTC), the
+ * entity that read the tag, the status code of the read and the UID bytes.
+ * The record layouts are:
+ *
+ *  csv:    ts,entity,status,uid\n             (uid as upper-case hex)
+ *  jsonl:  {"ts":...,"entity":...,"status":...,"uid":"..."}\n
+ *  binary: [WORD size][ULONGLONG ts][BYTE entity][BYTE status]
+ *          [BYTE uidlen][uidlen bytes of UID]  (little-endian, packed)
+ */
+#include "rfid.h"
+
+/* Milliseconds between 1601-01-01 (FILETIME epoch) and 1970-01-01 */
+#define RFID_EPOCH_DELTA 11644473600000ULL
+
+/**
+ * Gets the current time as milliseconds since the Unix epoch.
+ *
+ * @returns The number of milliseconds since 1970-01-01 UTC.
+ */
+static ULONGLONG rfid_sink_timestamp(void) {
+    FILETIME ft;
+    ULARGE_INTEGER t;
+
+    GetSystemTimeAsFileTime(&ft);
+    t.LowPart = ft.dwLowDateTime;
+    t.HighPart = ft.dwHighDateTime;
+
+    return (t.QuadPart / 10000) - RFID_EPOCH_DELTA;
+}
+
+/**
+ * Counts the whole records at the start of the buffer.
+ *
+ * @param RFID_EventSink* sink  The event sink.
+ * @param DWORD len             The number of bytes to look at.
+ * @returns The number of records that end within the first len bytes.
+ */
+static DWORD rfid_sink_records(RFID_EventSink* sink, DWORD len) {
+    DWORD count = 0;
+    DWORD at = 0;
+    WORD size = 0;
+
+    if (sink->format == kSinkBinary) {
+        /* Each record starts with its own size */
+        while (at + sizeof(WORD) <= sink->used) {
+            CopyMemory(&size, sink->buffer + at, sizeof(WORD));
+            if (size == 0 || at + size > len) {
+                break;
+            }
+            at += size;
+            count++;
+        }
+        return count;
+    }
+
+    for (at = 0; at < len; at++) {
+        if (sink->buffer[at] == '\n') {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Writes any buffered events out to the sink, in a single write unless the
+ * file or pipe takes less than all of it. The buffer is only emptied once
+ * every byte has been written, or the sink has failed and been closed.
+ *
+ * @param RFID_EventSink* sink  The event sink.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+DWORD rfid_sink_flush(RFID_EventSink* sink) {
+    DWORD done = 0;
+    DWORD written = 0;
+    BOOL ok = TRUE;
+
+    sink->lastflush = GetTickCount();
+
+    if (sink->hFile == INVALID_HANDLE_VALUE || sink->used == 0) {
+        return 0;
+    }
+
+    while (ok && done < sink->used) {
+        written = 0;
+        ok = WriteFile(sink->hFile, sink->buffer + done, sink->used - done,
+                &written, NULL);
+        if (ok && written == 0) {
+            /* Nothing was taken, so nothing ever will be */
+            ok = FALSE;
+        }
+        done += written;
+    }
+    sink->flushes++;
+
+    if (!ok) {
+        /* The reader on the other end of a pipe went away, or the disk is
+           full; the events not written in full are lost, so stop writing */
+        sink->dropped += sink->pending - rfid_sink_records(sink, done);
+        sink->pending = 0;
+        sink->used = 0;
+        CloseHandle(sink->hFile);
+        sink->hFile = INVALID_HANDLE_VALUE;
+        return 1;
+    }
+
+    sink->pending = 0;
+    sink->used = 0;
+    return 0;
+}
+
+/**
+ * Opens the event sink described by the [Events] section of rfid.ini.
+ * The sink stays closed if no Path is configured.
+ *
+ * @param RFID_EventSink* sink  The event sink to open.
+ * @returns 0 on success (or if the sink is disabled), greater than 0 otherwise.
+ */
+DWORD rfid_sink_open(RFID_EventSink* sink) {
+    TCHAR szPath[MAX_PATH];
+    TCHAR szFormat[16];
+    BOOLEAN isPipe = FALSE;
+
+    sink->hFile = INVALID_HANDLE_VALUE;
+    sink->used = 0;
+    sink->events = 0;
+    sink->pending = 0;
+    sink->flushes = 0;
+    sink->dropped = 0;
+    sink->interval = RFID_SINK_INTERVAL;
+    sink->lastflush = GetTickCount();
+
+    rfid_config_string(TEXT("Events"), TEXT("Path"), TEXT(""), szPath, MAX_PATH);
+    if (szPath[0] == 0) {
+        return 0;
+    }
+
+    rfid_config_string(TEXT("Events"), TEXT("Format"), TEXT("csv"), szFormat, 16);
+    if (_tcsicmp(szFormat, TEXT("jsonl")) == 0) {
+        sink->format = kSinkJsonl;
+    } else if (_tcsicmp(szFormat, TEXT("binary")) == 0) {
+        sink->format = kSinkBinary;
+    } else {
+        sink->format = kSinkCsv;
+    }
+
+    sink->interval = rfid_config_int(TEXT("Events"), TEXT("FlushInterval"),
+            sink->interval);
+    sink->size = rfid_config_int(TEXT("Events"), TEXT("BufferSize"),
+            RFID_SINK_BUFFER);
+    if (sink->size < RFID_SINK_RECORD) {
+        sink->size = RFID_SINK_RECORD;
+    }
+
+    sink->buffer = (BYTE*)malloc(sink->size);
+    if (sink->buffer == NULL) {
+        return 1;
+    }
+
+    isPipe = (_tcsnicmp(szPath, TEXT("\\\\.\\pipe\\"), 9) == 0);
+
+    sink->hFile = CreateFile(szPath, GENERIC_WRITE, FILE_SHARE_READ, NULL,
+            isPipe ? OPEN_EXISTING : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (sink->hFile == INVALID_HANDLE_VALUE) {
+        free(sink->buffer);
+        sink->buffer = NULL;
+        return 2;
+    }
+
+    if (!isPipe) {
+        /* Append to any events from previous sessions */
+        SetFilePointer(sink->hFile, 0, NULL, FILE_END);
+    }
+
+    return 0;
+}
+
+/**
+ * Appends a tag read event to the sink buffer, flushing it first if the
+ * buffer is full or the flush interval has passed.
+ *
+ * @param RFID_EventSink* sink  The event sink.
+ * @param BYTE entity           The entity (tag type) that read the tag.
+ * @param BYTE status           The status code of the read.
+ * @param BYTE* uid             The UID bytes of the tag (may be NULL).
+ * @param BYTE uidlen           The number of UID bytes.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+DWORD rfid_sink_event(RFID_EventSink* sink, BYTE entity, BYTE status,
+        BYTE* uid, BYTE uidlen) {
+    ULONGLONG ts = rfid_sink_timestamp();
+    BYTE* rec = NULL;
+    DWORD len = 0;
+    BYTE i = 0;
+
+    if (sink->hFile == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+
+    if (uidlen > RFID_MAX_UID) {
+        uidlen = RFID_MAX_UID;
+    }
+
+    if (sink->size - sink->used < RFID_SINK_RECORD) {
+        rfid_sink_flush(sink);
+        if (sink->hFile == INVALID_HANDLE_VALUE) {
+            sink->dropped++;
+            return 1;
+        }
+    }
+
+    rec = sink->buffer + sink->used;
+
+    switch (sink->format) {
+    case kSinkBinary:
+        {
+            WORD size = (WORD)(sizeof(WORD) + sizeof(ULONGLONG) + 3 + uidlen);
+
+            CopyMemory(rec, &size, sizeof(WORD));
+            CopyMemory(rec + 2, &ts, sizeof(ULONGLONG));
+            rec[10] = entity;
+            rec[11] = status;
+            rec[12] = uidlen;
+            CopyMemory(rec + 13, uid, uidlen);
+            len = size;
+        }
+        break;
+    case kSinkJsonl:
+    case kSinkCsv:
+        {
+            CHAR hex[RFID_MAX_UID * 2 + 1];
+            size_t remaining = 0;
+
+            for (i = 0; i < uidlen; i++) {
+                StringCchPrintfA(hex + (i * 2), 3, "%02X", uid[i]);
+            }
+            hex[uidlen * 2] = 0;
+
+            if (sink->format == kSinkJsonl) {
+                StringCchPrintfExA((LPSTR)rec, RFID_SINK_RECORD, NULL, &remaining, 0,
+                        "{\"ts\":%I64u,\"entity\":%u,\"status\":%u,\"uid\":\"%s\"}\n",
+                        ts, entity, status, hex);
+            } else {
+                StringCchPrintfExA((LPSTR)rec, RFID_SINK_RECORD, NULL, &remaining, 0,
+                        "%I64u,%u,%u,%s\n", ts, entity, status, hex);
+            }
+            len = RFID_SINK_RECORD - (DWORD)remaining;
+        }
+        break;
+    }
+
+    sink->used += len;
+    sink->events++;
+    sink->pending++;
+
+    if (GetTickCount() - sink->lastflush >= sink->interval) {
+        return rfid_sink_flush(sink);
+    }
+
+    return 0;
+}
+
+/**
+ * Flushes and closes the event sink.
+ *
+ * @param RFID_EventSink* sink  The event sink.
+ * @returns none
+ */
+void rfid_sink_close(RFID_EventSink* sink) {
+    rfid_sink_flush(sink);
+
+    if (sink->hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(sink->hFile);
+        sink->hFile = INVALID_HANDLE_VALUE;
+    }
+
+    free(sink->buffer);
+    sink->buffer = NULL;
+}
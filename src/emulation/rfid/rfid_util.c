@@ -1,115 +1,177 @@
-/**
- * @filename rfid_util.c
- * @author Darryl Pogue
- * @designer Darryl Pogue
- * @date 2010 11 10
- * @project Terminal Emulator: RFID Plugin
- *
- * This file contains the implementations for utility functions used by the
- * RFID plugin.
- */
-#include "rfid.h"
-
-LPCTSTR rfid_entity_name(BYTE entity) {
-    switch(entity) {
-    case 0x01:
-        return TEXT("Application Layer");
-    case 0x02:
-        return TEXT("ISO 14443-A");
-    case 0x03:
-        return TEXT("ISO 14443-B");
-    case 0x04:
-        return TEXT("ISO 15693");
-    case 0x05:
-        return TEXT("Tag-It");
-    case 0x06:
-        return TEXT("LF DST");
-    case 0x07:
-        return TEXT("ISO 14443-4");
-    case 0x08:
-        return TEXT("TI Apollo");
-    case 0x11:
-        return TEXT("Boot Loader");
-    default:
-        return TEXT("Unknown");
-    }
-}
-
-RFID_BCC rfid_calc_bcc(LPVOID message, WORD size) {
-    BYTE lrc = 0;
-    DWORD i = 0;
-    RFID_BCC bcc;
-
-    for (i = 0; i < size; i++) {
-        lrc ^= *((BYTE*)message + i);
-    }
-    
-    bcc.lrc = lrc;
-    bcc.i_lrc = (lrc ^ 0xFF);
-
-    return bcc;
-}
-
-void rfid_getversion_request(RFID_A2D_GetVersion** msg) {
-    *msg = (RFID_A2D_GetVersion*)malloc(sizeof(RFID_A2D_GetVersion));
-    (*msg)->header.soframe = 0x1;
-    (*msg)->header.length = sizeof(RFID_A2D_GetVersion);
-    (*msg)->header.deviceID = 0x3;
-    (*msg)->header.command1 = 0x1;
-    (*msg)->header.command2 = 0x40;
-    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
-}
-
-void rfid_findtoken_request(RFID_A2D_FindToken** msg) {
-    *msg = (RFID_A2D_FindToken*)malloc(sizeof(RFID_A2D_FindToken));
-    (*msg)->header.soframe = 0x1;
-    (*msg)->header.length = sizeof(RFID_A2D_FindToken);
-    (*msg)->header.deviceID = 0x3;
-    (*msg)->header.command1 = 0x1;
-    (*msg)->header.command2 = 0x41;
-    (*msg)->timeout = 0xA;
-    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
-}
-
-void rfid_setdriver_request(RFID_A2D_SetDriver** msg, BYTE drivers) {
-    *msg = (RFID_A2D_SetDriver*)malloc(sizeof(RFID_A2D_SetDriver));
-    (*msg)->header.soframe = 0x1;
-    (*msg)->header.length = sizeof(RFID_A2D_SetDriver);
-    (*msg)->header.deviceID = 0x3;
-    (*msg)->header.command1 = 0x1;
-    (*msg)->header.command2 = 0x43;
-    (*msg)->drivers = drivers;
-    (*msg)->active = 0x3;
-    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
-}
-
-void rfid_setbaud_request(RFID_A2D_SetBaud** msg, BYTE baud) {
-    *msg = (RFID_A2D_SetBaud*)malloc(sizeof(RFID_A2D_SetBaud));
-    (*msg)->header.soframe = 0x1;
-    (*msg)->header.length = sizeof(RFID_A2D_SetBaud);
-    (*msg)->header.deviceID = 0x3;
-    (*msg)->header.command1 = 0x1;
-    (*msg)->header.command2 = 0x46;
-    (*msg)->baud = baud;
-    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
-}
-
-void rfid_transon_request(RFID_A2D_TransOn** msg, BYTE entity) {
-    *msg = (RFID_A2D_TransOn*)malloc(sizeof(RFID_A2D_TransOn));
-    (*msg)->header.soframe = 0x1;
-    (*msg)->header.length = sizeof(RFID_A2D_TransOn);
-    (*msg)->header.deviceID = 0x3;
-    (*msg)->header.command1 = entity;
-    (*msg)->header.command2 = 0x48;
-    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
-}
-
-void rfid_transoff_request(RFID_A2D_TransOff** msg, BYTE entity) {
-    *msg = (RFID_A2D_TransOff*)malloc(sizeof(RFID_A2D_TransOff));
-    (*msg)->header.soframe = 0x1;
-    (*msg)->header.length = sizeof(RFID_A2D_TransOff);
-    (*msg)->header.deviceID = 0x3;
-    (*msg)->header.command1 = entity;
-    (*msg)->header.command2 = 0x49;
-    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
+/**
+ * @filename rfid_util.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 10
+ * @project Terminal Emulator: RFID Plugin
+ *
+ * This file contains the implementations for utility functions used by the
+ * RFID plugin.
+ */
+#include "rfid.h"
+
+LPCTSTR rfid_entity_name(BYTE entity) {
+    switch(entity) {
+    case 0x01:
+        return TEXT("Application Layer");
+    case 0x02:
+        return TEXT("ISO 14443-A");
+    case 0x03:
+        return TEXT("ISO 14443-B");
+    case 0x04:
+        return TEXT("ISO 15693");
+    case 0x05:
+        return TEXT("Tag-It");
+    case 0x06:
+        return TEXT("LF DST");
+    case 0x07:
+        return TEXT("ISO 14443-4");
+    case 0x08:
+        return TEXT("TI Apollo");
+    case 0x11:
+        return TEXT("Boot Loader");
+    default:
+        return TEXT("Unknown");
+    }
+}
+
+/**
+ * Builds the full path to rfid.ini, which lives beside the plugin DLL,
+ * whatever it has been named.
+ *
+ * @param LPTSTR szPath     A buffer of MAX_PATH TCHARs for the path.
+ * @returns TRUE if the path was found, FALSE otherwise.
+ */
+static BOOLEAN rfid_config_path(LPTSTR szPath) {
+    TCHAR* slash = NULL;
+
+    if (GetModuleFileName(rfid_module, szPath, MAX_PATH) == 0) {
+        return FALSE;
+    }
+    if ((slash = _tcsrchr(szPath, '\\')) == NULL) {
+        return FALSE;
+    }
+    *(slash + 1) = 0;
+    StringCchCat(szPath, MAX_PATH, TEXT("rfid.ini"));
+
+    return TRUE;
+}
+
+/**
+ * Reads an integer setting from rfid.ini, which lives beside the plugin DLL.
+ *
+ * @param LPCTSTR section   The ini section name.
+ * @param LPCTSTR key       The setting name.
+ * @param INT def           The value to use if the setting is missing.
+ * @returns The configured value, or def.
+ */
+INT rfid_config_int(LPCTSTR section, LPCTSTR key, INT def) {
+    TCHAR szPath[MAX_PATH];
+
+    if (!rfid_config_path(szPath)) {
+        return def;
+    }
+
+    return (INT)GetPrivateProfileInt(section, key, def, szPath);
+}
+
+/**
+ * Reads a string setting from rfid.ini, which lives beside the plugin DLL.
+ *
+ * @param LPCTSTR section   The ini section name.
+ * @param LPCTSTR key       The setting name.
+ * @param LPCTSTR def       The value to use if the setting is missing.
+ * @param LPTSTR value      The buffer that receives the value.
+ * @param DWORD size        The size of the buffer in TCHARs.
+ * @returns none
+ */
+void rfid_config_string(LPCTSTR section, LPCTSTR key, LPCTSTR def,
+        LPTSTR value, DWORD size) {
+    TCHAR szPath[MAX_PATH];
+
+    if (!rfid_config_path(szPath)) {
+        StringCchCopy(value, size, def);
+        return;
+    }
+
+    GetPrivateProfileString(section, key, def, value, size, szPath);
+}
+
+RFID_BCC rfid_calc_bcc(LPVOID message, WORD size) {
+    BYTE lrc = 0;
+    DWORD i = 0;
+    RFID_BCC bcc;
+
+    for (i = 0; i < size; i++) {
+        lrc ^= *((BYTE*)message + i);
+    }
+    
+    bcc.lrc = lrc;
+    bcc.i_lrc = (lrc ^ 0xFF);
+
+    return bcc;
+}
+
+void rfid_getversion_request(RFID_A2D_GetVersion** msg) {
+    *msg = (RFID_A2D_GetVersion*)malloc(sizeof(RFID_A2D_GetVersion));
+    (*msg)->header.soframe = 0x1;
+    (*msg)->header.length = sizeof(RFID_A2D_GetVersion);
+    (*msg)->header.deviceID = 0x3;
+    (*msg)->header.command1 = 0x1;
+    (*msg)->header.command2 = 0x40;
+    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
+}
+
+void rfid_findtoken_request(RFID_A2D_FindToken** msg) {
+    *msg = (RFID_A2D_FindToken*)malloc(sizeof(RFID_A2D_FindToken));
+    (*msg)->header.soframe = 0x1;
+    (*msg)->header.length = sizeof(RFID_A2D_FindToken);
+    (*msg)->header.deviceID = 0x3;
+    (*msg)->header.command1 = 0x1;
+    (*msg)->header.command2 = 0x41;
+    (*msg)->timeout = 0xA;
+    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
+}
+
+void rfid_setdriver_request(RFID_A2D_SetDriver** msg, BYTE drivers) {
+    *msg = (RFID_A2D_SetDriver*)malloc(sizeof(RFID_A2D_SetDriver));
+    (*msg)->header.soframe = 0x1;
+    (*msg)->header.length = sizeof(RFID_A2D_SetDriver);
+    (*msg)->header.deviceID = 0x3;
+    (*msg)->header.command1 = 0x1;
+    (*msg)->header.command2 = 0x43;
+    (*msg)->drivers = drivers;
+    (*msg)->active = 0x3;
+    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
+}
+
+void rfid_setbaud_request(RFID_A2D_SetBaud** msg, BYTE baud) {
+    *msg = (RFID_A2D_SetBaud*)malloc(sizeof(RFID_A2D_SetBaud));
+    (*msg)->header.soframe = 0x1;
+    (*msg)->header.length = sizeof(RFID_A2D_SetBaud);
+    (*msg)->header.deviceID = 0x3;
+    (*msg)->header.command1 = 0x1;
+    (*msg)->header.command2 = 0x46;
+    (*msg)->baud = baud;
+    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
+}
+
+void rfid_transon_request(RFID_A2D_TransOn** msg, BYTE entity) {
+    *msg = (RFID_A2D_TransOn*)malloc(sizeof(RFID_A2D_TransOn));
+    (*msg)->header.soframe = 0x1;
+    (*msg)->header.length = sizeof(RFID_A2D_TransOn);
+    (*msg)->header.deviceID = 0x3;
+    (*msg)->header.command1 = entity;
+    (*msg)->header.command2 = 0x48;
+    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
+}
+
+void rfid_transoff_request(RFID_A2D_TransOff** msg, BYTE entity) {
+    *msg = (RFID_A2D_TransOff*)malloc(sizeof(RFID_A2D_TransOff));
+    (*msg)->header.soframe = 0x1;
+    (*msg)->header.length = sizeof(RFID_A2D_TransOff);
+    (*msg)->header.deviceID = 0x3;
+    (*msg)->header.command1 = entity;
+    (*msg)->header.command2 = 0x49;
+    (*msg)->bcc = rfid_calc_bcc((LPVOID)*msg, (*msg)->header.length - 2);
 }
\ No newline at end of file
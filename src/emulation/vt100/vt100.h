@@ -1,134 +1,186 @@
-/**
- * @filename vt100.h
- * @author Darryl Pogue & Terence Stenvold
- * @designer Darryl Pogue
- * @date 2010 10 18
- * @project Terminal Emulator: VT100 Plugin
- *
- * This file contains the definitions and prototypes for functions used by
- * the VT100 emulation mode plugin.
- */
-#ifndef _VT100_H
-#define _VT100_H
-
-#include <Windows.h>
-#include <tchar.h>
-#include <strsafe.h>
-#include "../../defines.h"
-#include "../../emulation.h"
-
-#define STYLE_POS(x) (INT)((x & 0xFF000000) >> 24)
-
-typedef struct _cursor {
-    DWORD x;
-    DWORD y;
-    DWORD style;
-} Cursor;
-
-enum {
-    kKeypadNumericMode,
-    kKeypadApplicationMode,
-    kCursorApplicationMode
-};
-
-enum {
-    kLineNormal = 0,
-    kLineDoubleWidth = (1 << 0),
-    kLineDoubleTop = (1 << 1),
-    kLineDoubleBottom = (1 << 2)
-};
-
-enum {
-    kLineStyleNormal = 0,
-    kLineStyleBold = (1 << 1),
-    kLineStyleBlink = (1 << 2), /* Unsupported! */
-    kLineStyleUnderline = (1 << 3),
-    kLineStyleReverse = (1 << 4)
-};
-
-typedef struct _colstyle ColStyle;
-
-/** DWORD style:
- *  [8 bits] = Column Number (0 - 132)
- *  [8 bits] = Style (bit vector)
- *  [8 bits] = Foreground Colour
- *  [8 bits] = Background Colour
- */
-struct _colstyle {
-    DWORD style;
-    ColStyle* next;
-};
-
-typedef struct _line {
-    /* Refers to double height/width */
-    CHAR weight;
-    BOOLEAN bDirty;
-    ColStyle* colstyle;
-} Line;
-
-typedef struct _vt100_data {
-    HWND hwnd;
-    Cursor current;
-    Cursor saved;
-    Cursor origin; /* Not really a cursor */
-    CHAR htabs[132];
-    DWORD scroll_top;
-    DWORD scroll_bottom;
-    BOOLEAN autowrap;
-    BOOLEAN relorigin;
-    CHAR appcursormode;
-    BOOLEAN screen_reverse;
-    Line lines[24];
-    TCHAR screen[24][81];
-} VT100_Data;
-
-/**
- * Sets the style of a line on the screen.
- * @implementation vt100_parser.c
- */
-void set_line_style(ColStyle* ln, DWORD x, DWORD style);
-
-/**
- * Sets the cursor style.
- * @implementation vt100_parser.c
- */
-void set_style(VT100_Data* vt, CHAR attr, CHAR fg, CHAR bg, BOOL reset);
-
-/**
- * Handles an escape sequence beginning with ESC[ and ending with m.
- * @implementation vt100_parser.c
- */
-void escape_colour(LPCTSTR rx, VT100_Data* vt);
-
-/**
- * Handles an escape sequence beginning with ESC[.
- * @implementation vt100_parser.c
- */
-void escape_bracket(LPCTSTR rx, VT100_Data* vt);
-
-/**
- * Handles an escape sequence beginning with ESC?.
- * @implementation vt100_parser.c
- */
-void escape_question(LPCTSTR rx, VT100_Data* vt);
-
-/**
- * Handles an escape sequence beginning with ESC#.
- * @implementation vt100_parser.c
- */
-void escape_hash(LPCTSTR rx, VT100_Data* vt);
-
-/**
- * Scrolls all the lines in the scrolling region up or down by one line.
- * @implementation vt100_parser.c
- */
-void scroll_screen(char up, VT100_Data* vt);
-
-
-/**
- * Draws a line of text to the screen.
- * @implementation vt100_renderer.c
- */
-DWORD draw_line(DWORD ln, VT100_Data* vt, HWND hwnd, HDC hdc);
-
-#endif
+/**
+ * @filename vt100.h
+ * @author Darryl Pogue & Terence Stenvold
+ * @designer Darryl Pogue
+ * @date 2010 10 18
+ * @project Terminal Emulator: VT100 Plugin
+ *
+ * This file contains the definitions and prototypes for functions used by
+ * the VT100 emulation mode plugin.
+ */
+#ifndef _VT100_H
+#define _VT100_H
+
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+#include "../../defines.h"
+#include "../../emulation.h"
+
+#define STYLE_POS(x) (INT)((x & 0xFF000000) >> 24)
+
+/* Longest escape sequence kept, with its NUL; longer ones are dropped */
+#define VT100_ESC_MAX 16
+
+/* Version of the snapshot layout; change it whenever the layout changes */
+#define VT100_SNAPSHOT_VERSION 1
+/* Length of a snapshot: version, lines, two cursors, modes and tab stops */
+#define VT100_SNAPSHOT_SIZE (1 + 24 * (1 + 80 * 4) + 2 * 5 + 7 + 132)
+
+typedef struct _cursor {
+    DWORD x;
+    DWORD y;
+    DWORD style;
+} Cursor;
+
+enum {
+    kKeypadNumericMode,
+    kKeypadApplicationMode,
+    kCursorApplicationMode
+};
+
+enum {
+    kLineNormal = 0,
+    kLineDoubleWidth = (1 << 0),
+    kLineDoubleTop = (1 << 1),
+    kLineDoubleBottom = (1 << 2)
+};
+
+enum {
+    kLineStyleNormal = 0,
+    kLineStyleBold = (1 << 1),
+    kLineStyleBlink = (1 << 2), /* Unsupported! */
+    kLineStyleUnderline = (1 << 3),
+    kLineStyleReverse = (1 << 4)
+};
+
+typedef struct _colstyle ColStyle;
+
+/** DWORD style:
+ *  [8 bits] = Column Number (0 - 132)
+ *  [8 bits] = Style (bit vector)
+ *  [8 bits] = Foreground Colour
+ *  [8 bits] = Background Colour
+ */
+struct _colstyle {
+    DWORD style;
+    ColStyle* next;
+};
+
+typedef struct _line {
+    /* Refers to double height/width */
+    CHAR weight;
+    BOOLEAN bDirty;
+    ColStyle* colstyle;
+} Line;
+
+typedef struct _vt100_data {
+    HWND hwnd;
+    Cursor current;
+    Cursor saved;
+    Cursor origin; /* Not really a cursor */
+    CHAR htabs[132];
+    DWORD scroll_top;
+    DWORD scroll_bottom;
+    BOOLEAN autowrap;
+    BOOLEAN relorigin;
+    CHAR appcursormode;
+    BOOLEAN screen_reverse;
+    DWORD bells; /* Bells rung since the last receive */
+    TCHAR esc_buffer[VT100_ESC_MAX]; /* The escape sequence being parsed */
+    Line lines[24];
+    TCHAR screen[24][81];
+} VT100_Data;
+
+/**
+ * Makes a screen in its power-on state.
+ * @implementation vt100.c
+ */
+VT100_Data* vt100_screen_create(HWND hwnd);
+
+/**
+ * Frees a screen made by vt100_screen_create.
+ * @implementation vt100.c
+ */
+void vt100_screen_free(VT100_Data* vt);
+
+/**
+ * Parses received data into a screen.
+ * @implementation vt100.c
+ */
+DWORD vt100_parse(VT100_Data* vtdata, const BYTE* rx, DWORD len);
+
+/**
+ * Takes a snapshot of a screen, to compare or hash.
+ * @implementation vt100_snapshot.c
+ */
+DWORD vt100_snapshot(VT100_Data* vt, BYTE* out, DWORD size);
+
+/**
+ * Hashes a snapshot of a screen.
+ * @implementation vt100_snapshot.c
+ */
+DWORD vt100_hash(VT100_Data* vt);
+
+/**
+ * Frees a line's list of styles.
+ * @implementation vt100_parser.c
+ */
+void free_tree_recur(ColStyle* root);
+
+/**
+ * Sets the style of a line on the screen.
+ * @implementation vt100_parser.c
+ */
+void set_line_style(ColStyle* ln, DWORD x, DWORD style);
+
+/**
+ * Sets the cursor style.
+ * @implementation vt100_parser.c
+ */
+void set_style(VT100_Data* vt, CHAR attr, CHAR fg, CHAR bg, BOOL reset);
+
+/**
+ * Handles an escape sequence beginning with ESC[ and ending with m.
+ * @implementation vt100_parser.c
+ */
+void escape_colour(LPCTSTR rx, VT100_Data* vt);
+
+/**
+ * Handles an escape sequence beginning with ESC[.
+ * @implementation vt100_parser.c
+ */
+void escape_bracket(LPCTSTR rx, VT100_Data* vt);
+
+/**
+ * Handles an escape sequence beginning with ESC?.
+ * @implementation vt100_parser.c
+ */
+void escape_question(LPCTSTR rx, VT100_Data* vt);
+
+/**
+ * Handles an escape sequence beginning with ESC#.
+ * @implementation vt100_parser.c
+ */
+void escape_hash(LPCTSTR rx, VT100_Data* vt);
+
+/**
+ * Scrolls all the lines in the scrolling region up or down by one line.
+ * @implementation vt100_parser.c
+ */
+void scroll_screen(char up, VT100_Data* vt);
+
+/**
+ * Moves the cursor down a line, scrolling at the bottom of the region.
+ * @implementation vt100_parser.c
+ */
+void line_feed(VT100_Data* vt);
+
+
+/**
+ * Draws a line of text to the screen.
+ * @implementation vt100_renderer.c
+ */
+DWORD draw_line(DWORD ln, VT100_Data* vt, HWND hwnd, HDC hdc);
+
+#endif
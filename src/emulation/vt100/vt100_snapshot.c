@@ -0,0 +1,140 @@
+/**
+ * @filename vt100_snapshot.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator: VT100 Plugin
+ *
+ * This file contains the functions that take a snapshot of a screen: what
+ * it shows, and the state that decides what it will show next, in a fixed
+ * layout that can be compared or hashed. Two parsers that agree on every
+ * snapshot agree on the screen.
+ *
+ * The layout, every field one byte:
+ *   version
+ *   for each of the 24 lines: weight, then for each of the 80 columns the
+ *       character, attributes, foreground and background
+ *   cursor: x, y, attributes, foreground, background
+ *   saved cursor: the same
+ *   modes: origin line, scroll top, scroll bottom, autowrap, relative
+ *       origin, cursor and keypad mode, reverse screen
+ *   tab stops: one byte for each of the 132 columns
+ *
+ * Dirty flags, bells and any half-parsed escape sequence are left out;
+ * they depend on how the data was split into reads.
+ */
+#include "vt100.h"
+#include "../../crc.h"
+
+/**
+ * Adds a style to a snapshot: its attributes, foreground and background,
+ * without the column it starts at.
+ *
+ * @param BYTE* out     Where to put it.
+ * @param DWORD style   The style.
+ * @returns The byte after it.
+ */
+static BYTE* snapshot_style(BYTE* out, DWORD style) {
+    *out++ = (BYTE)(style >> 16);
+    *out++ = (BYTE)(style >> 8);
+    *out++ = (BYTE)style;
+    return out;
+}
+
+/**
+ * Adds a cursor to a snapshot.
+ *
+ * @param BYTE* out     Where to put it.
+ * @param Cursor* c     The cursor.
+ * @returns The byte after it.
+ */
+static BYTE* snapshot_cursor(BYTE* out, Cursor* c) {
+    *out++ = (BYTE)c->x;
+    *out++ = (BYTE)c->y;
+    return snapshot_style(out, c->style);
+}
+
+/**
+ * Adds a line to a snapshot, with the style of each column worked out from
+ * the line's list the way draw_line does: a style at position p starts at
+ * column p - 1.
+ *
+ * @param BYTE* out         Where to put it.
+ * @param VT100_Data* vt    The screen.
+ * @param DWORD y           The line.
+ * @returns The byte after it.
+ */
+static BYTE* snapshot_line(BYTE* out, VT100_Data* vt, DWORD y) {
+    ColStyle* cur = vt->lines[y].colstyle;
+    DWORD x;
+
+    *out++ = (BYTE)vt->lines[y].weight;
+
+    for (x = 0; x < 80; x++) {
+        while (cur->next != NULL && (DWORD)STYLE_POS(cur->next->style) <= x + 1) {
+            cur = cur->next;
+        }
+
+        *out++ = (BYTE)vt->screen[y][x];
+        out = snapshot_style(out, cur->style);
+    }
+
+    return out;
+}
+
+/**
+ * Takes a snapshot of a screen, in the layout described above.
+ *
+ * @param VT100_Data* vt    The screen.
+ * @param BYTE* out         Receives the snapshot.
+ * @param DWORD size        The size of out; at least VT100_SNAPSHOT_SIZE.
+ *
+ * @returns The length of the snapshot, or 0 if out is too small.
+ */
+DWORD vt100_snapshot(VT100_Data* vt, BYTE* out, DWORD size) {
+    BYTE* p = out;
+    DWORD y;
+    DWORD x;
+
+    if (size < VT100_SNAPSHOT_SIZE) {
+        return 0;
+    }
+
+    *p++ = VT100_SNAPSHOT_VERSION;
+
+    for (y = 0; y < 24; y++) {
+        p = snapshot_line(p, vt, y);
+    }
+
+    p = snapshot_cursor(p, &vt->current);
+    p = snapshot_cursor(p, &vt->saved);
+
+    *p++ = (BYTE)vt->origin.y;
+    *p++ = (BYTE)vt->scroll_top;
+    *p++ = (BYTE)vt->scroll_bottom;
+    *p++ = (BYTE)vt->autowrap;
+    *p++ = (BYTE)vt->relorigin;
+    *p++ = (BYTE)vt->appcursormode;
+    *p++ = (BYTE)vt->screen_reverse;
+
+    for (x = 0; x < 132; x++) {
+        *p++ = (BYTE)vt->htabs[x];
+    }
+
+    return (DWORD)(p - out);
+}
+
+/**
+ * Hashes a snapshot of a screen, to compare screens or check one against
+ * a known result.
+ *
+ * @param VT100_Data* vt    The screen.
+ *
+ * @returns The CRC-32 of the snapshot.
+ */
+DWORD vt100_hash(VT100_Data* vt) {
+    BYTE snap[VT100_SNAPSHOT_SIZE];
+    DWORD len = vt100_snapshot(vt, snap, VT100_SNAPSHOT_SIZE);
+
+    return Crc32(0, snap, len);
+}
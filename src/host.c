@@ -0,0 +1,378 @@
+/**
+ * @filename host.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for running a decoder
+ * in the plugin host.
+ *
+ * The host stage consumes everything it is given, copying it into the in
+ * ring. A watch thread waits for the host to fill the out ring and posts
+ * what it decoded to the session window with TWM_HOSTDATA, where it goes
+ * through the rest of the pipeline. If the host exits, or has data waiting
+ * that it does not read for HOST_TIMEOUT, the window is sent TWM_HOSTLOST
+ * and starts it again. The port is never touched, and data that arrives in
+ * the meantime waits in the ring for the new host.
+ *
+ * The host can write the whole of the shared memory, counters included. If
+ * a ring comes back with counters that can't be right (RING_BROKEN), the
+ * host is killed and, rather than starting another on the same memory,
+ * TWM_HOSTLOST stops the decoder.
+ */
+#include "host.h"
+
+/* Numbers the shared memory of each host in this process */
+static volatile LONG host_serial = 0;
+
+/**
+ * Gives up on a host that has left a ring in a state it can't be in. The
+ * host is killed, and the watch thread sees it go and sends TWM_HOSTLOST.
+ *
+ * @param Host* host    The host.
+ * @returns none
+ */
+static void HostBroken(Host* host) {
+    host->broken = TRUE;
+    TerminateProcess(host->hProcess, 1);
+}
+
+/**
+ * Posts whatever the host has decoded to the session window. Data the
+ * window can't be sent is dropped and counted in the port's statistics.
+ *
+ * @param Host* host    The host.
+ * @returns none
+ */
+static void HostDrain(Host* host) {
+    DWORD len = 0;
+
+    while ((len = RingUsed(&host->shm->out)) > 0) {
+        BYTE* data = NULL;
+
+        if (len == RING_BROKEN) {
+            HostBroken(host);
+            return;
+        }
+
+        data = (BYTE*)malloc(len);
+        if (data == NULL) {
+            return;
+        }
+
+        len = RingRead(&host->shm->out, data, len);
+        if (len == RING_BROKEN) {
+            free(data);
+            HostBroken(host);
+            return;
+        }
+
+        if (!PostMessage(host->hwnd, TWM_HOSTDATA, (WPARAM)data, (LPARAM)len)) {
+            StatsDropped(host->stats, len);
+            free(data);
+        }
+    }
+}
+
+/**
+ * The thread procedure of the watch thread. Passes on decoded data until
+ * the host dies or the thread is stopped.
+ *
+ * @param LPVOID lpParameter    Pointer to the Host
+ * @returns 0 if the thread exited successfully.
+ */
+static DWORD WINAPI HostWatch(LPVOID lpParameter) {
+    Host* host = (Host*)lpParameter;
+    HANDLE waits[3] = {host->hStop, host->hOut, host->hProcess};
+    DWORD tail = host->shm->in.tail;
+
+    for (;;) {
+        DWORD ret = WaitForMultipleObjects(3, waits, FALSE, HOST_TIMEOUT);
+
+        if (ret == WAIT_OBJECT_0 + 1) {
+            HostDrain(host);
+        } else if (ret == WAIT_OBJECT_0 + 2) {
+            /* Keep what it decoded before it went */
+            HostDrain(host);
+            PostMessage(host->hwnd, TWM_HOSTLOST, 0, 0);
+            break;
+        } else if (ret == WAIT_TIMEOUT) {
+            DWORD used = RingUsed(&host->shm->in);
+
+            /* Data waiting, and none read since the last timeout: it is hung.
+               Its exit is seen on the next wait */
+            if (used == RING_BROKEN) {
+                HostBroken(host);
+            } else if (used > 0 && host->shm->in.tail == tail) {
+                TerminateProcess(host->hProcess, 1);
+            }
+            tail = host->shm->in.tail;
+        } else {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Creates one of the events shared with the host.
+ *
+ * @param Host* host        The host, with its name set.
+ * @param LPCTSTR suffix    Which event.
+ * @returns The event, or NULL on error.
+ */
+static HANDLE HostEvent(Host* host, LPCTSTR suffix) {
+    TCHAR full[HOST_NAME];
+
+    StringCchPrintf(full, HOST_NAME, TEXT("%s.%s"), host->name, suffix);
+    return CreateEvent(NULL, FALSE, FALSE, full);
+}
+
+/**
+ * Starts the host process, which the terminal is expected next to, and the
+ * thread that watches it.
+ *
+ * @param Host* host    The host, with its shared memory made.
+ * @returns 0 on success, >0 otherwise
+ */
+static int HostSpawn(Host* host) {
+    TCHAR exe[MAX_PATH];
+    TCHAR cmd[MAX_PATH * 2 + HOST_NAME + 32];
+    STARTUPINFO si;
+    PROCESS_INFORMATION pi;
+    LPTSTR slash = NULL;
+
+    if (GetModuleFileName(NULL, exe, MAX_PATH) == 0) {
+        return 1;
+    }
+    slash = _tcsrchr(exe, TEXT('\\'));
+    slash = (slash != NULL) ? slash + 1 : exe;
+    *slash = TEXT('\0');
+    StringCchCat(exe, MAX_PATH, HOST_EXE);
+
+    StringCchPrintf(cmd, MAX_PATH * 2 + HOST_NAME + 32,
+            TEXT("\"%s\" %s %lu \"%s\""), exe, host->name,
+            GetCurrentProcessId(), host->path);
+
+    ZeroMemory(&si, sizeof(STARTUPINFO));
+    si.cb = sizeof(STARTUPINFO);
+    if (!CreateProcess(exe, cmd, NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL,
+            NULL, &si, &pi)) {
+        return 2;
+    }
+    CloseHandle(pi.hThread);
+    host->hProcess = pi.hProcess;
+    host->dwStarted = GetTickCount();
+    /* A new host reads whatever the last one left waiting */
+    SetEvent(host->hIn);
+
+    host->hWatch = CreateThread(NULL, 0, &HostWatch, (LPVOID)host, 0, 0);
+    if (host->hWatch == NULL) {
+        TerminateProcess(host->hProcess, 1);
+        CloseHandle(host->hProcess);
+        host->hProcess = NULL;
+        return 3;
+    }
+
+    return 0;
+}
+
+/**
+ * Stops the watch thread and the host process, asking it to exit before it
+ * is killed.
+ *
+ * @param Host* host    The host.
+ * @returns none
+ */
+static void HostReap(Host* host) {
+    if (host->hWatch != NULL) {
+        SetEvent(host->hStop);
+        WaitForSingleObject(host->hWatch, INFINITE);
+        CloseHandle(host->hWatch);
+        host->hWatch = NULL;
+        ResetEvent(host->hStop);
+    }
+
+    if (host->hProcess != NULL) {
+        SetEvent(host->hQuit);
+        if (WaitForSingleObject(host->hProcess, HOST_QUIT_WAIT) != WAIT_OBJECT_0) {
+            TerminateProcess(host->hProcess, 1);
+        }
+        CloseHandle(host->hProcess);
+        host->hProcess = NULL;
+        ResetEvent(host->hQuit);
+    }
+}
+
+/**
+ * Sets up a Host with no decoder in use.
+ *
+ * @param Host* host    The host.
+ * @param HWND hwnd     The session window, sent the decoded data.
+ * @param PortStats* stats  The port counters, told of dropped data.
+ * @returns none
+ */
+void HostInit(Host* host, HWND hwnd, PortStats* stats) {
+    ZeroMemory(host, sizeof(Host));
+    host->hwnd = hwnd;
+    host->stats = stats;
+}
+
+/**
+ * Makes the memory and events shared with a plugin host, and starts it
+ * running a decoder.
+ *
+ * @param Host* host    The host, not in use.
+ * @param LPCTSTR path  The decoder DLL.
+ * @returns 0 on success, >0 otherwise
+ */
+int HostStart(Host* host, LPCTSTR path) {
+    StringCchCopy(host->path, MAX_PATH, path);
+    StringCchPrintf(host->name, HOST_NAME, TEXT("Local\\TerminalHost.%lu.%ld"),
+            GetCurrentProcessId(), InterlockedIncrement(&host_serial));
+
+    host->hMap = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+            0, sizeof(HostShared), host->name);
+    if (host->hMap == NULL) {
+        return 1;
+    }
+
+    host->shm = (HostShared*)MapViewOfFile(host->hMap, FILE_MAP_WRITE, 0, 0,
+            sizeof(HostShared));
+    host->hIn = HostEvent(host, TEXT("in"));
+    host->hOut = HostEvent(host, TEXT("out"));
+    host->hQuit = HostEvent(host, TEXT("quit"));
+    host->hStop = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (host->shm == NULL || host->hIn == NULL || host->hOut == NULL ||
+            host->hQuit == NULL || host->hStop == NULL) {
+        HostStop(host);
+        return 2;
+    }
+
+    host->shm->dwVersion = HOST_VERSION;
+    RingInit(&host->shm->in);
+    RingInit(&host->shm->out);
+    host->dwQuick = 0;
+    host->broken = FALSE;
+
+    if (HostSpawn(host) != 0) {
+        HostStop(host);
+        return 3;
+    }
+
+    return 0;
+}
+
+/**
+ * Starts the plugin host again after it died, keeping the shared memory
+ * and whatever is waiting in it. Whatever the old host had read but not
+ * yet decoded is lost. A host that keeps dying as soon as it starts is
+ * given up on, as is one that broke a ring, since the next would start
+ * from the same counters. Called when the session window gets
+ * TWM_HOSTLOST; if the host is still running, the message was about one
+ * already replaced.
+ *
+ * @param Host* host    The host.
+ * @returns 0 if the host is running, >0 if it was given up on: 1 if it kept
+ *          dying, 2 if it can't be started, 3 if it broke a ring.
+ */
+int HostRestart(Host* host) {
+    if (!HostRunning(host) ||
+            WaitForSingleObject(host->hProcess, 0) != WAIT_OBJECT_0) {
+        return 0;
+    }
+
+    if (host->broken) {
+        return 3;
+    }
+
+    if (GetTickCount() - host->dwStarted < HOST_QUICK) {
+        if (++host->dwQuick >= HOST_RESTARTS) {
+            return 1;
+        }
+    } else {
+        host->dwQuick = 0;
+    }
+
+    HostReap(host);
+    return (HostSpawn(host) == 0) ? 0 : 2;
+}
+
+/**
+ * Stops the plugin host and frees what is shared with it. Anything not
+ * yet decoded is dropped.
+ *
+ * @param Host* host    The host.
+ * @returns none
+ */
+void HostStop(Host* host) {
+    HostReap(host);
+
+    if (host->shm != NULL) {
+        UnmapViewOfFile(host->shm);
+        host->shm = NULL;
+    }
+    if (host->hMap != NULL) {
+        CloseHandle(host->hMap);
+        host->hMap = NULL;
+    }
+    if (host->hIn != NULL) {
+        CloseHandle(host->hIn);
+        host->hIn = NULL;
+    }
+    if (host->hOut != NULL) {
+        CloseHandle(host->hOut);
+        host->hOut = NULL;
+    }
+    if (host->hQuit != NULL) {
+        CloseHandle(host->hQuit);
+        host->hQuit = NULL;
+    }
+    if (host->hStop != NULL) {
+        CloseHandle(host->hStop);
+        host->hStop = NULL;
+    }
+}
+
+/**
+ * Tells whether a decoder is in use.
+ *
+ * @param Host* host    The host.
+ * @returns TRUE if HostStart succeeded and HostStop has not been called.
+ */
+BOOLEAN HostRunning(Host* host) {
+    return host->hMap != NULL;
+}
+
+/**
+ * Pipeline stage: hands received data to the plugin host and consumes it.
+ * The decoded data comes back later with TWM_HOSTDATA. Data that does not
+ * fit in the ring is dropped, as it would be if the port overran, and
+ * counted in the port's statistics, as is data given to a host that has
+ * broken the ring, which is then killed.
+ *
+ * @param LPVOID data   Pointer to the Host
+ * @param RxSlice* in   The received data.
+ * @param RxSlice* out  Unused.
+ * @param DWORD max     Unused.
+ * @returns 0; every slice is consumed.
+ */
+DWORD HostStage(LPVOID data, RxSlice* in, RxSlice* out, DWORD max) {
+    Host* host = (Host*)data;
+    DWORD written = 0;
+
+    written = RingWrite(&host->shm->in, in->data, in->len);
+    if (written == RING_BROKEN) {
+        StatsDropped(host->stats, in->len);
+        HostBroken(host);
+        return 0;
+    }
+    if (written < in->len) {
+        StatsDropped(host->stats, in->len - written);
+    }
+    SetEvent(host->hIn);
+
+    return 0;
+}
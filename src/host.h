@@ -0,0 +1,110 @@
+/**
+ * @filename host.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for running a decoder
+ * plugin out of process, in the plugin host (tools\pluginhost), as a stage
+ * of a session's receive pipeline.
+ */
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <Windows.h>
+#include <strsafe.h>
+#include "defines.h"
+#include "hostring.h"
+#include "pipeline.h"
+#include "stats.h"
+
+/* The plugin host, found next to the terminal */
+#define HOST_EXE TEXT("pluginhost.exe")
+/* Longest name of an object shared with the host */
+#define HOST_NAME 96
+/* Longest wait (ms) for the host to read waiting data before it is killed */
+#define HOST_TIMEOUT 2000
+/* Longest wait (ms) for the host to exit when asked */
+#define HOST_QUIT_WAIT 1000
+/* A host that dies within this long (ms) of starting died quickly */
+#define HOST_QUICK 5000
+/* Quick deaths in a row before the host is given up on */
+#define HOST_RESTARTS 3
+
+/**
+ * The Host structure contains a plugin host and what the session shares
+ * with it. The shared memory and events last as long as the decoder is in
+ * use; the process may be restarted under them.
+ *
+ * @member HWND hwnd            The session window, sent the decoded data
+ * @member PortStats* stats     The port counters, told of dropped data
+ * @member TCHAR path[]         The decoder DLL
+ * @member TCHAR name[]         The name of the shared memory
+ * @member HANDLE hMap          The shared memory, or NULL if not in use
+ * @member HostShared* shm      The view of the shared memory
+ * @member HANDLE hIn           Set when there is data for the host
+ * @member HANDLE hOut          Set by the host when there is decoded data
+ * @member HANDLE hQuit         Set to ask the host to exit
+ * @member HANDLE hStop         Set to stop the watch thread
+ * @member HANDLE hProcess      The host process
+ * @member HANDLE hWatch        The thread watching the host
+ * @member DWORD dwStarted      The tick count when the host was started
+ * @member DWORD dwQuick        The number of quick deaths in a row
+ * @member BOOLEAN broken       Set when a ring's counters can't be trusted
+ */
+typedef struct _Host {
+    HWND hwnd;
+    PortStats* stats;
+    TCHAR path[MAX_PATH];
+    TCHAR name[HOST_NAME];
+    HANDLE hMap;
+    HostShared* shm;
+    HANDLE hIn;
+    HANDLE hOut;
+    HANDLE hQuit;
+    HANDLE hStop;
+    HANDLE hProcess;
+    HANDLE hWatch;
+    DWORD dwStarted;
+    DWORD dwQuick;
+    volatile BOOLEAN broken;
+} Host;
+
+/**
+ * Sets up a Host with no decoder in use.
+ * @implementation host.c
+ */
+void HostInit(Host* host, HWND hwnd, PortStats* stats);
+
+/**
+ * Starts a decoder in a plugin host.
+ * @implementation host.c
+ */
+int HostStart(Host* host, LPCTSTR path);
+
+/**
+ * Starts the plugin host again after it died.
+ * @implementation host.c
+ */
+int HostRestart(Host* host);
+
+/**
+ * Stops the plugin host and frees what is shared with it.
+ * @implementation host.c
+ */
+void HostStop(Host* host);
+
+/**
+ * Tells whether a decoder is in use.
+ * @implementation host.c
+ */
+BOOLEAN HostRunning(Host* host);
+
+/**
+ * Pipeline stage: hands received data to the plugin host.
+ * @implementation host.c
+ */
+DWORD HostStage(LPVOID data, RxSlice* in, RxSlice* out, DWORD max);
+
+#endif
@@ -0,0 +1,117 @@
+/**
+ * @filename hostring.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for the rings shared
+ * with a plugin host.
+ *
+ * Only the writer moves head and only the reader moves tail, so no lock is
+ * needed. Each side publishes its counter with an interlocked exchange
+ * after the data is in place, which is also the barrier that makes the
+ * data visible to the other process first.
+ *
+ * The counters live in memory the other process can write, so each call
+ * reads them once and checks that they are no more than HOST_RING apart
+ * before using them; a copy sized from counters that are not would run off
+ * the end of the buffer. Such a ring is left alone and RING_BROKEN is
+ * returned, and whoever sees it gives up on the other side.
+ */
+#include "hostring.h"
+
+#ifndef _WIN32
+#include <string.h>
+/* Off Windows the compiler gives the same copy and full barrier */
+#define CopyMemory memcpy
+#define InterlockedExchange(target, value) \
+    __atomic_exchange_n((target), (value), __ATOMIC_SEQ_CST)
+#endif
+
+/**
+ * Empties a ring. Neither side may be using it.
+ *
+ * @param HostRing* r   The ring.
+ * @returns none
+ */
+void RingInit(HostRing* r) {
+    r->head = 0;
+    r->tail = 0;
+}
+
+/**
+ * Gets the number of bytes waiting in a ring.
+ *
+ * @param HostRing* r   The ring.
+ * @returns The number of bytes written and not yet read, or RING_BROKEN.
+ */
+DWORD RingUsed(HostRing* r) {
+    DWORD head = r->head;
+    DWORD tail = r->tail;
+
+    return (head - tail <= HOST_RING) ? head - tail : RING_BROKEN;
+}
+
+/**
+ * Writes as much as fits into a ring. Called by the writer only.
+ *
+ * @param HostRing* r   The ring.
+ * @param BYTE* data    The data to write.
+ * @param DWORD len     The length of the data.
+ * @returns The number of bytes written, or RING_BROKEN.
+ */
+DWORD RingWrite(HostRing* r, const BYTE* data, DWORD len) {
+    DWORD head = r->head;
+    DWORD tail = r->tail;
+    DWORD room = 0;
+    DWORD at = head & (HOST_RING - 1);
+    DWORD first = 0;
+
+    if (head - tail > HOST_RING) {
+        return RING_BROKEN;
+    }
+
+    room = HOST_RING - (head - tail);
+    if (len > room) {
+        len = room;
+    }
+
+    first = (len < HOST_RING - at) ? len : HOST_RING - at;
+    CopyMemory(r->data + at, data, first);
+    CopyMemory(r->data, data + first, len - first);
+
+    InterlockedExchange((volatile LONG*)&r->head, (LONG)(head + len));
+    return len;
+}
+
+/**
+ * Reads what is waiting in a ring. Called by the reader only.
+ *
+ * @param HostRing* r   The ring.
+ * @param BYTE* data    Receives the data.
+ * @param DWORD size    The size of data.
+ * @returns The number of bytes read, or RING_BROKEN.
+ */
+DWORD RingRead(HostRing* r, BYTE* data, DWORD size) {
+    DWORD head = r->head;
+    DWORD tail = r->tail;
+    DWORD len = head - tail;
+    DWORD at = tail & (HOST_RING - 1);
+    DWORD first = 0;
+
+    if (len > HOST_RING) {
+        return RING_BROKEN;
+    }
+
+    if (len > size) {
+        len = size;
+    }
+
+    first = (len < HOST_RING - at) ? len : HOST_RING - at;
+    CopyMemory(data, r->data + at, first);
+    CopyMemory(data + first, r->data, len - first);
+
+    InterlockedExchange((volatile LONG*)&r->tail, (LONG)(tail + len));
+    return len;
+}
@@ -0,0 +1,83 @@
+/**
+ * @filename hostring.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the shared memory
+ * shared by the terminal and a plugin host: a ring of data each way, each
+ * with one writer and one reader.
+ */
+#ifndef _HOSTRING_H_
+#define _HOSTRING_H_
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+/* The rings are plain C, so their tests also build and run off Windows */
+typedef unsigned char BYTE;
+typedef unsigned int DWORD;
+typedef int LONG;
+#endif
+
+/* Size of each ring; a power of two */
+#define HOST_RING 1048576
+/* Version of the shared memory layout, checked by the host */
+#define HOST_VERSION 1
+/* Returned by the ring functions when the counters are more than HOST_RING
+   apart, which they never are unless the other side has scribbled on them */
+#define RING_BROKEN 0xFFFFFFFF
+
+/**
+ * The HostRing structure contains a ring of bytes. The counters only ever
+ * grow, wrapping at 2^32; the data lives at each counter modulo HOST_RING.
+ *
+ * @member DWORD head       The number of bytes ever written
+ * @member DWORD tail       The number of bytes ever read
+ * @member BYTE data[]      The bytes
+ */
+typedef struct _HostRing {
+    volatile DWORD head;
+    volatile DWORD tail;
+    BYTE data[HOST_RING];
+} HostRing;
+
+/**
+ * The HostShared structure contains the memory shared with a plugin host.
+ *
+ * @member DWORD dwVersion  HOST_VERSION
+ * @member HostRing in      Received data, written by the terminal
+ * @member HostRing out     Decoded data, written by the host
+ */
+typedef struct _HostShared {
+    DWORD dwVersion;
+    HostRing in;
+    HostRing out;
+} HostShared;
+
+/**
+ * Empties a ring.
+ * @implementation hostring.c
+ */
+void RingInit(HostRing* r);
+
+/**
+ * Gets the number of bytes waiting in a ring.
+ * @implementation hostring.c
+ */
+DWORD RingUsed(HostRing* r);
+
+/**
+ * Writes as much as fits into a ring.
+ * @implementation hostring.c
+ */
+DWORD RingWrite(HostRing* r, const BYTE* data, DWORD len);
+
+/**
+ * Reads what is waiting in a ring.
+ * @implementation hostring.c
+ */
+DWORD RingRead(HostRing* r, BYTE* data, DWORD size);
+
+#endif
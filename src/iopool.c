@@ -0,0 +1,237 @@
+/**
+ * @filename iopool.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for the I/O pool.
+ *
+ * Every open port, whichever session it belongs to, has one overlapped read
+ * outstanding at a time. Its completion is picked up by whichever thread of
+ * the pool is free, which hands the data to the port's window and issues the
+ * next read. A read is only ever issued from the thread that handled the
+ * last one, or by IoPoolAttach, so a port's reads are handled in order.
+ * Writes still go through each port's transmit thread.
+ */
+#include "iopool.h"
+
+/**
+ * Gets the handle a port's reads are issued on.
+ *
+ * @param SerialPort* sp    The port.
+ * @returns The device handle, or the socket of a network connection.
+ */
+static HANDLE IoHandle(SerialPort* sp) {
+    if (sp->transport->type == kTransportNet) {
+        return (HANDLE)sp->sock;
+    }
+
+    return sp->hDev;
+}
+
+/**
+ * Handles a completed read and issues the next one. If the read failed, or
+ * the next one cannot be issued, the port is left idle and its window is
+ * told the port was lost, unless the port is being detached anyway.
+ *
+ * @param SerialPort* sp        The port.
+ * @param BOOL ok               FALSE if the read failed or was cancelled.
+ * @param DWORD transferred     The number of bytes read.
+ * @returns none
+ */
+static void IoComplete(SerialPort* sp, BOOL ok, DWORD transferred) {
+    HANDLE hIdle = sp->hRxIdle;
+    HWND hwnd = sp->hwnd;
+    BOOLEAN lost = FALSE;
+    int ret = 0;
+
+    if (ok) {
+        ret = sp->transport->read_done(sp, transferred);
+    } else {
+        free(sp->rxbuf);
+        sp->rxbuf = NULL;
+        ret = 1;
+    }
+
+    EnterCriticalSection(&sp->rxlock);
+    if (ret == 0 && !sp->rxstop) {
+        ret = sp->transport->read_start(sp);
+        if (ret == 0) {
+            LeaveCriticalSection(&sp->rxlock);
+            return;
+        }
+    }
+    lost = !sp->rxstop;
+    sp->rxpending = FALSE;
+    LeaveCriticalSection(&sp->rxlock);
+
+    if (lost) {
+        /* Most likely the device was unplugged; let the window thread
+           reconnect */
+        PostMessage(hwnd, TWM_PORTLOST, 0, 0);
+    }
+
+    /* The port may be closed as soon as this is set */
+    SetEvent(hIdle);
+}
+
+/**
+ * The thread procedure of the pool. Handles completed reads until
+ * IoPoolStop posts a packet without an OVERLAPPED.
+ *
+ * @param LPVOID lpParameter    Pointer to the IoPool
+ * @returns 0 if the thread exited successfully.
+ */
+static DWORD WINAPI IoLoop(LPVOID lpParameter) {
+    IoPool* pool = (IoPool*)lpParameter;
+
+    for (;;) {
+        DWORD transferred = 0;
+        ULONG_PTR key = 0;
+        LPOVERLAPPED ov = NULL;
+        BOOL ok = FALSE;
+
+        ok = GetQueuedCompletionStatus(pool->hPort, &transferred, &key, &ov,
+                INFINITE);
+        if (ov == NULL) {
+            break;
+        }
+
+        IoComplete((SerialPort*)key, ok, transferred);
+    }
+
+    return 0;
+}
+
+/**
+ * Creates the completion port and starts a thread for each processor,
+ * between IOPOOL_MIN and IOPOOL_MAX of them.
+ *
+ * @param IoPool* pool  The pool.
+ * @returns 0 on success, >0 otherwise
+ */
+int IoPoolStart(IoPool* pool) {
+    SYSTEM_INFO si;
+    DWORD want = 0;
+
+    GetSystemInfo(&si);
+    want = si.dwNumberOfProcessors;
+    want = (want < IOPOOL_MIN) ? IOPOOL_MIN : want;
+    want = (want > IOPOOL_MAX) ? IOPOOL_MAX : want;
+
+    pool->count = 0;
+    pool->hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, want);
+    if (pool->hPort == NULL) {
+        return 1;
+    }
+
+    while (pool->count < want) {
+        HANDLE hThread = CreateThread(NULL, 0, &IoLoop, (LPVOID)pool, 0, 0);
+
+        if (hThread == NULL) {
+            break;
+        }
+        pool->threads[pool->count++] = hThread;
+    }
+
+    if (pool->count == 0) {
+        CloseHandle(pool->hPort);
+        pool->hPort = NULL;
+        return 2;
+    }
+
+    return 0;
+}
+
+/**
+ * Starts reading an open port on the pool. Its data is sent to the port's
+ * window with TWM_RXDATA from the pool's threads, and TWM_PORTLOST is
+ * posted if reading fails.
+ *
+ * @param IoPool* pool      The pool.
+ * @param SerialPort* sp    The port, opened and started.
+ * @returns 0 on success, >0 otherwise
+ */
+int IoPoolAttach(IoPool* pool, SerialPort* sp) {
+    int ret = 0;
+
+    /* A new handle each time the port is opened, so it is never already
+       attached */
+    if (CreateIoCompletionPort(IoHandle(sp), pool->hPort, (ULONG_PTR)sp, 0) == NULL) {
+        return 1;
+    }
+
+    EnterCriticalSection(&sp->rxlock);
+    sp->rxstop = FALSE;
+    sp->rxqueued = 0;
+    sp->rxpending = TRUE;
+    ResetEvent(sp->hRxIdle);
+
+    if (sp->transport->read_start(sp) != 0) {
+        sp->rxpending = FALSE;
+        SetEvent(sp->hRxIdle);
+        ret = 2;
+    }
+    LeaveCriticalSection(&sp->rxlock);
+
+    return ret;
+}
+
+/**
+ * Stops reading a port. The outstanding read is cancelled, and this waits
+ * for the pool to let go of the port, after which it may be closed. The
+ * pool may be sending TWM_RXDATA to the window at the time, so sent
+ * messages are handled while waiting.
+ *
+ * @param SerialPort* sp    The port.
+ * @returns none
+ */
+void IoPoolDetach(SerialPort* sp) {
+    if (sp->hRxIdle == NULL) {
+        return;
+    }
+
+    EnterCriticalSection(&sp->rxlock);
+    sp->rxstop = TRUE;
+    if (sp->rxpending) {
+        CancelIoEx(IoHandle(sp), &sp->rxov);
+    }
+    LeaveCriticalSection(&sp->rxlock);
+
+    while (MsgWaitForMultipleObjects(1, &sp->hRxIdle, FALSE, INFINITE,
+            QS_SENDMESSAGE) == WAIT_OBJECT_0 + 1) {
+        MSG msg;
+
+        /* Peeking delivers the message the pool is waiting on */
+        PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE | PM_QS_SENDMESSAGE);
+    }
+}
+
+/**
+ * Stops the threads of the pool and closes the completion port. Every port
+ * must have been detached first.
+ *
+ * @param IoPool* pool  The pool.
+ * @returns none
+ */
+void IoPoolStop(IoPool* pool) {
+    DWORD i;
+
+    if (pool->hPort == NULL) {
+        return;
+    }
+
+    for (i = 0; i < pool->count; i++) {
+        PostQueuedCompletionStatus(pool->hPort, 0, 0, NULL);
+    }
+
+    WaitForMultipleObjects(pool->count, pool->threads, TRUE, INFINITE);
+
+    for (i = 0; i < pool->count; i++) {
+        CloseHandle(pool->threads[i]);
+    }
+    CloseHandle(pool->hPort);
+    pool->hPort = NULL;
+    pool->count = 0;
+}
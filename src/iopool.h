@@ -0,0 +1,61 @@
+/**
+ * @filename iopool.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the I/O pool, a
+ * few threads that handle the reads of every open port through one I/O
+ * completion port.
+ */
+#ifndef _IOPOOL_H_
+#define _IOPOOL_H_
+
+#include <Windows.h>
+#include "serial.h"
+
+/* Most threads in the pool, however many processors there are */
+#define IOPOOL_MAX 8
+/* Fewest threads in the pool, so one slow window cannot stall every port */
+#define IOPOOL_MIN 2
+
+/**
+ * The IoPool structure contains the completion port and the threads that
+ * wait on it. A port's SerialPort is its completion key.
+ *
+ * @member HANDLE hPort         The I/O completion port
+ * @member HANDLE threads[]     The threads of the pool
+ * @member DWORD count          The number of threads
+ */
+typedef struct _IoPool {
+    HANDLE hPort;
+    HANDLE threads[IOPOOL_MAX];
+    DWORD count;
+} IoPool;
+
+/**
+ * Creates the completion port and starts the threads of the pool.
+ * @implementation iopool.c
+ */
+int IoPoolStart(IoPool* pool);
+
+/**
+ * Starts reading an open port on the pool.
+ * @implementation iopool.c
+ */
+int IoPoolAttach(IoPool* pool, SerialPort* sp);
+
+/**
+ * Stops reading a port, waiting for its outstanding read to finish.
+ * @implementation iopool.c
+ */
+void IoPoolDetach(SerialPort* sp);
+
+/**
+ * Stops the threads of the pool and closes the completion port.
+ * @implementation iopool.c
+ */
+void IoPoolStop(IoPool* pool);
+
+#endif
@@ -0,0 +1,124 @@
+/**
+ * @filename manifest.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for the plugin manifest.
+ *
+ * The manifest is plugins.ini, in the emulation folder, with a section for
+ * each plugin that has been loaded before:
+ *
+ *     [vt100.dll]
+ *     Name=VT100
+ *     Stamp=0000000000012A00-01CB912F6D1E4B80    ; size and write time
+ *
+ * An entry is only trusted while the plugin's size and write time match
+ * its stamp, so a rebuilt or replaced plugin is loaded and cached again.
+ * The file is only a cache; deleting it costs one slower start.
+ */
+#include "manifest.h"
+
+/**
+ * Gets the path of the manifest, and the plugin's file name, which is the
+ * plugin's section in it.
+ *
+ * @param LPCTSTR plugin    The full path of the plugin.
+ * @param LPTSTR path       Receives the manifest path, MAX_PATH long.
+ * @returns The plugin's file name, within plugin.
+ */
+static LPCTSTR ManifestPath(LPCTSTR plugin, LPTSTR path) {
+    LPCTSTR file = _tcsrchr(plugin, '\\');
+
+    file = (file == NULL) ? plugin : file + 1;
+
+    StringCchCopy(path, file - plugin + 1, plugin);
+    StringCchCat(path, MAX_PATH, MANIFEST_FILE);
+
+    return file;
+}
+
+/**
+ * Gets the size and write time of a plugin as a string.
+ *
+ * @param LPCTSTR plugin    The full path of the plugin.
+ * @param LPTSTR stamp      Receives the stamp.
+ * @param DWORD size        The size of stamp, in characters.
+ * @returns TRUE if the plugin was found.
+ */
+static BOOLEAN ManifestStamp(LPCTSTR plugin, LPTSTR stamp, DWORD size) {
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+
+    if (!GetFileAttributesEx(plugin, GetFileExInfoStandard, &fad)) {
+        return FALSE;
+    }
+
+    StringCchPrintf(stamp, size, TEXT("%08lX%08lX-%08lX%08lX"),
+            fad.nFileSizeHigh, fad.nFileSizeLow,
+            fad.ftLastWriteTime.dwHighDateTime,
+            fad.ftLastWriteTime.dwLowDateTime);
+
+    return TRUE;
+}
+
+/**
+ * Looks up the name of a plugin in the manifest. Nothing is found if the
+ * plugin has changed since its name was cached.
+ *
+ * @param LPCTSTR plugin    The full path of the plugin.
+ * @param LPTSTR name       Receives the name, MANIFEST_NAME characters long.
+ * @returns TRUE if the name was found.
+ */
+BOOLEAN ManifestLookup(LPCTSTR plugin, LPTSTR name) {
+    TCHAR path[MAX_PATH];
+    TCHAR stamp[40];
+    TCHAR cached[40];
+    LPCTSTR file = ManifestPath(plugin, path);
+
+    if (!ManifestStamp(plugin, stamp, 40)) {
+        return FALSE;
+    }
+
+    GetPrivateProfileString(file, TEXT("Stamp"), TEXT(""), cached, 40, path);
+    if (_tcscmp(stamp, cached) != 0) {
+        return FALSE;
+    }
+
+    return GetPrivateProfileString(file, TEXT("Name"), TEXT(""), name,
+            MANIFEST_NAME, path) > 0;
+}
+
+/**
+ * Caches the name of a plugin in the manifest.
+ *
+ * @param LPCTSTR plugin    The full path of the plugin.
+ * @param LPCTSTR name      The name the plugin gives itself.
+ * @returns none
+ */
+void ManifestStore(LPCTSTR plugin, LPCTSTR name) {
+    TCHAR path[MAX_PATH];
+    TCHAR stamp[40];
+    LPCTSTR file = ManifestPath(plugin, path);
+
+    if (!ManifestStamp(plugin, stamp, 40)) {
+        return;
+    }
+
+    WritePrivateProfileString(file, TEXT("Name"), name, path);
+    WritePrivateProfileString(file, TEXT("Stamp"), stamp, path);
+}
+
+/**
+ * Removes a plugin from the manifest, so it is probed again at the next
+ * start. Used when a cached plugin fails to load.
+ *
+ * @param LPCTSTR plugin    The full path of the plugin.
+ * @returns none
+ */
+void ManifestForget(LPCTSTR plugin) {
+    TCHAR path[MAX_PATH];
+    LPCTSTR file = ManifestPath(plugin, path);
+
+    WritePrivateProfileString(file, NULL, NULL, path);
+}
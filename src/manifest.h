@@ -0,0 +1,42 @@
+/**
+ * @filename manifest.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the plugin
+ * manifest, a cache of emulation plugin names that lets the Emulation menu
+ * be built without loading every plugin.
+ */
+#ifndef _MANIFEST_H_
+#define _MANIFEST_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+
+/* Name of the manifest, found beside the plugins */
+#define MANIFEST_FILE TEXT("plugins.ini")
+/* Longest emulator name kept in the manifest */
+#define MANIFEST_NAME 64
+
+/**
+ * Looks up the name of a plugin, if it has not changed since it was cached.
+ * @implementation manifest.c
+ */
+BOOLEAN ManifestLookup(LPCTSTR plugin, LPTSTR name);
+
+/**
+ * Caches the name of a plugin.
+ * @implementation manifest.c
+ */
+void ManifestStore(LPCTSTR plugin, LPCTSTR name);
+
+/**
+ * Removes a plugin from the manifest.
+ * @implementation manifest.c
+ */
+void ManifestForget(LPCTSTR plugin);
+
+#endif
@@ -0,0 +1,444 @@
+/**
+ * @filename net.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for connecting to a
+ * terminal server over TCP.
+ *
+ * A connection is a SerialPort with the network transport, so the
+ * transmit queue and thread, the I/O pool, the statistics and the
+ * emulators all work on it unchanged. Sockets are opened for overlapped I/O
+ * and use the port's txov and rxov, the same as a COM port. With telnet on,
+ * commands are stripped from the input and answered, and the output is
+ * escaped; replies are sent under txlock so they never land in the middle
+ * of a write from the transmit thread.
+ */
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include "net.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+/* Largest set of telnet replies to one read */
+#define NET_REPLY 256
+
+/**
+ * Sends telnet replies straight to the server.
+ *
+ * @param SerialPort* sp    The connection.
+ * @param BYTE* reply       The replies.
+ * @param DWORD len         The length of the replies.
+ * @returns none
+ */
+static void NetReply(SerialPort* sp, BYTE* reply, DWORD len) {
+    EnterCriticalSection(&sp->txlock);
+    send(sp->sock, (const char*)reply, (int)len, 0);
+    LeaveCriticalSection(&sp->txlock);
+}
+
+/**
+ * Connects a socket to an address, giving up after a timeout rather than
+ * waiting out the system's retries, which take about 21 seconds for a host
+ * that doesn't answer. The socket is left blocking, as it was.
+ *
+ * @param SOCKET sock               The socket.
+ * @param const struct sockaddr* addr   The address to connect to.
+ * @param int len                   The length of the address.
+ * @param DWORD timeout             The longest wait in milliseconds.
+ * @returns 0 on success, greater than 0 with the error set otherwise.
+ */
+static int NetConnectTimed(SOCKET sock, const struct sockaddr* addr, int len,
+        DWORD timeout) {
+    u_long nonblocking = 1;
+    fd_set writable;
+    fd_set failed;
+    struct timeval tv;
+    int error = 0;
+    int errlen = sizeof(int);
+
+    if (ioctlsocket(sock, FIONBIO, &nonblocking) != 0) {
+        return 1;
+    }
+
+    if (connect(sock, addr, len) != 0) {
+        if (WSAGetLastError() != WSAEWOULDBLOCK) {
+            return 2;
+        }
+
+        /* Success shows as writable, failure as an exception */
+        FD_ZERO(&writable);
+        FD_SET(sock, &writable);
+        FD_ZERO(&failed);
+        FD_SET(sock, &failed);
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+
+        switch (select(0, NULL, &writable, &failed, &tv)) {
+        case 0:
+            WSASetLastError(WSAETIMEDOUT);
+            return 3;
+        case SOCKET_ERROR:
+            return 4;
+        }
+
+        if (FD_ISSET(sock, &failed)) {
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error, &errlen);
+            WSASetLastError(error);
+            return 5;
+        }
+    }
+
+    nonblocking = 0;
+    if (ioctlsocket(sock, FIONBIO, &nonblocking) != 0) {
+        return 6;
+    }
+
+    return 0;
+}
+
+/**
+ * Connects to the address kept in the SerialPort and starts the transmit
+ * thread. Each address of the server is given NET_CONNECT_TIMEOUT to
+ * answer, so an unreachable one doesn't hold the window for long. On
+ * failure, whatever was opened is closed again and the error is left for
+ * GetLastError.
+ *
+ * @param SerialPort* sp    The connection, with name and options set.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static int NetConnect(SerialPort* sp) {
+    static BOOLEAN started = FALSE;
+    WSADATA wsa;
+    ADDRINFOT hints;
+    ADDRINFOT* addrs = NULL;
+    ADDRINFOT* ai = NULL;
+    TCHAR host[SERIAL_NAME];
+    LPTSTR name = host;
+    LPCTSTR service = NET_TELNET_PORT;
+    LPTSTR end = NULL;
+    SOCKET sock = INVALID_SOCKET;
+    BOOL nodelay = sp->nodelay;
+    BOOL keepalive = TRUE;
+    int rxbuffer = (sp->rxqueue != 0) ? (int)sp->rxqueue : NET_BUFFER;
+    int txbuffer = (sp->txqueue != 0) ? (int)sp->txqueue : NET_BUFFER;
+    int ret = 0;
+
+    if (!started) {
+        if ((ret = WSAStartup(MAKEWORD(2, 2), &wsa)) != 0) {
+            SetLastError(ret);
+            return 1;
+        }
+        started = TRUE;
+    }
+
+    /* host:port, or [address]:port for IPv6 */
+    StringCchCopy(host, SERIAL_NAME, sp->name);
+    if (host[0] == '[' && (end = _tcschr(host, ']')) != NULL) {
+        *end = 0;
+        name = host + 1;
+        if (end[1] == ':') {
+            service = end + 2;
+        }
+    } else if ((end = _tcschr(host, ':')) != NULL && _tcschr(end + 1, ':') == NULL) {
+        /* A bare IPv6 address has several colons and no port */
+        *end = 0;
+        service = end + 1;
+    }
+
+    ZeroMemory(&hints, sizeof(ADDRINFOT));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    if ((ret = GetAddrInfo(name, service, &hints, &addrs)) != 0) {
+        SetLastError(ret);
+        return 2;
+    }
+
+    /* Use the first address that answers */
+    for (ai = addrs; ai != NULL && sock == INVALID_SOCKET; ai = ai->ai_next) {
+        sock = WSASocket(ai->ai_family, ai->ai_socktype, ai->ai_protocol,
+                NULL, 0, WSA_FLAG_OVERLAPPED);
+        if (sock != INVALID_SOCKET && NetConnectTimed(sock, ai->ai_addr,
+                    (int)ai->ai_addrlen, NET_CONNECT_TIMEOUT) != 0) {
+            DWORD dwError = WSAGetLastError();
+
+            closesocket(sock);
+            sock = INVALID_SOCKET;
+            SetLastError(dwError);
+        }
+    }
+    FreeAddrInfo(addrs);
+
+    if (sock == INVALID_SOCKET) {
+        return 3;
+    }
+
+    /* Keystrokes go out at once unless Nagle is wanted, large buffers keep
+       bulk output flowing, and keepalives notice a dead terminal server */
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(BOOL));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*)&rxbuffer, sizeof(int));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (const char*)&txbuffer, sizeof(int));
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (const char*)&keepalive, sizeof(BOOL));
+
+    sp->sock = sock;
+    sp->hDev = INVALID_HANDLE_VALUE;
+
+    if ((ret = StartPort(sp)) != 0) {
+        DWORD dwError = GetLastError();
+
+        ClosePort(sp);
+        SetLastError(dwError);
+        return 4;
+    }
+
+    if (sp->telnet) {
+        CHAR ttype[TELNET_TTYPE_MAX];
+        BYTE reply[NET_REPLY];
+        DWORD len = 0;
+
+        /* Kept from the last connection, which TelnetInit clears */
+        StringCchCopyA(ttype, TELNET_TTYPE_MAX, sp->tn.ttype);
+        len = TelnetInit(&sp->tn, ttype, NET_COLS, NET_ROWS, reply, NET_REPLY);
+        NetReply(sp, reply, len);
+    }
+
+    return 0;
+}
+
+/**
+ * Writes a run of the transmit queue to the connection, waiting for the
+ * send to finish.
+ *
+ * @param SerialPort* sp    The connection.
+ * @param BYTE* data        The data to write.
+ * @param DWORD len         The length of the data.
+ * @param LPDWORD written   Receives the number of bytes of data written.
+ * @returns 0 if successful, greater than 0 otherwise.
+ */
+static int NetWrite(SerialPort* sp, BYTE* data, DWORD len, LPDWORD written) {
+    BYTE escaped[2 * SERIAL_TX_CHUNK];
+    WSABUF buf;
+    DWORD sent = 0;
+    DWORD flags = 0;
+    DWORD used = len;
+    int ret = 0;
+
+    buf.buf = (char*)data;
+    buf.len = len;
+
+    if (sp->telnet) {
+        buf.buf = (char*)escaped;
+        buf.len = TelnetEncode(&sp->tn, data, len, escaped,
+                2 * SERIAL_TX_CHUNK, &used);
+    }
+
+    EnterCriticalSection(&sp->txlock);
+    ret = WSASend(sp->sock, &buf, 1, &sent, 0, &sp->txov, NULL);
+    LeaveCriticalSection(&sp->txlock);
+
+    if (ret == SOCKET_ERROR && WSAGetLastError() != WSA_IO_PENDING) {
+        return 1;
+    }
+
+    if (!WSAGetOverlappedResult(sp->sock, &sp->txov, &sent, TRUE, &flags)) {
+        return 2;
+    }
+
+    *written = used;
+    return 0;
+}
+
+/**
+ * Issues the next overlapped receive on the connection.
+ *
+ * @param SerialPort* sp    The connection.
+ * @returns 0 if the receive was issued, greater than 0 otherwise.
+ */
+static int NetReadStart(SerialPort* sp) {
+    WSABUF buf;
+    DWORD flags = 0;
+
+    if ((sp->rxbuf = (BYTE*)malloc(SERIAL_RX_CHUNK + 1)) == NULL) {
+        return 1;
+    }
+
+    buf.buf = (char*)sp->rxbuf;
+    buf.len = SERIAL_RX_CHUNK;
+
+    if (WSARecv(sp->sock, &buf, 1, NULL, &flags, &sp->rxov, NULL) == SOCKET_ERROR &&
+            WSAGetLastError() != WSA_IO_PENDING) {
+        free(sp->rxbuf);
+        sp->rxbuf = NULL;
+        return 2;
+    }
+
+    return 0;
+}
+
+/**
+ * Handles a completed receive on the connection, answering any telnet
+ * commands and sending the rest to the window with TWM_RXDATA. A
+ * connection closed by the server is reported as an error, so the port is
+ * treated as lost.
+ *
+ * @param SerialPort* sp        The connection.
+ * @param DWORD transferred     The number of bytes received.
+ * @returns 0 if successful, greater than 0 otherwise.
+ */
+static int NetReadDone(SerialPort* sp, DWORD transferred) {
+    BYTE* chars = sp->rxbuf;
+    DWORD read = transferred;
+
+    sp->rxbuf = NULL;
+
+    if (read == 0) {
+        free(chars);
+        SetLastError(WSAECONNRESET);
+        return 1;
+    }
+
+    QueryPerformanceCounter(&sp->rxarrived);
+    StatsRead(&sp->stats, read, 0, 0);
+
+    if (sp->telnet) {
+        BYTE reply[NET_REPLY];
+        DWORD replied = 0;
+
+        read = TelnetDecode(&sp->tn, chars, read, reply, NET_REPLY, &replied);
+        if (replied > 0) {
+            NetReply(sp, reply, replied);
+        }
+    }
+
+    if (read == 0) {
+        free(chars);
+        return 0;
+    }
+
+    chars[read] = 0;
+    SendMessage(sp->hwnd, TWM_RXDATA, (WPARAM)chars, read);
+
+    return 0;
+}
+
+/**
+ * Sets the flow control of a connection. TCP has its own, so there is
+ * nothing to do.
+ *
+ * @param SerialPort* sp    The connection.
+ * @param DWORD flow        One of the flow enumeration values.
+ * @returns 0
+ */
+static int NetFlow(SerialPort* sp, DWORD flow) {
+    return 0;
+}
+
+/**
+ * Changes the baud rate of a connection, which a plain TCP connection
+ * cannot do.
+ *
+ * @param SerialPort* sp    The connection.
+ * @param DWORD baud        The new baud rate.
+ * @param DWORD* previous   Receives 0.
+ * @returns 1
+ */
+static int NetBaud(SerialPort* sp, DWORD baud, DWORD* previous) {
+    *previous = 0;
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return 1;
+}
+
+/**
+ * Aborts a send in progress by closing the socket, which completes every
+ * operation still pending on it.
+ *
+ * @param SerialPort* sp    The connection.
+ * @returns none
+ */
+static void NetAbort(SerialPort* sp) {
+    if (sp->sock != INVALID_SOCKET) {
+        closesocket(sp->sock);
+        sp->sock = INVALID_SOCKET;
+    }
+}
+
+/**
+ * Connects again to the same address with the same options.
+ *
+ * @param SerialPort* sp    The connection.
+ * @param HWND hwnd         The window that owns the connection.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static int NetReopen(SerialPort* sp, HWND hwnd) {
+    sp->hwnd = hwnd;
+
+    return NetConnect(sp);
+}
+
+/**
+ * Closes the socket of a connection.
+ *
+ * @param SerialPort* sp    The connection.
+ * @returns 0
+ */
+static int NetClose(SerialPort* sp) {
+    NetAbort(sp);
+
+    return 0;
+}
+
+static const Transport kNetTransport = {
+    kTransportNet,
+    &NetWrite,
+    &NetReadStart,
+    &NetReadDone,
+    &NetFlow,
+    &NetBaud,
+    &NetAbort,
+    &NetReopen,
+    &NetClose
+};
+
+/**
+ * Opens a TCP connection to a terminal server, to be used like a serial
+ * port.
+ *
+ * @param LPCTSTR address   The server, as host:port or [address]:port.
+ *                          Without a port, the telnet port is used.
+ * @param SerialPort* sp    The serial port structure.
+ * @param HWND hwnd         The window that owns the connection.
+ * @param BOOLEAN telnet    TRUE to speak telnet, FALSE for raw TCP.
+ * @param BOOLEAN nodelay   TRUE to send small writes at once (no Nagle).
+ * @param DWORD rxbuffer    The socket receive buffer size, 0 for NET_BUFFER.
+ * @param DWORD txbuffer    The socket send buffer size, 0 for NET_BUFFER.
+ * @param LPCTSTR ttype     The terminal type reported to telnet servers.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int OpenNet(LPCTSTR address, SerialPort* sp, HWND hwnd, BOOLEAN telnet,
+        BOOLEAN nodelay, DWORD rxbuffer, DWORD txbuffer, LPCTSTR ttype) {
+    StatsReset(&sp->stats);
+
+    sp->hwnd = hwnd;
+    sp->transport = &kNetTransport;
+    sp->sock = INVALID_SOCKET;
+    sp->telnet = telnet;
+    sp->nodelay = nodelay;
+    sp->rxqueue = rxbuffer;
+    sp->txqueue = txbuffer;
+    StringCchCopy(sp->name, SERIAL_NAME, address);
+
+#ifdef UNICODE
+    if (WideCharToMultiByte(CP_ACP, 0, ttype, -1, sp->tn.ttype,
+            TELNET_TTYPE_MAX, NULL, NULL) == 0) {
+        StringCchCopyA(sp->tn.ttype, TELNET_TTYPE_MAX, "UNKNOWN");
+    }
+#else
+    StringCchCopyA(sp->tn.ttype, TELNET_TTYPE_MAX, ttype);
+#endif
+
+    return NetConnect(sp);
+}
@@ -0,0 +1,35 @@
+/**
+ * @filename net.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for connecting to a
+ * terminal server over TCP, in place of a serial port.
+ */
+#ifndef _NET_H_
+#define _NET_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include "serial.h"
+
+/* Port used for telnet when the address has none */
+#define NET_TELNET_PORT TEXT("23")
+/* Socket buffer sizes used when none are given */
+#define NET_BUFFER 262144
+/* Longest wait (ms) for each address of a server to accept a connection */
+#define NET_CONNECT_TIMEOUT 5000
+/* Size of the window reported to telnet servers */
+#define NET_COLS 80
+#define NET_ROWS 24
+
+/**
+ * Opens a TCP connection to be used like a serial port.
+ * @implementation net.c
+ */
+int OpenNet(LPCTSTR address, SerialPort* sp, HWND hwnd, BOOLEAN telnet,
+        BOOLEAN nodelay, DWORD rxbuffer, DWORD txbuffer, LPCTSTR ttype);
+
+#endif
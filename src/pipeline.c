@@ -0,0 +1,157 @@
+/**
+ * @filename pipeline.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for the receive
+ * pipeline.
+ *
+ * Nothing is copied on the way through. A stage passes data on by handing
+ * the next stage slices of what it was given: the whole slice to let it
+ * through, part of it to consume some, or none to consume it all. A stage
+ * may change the bytes of its slice in place, or pass on slices of a
+ * buffer of its own, which need only last until it returns.
+ */
+#include "pipeline.h"
+
+/**
+ * Empties a pipeline.
+ *
+ * @param Pipeline* pl  The pipeline.
+ * @returns none
+ */
+void PipelineInit(Pipeline* pl) {
+    pl->count = 0;
+}
+
+/**
+ * Puts a stage into a pipeline, ahead of the stage at pos. Data is given to
+ * the stages in order, so pos 0 sees it first.
+ *
+ * @param Pipeline* pl          The pipeline.
+ * @param DWORD pos             Where to put the stage; past the end to add
+ *                              it last.
+ * @param stage_func process    The function that handles each slice.
+ * @param LPVOID data           The stage's own data, which also names the
+ *                              stage to PipelineRemove.
+ * @returns 0 on success, 1 if the pipeline is full.
+ */
+int PipelineInsert(Pipeline* pl, DWORD pos, stage_func process, LPVOID data) {
+    if (pl->count == PIPELINE_MAX) {
+        return 1;
+    }
+
+    if (pos > pl->count) {
+        pos = pl->count;
+    }
+
+    MoveMemory(&pl->stages[pos + 1], &pl->stages[pos],
+            sizeof(Stage) * (pl->count - pos));
+    pl->stages[pos].process = process;
+    pl->stages[pos].data = data;
+    pl->count++;
+
+    return 0;
+}
+
+/**
+ * Takes a stage out of a pipeline. The stage's data is left to its owner.
+ *
+ * @param Pipeline* pl  The pipeline.
+ * @param LPVOID data   The data the stage was put in with.
+ * @returns none
+ */
+void PipelineRemove(Pipeline* pl, LPVOID data) {
+    DWORD i;
+
+    for (i = 0; i < pl->count; i++) {
+        if (pl->stages[i].data == data) {
+            MoveMemory(&pl->stages[i], &pl->stages[i + 1],
+                    sizeof(Stage) * (pl->count - i - 1));
+            pl->count--;
+            return;
+        }
+    }
+}
+
+/**
+ * Passes a slice to a stage, and what it passes on to the stages after it.
+ *
+ * @param Pipeline* pl      The pipeline.
+ * @param DWORD i           The stage, or the count of stages for the sink.
+ * @param RxSlice* in       The slice.
+ * @param sink_func sink    The end of the pipeline.
+ * @param LPVOID sinkdata   The data given to the sink.
+ * @returns none
+ */
+static void PipelineStage(Pipeline* pl, DWORD i, RxSlice* in, sink_func sink,
+        LPVOID sinkdata) {
+    RxSlice out[PIPELINE_FANOUT];
+    DWORD count = 0;
+    DWORD j;
+
+    if (in->len == 0) {
+        return;
+    }
+
+    if (i == pl->count) {
+        sink(sinkdata, in->data, in->len);
+        return;
+    }
+
+    count = pl->stages[i].process(pl->stages[i].data, in, out, PIPELINE_FANOUT);
+    for (j = 0; j < count && j < PIPELINE_FANOUT; j++) {
+        PipelineStage(pl, i + 1, &out[j], sink, sinkdata);
+    }
+}
+
+/**
+ * Passes received data through each stage of a pipeline in turn, and gives
+ * whatever is left to the sink.
+ *
+ * @param Pipeline* pl      The pipeline.
+ * @param BYTE* rx          The received data.
+ * @param DWORD len         The length of the received data.
+ * @param sink_func sink    The end of the pipeline.
+ * @param LPVOID sinkdata   The data given to the sink.
+ * @returns none
+ */
+void PipelineRun(Pipeline* pl, BYTE* rx, DWORD len, sink_func sink,
+        LPVOID sinkdata) {
+    RxSlice in;
+
+    in.data = rx;
+    in.len = len;
+    PipelineStage(pl, 0, &in, sink, sinkdata);
+}
+
+/**
+ * Passes data through the stages after a given stage, and gives whatever is
+ * left to the sink. This is how a stage that consumed data passes on what
+ * it made of it later, from outside the pipeline. If the stage has been
+ * taken out of the pipeline, the data is dropped.
+ *
+ * @param Pipeline* pl      The pipeline.
+ * @param LPVOID after      The data the stage was put in with.
+ * @param BYTE* rx          The data.
+ * @param DWORD len         The length of the data.
+ * @param sink_func sink    The end of the pipeline.
+ * @param LPVOID sinkdata   The data given to the sink.
+ * @returns none
+ */
+void PipelineResume(Pipeline* pl, LPVOID after, BYTE* rx, DWORD len,
+        sink_func sink, LPVOID sinkdata) {
+    RxSlice in;
+    DWORD i;
+
+    in.data = rx;
+    in.len = len;
+    for (i = 0; i < pl->count; i++) {
+        if (pl->stages[i].data == after) {
+            PipelineStage(pl, i + 1, &in, sink, sinkdata);
+            return;
+        }
+    }
+}
@@ -0,0 +1,96 @@
+/**
+ * @filename pipeline.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the receive
+ * pipeline, the chain of stages received data passes through on its way to
+ * the emulator.
+ */
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <Windows.h>
+
+/* Most stages in one pipeline */
+#define PIPELINE_MAX 8
+/* Most slices a stage may pass on from one slice */
+#define PIPELINE_FANOUT 4
+
+/**
+ * The RxSlice structure contains a run of received data. It points into
+ * memory owned by whoever passed it on, and is only valid for the call it
+ * is passed to. It is not NUL terminated.
+ *
+ * @member BYTE* data   The first byte
+ * @member DWORD len    The number of bytes
+ */
+typedef struct _RxSlice {
+    BYTE* data;
+    DWORD len;
+} RxSlice;
+
+/* A stage: handles a slice, and fills out with up to max slices to pass on.
+   Returns the number of slices passed on, 0 if it consumed them all. */
+typedef DWORD (*stage_func)(LPVOID data, RxSlice* in, RxSlice* out, DWORD max);
+/* The end of the pipeline, which gets whatever the stages pass on */
+typedef void (*sink_func)(LPVOID data, BYTE* rx, DWORD len);
+
+/**
+ * The Stage structure contains one stage of a pipeline.
+ *
+ * @member stage_func process   The function that handles each slice
+ * @member LPVOID data          The stage's own data, given to process
+ */
+typedef struct _Stage {
+    stage_func process;
+    LPVOID data;
+} Stage;
+
+/**
+ * The Pipeline structure contains the stages received data passes through,
+ * in order.
+ *
+ * @member Stage stages[]   The stages
+ * @member DWORD count      The number of stages
+ */
+typedef struct _Pipeline {
+    Stage stages[PIPELINE_MAX];
+    DWORD count;
+} Pipeline;
+
+/**
+ * Empties a pipeline.
+ * @implementation pipeline.c
+ */
+void PipelineInit(Pipeline* pl);
+
+/**
+ * Puts a stage into a pipeline.
+ * @implementation pipeline.c
+ */
+int PipelineInsert(Pipeline* pl, DWORD pos, stage_func process, LPVOID data);
+
+/**
+ * Takes a stage out of a pipeline.
+ * @implementation pipeline.c
+ */
+void PipelineRemove(Pipeline* pl, LPVOID data);
+
+/**
+ * Passes received data through a pipeline to its sink.
+ * @implementation pipeline.c
+ */
+void PipelineRun(Pipeline* pl, BYTE* rx, DWORD len, sink_func sink,
+        LPVOID sinkdata);
+
+/**
+ * Passes data through the stages after a given stage to its sink.
+ * @implementation pipeline.c
+ */
+void PipelineResume(Pipeline* pl, LPVOID after, BYTE* rx, DWORD len,
+        sink_func sink, LPVOID sinkdata);
+
+#endif
@@ -0,0 +1,345 @@
+/**
+ * @filename plugin.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for the plugin registry.
+ *
+ * A plugin is loaded by calling its emulator_init_plugin export, made by
+ * EMULATOR_INIT_PLUGIN. When it is unloaded, its emulator_free_plugin
+ * export, made by EMULATOR_FREE_PLUGIN, is called first if it has one, so
+ * the plugin can free what its init function allocated.
+ *
+ * From version 5, calling the init function again makes a new instance of
+ * the emulator, with state of its own, so several sessions can use one
+ * plugin. Instances are then only made by PluginCreate, for a session, and
+ * the one made at load time to learn the version is freed at once. Older
+ * plugins keep their state in one global structure, and calling their init
+ * function again would reset the session using it, so the instance made at
+ * load time is kept by the registry and shared.
+ */
+#include "plugin.h"
+
+/**
+ * Keeps what is needed of the instance made when a plugin is loaded: its
+ * version, and the instance itself if the plugin is older than version 5
+ * and so cannot make another. A newer plugin's instance is freed.
+ *
+ * @param Plugin* p     The plugin, with its init and free functions set.
+ * @param Emulator* e   The instance made when it was loaded.
+ * @returns none
+ */
+static void PluginKeep(Plugin* p, Emulator* e) {
+    p->version = e->dwVersion;
+    p->emu = NULL;
+
+    if (p->version < EMULATOR_VERSION_INSTANCES) {
+        p->emu = e;
+    } else if (p->release != NULL) {
+        p->release(e);
+    }
+}
+
+/**
+ * Loads a plugin DLL and calls its init function once.
+ *
+ * @param Plugin* p     The plugin, with its path set.
+ * @param HWND hwnd     The handle to the application window.
+ * @returns The instance made, or NULL if the plugin could not be loaded.
+ */
+static Emulator* PluginOpen(Plugin* p, HWND hwnd) {
+    Emulator* e = NULL;
+
+    if ((p->lib = LoadLibrary(p->path)) == NULL) {
+        return NULL;
+    }
+
+    p->init = (init_plugin)GetProcAddress(p->lib, "emulator_init_plugin");
+    p->release = (free_plugin)GetProcAddress(p->lib, "emulator_free_plugin");
+    if (p->init == NULL || !p->init(hwnd, &e)) {
+        FreeLibrary(p->lib);
+        p->lib = NULL;
+        p->init = NULL;
+        p->release = NULL;
+        return NULL;
+    }
+
+    return e;
+}
+
+/**
+ * Empties the plugin registry.
+ *
+ * @param PluginRegistry* pr    The plugin registry.
+ * @returns none
+ */
+void PluginInit(PluginRegistry* pr) {
+    pr->plugins = NULL;
+    pr->count = 0;
+    pr->capacity = 0;
+}
+
+/**
+ * Adds an emulator to the registry, making room for it if needed.
+ *
+ * @param PluginRegistry* pr    The plugin registry.
+ * @param LPCTSTR name          The name of the emulator.
+ * @param LPCTSTR path          The path of the plugin, or NULL if built in.
+ * @param Emulator* emu         The emulator, or NULL if it is not loaded.
+ * @returns The index of the emulator, or PLUGIN_NONE if out of memory.
+ */
+DWORD PluginAdd(PluginRegistry* pr, LPCTSTR name, LPCTSTR path, Emulator* emu) {
+    Plugin* p = NULL;
+
+    if (pr->count == pr->capacity) {
+        DWORD capacity = (pr->capacity == 0) ? PLUGIN_GROW : pr->capacity * 2;
+        Plugin* plugins = (Plugin*)realloc(pr->plugins, sizeof(Plugin) * capacity);
+
+        if (plugins == NULL) {
+            return PLUGIN_NONE;
+        }
+        pr->plugins = plugins;
+        pr->capacity = capacity;
+    }
+
+    p = &pr->plugins[pr->count];
+    p->emu = emu;
+    p->lib = NULL;
+    p->init = NULL;
+    p->release = NULL;
+    p->version = (emu != NULL) ? emu->dwVersion : 0;
+    p->instances = 0;
+    StringCchCopy(p->name, MANIFEST_NAME, name);
+    StringCchCopy(p->path, MAX_PATH, (path == NULL) ? TEXT("") : path);
+
+    return pr->count++;
+}
+
+/**
+ * Adds an emulator built into the program to the registry.
+ *
+ * @param PluginRegistry* pr    The plugin registry.
+ * @param HWND hwnd             The handle to the application window.
+ * @param init_plugin init      Makes an instance of the emulator.
+ * @param free_plugin release   Frees an instance of the emulator.
+ * @returns The index of the emulator, or PLUGIN_NONE if it failed.
+ */
+DWORD PluginBuiltin(PluginRegistry* pr, HWND hwnd, init_plugin init,
+        free_plugin release) {
+    Emulator* e = NULL;
+    DWORD i = PLUGIN_NONE;
+
+    if (!init(hwnd, &e)) {
+        return PLUGIN_NONE;
+    }
+
+    if ((i = PluginAdd(pr, e->emulation_name(), NULL, NULL)) == PLUGIN_NONE) {
+        release(e);
+        return PLUGIN_NONE;
+    }
+    pr->plugins[i].init = init;
+    pr->plugins[i].release = release;
+    PluginKeep(&pr->plugins[i], e);
+
+    return i;
+}
+
+/**
+ * Loads a plugin to learn its name, adds it to the registry and caches the
+ * name in the manifest. The plugin stays loaded.
+ *
+ * @param PluginRegistry* pr    The plugin registry.
+ * @param LPCTSTR path          The path of the plugin.
+ * @param HWND hwnd             The handle to the application window.
+ * @returns The index of the emulator, or PLUGIN_NONE if it did not load.
+ */
+DWORD PluginProbe(PluginRegistry* pr, LPCTSTR path, HWND hwnd) {
+    Plugin probe;
+    Emulator* e = NULL;
+    DWORD i = PLUGIN_NONE;
+
+    StringCchCopy(probe.path, MAX_PATH, path);
+    if ((e = PluginOpen(&probe, hwnd)) == NULL) {
+        return PLUGIN_NONE;
+    }
+
+    i = PluginAdd(pr, e->emulation_name(), path, NULL);
+    if (i == PLUGIN_NONE) {
+        if (probe.release != NULL) {
+            probe.release(e);
+        }
+        FreeLibrary(probe.lib);
+        return PLUGIN_NONE;
+    }
+    pr->plugins[i].lib = probe.lib;
+    pr->plugins[i].init = probe.init;
+    pr->plugins[i].release = probe.release;
+    PluginKeep(&pr->plugins[i], e);
+
+    ManifestStore(path, pr->plugins[i].name);
+    return i;
+}
+
+/**
+ * Looks up an emulator by the name it gives itself, ignoring case.
+ *
+ * @param PluginRegistry* pr    The plugin registry.
+ * @param LPCTSTR name          The name of the emulator.
+ * @returns The index of the emulator, or PLUGIN_NONE if there is none.
+ */
+DWORD PluginFind(const PluginRegistry* pr, LPCTSTR name) {
+    DWORD i;
+
+    for (i = 0; i < pr->count; i++) {
+        if (_tcsicmp(pr->plugins[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return PLUGIN_NONE;
+}
+
+/**
+ * Loads an emulator's plugin and initialises it, if it is not loaded.
+ *
+ * @param PluginRegistry* pr    The plugin registry.
+ * @param DWORD i               The index of the emulator.
+ * @param HWND hwnd             The handle to the application window.
+ * @returns 0 if the emulator is loaded, greater than 0 otherwise.
+ */
+int PluginLoad(PluginRegistry* pr, DWORD i, HWND hwnd) {
+    Plugin* p = NULL;
+    Emulator* e = NULL;
+
+    if (i >= pr->count) {
+        return 1;
+    }
+
+    p = &pr->plugins[i];
+    if (p->init != NULL) {
+        return 0;
+    }
+
+    if (p->path[0] == 0 || (e = PluginOpen(p, hwnd)) == NULL) {
+        return 2;
+    }
+    PluginKeep(p, e);
+
+    return 0;
+}
+
+/**
+ * Gets an instance of an emulator for a session. Its plugin must have been
+ * loaded with PluginLoad. From version 5 each call makes a new instance,
+ * which belongs to the caller. An older plugin has only the one instance
+ * the registry keeps, which is returned to every caller. Either way, the
+ * instance is given back with PluginDestroy.
+ *
+ * @param PluginRegistry* pr    The plugin registry.
+ * @param DWORD i               The index of the emulator.
+ * @param HWND hwnd             The handle to the session's window.
+ * @returns The instance, or NULL if the plugin is not loaded or its init
+ *          function failed.
+ */
+Emulator* PluginCreate(PluginRegistry* pr, DWORD i, HWND hwnd) {
+    Plugin* p = NULL;
+    Emulator* e = NULL;
+
+    if (i >= pr->count || pr->plugins[i].init == NULL) {
+        return NULL;
+    }
+
+    p = &pr->plugins[i];
+    if (p->version < EMULATOR_VERSION_INSTANCES) {
+        return p->emu;
+    }
+
+    if (!p->init(hwnd, &e)) {
+        return NULL;
+    }
+
+    p->instances++;
+    return e;
+}
+
+/**
+ * Gives back an instance got from PluginCreate. An instance of its own is
+ * freed; the shared instance of a plugin older than version 5 is left to
+ * the registry.
+ *
+ * @param PluginRegistry* pr    The plugin registry.
+ * @param DWORD i               The index of the emulator.
+ * @param Emulator* e           The instance.
+ * @returns none
+ */
+void PluginDestroy(PluginRegistry* pr, DWORD i, Emulator* e) {
+    Plugin* p = NULL;
+
+    if (i >= pr->count || e == NULL || e == pr->plugins[i].emu) {
+        return;
+    }
+
+    p = &pr->plugins[i];
+    if (p->release != NULL) {
+        p->release(e);
+    }
+    p->instances--;
+}
+
+/**
+ * Unloads a plugin. The shared instance of a plugin older than version 5
+ * is freed, if the plugin has a free function. The plugin stays in the
+ * registry and can be loaded again. Nothing is done while instances made
+ * by PluginCreate are still in use, as their code is in the plugin.
+ * Built-in emulators are only unloaded by PluginFree.
+ *
+ * @param PluginRegistry* pr    The plugin registry.
+ * @param DWORD i               The index of the emulator.
+ * @returns none
+ */
+void PluginUnload(PluginRegistry* pr, DWORD i) {
+    Plugin* p = NULL;
+
+    if (i >= pr->count || pr->plugins[i].lib == NULL ||
+            pr->plugins[i].instances > 0) {
+        return;
+    }
+
+    p = &pr->plugins[i];
+    if (p->release != NULL && p->emu != NULL) {
+        p->release(p->emu);
+    }
+
+    FreeLibrary(p->lib);
+    p->lib = NULL;
+    p->emu = NULL;
+    p->init = NULL;
+    p->release = NULL;
+    p->version = 0;
+}
+
+/**
+ * Unloads every plugin and frees the registry.
+ *
+ * @param PluginRegistry* pr    The plugin registry.
+ * @returns none
+ */
+void PluginFree(PluginRegistry* pr) {
+    DWORD i;
+
+    for (i = 0; i < pr->count; i++) {
+        Plugin* p = &pr->plugins[i];
+
+        if (p->lib == NULL && p->release != NULL && p->emu != NULL) {
+            /* Built in */
+            p->release(p->emu);
+            p->emu = NULL;
+        }
+        PluginUnload(pr, i);
+    }
+
+    free(pr->plugins);
+    PluginInit(pr);
+}
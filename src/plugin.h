@@ -0,0 +1,132 @@
+/**
+ * @filename plugin.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the plugin
+ * registry, which keeps track of the emulation plugins that were found and
+ * which of them are loaded.
+ */
+#ifndef _PLUGIN_H_
+#define _PLUGIN_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+#include "emulation.h"
+#include "manifest.h"
+
+/* Room made in the registry at first; it doubles when full */
+#define PLUGIN_GROW 8
+/* Index returned when no plugin is found or added */
+#define PLUGIN_NONE MAXDWORD
+
+/* A plugin's init and free functions (EMULATOR_INIT_PLUGIN and
+   EMULATOR_FREE_PLUGIN) */
+typedef BOOLEAN (*init_plugin)(HWND hwnd, Emulator** e);
+typedef void (*free_plugin)(Emulator* e);
+
+/**
+ * The Plugin structure contains an emulator in the registry.
+ *
+ * @member Emulator* emu    The one instance of a plugin older than version 5,
+ *                          which every session shares; NULL otherwise
+ * @member HMODULE lib      The plugin DLL, or NULL for a built-in emulator
+ * @member init_plugin init     The init function, once loaded
+ * @member free_plugin release  The free function, or NULL if it has none
+ * @member DWORD version    The structure version of the emulator, 0 until
+ *                          it is loaded
+ * @member DWORD instances  The instances made by PluginCreate still in use
+ * @member TCHAR name[]     The name of the emulator
+ * @member TCHAR path[]     The path of the plugin DLL, empty if built in
+ */
+typedef struct _Plugin {
+    Emulator* emu;
+    HMODULE lib;
+    init_plugin init;
+    free_plugin release;
+    DWORD version;
+    DWORD instances;
+    TCHAR name[MANIFEST_NAME];
+    TCHAR path[MAX_PATH];
+} Plugin;
+
+/**
+ * The PluginRegistry structure contains every emulator found. Plugins are
+ * never removed, so an index stays valid for as long as the registry does;
+ * a Plugin pointer does not, as adding a plugin can move them all.
+ *
+ * @member Plugin* plugins  The emulators
+ * @member DWORD count      The number of emulators
+ * @member DWORD capacity   The room in plugins
+ */
+typedef struct _PluginRegistry {
+    Plugin* plugins;
+    DWORD count;
+    DWORD capacity;
+} PluginRegistry;
+
+/**
+ * Empties the plugin registry.
+ * @implementation plugin.c
+ */
+void PluginInit(PluginRegistry* pr);
+
+/**
+ * Adds an emulator to the registry.
+ * @implementation plugin.c
+ */
+DWORD PluginAdd(PluginRegistry* pr, LPCTSTR name, LPCTSTR path, Emulator* emu);
+
+/**
+ * Adds an emulator built into the program to the registry.
+ * @implementation plugin.c
+ */
+DWORD PluginBuiltin(PluginRegistry* pr, HWND hwnd, init_plugin init,
+        free_plugin release);
+
+/**
+ * Loads a plugin that is not in the manifest and adds it to the registry.
+ * @implementation plugin.c
+ */
+DWORD PluginProbe(PluginRegistry* pr, LPCTSTR path, HWND hwnd);
+
+/**
+ * Looks up an emulator by name.
+ * @implementation plugin.c
+ */
+DWORD PluginFind(const PluginRegistry* pr, LPCTSTR name);
+
+/**
+ * Loads an emulator's plugin if it is not loaded.
+ * @implementation plugin.c
+ */
+int PluginLoad(PluginRegistry* pr, DWORD i, HWND hwnd);
+
+/**
+ * Gets an instance of an emulator for a session.
+ * @implementation plugin.c
+ */
+Emulator* PluginCreate(PluginRegistry* pr, DWORD i, HWND hwnd);
+
+/**
+ * Gives back an instance got from PluginCreate.
+ * @implementation plugin.c
+ */
+void PluginDestroy(PluginRegistry* pr, DWORD i, Emulator* e);
+
+/**
+ * Unloads a plugin, letting it free its data first.
+ * @implementation plugin.c
+ */
+void PluginUnload(PluginRegistry* pr, DWORD i);
+
+/**
+ * Unloads every plugin and frees the registry.
+ * @implementation plugin.c
+ */
+void PluginFree(PluginRegistry* pr);
+
+#endif
@@ -0,0 +1,117 @@
+/**
+ * @filename portlist.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for finding the serial
+ * ports present on the system.
+ *
+ * Every serial port driver, including USB adapters and multiport cards,
+ * registers its ports under HKLM\HARDWARE\DEVICEMAP\SERIALCOMM while they
+ * are present, so reading that key is quick and needs no probing. The
+ * result is cached until a device change marks it out of date.
+ */
+#include "portlist.h"
+
+/**
+ * Adds a port to the list, keeping the list in order of number.
+ *
+ * @param PortList* pl      The port list.
+ * @param DWORD number      The COM port number.
+ * @param LPCTSTR device    The kernel device behind the port.
+ * @returns none
+ */
+static void PortListAdd(PortList* pl, DWORD number, LPCTSTR device) {
+    DWORD i = pl->count;
+
+    while (i > 0 && pl->ports[i - 1].number > number) {
+        i--;
+    }
+
+    if (i > 0 && pl->ports[i - 1].number == number) {
+        return;
+    }
+
+    memmove(&pl->ports[i + 1], &pl->ports[i], (pl->count - i) * sizeof(PortInfo));
+    pl->ports[i].number = number;
+    StringCchCopy(pl->ports[i].device, PORTLIST_DEVICE, device);
+    pl->count++;
+}
+
+/**
+ * Reads the list of serial ports from the registry if it is out of date.
+ *
+ * @param PortList* pl      The port list.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int PortListUpdate(PortList* pl) {
+    HKEY hKey = NULL;
+    DWORD i = 0;
+
+    if (pl->valid) {
+        return 0;
+    }
+
+    pl->count = 0;
+
+    /* The key only exists while at least one port does */
+    if (RegOpenKeyEx(HKEY_LOCAL_MACHINE, TEXT("HARDWARE\\DEVICEMAP\\SERIALCOMM"),
+            0, KEY_QUERY_VALUE, &hKey) != ERROR_SUCCESS) {
+        pl->valid = TRUE;
+        return 0;
+    }
+
+    for (i = 0; pl->count < PORTLIST_MAX; i++) {
+        TCHAR device[256];
+        TCHAR name[16];
+        DWORD devlen = 256;
+        DWORD namelen = sizeof(name) - sizeof(TCHAR);
+        DWORD type = 0;
+        DWORD number = 0;
+        LPCTSTR shortdev = device;
+        LONG ret = 0;
+
+        ZeroMemory(name, sizeof(name));
+        ret = RegEnumValue(hKey, i, device, &devlen, NULL, &type,
+                (LPBYTE)name, &namelen);
+        if (ret == ERROR_NO_MORE_ITEMS) {
+            break;
+        }
+        if (ret != ERROR_SUCCESS || type != REG_SZ) {
+            continue;
+        }
+
+        if (_tcsnicmp(name, TEXT("COM"), 3) != 0) {
+            continue;
+        }
+        number = _tcstoul(name + 3, NULL, 10);
+        if (number == 0 || number >= PORTLIST_MAX) {
+            continue;
+        }
+
+        /* "\Device\Serial0" is shown as "Serial0" */
+        if (_tcsrchr(device, '\\') != NULL) {
+            shortdev = _tcsrchr(device, '\\') + 1;
+        }
+
+        PortListAdd(pl, number, shortdev);
+    }
+
+    RegCloseKey(hKey);
+    pl->valid = TRUE;
+
+    return 0;
+}
+
+/**
+ * Marks the list of serial ports as out of date, so it is read again the
+ * next time it is used. Called when a port device arrives or is removed.
+ *
+ * @param PortList* pl      The port list.
+ * @returns none
+ */
+void PortListInvalidate(PortList* pl) {
+    pl->valid = FALSE;
+}
@@ -0,0 +1,59 @@
+/**
+ * @filename portlist.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for finding the serial
+ * ports present on the system.
+ */
+#ifndef _PORTLIST_H_
+#define _PORTLIST_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+
+/* Ports are numbered COM1 to COM(PORTLIST_MAX - 1) */
+#define PORTLIST_MAX 256
+/* Longest device name kept for a port */
+#define PORTLIST_DEVICE 64
+
+/**
+ * The PortInfo structure describes one serial port.
+ *
+ * @member DWORD number         The COM port number
+ * @member TCHAR device[]       The kernel device behind the port
+ */
+typedef struct _PortInfo {
+    DWORD number;
+    TCHAR device[PORTLIST_DEVICE];
+} PortInfo;
+
+/**
+ * The PortList structure caches the serial ports found on the system.
+ *
+ * @member PortInfo ports[]     The ports, in order of number
+ * @member DWORD count          The number of ports
+ * @member BOOLEAN valid        FALSE if the list must be read again
+ */
+typedef struct _PortList {
+    PortInfo ports[PORTLIST_MAX];
+    DWORD count;
+    BOOLEAN valid;
+} PortList;
+
+/**
+ * Reads the list of serial ports again if it is out of date.
+ * @implementation portlist.c
+ */
+int PortListUpdate(PortList* pl);
+
+/**
+ * Marks the list of serial ports as out of date.
+ * @implementation portlist.c
+ */
+void PortListInvalidate(PortList* pl);
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * @filename profile.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for saved connection
+ * profiles, which connect to a port without showing the port dialog.
+ *
+ * Profiles are sections of profiles.ini, beside the program:
+ *
+ *     [Rig 1]
+ *     Port=3
+ *     Baud=115200
+ *     DataBits=8
+ *     Parity=N            ; N, E, O, M or S
+ *     StopBits=1          ; 1, 1.5 or 2
+ *     Flow=rtscts         ; none, rtscts or xonxoff; omit to leave as is
+ *     Emulator=VT100      ; as named in the Emulation menu
+ *     RxBuffer=16384      ; driver buffer sizes; omit for the largest
+ *     TxBuffer=4096
+ *     ReadInterval=10     ; COMMTIMEOUTS, in ms; "max" for MAXDWORD
+ *     ReadMultiplier=0
+ *     ReadConstant=0
+ *     WriteMultiplier=0
+ *     WriteConstant=0
+ *
+ * A profile for a terminal server gives its address instead of a port:
+ *
+ *     [Rack 4]
+ *     Host=ts1.lab:2004   ; host:port or [address]:port; telnet port if none
+ *     Protocol=telnet     ; telnet or raw
+ *     NoDelay=1           ; 0 to leave Nagle's algorithm on
+ *     Emulator=VT100      ; also the terminal type sent to telnet servers
+ *     RxBuffer=262144     ; socket buffer sizes
+ *     TxBuffer=262144
+ *
+ * Only Port or Host is required. Without read timeouts, reads wait for
+ * characters with WaitCommEvent and take whatever is waiting; with them,
+ * ReadFile gathers the input into larger chunks. The Benchmark Port
+ * command measures which works best for an adapter.
+ */
+#include "profile.h"
+
+/**
+ * Gets the full path of the profile file.
+ *
+ * @param LPTSTR path   Receives the path, MAX_PATH characters long.
+ * @returns none
+ */
+static void ProfilePath(LPTSTR path) {
+    TCHAR szAppPath[MAX_PATH];
+
+    GetModuleFileName(0, szAppPath, MAX_PATH - 1);
+    StringCchCopy(path, _tcsrchr(szAppPath, '\\') - szAppPath + 2, szAppPath);
+    StringCchCat(path, MAX_PATH, PROFILE_FILE);
+}
+
+/**
+ * Reads a number from a profile, where "max" stands for MAXDWORD.
+ *
+ * @param LPCTSTR name      The name of the profile.
+ * @param LPCTSTR key       The name of the setting.
+ * @param DWORD def         The value if the setting is missing.
+ * @param LPCTSTR path      The path of the profile file.
+ * @returns The value of the setting.
+ */
+static DWORD ProfileDword(LPCTSTR name, LPCTSTR key, DWORD def, LPCTSTR path) {
+    TCHAR value[16];
+
+    if (GetPrivateProfileString(name, key, TEXT(""), value, 16, path) == 0) {
+        return def;
+    }
+
+    if (_tcsicmp(value, TEXT("max")) == 0) {
+        return MAXDWORD;
+    }
+
+    return _tcstoul(value, NULL, 0);
+}
+
+/**
+ * Gets the names of the saved profiles, in the order they are in the file.
+ *
+ * @param TCHAR names[][]   Receives the names.
+ * @param DWORD max         The most names to get.
+ * @returns The number of names.
+ */
+DWORD ProfileNames(TCHAR names[][PROFILE_NAME], DWORD max) {
+    TCHAR path[MAX_PATH];
+    TCHAR sections[4096];
+    LPCTSTR name = sections;
+    DWORD count = 0;
+
+    ProfilePath(path);
+    if (GetPrivateProfileSectionNames(sections, 4096, path) == 0) {
+        return 0;
+    }
+
+    /* The names are separated by NULs and end with an empty name */
+    while (*name != 0 && count < max) {
+        StringCchCopy(names[count++], PROFILE_NAME, name);
+        name += _tcslen(name) + 1;
+    }
+
+    return count;
+}
+
+/**
+ * Loads a saved profile by name.
+ *
+ * @param LPCTSTR name  The name of the profile.
+ * @param Profile* p    Receives the profile.
+ * @returns 0 on success, greater than 0 if there is no such profile.
+ */
+int ProfileLoad(LPCTSTR name, Profile* p) {
+    TCHAR path[MAX_PATH];
+    TCHAR parity[8];
+    TCHAR stop[8];
+    TCHAR flow[16];
+    TCHAR protocol[16];
+
+    ProfilePath(path);
+    ZeroMemory(p, sizeof(Profile));
+    StringCchCopy(p->name, PROFILE_NAME, name);
+
+    p->port = GetPrivateProfileInt(name, TEXT("Port"), 0, path);
+    GetPrivateProfileString(name, TEXT("Host"), TEXT(""), p->host, 256, path);
+    if (p->port == 0 && p->host[0] == 0) {
+        return 1;
+    }
+
+    GetPrivateProfileString(name, TEXT("Protocol"), TEXT("telnet"), protocol,
+            16, path);
+    p->telnet = (_tcsicmp(protocol, TEXT("raw")) != 0);
+    p->nodelay = (GetPrivateProfileInt(name, TEXT("NoDelay"), 1, path) != 0);
+
+    GetPrivateProfileString(name, TEXT("Parity"), TEXT("N"), parity, 8, path);
+    GetPrivateProfileString(name, TEXT("StopBits"), TEXT("1"), stop, 8, path);
+    StringCchPrintf(p->settings, 128, TEXT("baud=%u parity=%c data=%u stop=%s"),
+            GetPrivateProfileInt(name, TEXT("Baud"), 9600, path),
+            parity[0], GetPrivateProfileInt(name, TEXT("DataBits"), 8, path),
+            stop);
+
+    GetPrivateProfileString(name, TEXT("Flow"), TEXT(""), flow, 16, path);
+    if (_tcsicmp(flow, TEXT("none")) == 0) {
+        p->flow = kFlowNone;
+    } else if (_tcsicmp(flow, TEXT("rtscts")) == 0) {
+        p->flow = kFlowRtsCts;
+    } else if (_tcsicmp(flow, TEXT("xonxoff")) == 0) {
+        p->flow = kFlowXonXoff;
+    } else {
+        p->flow = kFlowPort;
+    }
+
+    GetPrivateProfileString(name, TEXT("Emulator"), TEXT(""), p->emulator,
+            64, path);
+    p->rxqueue = GetPrivateProfileInt(name, TEXT("RxBuffer"), 0, path);
+    p->txqueue = GetPrivateProfileInt(name, TEXT("TxBuffer"), 0, path);
+
+    DefaultTimeouts(&p->timeouts);
+    p->timeouts.ReadIntervalTimeout = ProfileDword(name, TEXT("ReadInterval"),
+            p->timeouts.ReadIntervalTimeout, path);
+    p->timeouts.ReadTotalTimeoutMultiplier = ProfileDword(name,
+            TEXT("ReadMultiplier"), p->timeouts.ReadTotalTimeoutMultiplier, path);
+    p->timeouts.ReadTotalTimeoutConstant = ProfileDword(name,
+            TEXT("ReadConstant"), p->timeouts.ReadTotalTimeoutConstant, path);
+    p->timeouts.WriteTotalTimeoutMultiplier = ProfileDword(name,
+            TEXT("WriteMultiplier"), p->timeouts.WriteTotalTimeoutMultiplier, path);
+    p->timeouts.WriteTotalTimeoutConstant = ProfileDword(name,
+            TEXT("WriteConstant"), p->timeouts.WriteTotalTimeoutConstant, path);
+
+    return 0;
+}
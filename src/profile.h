@@ -0,0 +1,67 @@
+/**
+ * @filename profile.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for saved connection
+ * profiles.
+ */
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+#include "serial.h"
+
+/* Name of the profile file, found beside the program */
+#define PROFILE_FILE TEXT("profiles.ini")
+/* Longest profile name */
+#define PROFILE_NAME 64
+/* Most profiles shown in the menu */
+#define PROFILE_MAX 40
+
+/**
+ * The Profile structure contains the settings of a saved connection.
+ *
+ * @member TCHAR name[]         The name of the profile
+ * @member DWORD port           The COM port number, or 0 for a network one
+ * @member TCHAR host[]         The terminal server, as host:port
+ * @member BOOLEAN telnet       TRUE to speak telnet to the server
+ * @member BOOLEAN nodelay      TRUE to turn off Nagle's algorithm
+ * @member TCHAR settings[]     The port settings, as given to BuildCommDCB
+ * @member DWORD flow           One of the flow enumeration values
+ * @member TCHAR emulator[]     The name of the emulator to use, or empty
+ * @member DWORD rxqueue        The receive buffer size, 0 for the default
+ * @member DWORD txqueue        The transmit buffer size, 0 for the default
+ * @member COMMTIMEOUTS timeouts    The read and write timeouts
+ */
+typedef struct _Profile {
+    TCHAR name[PROFILE_NAME];
+    DWORD port;
+    TCHAR host[256];
+    BOOLEAN telnet;
+    BOOLEAN nodelay;
+    TCHAR settings[128];
+    DWORD flow;
+    TCHAR emulator[64];
+    DWORD rxqueue;
+    DWORD txqueue;
+    COMMTIMEOUTS timeouts;
+} Profile;
+
+/**
+ * Gets the names of the saved profiles.
+ * @implementation profile.c
+ */
+DWORD ProfileNames(TCHAR names[][PROFILE_NAME], DWORD max);
+
+/**
+ * Loads a saved profile by name.
+ * @implementation profile.c
+ */
+int ProfileLoad(LPCTSTR name, Profile* p);
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @filename replay.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for the replay buffer.
+ */
+#include "replay.h"
+
+/**
+ * Empties a replay buffer.
+ *
+ * @param Replay* rp    The replay buffer.
+ * @returns none
+ */
+void ReplayInit(Replay* rp) {
+    rp->head = 0;
+    rp->len = 0;
+}
+
+/**
+ * Adds data to a replay buffer. Once it is full, the oldest data is
+ * overwritten.
+ *
+ * @param Replay* rp    The replay buffer.
+ * @param BYTE* data    The data.
+ * @param DWORD len     The length of the data.
+ * @returns none
+ */
+void ReplayAppend(Replay* rp, const BYTE* data, DWORD len) {
+    DWORD first = 0;
+
+    /* Only the last REPLAY_SIZE bytes would survive anyway */
+    if (len > REPLAY_SIZE) {
+        data += len - REPLAY_SIZE;
+        len = REPLAY_SIZE;
+    }
+
+    first = min(len, REPLAY_SIZE - rp->head);
+    CopyMemory(rp->data + rp->head, data, first);
+    CopyMemory(rp->data, data + first, len - first);
+
+    rp->head = (rp->head + len) % REPLAY_SIZE;
+    rp->len = min(rp->len + len, REPLAY_SIZE);
+}
+
+/**
+ * Copies the data kept in a replay buffer out, oldest first.
+ *
+ * @param Replay* rp    The replay buffer.
+ * @param BYTE* out     Receives the data; REPLAY_SIZE bytes long.
+ * @returns The number of bytes copied.
+ */
+DWORD ReplayCopy(Replay* rp, BYTE* out) {
+    DWORD start = (rp->head + REPLAY_SIZE - rp->len) % REPLAY_SIZE;
+    DWORD first = min(rp->len, REPLAY_SIZE - start);
+
+    CopyMemory(out, rp->data + start, first);
+    CopyMemory(out + first, rp->data, rp->len - first);
+
+    return rp->len;
+}
@@ -0,0 +1,52 @@
+/**
+ * @filename replay.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the replay buffer,
+ * which keeps the last of the data a session's emulator was given so that
+ * another emulator can be shown it when the user switches.
+ */
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <Windows.h>
+
+/* Data kept for replay; a few screens' worth */
+#define REPLAY_SIZE 32768
+
+/**
+ * The Replay structure contains the most recent data given to an emulator,
+ * in a ring that overwrites the oldest.
+ *
+ * @member BYTE data[]  The ring
+ * @member DWORD head   Where the next byte goes
+ * @member DWORD len    The number of bytes kept, up to REPLAY_SIZE
+ */
+typedef struct _Replay {
+    BYTE data[REPLAY_SIZE];
+    DWORD head;
+    DWORD len;
+} Replay;
+
+/**
+ * Empties a replay buffer.
+ * @implementation replay.c
+ */
+void ReplayInit(Replay* rp);
+
+/**
+ * Adds data to a replay buffer, dropping the oldest if it is full.
+ * @implementation replay.c
+ */
+void ReplayAppend(Replay* rp, const BYTE* data, DWORD len);
+
+/**
+ * Copies the data kept in a replay buffer out, oldest first.
+ * @implementation replay.c
+ */
+DWORD ReplayCopy(Replay* rp, BYTE* out);
+
+#endif
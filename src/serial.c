@@ -1,189 +1,867 @@
-/**
- * @filename serial.c
- * @author Darryl Pogue
- * @designer Darryl Pogue
- * @date 2010 10 20
- * @project Terminal Emulator
- *
- * This file contains the function implementations for serial port
- * communication.
- */
-#include "serial.h"
-
-/**
- * Initialises a serial port handle for reading and writing
- *
- * @param LPCTSTR port  The name of the serial port to open.
- * @param HANDLE* fd    The pointer to the handle which will be initialised to the open
- *                      serial port connection.
- * @returns int 0 on success, >0 otherwise
- */
-int OpenPort(const LPCTSTR port, HANDLE* fd, HWND hwnd) {
-    COMMPROP cprops;
-    DCB dcb;
-    COMMCONFIG config;
-
-    /* Create the file descriptor handle */
-    if ((*fd = CreateFile(port, GENERIC_READ | GENERIC_WRITE, 0, NULL,
-                    OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL))
-        == INVALID_HANDLE_VALUE) {
-        return 1;
-    }
-
-    if (!GetCommProperties(*fd, &cprops)) {
-        return 2;
-    }
-
-    /* Setup the port for sending and receiving data */
-    if (!SetupComm(*fd, cprops.dwMaxRxQueue, cprops.dwMaxTxQueue)) {
-        return 3;
-    }
-
-    /* Get the current DCB settings */
-    if (!GetCommState(*fd, &dcb)) {
-        return 4;
-    }
-
-    config.dwSize = sizeof(COMMCONFIG);
-    config.wVersion = 0x1;
-    config.dcb = dcb;
-    config.dwProviderSubType = cprops.dwProvSubType;
-    config.dwProviderOffset = 0;
-    config.dwProviderSize = 0;
-
-    /* Show the port configuration dialog */
-    if (!CommConfigDialog(port, hwnd, &config)) {
-        return 5;
-    }
-
-    /* Set the DCB to the config settings */
-    if (!SetCommState(*fd, &config.dcb)) {
-        return 6;
-    }
-
-    /* Specify events to receive */
-    if (!SetCommMask(*fd, EV_RXCHAR | EV_TXEMPTY)) {
-        return 7;
-    }
-    
-    return 0;
-}
-
-/**
- * Sends data out the serial port pointed to by the handle fd.
- *
- * @param HANDLE fd The handle to the serial port.
- * @param LPVOID tx The data to be transmitted.
- * @param DWORD len The length of the data.
- *
- * @returns 0 if successful, greater than 0 otherwise.
- */
-int SendData(HANDLE* fd, LPVOID tx, DWORD len) {
-    DWORD dwEvtMask = 0;
-    DWORD dwWait = 0;
-    DWORD written = 0;
-    OVERLAPPED ov;
-
-    /* Initialise OVERLAPPED structure with defaults */
-    ov.Internal = 0;
-    ov.InternalHigh = 0;
-    ov.Offset = 0;
-    ov.OffsetHigh = 0;
-    ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-
-    if (!ov.hEvent) {
-        return 1;
-    }
-
-    /* Write to the port handle */
-    if (!WriteFile(*fd, tx, len, &written, &ov)) {
-        /* Wait for the write to finish */
-        WaitForSingleObject(ov.hEvent, INFINITE);
-    }
-
-    CloseHandle(ov.hEvent);
-    return 0;
-}
-
-/**
- * Reads data from the serial port.
- *
- * @param HANDLE fd   The handle to the serial port
- * @param HWND hwnd   The handle to the application window
- *
- * @returns 0 if successful, greater than 0 otherwise
- */
-int ReadData(HANDLE* fd, HWND hwnd) {
-    DWORD dwEvtMask = 0;
-    DWORD dwWait = 0;
-    DWORD read = 0;
-    OVERLAPPED ov;
-
-    /* Initialise OVERLAPPED structure with defaults */
-    ov.Internal = 0;
-    ov.InternalHigh = 0;
-    ov.Offset = 0;
-    ov.OffsetHigh = 0;
-    ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-
-    if (!ov.hEvent) {
-        return 1;
-    }
-
-    /* Wait for an event (characters to read) */
-    if (!WaitCommEvent(*fd, &dwEvtMask, &ov)) {
-        if (GetLastError() != ERROR_IO_PENDING) {
-            return 2;
-        }
-    }
-
-    /* Wait for the characters to become available */
-    dwWait = WaitForSingleObject(ov.hEvent, INFINITE);
-    switch (dwWait) {
-        case WAIT_OBJECT_0:
-            if (dwEvtMask & EV_RXCHAR) {
-                COMSTAT cstat;
-                DWORD i;
-
-                /* Get the stats (including number of available characters) */
-                ClearCommError(*fd, NULL, &cstat);
-
-                if (cstat.cbInQue > 0) {
-                    DWORD bytes = cstat.cbInQue;
-                    do {
-                        BYTE* chars = (BYTE*)malloc(cstat.cbInQue + 1);
-                        for (i = 0; i < (bytes > 1024 ? 1024 : bytes); i++) {
-                            chars[i] = 0;
-                            /* Read each character individually */
-                            if (!ReadFile(*fd, (LPVOID)(chars + i), 1, &read, &ov)) {
-                                free(chars);
-                                return 3;
-                            }
-                        }
-                        chars[i] = 0;
-
-                        SendMessage(hwnd, TWM_RXDATA, (WPARAM)chars, cstat.cbInQue);
-                        bytes -= (bytes > 1024 ? 1024 : bytes);
-                    } while(bytes > 0);
-                }
-                ResetEvent(ov.hEvent);
-            }
-            break;
-    }
-
-    return 0;
-}
-
-/**
- * Closes a serial port handle.
- *
- * @param HANDLE* fd    The pointer to the handle of the serial port.
- * @return zero if successful, non-zero otherwise.
- */
-int ClosePort(HANDLE* fd) {
-    if(!CloseHandle(*fd)) {
-        return 1;
-    }
-
-    return 0;
-}
+/**
+ * @filename serial.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 10 20
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for serial port
+ * communication.
+ */
+#include "serial.h"
+
+/**
+ * Switches a serial port device to the baud rate waiting in txbaud, once
+ * what was queued before the change has been written, and tells the window
+ * with TWM_BAUDDONE. Any unread input is discarded, since it was received
+ * at the old rate. Called by the transmit thread.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @returns none
+ */
+static void TxBaud(SerialPort* sp) {
+    DCB dcb;
+    DWORD baud = sp->txbaud;
+
+    if (!GetCommState(sp->hDev, &dcb)) {
+        baud = 0;
+    } else {
+        dcb.BaudRate = baud;
+        if (!SetCommState(sp->hDev, &dcb)) {
+            baud = 0;
+        } else {
+            sp->dcb = dcb;
+            PurgeComm(sp->hDev, PURGE_RXCLEAR);
+        }
+    }
+
+    EnterCriticalSection(&sp->txlock);
+    sp->txbaud = 0;
+    LeaveCriticalSection(&sp->txlock);
+
+    PostMessage(sp->hwnd, TWM_BAUDDONE, (WPARAM)baud, 0);
+}
+
+/**
+ * The thread procedure for writing queued data to the serial port. Each
+ * pass writes the longest contiguous run in the queue, so bytes queued
+ * while a write is in flight go out together in the next one. While a baud
+ * rate change is waiting, only the bytes queued before it are written, and
+ * the rate is changed once they are gone.
+ *
+ * @param LPVOID lpParameter    Pointer to the SerialPort
+ * @returns 0 if the thread exited successfully.
+ */
+static DWORD WINAPI TxLoop(LPVOID lpParameter) {
+    SerialPort* sp = (SerialPort*)lpParameter;
+
+    while (!sp->closing) {
+        WaitForSingleObject(sp->hTxReady, INFINITE);
+
+        while (!sp->closing) {
+            BYTE* run = NULL;
+            DWORD len = 0;
+            DWORD max = SERIAL_TX_CHUNK;
+            DWORD written = 0;
+            DWORD queued = 0;
+            BOOLEAN baud = FALSE;
+
+            EnterCriticalSection(&sp->txlock);
+            if (sp->txbaud != 0 && sp->txbaudwait < max) {
+                max = sp->txbaudwait;
+            }
+            if (max > 0) {
+                len = TxQueuePeek(&sp->txq, &run, max);
+            }
+            baud = (sp->txbaud != 0 && sp->txbaudwait == 0);
+            if (len == 0 && !baud) {
+                SetEvent(sp->hTxIdle);
+            }
+            LeaveCriticalSection(&sp->txlock);
+
+            if (baud) {
+                TxBaud(sp);
+                continue;
+            }
+
+            if (len == 0) {
+                break;
+            }
+
+            /* The run is not touched by SendData until it is consumed */
+            if (sp->transport->write(sp, run, len, &written) != 0) {
+                /* Drop what couldn't be sent rather than retry forever */
+                written = len;
+            }
+
+            EnterCriticalSection(&sp->txlock);
+            TxQueueConsume(&sp->txq, written);
+            queued = sp->txq.count;
+            if (sp->txbaud != 0) {
+                sp->txbaudwait -= (written < sp->txbaudwait) ? written : sp->txbaudwait;
+            }
+            SetEvent(sp->hTxSpace);
+            LeaveCriticalSection(&sp->txlock);
+
+            StatsWrite(&sp->stats, written, queued);
+
+            PostMessage(sp->hwnd, TWM_TXDONE, (WPARAM)written, (LPARAM)queued);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Frees the transmit queue and events of a serial port once its transmit
+ * thread has stopped, or after StartTx failed to start it. Events that
+ * were never created are skipped.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @returns none
+ */
+static void FreeTx(SerialPort* sp) {
+    HANDLE hEvent = (HANDLE)((ULONG_PTR)sp->txov.hEvent & ~1);
+
+    if (sp->hTxReady != NULL) {
+        CloseHandle(sp->hTxReady);
+    }
+    if (sp->hTxSpace != NULL) {
+        CloseHandle(sp->hTxSpace);
+    }
+    if (sp->hTxIdle != NULL) {
+        CloseHandle(sp->hTxIdle);
+    }
+    if (hEvent != NULL) {
+        CloseHandle(hEvent);
+    }
+    sp->hTxReady = NULL;
+    sp->hTxSpace = NULL;
+    sp->hTxIdle = NULL;
+    sp->txov.hEvent = NULL;
+
+    DeleteCriticalSection(&sp->txlock);
+    TxQueueFree(&sp->txq);
+}
+
+/**
+ * Creates the transmit queue, events and thread of an open serial port.
+ * On failure, whatever was created is freed again.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @returns 0 on success, >0 otherwise
+ */
+static int StartTx(SerialPort* sp) {
+    sp->hTxThread = NULL;
+    sp->closing = FALSE;
+    sp->txbaud = 0;
+    sp->txbaudwait = 0;
+    ZeroMemory(&sp->txov, sizeof(OVERLAPPED));
+
+    if (!TxQueueInit(&sp->txq, TXQUEUE_SIZE)) {
+        return 1;
+    }
+
+    InitializeCriticalSection(&sp->txlock);
+    sp->hTxReady = CreateEvent(NULL, FALSE, FALSE, NULL);
+    sp->hTxSpace = CreateEvent(NULL, TRUE, TRUE, NULL);
+    sp->hTxIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+    sp->txov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    if (!sp->hTxReady || !sp->hTxSpace || !sp->hTxIdle || !sp->txov.hEvent) {
+        FreeTx(sp);
+        return 2;
+    }
+
+    /* Writes are waited on here, so the low bit keeps their completions
+       off the I/O pool's port */
+    sp->txov.hEvent = (HANDLE)((ULONG_PTR)sp->txov.hEvent | 1);
+
+    sp->hTxThread = CreateThread(NULL, 0, &TxLoop, (LPVOID)sp, 0, 0);
+    if (sp->hTxThread == NULL) {
+        FreeTx(sp);
+        return 3;
+    }
+
+    return 0;
+}
+
+/**
+ * Creates the read state of an open serial port. Nothing is read until the
+ * port is attached to the I/O pool.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @returns 0 on success, >0 otherwise
+ */
+static int StartRx(SerialPort* sp) {
+    ZeroMemory(&sp->rxov, sizeof(OVERLAPPED));
+    sp->rxstop = FALSE;
+    sp->rxpending = FALSE;
+    sp->rxstate = kRxWait;
+    sp->rxqueued = 0;
+    sp->rxbuf = NULL;
+
+    InitializeCriticalSection(&sp->rxlock);
+    sp->hRxIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+
+    if (!sp->hRxIdle) {
+        DeleteCriticalSection(&sp->rxlock);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Starts the transmit thread and creates the read state of a newly
+ * opened port, once its device is set up. If the read state can't be
+ * made, the transmit thread is left for ClosePort to stop.
+ *
+ * @param SerialPort* sp    The serial port, with its device open.
+ * @returns 0 on success, >0 otherwise
+ */
+int StartPort(SerialPort* sp) {
+    if (StartTx(sp) != 0) {
+        return 1;
+    }
+
+    if (StartRx(sp) != 0) {
+        return 2;
+    }
+
+    return 0;
+}
+
+/* The serial port transport, implemented below */
+static int SerialWrite(SerialPort* sp, BYTE* data, DWORD len, LPDWORD written);
+static int SerialReadStart(SerialPort* sp);
+static int SerialReadDone(SerialPort* sp, DWORD transferred);
+static int SerialFlow(SerialPort* sp, DWORD flow);
+static int SerialBaud(SerialPort* sp, DWORD baud, DWORD* previous);
+static void SerialAbort(SerialPort* sp);
+static int SerialReopen(SerialPort* sp, HWND hwnd);
+static int SerialClose(SerialPort* sp);
+
+static const Transport kSerialTransport = {
+    kTransportSerial,
+    &SerialWrite,
+    &SerialReadStart,
+    &SerialReadDone,
+    &SerialFlow,
+    &SerialBaud,
+    &SerialAbort,
+    &SerialReopen,
+    &SerialClose
+};
+
+/**
+ * Sets up an open serial port device and starts its transmit thread. If
+ * ask is TRUE the user picks the settings in the port dialog; if settings
+ * are given they are applied to the current state of the port. Either way
+ * they are kept in sp->dcb; otherwise sp->dcb is applied as it is.
+ *
+ * @param LPCTSTR port      The name of the serial port.
+ * @param SerialPort* sp    The serial port, with hDev open.
+ * @param BOOLEAN ask       TRUE to show the port configuration dialog.
+ * @param LPCTSTR settings  The settings, as given to BuildCommDCB, or NULL.
+ * @returns int 0 on success, >0 otherwise
+ */
+static int SetupPort(const LPCTSTR port, SerialPort* sp, BOOLEAN ask,
+        LPCTSTR settings) {
+    COMMPROP cprops;
+    DCB dcb;
+    COMMCONFIG config;
+    DWORD rxqueue = 0;
+    DWORD txqueue = 0;
+
+    if (!GetCommProperties(sp->hDev, &cprops)) {
+        return 2;
+    }
+
+    /* Use the largest buffers the driver allows unless told otherwise */
+    rxqueue = (sp->rxqueue != 0) ? sp->rxqueue : cprops.dwMaxRxQueue;
+    txqueue = (sp->txqueue != 0) ? sp->txqueue : cprops.dwMaxTxQueue;
+
+    /* Setup the port for sending and receiving data */
+    if (!SetupComm(sp->hDev, rxqueue, txqueue)) {
+        return 3;
+    }
+
+    if (settings != NULL) {
+        if (!GetCommState(sp->hDev, &sp->dcb)) {
+            return 4;
+        }
+
+        if (!BuildCommDCB(settings, &sp->dcb)) {
+            return 5;
+        }
+    } else if (ask) {
+        /* Get the current DCB settings */
+        if (!GetCommState(sp->hDev, &dcb)) {
+            return 4;
+        }
+
+        config.dwSize = sizeof(COMMCONFIG);
+        config.wVersion = 0x1;
+        config.dcb = dcb;
+        config.dwProviderSubType = cprops.dwProvSubType;
+        config.dwProviderOffset = 0;
+        config.dwProviderSize = 0;
+
+        /* Show the port configuration dialog */
+        if (!CommConfigDialog(PortShortName(port), sp->hwnd, &config)) {
+            return 5;
+        }
+
+        sp->dcb = config.dcb;
+    }
+
+    /* Set the DCB to the config settings */
+    if (!SetCommState(sp->hDev, &sp->dcb)) {
+        return 6;
+    }
+
+    if (!SetCommTimeouts(sp->hDev, &sp->timeouts)) {
+        return 7;
+    }
+
+    /* Specify events to receive */
+    if (!SetCommMask(sp->hDev, EV_RXCHAR | EV_TXEMPTY)) {
+        return 8;
+    }
+
+    /* Start the transmit thread and create the read events */
+    if (StartPort(sp) != 0) {
+        return 9;
+    }
+
+    return 0;
+}
+
+/**
+ * Opens a serial port device and sets it up. On failure, whatever was
+ * opened is closed again and the error is left for GetLastError.
+ *
+ * @param LPCTSTR port      The name of the serial port to open.
+ * @param SerialPort* sp    The serial port structure.
+ * @param HWND hwnd         The window that owns the connection.
+ * @param BOOLEAN ask       TRUE to show the port configuration dialog.
+ * @param LPCTSTR settings  The settings to use instead, or NULL.
+ * @returns int 0 on success, >0 otherwise
+ */
+static int OpenDevice(const LPCTSTR port, SerialPort* sp, HWND hwnd,
+        BOOLEAN ask, LPCTSTR settings) {
+    int ret = 0;
+
+    sp->hwnd = hwnd;
+    sp->transport = &kSerialTransport;
+    if (port != sp->name) {
+        StringCchCopy(sp->name, SERIAL_NAME, port);
+    }
+
+    /* Create the file descriptor handle */
+    if ((sp->hDev = CreateFile(port, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                    OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL))
+        == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+
+    if ((ret = SetupPort(port, sp, ask, settings)) != 0) {
+        DWORD dwError = GetLastError();
+
+        ClosePort(sp);
+        SetLastError(dwError);
+    }
+
+    return ret;
+}
+
+/**
+ * Gets the device name of a COM port. The name always has the \\.\
+ * prefix, which COM10 and above need and the lower ports accept.
+ *
+ * @param DWORD port    The number of the COM port.
+ * @param LPTSTR name   Receives the name.
+ * @param DWORD len     The room in name, at least SERIAL_DEVICE.
+ * @returns none
+ */
+void PortDeviceName(DWORD port, LPTSTR name, DWORD len) {
+    StringCchPrintf(name, len, TEXT("\\\\.\\COM%lu"), port);
+}
+
+/**
+ * Gets the name of a port as Windows shows it and reports it in device
+ * notifications: COM10 for \\.\COM10. Other names are returned as they
+ * are.
+ *
+ * @param LPCTSTR name  The port name.
+ * @returns The name without the device prefix.
+ */
+LPCTSTR PortShortName(LPCTSTR name) {
+    if (_tcsncmp(name, TEXT("\\\\.\\"), 4) == 0) {
+        return name + 4;
+    }
+
+    return name;
+}
+
+/**
+ * Initialises a serial port for reading and writing
+ *
+ * @param LPCTSTR port      The name of the serial port to open.
+ * @param SerialPort* sp    The serial port structure which will be
+ *                          initialised to the open serial port connection.
+ * @param HWND hwnd         The window that owns the connection.
+ * @returns int 0 on success, >0 otherwise
+ */
+int OpenPort(const LPCTSTR port, SerialPort* sp, HWND hwnd) {
+    StatsReset(&sp->stats);
+    sp->rxqueue = 0;
+    sp->txqueue = 0;
+    DefaultTimeouts(&sp->timeouts);
+
+    return OpenDevice(port, sp, hwnd, TRUE, NULL);
+}
+
+/**
+ * Initialises a serial port with the given settings, without showing the
+ * port configuration dialog.
+ *
+ * @param LPCTSTR port      The name of the serial port to open.
+ * @param SerialPort* sp    The serial port structure.
+ * @param HWND hwnd         The window that owns the connection.
+ * @param LPCTSTR settings  The settings, as given to BuildCommDCB
+ *                          (e.g. "baud=9600 parity=N data=8 stop=1").
+ * @param DWORD rxqueue     The driver receive buffer size, 0 for the most.
+ * @param DWORD txqueue     The driver transmit buffer size, 0 for the most.
+ * @param COMMTIMEOUTS* timeouts    The timeouts, or NULL for the defaults.
+ * @returns int 0 on success, >0 otherwise
+ */
+int OpenPortSettings(const LPCTSTR port, SerialPort* sp, HWND hwnd,
+        LPCTSTR settings, DWORD rxqueue, DWORD txqueue,
+        const COMMTIMEOUTS* timeouts) {
+    StatsReset(&sp->stats);
+    sp->rxqueue = rxqueue;
+    sp->txqueue = txqueue;
+    if (timeouts != NULL) {
+        sp->timeouts = *timeouts;
+    } else {
+        DefaultTimeouts(&sp->timeouts);
+    }
+
+    return OpenDevice(port, sp, hwnd, FALSE, settings);
+}
+
+/**
+ * Gets the timeouts a port is opened with when none are given: reads
+ * return at once with whatever is waiting, and writes never time out.
+ * The port waits for characters with WaitCommEvent before reading them.
+ *
+ * @param COMMTIMEOUTS* timeouts    Receives the timeouts.
+ * @returns none
+ */
+void DefaultTimeouts(COMMTIMEOUTS* timeouts) {
+    timeouts->ReadIntervalTimeout = MAXDWORD;
+    timeouts->ReadTotalTimeoutMultiplier = 0;
+    timeouts->ReadTotalTimeoutConstant = 0;
+    timeouts->WriteTotalTimeoutMultiplier = 0;
+    timeouts->WriteTotalTimeoutConstant = 0;
+}
+
+/**
+ * Opens a port again with the settings it had when it was last open,
+ * without asking the user. Used to recover from a lost device or a dropped
+ * connection. The statistics carry on from the previous connection.
+ *
+ * @param SerialPort* sp    The serial port structure, opened before.
+ * @param HWND hwnd         The window that owns the connection.
+ * @returns int 0 on success, >0 otherwise
+ */
+int ReopenPort(SerialPort* sp, HWND hwnd) {
+    return sp->transport->reopen(sp, hwnd);
+}
+
+/**
+ * Opens a serial port device again with its last settings.
+ *
+ * @param SerialPort* sp    The serial port structure.
+ * @param HWND hwnd         The window that owns the connection.
+ * @returns int 0 on success, >0 otherwise
+ */
+static int SerialReopen(SerialPort* sp, HWND hwnd) {
+    return OpenDevice(sp->name, sp, hwnd, FALSE, NULL);
+}
+
+/**
+ * Queues as much data as will fit in the transmit queue without waiting.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @param LPVOID tx         The data to be transmitted.
+ * @param DWORD len         The length of the data.
+ *
+ * @returns The number of bytes queued, which may be less than len.
+ */
+DWORD QueueData(SerialPort* sp, LPVOID tx, DWORD len) {
+    DWORD queued = 0;
+
+    EnterCriticalSection(&sp->txlock);
+    queued = TxQueuePut(&sp->txq, (BYTE*)tx, len);
+    if (queued > 0) {
+        ResetEvent(sp->hTxIdle);
+        SetEvent(sp->hTxReady);
+    }
+    if (TxQueueSpace(&sp->txq) == 0) {
+        ResetEvent(sp->hTxSpace);
+    }
+    LeaveCriticalSection(&sp->txlock);
+
+    return queued;
+}
+
+/**
+ * Queues data to be sent out the serial port and returns without waiting
+ * for it to be written. If the queue is full, waits up to
+ * SERIAL_TX_TIMEOUT for the transmit thread to make room.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @param LPVOID tx         The data to be transmitted.
+ * @param DWORD len         The length of the data.
+ *
+ * @returns 0 if successful, greater than 0 otherwise.
+ */
+int SendData(SerialPort* sp, LPVOID tx, DWORD len) {
+    BYTE* data = (BYTE*)tx;
+
+    while (len > 0) {
+        DWORD queued = QueueData(sp, data, len);
+
+        data += queued;
+        len -= queued;
+
+        if (len > 0 && WaitForSingleObject(sp->hTxSpace, SERIAL_TX_TIMEOUT)
+                != WAIT_OBJECT_0) {
+            SetLastError(ERROR_TIMEOUT);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Sets the flow control used by an open serial port. Output is held back
+ * by the driver while the device deasserts CTS (kFlowRtsCts) or after it
+ * sends XOFF (kFlowXonXoff), and the same is asked of the device when the
+ * receive buffer fills.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @param DWORD flow        One of the flow enumeration values.
+ *                          kFlowPort leaves the settings unchanged.
+ *
+ * @returns 0 if successful, greater than 0 otherwise.
+ */
+int SetPortFlow(SerialPort* sp, DWORD flow) {
+    if (flow == kFlowPort) {
+        return 0;
+    }
+
+    return sp->transport->set_flow(sp, flow);
+}
+
+/**
+ * Sets the flow control of a serial port device in its DCB.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @param DWORD flow        One of the flow enumeration values.
+ * @returns 0 if successful, greater than 0 otherwise.
+ */
+static int SerialFlow(SerialPort* sp, DWORD flow) {
+    DCB dcb;
+
+    if (!GetCommState(sp->hDev, &dcb)) {
+        return 1;
+    }
+
+    dcb.fOutxCtsFlow = (flow == kFlowRtsCts);
+    dcb.fOutxDsrFlow = FALSE;
+    dcb.fDtrControl = DTR_CONTROL_ENABLE;
+    dcb.fRtsControl = (flow == kFlowRtsCts)
+            ? RTS_CONTROL_HANDSHAKE : RTS_CONTROL_ENABLE;
+
+    dcb.fOutX = (flow == kFlowXonXoff);
+    dcb.fInX = (flow == kFlowXonXoff);
+    dcb.XonChar = 0x11;
+    dcb.XoffChar = 0x13;
+    dcb.XonLim = 2048;
+    dcb.XoffLim = 512;
+
+    if (!SetCommState(sp->hDev, &dcb)) {
+        return 2;
+    }
+    sp->dcb = dcb;
+
+    return 0;
+}
+
+/**
+ * Waits until all queued data has been written to the serial port.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @param DWORD timeout     The longest time to wait in milliseconds.
+ *
+ * @returns 0 if the queue drained, greater than 0 otherwise.
+ */
+int DrainPort(SerialPort* sp, DWORD timeout) {
+    if (WaitForSingleObject(sp->hTxIdle, timeout) != WAIT_OBJECT_0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Writes a run of the transmit queue to a serial port device, waiting for
+ * the write to finish.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @param BYTE* data        The data to write.
+ * @param DWORD len         The length of the data.
+ * @param LPDWORD written   Receives the number of bytes written.
+ * @returns 0 if successful, greater than 0 otherwise.
+ */
+static int SerialWrite(SerialPort* sp, BYTE* data, DWORD len, LPDWORD written) {
+    if (!WriteFile(sp->hDev, data, len, written, &sp->txov)) {
+        if (GetLastError() != ERROR_IO_PENDING ||
+                !GetOverlappedResult(sp->hDev, &sp->txov, written, TRUE)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Tells whether a port reads with ReadFile doing the waiting, rather than
+ * waiting for a comm event and reading what is there.
+ *
+ * @param SerialPort* sp    The serial port
+ * @returns TRUE if the port has read timeouts set.
+ */
+static BOOLEAN ReadsTimed(SerialPort* sp) {
+    return sp->timeouts.ReadIntervalTimeout != MAXDWORD ||
+            sp->timeouts.ReadTotalTimeoutMultiplier != 0 ||
+            sp->timeouts.ReadTotalTimeoutConstant != 0;
+}
+
+/**
+ * Issues the next overlapped read on a serial port device. While the driver
+ * holds data it is read a chunk at a time; once it is empty, the port waits
+ * for a comm event. If the port has read timeouts, ReadFile is given a whole
+ * chunk and the timeouts decide how the data is gathered instead.
+ *
+ * @param SerialPort* sp    The serial port
+ *
+ * @returns 0 if the read was issued, greater than 0 otherwise
+ */
+static int SerialReadStart(SerialPort* sp) {
+    DWORD want = SERIAL_RX_CHUNK;
+
+    if (!ReadsTimed(sp) && sp->rxqueued == 0) {
+        sp->rxstate = kRxWait;
+        sp->rxmask = 0;
+
+        if (!WaitCommEvent(sp->hDev, &sp->rxmask, &sp->rxov) &&
+                GetLastError() != ERROR_IO_PENDING) {
+            return 1;
+        }
+        return 0;
+    }
+
+    if (ReadsTimed(sp)) {
+        sp->rxstate = kRxTimed;
+    } else {
+        sp->rxstate = kRxRead;
+        want = (sp->rxqueued > SERIAL_RX_CHUNK) ? SERIAL_RX_CHUNK : sp->rxqueued;
+    }
+
+    if ((sp->rxbuf = (BYTE*)malloc(want + 1)) == NULL) {
+        return 2;
+    }
+
+    /* Completes through the I/O pool even if the data is already there */
+    if (!ReadFile(sp->hDev, (LPVOID)sp->rxbuf, want, NULL, &sp->rxov) &&
+            GetLastError() != ERROR_IO_PENDING) {
+        free(sp->rxbuf);
+        sp->rxbuf = NULL;
+        return 3;
+    }
+
+    return 0;
+}
+
+/**
+ * Handles a completed read on a serial port device. A comm event counts the
+ * characters waiting in the driver for the reads that follow it; a read
+ * sends its chunk to the window with TWM_RXDATA, and the window frees it.
+ *
+ * @param SerialPort* sp        The serial port
+ * @param DWORD transferred     The number of bytes read
+ *
+ * @returns 0 if successful, greater than 0 otherwise
+ */
+static int SerialReadDone(SerialPort* sp, DWORD transferred) {
+    DWORD errors = 0;
+    COMSTAT cstat;
+    BYTE* chars = sp->rxbuf;
+
+    sp->rxbuf = NULL;
+
+    switch (sp->rxstate) {
+    case kRxWait:
+        if (!(sp->rxmask & EV_RXCHAR)) {
+            return 0;
+        }
+
+        QueryPerformanceCounter(&sp->rxarrived);
+
+        /* Get the stats (including number of available characters) */
+        ClearCommError(sp->hDev, &errors, &cstat);
+        StatsRead(&sp->stats, 0, errors, cstat.cbInQue);
+        sp->rxqueued = cstat.cbInQue;
+        return 0;
+    case kRxRead:
+        if (transferred == 0) {
+            sp->rxqueued = 0;
+            break;
+        }
+
+        sp->rxqueued -= (transferred < sp->rxqueued) ? transferred : sp->rxqueued;
+        StatsRead(&sp->stats, transferred, 0, sp->rxqueued);
+        break;
+    case kRxTimed:
+        /* Latency is measured from the end of the read, so it leaves out
+           the time spent gathering the chunk */
+        QueryPerformanceCounter(&sp->rxarrived);
+
+        ClearCommError(sp->hDev, &errors, &cstat);
+        StatsRead(&sp->stats, transferred, errors, cstat.cbInQue);
+        break;
+    }
+
+    if (transferred == 0) {
+        free(chars);
+        return 0;
+    }
+
+    chars[transferred] = 0;
+    SendMessage(sp->hwnd, TWM_RXDATA, (WPARAM)chars, transferred);
+
+    return 0;
+}
+
+/**
+ * Changes the baud rate of an open serial port, leaving the rest of the
+ * DCB settings untouched. The change is made by the transmit thread once
+ * the data queued before it has been sent, so this does not wait; the
+ * window is posted TWM_BAUDDONE when it is done. Data queued after the
+ * call is sent at the new rate.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @param DWORD baud        The new baud rate, or 0 to leave it unchanged.
+ * @param DWORD* previous   Receives the baud rate before the change.
+ * @returns 0 if successful, greater than 0 otherwise.
+ */
+int SetPortBaud(SerialPort* sp, DWORD baud, DWORD* previous) {
+    return sp->transport->set_baud(sp, baud, previous);
+}
+
+/**
+ * Changes the baud rate of a serial port device, as SetPortBaud.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @param DWORD baud        The new baud rate, or 0 to leave it unchanged.
+ * @param DWORD* previous   Receives the baud rate before the change.
+ * @returns 0 if successful, greater than 0 otherwise.
+ */
+static int SerialBaud(SerialPort* sp, DWORD baud, DWORD* previous) {
+    DCB dcb;
+    int ret = 0;
+
+    if (!GetCommState(sp->hDev, &dcb)) {
+        return 1;
+    }
+
+    *previous = dcb.BaudRate;
+    if (baud == 0) {
+        return 0;
+    }
+
+    EnterCriticalSection(&sp->txlock);
+    if (sp->txbaud != 0) {
+        /* One change at a time; the caller waits for TWM_BAUDDONE */
+        ret = 2;
+    } else {
+        sp->txbaud = baud;
+        sp->txbaudwait = sp->txq.count;
+        ResetEvent(sp->hTxIdle);
+        SetEvent(sp->hTxReady);
+    }
+    LeaveCriticalSection(&sp->txlock);
+
+    return ret;
+}
+
+/**
+ * Closes a serial port, stopping its transmit thread. Data still queued is
+ * discarded. The port must have been detached from the I/O pool first.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @return zero if successful, non-zero otherwise.
+ */
+int ClosePort(SerialPort* sp) {
+    if (sp->hTxThread != NULL) {
+        sp->closing = TRUE;
+        SetEvent(sp->hTxReady);
+
+        /* Abort a write that is waiting on flow control */
+        sp->transport->abort(sp);
+
+        WaitForSingleObject(sp->hTxThread, INFINITE);
+        CloseHandle(sp->hTxThread);
+        sp->hTxThread = NULL;
+
+        FreeTx(sp);
+    }
+
+    if (sp->hRxIdle != NULL) {
+        CloseHandle(sp->hRxIdle);
+        DeleteCriticalSection(&sp->rxlock);
+        sp->hRxIdle = NULL;
+    }
+
+    return sp->transport->close(sp);
+}
+
+/**
+ * Aborts a write to a serial port device that is waiting on flow control.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @returns none
+ */
+static void SerialAbort(SerialPort* sp) {
+    PurgeComm(sp->hDev, PURGE_TXABORT | PURGE_TXCLEAR);
+}
+
+/**
+ * Closes a serial port device.
+ *
+ * @param SerialPort* sp    The serial port.
+ * @return zero if successful, non-zero otherwise.
+ */
+static int SerialClose(SerialPort* sp) {
+    if (!CloseHandle(sp->hDev)) {
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,42 +1,244 @@
-/**
- * @filename serial.h
- * @author Darryl Pogue
- * @designer Darryl Pogue
- * @date 2010 10 20
- * @project Terminal Emulator
- *
- * This file contains the definitions and prototypes for communication
- * across a serial port.
- */
-#ifndef _SERIAL_H_
-#define _SERIAL_H_
-
-#include <Windows.h>
-#include <tchar.h>
-#include "defines.h"
-
-/**
- * Initialises a serial port handle for reading and writing
- * @implementation serial.c
- */
-int OpenPort(const LPCTSTR port, HANDLE* fd, HWND hwnd);
-
-/**
- * Sends data out the serial port pointed to by the handle fd.
- * @implementation serial.c
- */
-int SendData(HANDLE* fd, LPVOID tx, DWORD len);
-
-/**
- * Receives data from the serial port pointed to by the handle fd.
- * @implementation serial.c
- */
-int ReadData(HANDLE* fd, HWND hwnd);
-
-/**
- * Closes a serial port handle.
- * @implementation serial.c
- */
-int ClosePort(HANDLE* fd);
-
-#endif
+/**
+ * @filename serial.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 10 20
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for communication
+ * across a serial port.
+ */
+#ifndef _SERIAL_H_
+#define _SERIAL_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include "defines.h"
+#include "txqueue.h"
+#include "stats.h"
+#include "telnet.h"
+
+/* ENUMERATION DECLARATIONS */
+enum flow {
+    kFlowPort = 0,      /* Whatever was chosen in the port dialog */
+    kFlowNone = 1,
+    kFlowRtsCts = 2,
+    kFlowXonXoff = 3
+};
+
+/* Largest single write made by the transmit thread */
+#define SERIAL_TX_CHUNK 4096
+/* Longest time (ms) SendData waits for room in a full queue */
+#define SERIAL_TX_TIMEOUT 5000
+/* Largest single read passed to the window */
+#define SERIAL_RX_CHUNK 4096
+/* Longest port name or network address */
+#define SERIAL_NAME 256
+/* Room for the device name of any COM port, up to \\.\COM4294967295 */
+#define SERIAL_DEVICE 20
+
+enum transport {
+    kTransportSerial = 0,   /* A COM port */
+    kTransportNet = 1       /* A TCP connection, raw or telnet */
+};
+
+/* READ STATES */
+enum rx_state {
+    kRxWait = 0,        /* Waiting for a comm event */
+    kRxRead = 1,        /* Reading what the driver holds */
+    kRxTimed = 2        /* Reading a chunk, the read timeouts doing the waiting */
+};
+
+struct _SerialPort;
+
+/**
+ * The Transport structure contains the operations that differ between a
+ * COM port and a network connection. Everything else, the transmit queue
+ * and thread, the read state and the statistics, is shared.
+ *
+ * Reads are never waited on. read_start issues the next overlapped read on
+ * rxov, and the I/O pool calls read_done on one of its threads when it
+ * completes (see iopool.h).
+ *
+ * @member DWORD type       One of the transport enumeration values
+ * @member write            Writes a run of the transmit queue, waiting for
+ *                          it to finish. Called by the transmit thread.
+ * @member read_start       Issues the next overlapped read.
+ * @member read_done        Handles a completed read, sending any data to
+ *                          the window with TWM_RXDATA.
+ * @member set_flow         Sets the flow control, as SetPortFlow.
+ * @member set_baud         Sets the baud rate, as SetPortBaud.
+ * @member abort            Aborts a write that is in progress.
+ * @member reopen           Opens the device again with its last settings.
+ * @member close            Closes the device.
+ */
+typedef struct _Transport {
+    DWORD type;
+    int (*write)(struct _SerialPort* sp, BYTE* data, DWORD len, LPDWORD written);
+    int (*read_start)(struct _SerialPort* sp);
+    int (*read_done)(struct _SerialPort* sp, DWORD transferred);
+    int (*set_flow)(struct _SerialPort* sp, DWORD flow);
+    int (*set_baud)(struct _SerialPort* sp, DWORD baud, DWORD* previous);
+    void (*abort)(struct _SerialPort* sp);
+    int (*reopen)(struct _SerialPort* sp, HWND hwnd);
+    int (*close)(struct _SerialPort* sp);
+} Transport;
+
+/**
+ * The SerialPort structure contains an open serial port and its transmit
+ * path. Data to send is queued by SendData and written by a dedicated
+ * thread that reuses one OVERLAPPED structure for every write. The port
+ * may also be a network connection, opened by OpenNet.
+ *
+ * @member Transport* transport The operations of the kind of port
+ * @member TCHAR name[]         The port name or network address, for reopening
+ * @member HANDLE hDev          The handle to the serial port device
+ * @member HWND hwnd            The window sent TWM_RXDATA and TWM_TXDONE
+ * @member HANDLE hTxThread     The handle to the transmit thread
+ * @member HANDLE hTxReady      Signalled when data is queued or on close
+ * @member HANDLE hTxSpace      Signalled while the queue has free space
+ * @member HANDLE hTxIdle       Signalled while nothing is queued or in flight
+ * @member OVERLAPPED txov      The overlapped context for writes
+ * @member CRITICAL_SECTION txlock  Guards the queue
+ * @member TxQueue txq          The bytes waiting to be sent
+ * @member DWORD txbaud         A baud rate to switch to, 0 if none is waiting
+ * @member DWORD txbaudwait     The bytes to send at the old rate first
+ * @member BOOLEAN closing      Set when the transmit thread should exit
+ * @member OVERLAPPED rxov      The overlapped context for reads
+ * @member CRITICAL_SECTION rxlock  Guards issuing a read against stopping
+ * @member HANDLE hRxIdle       Signalled while no read is outstanding
+ * @member BOOLEAN rxstop       Set when no further read should be issued
+ * @member BOOLEAN rxpending    TRUE while a read is outstanding
+ * @member DWORD rxstate        One of the rx_state enumeration values
+ * @member DWORD rxmask         The events reported by WaitCommEvent
+ * @member DWORD rxqueued       The bytes the driver still holds
+ * @member BYTE* rxbuf          The buffer of the read in flight
+ * @member LARGE_INTEGER rxarrived  When the data being read arrived, for
+ *                                  the window to time its paint from
+ * @member PortStats stats      The read and write counters of the port
+ * @member DCB dcb              The settings in use, kept for ReopenPort
+ * @member DWORD rxqueue        The driver receive buffer size, 0 for the most
+ * @member DWORD txqueue        The driver transmit buffer size, 0 for the most
+ * @member COMMTIMEOUTS timeouts    The read and write timeouts of the port
+ * @member SOCKET sock          The socket of a network connection
+ * @member BOOLEAN telnet       TRUE if the connection speaks telnet
+ * @member BOOLEAN nodelay      TRUE to turn off Nagle's algorithm
+ * @member Telnet tn            The telnet state of the connection
+ */
+typedef struct _SerialPort {
+    const Transport* transport;
+    TCHAR name[SERIAL_NAME];
+    HANDLE hDev;
+    HWND hwnd;
+    HANDLE hTxThread;
+    HANDLE hTxReady;
+    HANDLE hTxSpace;
+    HANDLE hTxIdle;
+    OVERLAPPED txov;
+    CRITICAL_SECTION txlock;
+    TxQueue txq;
+    DWORD txbaud;
+    DWORD txbaudwait;
+    volatile BOOLEAN closing;
+    OVERLAPPED rxov;
+    CRITICAL_SECTION rxlock;
+    HANDLE hRxIdle;
+    volatile BOOLEAN rxstop;
+    BOOLEAN rxpending;
+    DWORD rxstate;
+    DWORD rxmask;
+    DWORD rxqueued;
+    BYTE* rxbuf;
+    LARGE_INTEGER rxarrived;
+    PortStats stats;
+    DCB dcb;
+    DWORD rxqueue;
+    DWORD txqueue;
+    COMMTIMEOUTS timeouts;
+    SOCKET sock;
+    BOOLEAN telnet;
+    BOOLEAN nodelay;
+    Telnet tn;
+} SerialPort;
+
+/**
+ * Initialises a serial port for reading and writing
+ * @implementation serial.c
+ */
+int OpenPort(const LPCTSTR port, SerialPort* sp, HWND hwnd);
+
+/**
+ * Initialises a serial port with the given settings.
+ * @implementation serial.c
+ */
+int OpenPortSettings(const LPCTSTR port, SerialPort* sp, HWND hwnd,
+        LPCTSTR settings, DWORD rxqueue, DWORD txqueue,
+        const COMMTIMEOUTS* timeouts);
+
+/**
+ * Gets the device name of a COM port, as given to OpenPort.
+ * @implementation serial.c
+ */
+void PortDeviceName(DWORD port, LPTSTR name, DWORD len);
+
+/**
+ * Gets the name of a port as Windows shows it, without the device prefix.
+ * @implementation serial.c
+ */
+LPCTSTR PortShortName(LPCTSTR name);
+
+/**
+ * Gets the timeouts a port is opened with when none are given.
+ * @implementation serial.c
+ */
+void DefaultTimeouts(COMMTIMEOUTS* timeouts);
+
+/**
+ * Opens a port again with its previous settings.
+ * @implementation serial.c
+ */
+int ReopenPort(SerialPort* sp, HWND hwnd);
+
+/**
+ * Starts the transmit thread and read state of a newly opened port.
+ * @implementation serial.c
+ */
+int StartPort(SerialPort* sp);
+
+/**
+ * Queues data to be sent out the serial port.
+ * @implementation serial.c
+ */
+int SendData(SerialPort* sp, LPVOID tx, DWORD len);
+
+/**
+ * Queues as much data as will fit without waiting.
+ * @implementation serial.c
+ */
+DWORD QueueData(SerialPort* sp, LPVOID tx, DWORD len);
+
+/**
+ * Sets the flow control used by an open serial port.
+ * @implementation serial.c
+ */
+int SetPortFlow(SerialPort* sp, DWORD flow);
+
+/**
+ * Waits until all queued data has been written to the serial port.
+ * @implementation serial.c
+ */
+int DrainPort(SerialPort* sp, DWORD timeout);
+
+/**
+ * Changes the baud rate of an open serial port once queued data is sent.
+ * @implementation serial.c
+ */
+int SetPortBaud(SerialPort* sp, DWORD baud, DWORD* previous);
+
+/**
+ * Closes a serial port.
+ * @implementation serial.c
+ */
+int ClosePort(SerialPort* sp);
+
+#endif
@@ -0,0 +1,311 @@
+/**
+ * @filename stats.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 30
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for the serial port
+ * statistics.
+ *
+ * Each counter has a single writer (the I/O pool, which handles one read
+ * of a port at a time, or the transmit thread), but the window thread may
+ * read or reset them at any time, so
+ * every update is interlocked and the 64-bit totals are read atomically.
+ * Latencies are kept as a histogram of power-of-two microsecond buckets,
+ * which is enough to see where percentiles fall without storing samples.
+ */
+#include "stats.h"
+
+/**
+ * Reads a 64-bit counter in one piece, even on 32-bit Windows.
+ *
+ * @param volatile LONGLONG* value  The counter.
+ * @returns The value of the counter.
+ */
+static LONGLONG StatsGet64(volatile LONGLONG* value) {
+    return InterlockedCompareExchange64(value, 0, 0);
+}
+
+/**
+ * Raises a high-water mark if a new value is above it.
+ *
+ * @param volatile LONG* max    The high-water mark.
+ * @param LONG value            The new value.
+ * @returns none
+ */
+static void StatsMax(volatile LONG* max, LONG value) {
+    LONG old = *max;
+
+    while (value > old) {
+        LONG seen = InterlockedCompareExchange(max, value, old);
+        if (seen == old) {
+            break;
+        }
+        old = seen;
+    }
+}
+
+/**
+ * Clears the counters of a port. Called when the port is opened.
+ *
+ * @param PortStats* ps     The port statistics.
+ * @returns none
+ */
+void StatsReset(PortStats* ps) {
+    LARGE_INTEGER freq;
+    DWORD i = 0;
+
+    InterlockedExchange64(&ps->bytesIn, 0);
+    InterlockedExchange64(&ps->bytesOut, 0);
+    InterlockedExchange(&ps->reads, 0);
+    InterlockedExchange(&ps->writes, 0);
+    InterlockedExchange(&ps->overruns, 0);
+    InterlockedExchange(&ps->rxOverflows, 0);
+    InterlockedExchange(&ps->frameErrors, 0);
+    InterlockedExchange(&ps->parityErrors, 0);
+    InterlockedExchange(&ps->breaks, 0);
+    InterlockedExchange(&ps->rxQueue, 0);
+    InterlockedExchange(&ps->rxQueueMax, 0);
+    InterlockedExchange(&ps->txQueue, 0);
+    InterlockedExchange(&ps->txQueueMax, 0);
+    InterlockedExchange(&ps->hostOverruns, 0);
+    for (i = 0; i < STATS_BUCKETS; i++) {
+        InterlockedExchange(&ps->latency[i], 0);
+    }
+
+    QueryPerformanceFrequency(&freq);
+    ps->frequency = freq.QuadPart;
+    ps->start = GetTickCount();
+}
+
+/**
+ * Counts a read and the line errors reported by ClearCommError with it.
+ *
+ * @param PortStats* ps     The port statistics.
+ * @param DWORD bytes       The number of bytes read.
+ * @param DWORD errors      The error flags from ClearCommError.
+ * @param DWORD inque       The number of bytes waiting in the driver.
+ * @returns none
+ */
+void StatsRead(PortStats* ps, DWORD bytes, DWORD errors, DWORD inque) {
+    if (bytes > 0) {
+        InterlockedExchangeAdd64(&ps->bytesIn, bytes);
+        InterlockedIncrement(&ps->reads);
+    }
+
+    if (errors & CE_OVERRUN) {
+        InterlockedIncrement(&ps->overruns);
+    }
+    if (errors & CE_RXOVER) {
+        InterlockedIncrement(&ps->rxOverflows);
+    }
+    if (errors & CE_FRAME) {
+        InterlockedIncrement(&ps->frameErrors);
+    }
+    if (errors & CE_RXPARITY) {
+        InterlockedIncrement(&ps->parityErrors);
+    }
+    if (errors & CE_BREAK) {
+        InterlockedIncrement(&ps->breaks);
+    }
+
+    InterlockedExchange(&ps->rxQueue, (LONG)inque);
+    StatsMax(&ps->rxQueueMax, (LONG)inque);
+}
+
+/**
+ * Counts a completed write.
+ *
+ * @param PortStats* ps     The port statistics.
+ * @param DWORD bytes       The number of bytes written.
+ * @param DWORD queued      The number of bytes still in the transmit queue.
+ * @returns none
+ */
+void StatsWrite(PortStats* ps, DWORD bytes, DWORD queued) {
+    InterlockedExchangeAdd64(&ps->bytesOut, bytes);
+    InterlockedIncrement(&ps->writes);
+
+    InterlockedExchange(&ps->txQueue, (LONG)queued);
+    /* The queue held at least this much before the write */
+    StatsMax(&ps->txQueueMax, (LONG)(queued + bytes));
+}
+
+/**
+ * Counts received bytes dropped on the way through the decoder host,
+ * because it fell too far behind, it broke the ring, or what it decoded
+ * could not be passed on to the session.
+ *
+ * @param PortStats* ps     The port statistics.
+ * @param DWORD bytes       The number of bytes dropped.
+ * @returns none
+ */
+void StatsDropped(PortStats* ps, DWORD bytes) {
+    InterlockedExchangeAdd(&ps->hostOverruns, (LONG)bytes);
+}
+
+/**
+ * Records the time taken to receive and paint a block of data.
+ *
+ * @param PortStats* ps     The port statistics.
+ * @param LONGLONG ticks    The elapsed performance counter ticks.
+ * @returns none
+ */
+void StatsLatency(PortStats* ps, LONGLONG ticks) {
+    ULONGLONG us = 0;
+    DWORD bucket = 0;
+
+    if (ps->frequency == 0 || ticks < 0) {
+        return;
+    }
+
+    us = ((ULONGLONG)ticks * 1000000) / (ULONGLONG)ps->frequency;
+    while (bucket < STATS_BUCKETS - 1 && us >= ((ULONGLONG)1 << bucket)) {
+        bucket++;
+    }
+
+    InterlockedIncrement(&ps->latency[bucket]);
+}
+
+/**
+ * Estimates a latency percentile. The result is the upper bound of the
+ * bucket the percentile falls in, so it is accurate to a factor of two.
+ *
+ * @param PortStats* ps     The port statistics.
+ * @param DWORD percent     The percentile, from 1 to 100.
+ * @returns The latency in microseconds, or 0 if nothing has been measured.
+ */
+DWORD StatsPercentile(PortStats* ps, DWORD percent) {
+    LONG counts[STATS_BUCKETS];
+    ULONGLONG total = 0;
+    ULONGLONG target = 0;
+    ULONGLONG seen = 0;
+    DWORD i = 0;
+
+    for (i = 0; i < STATS_BUCKETS; i++) {
+        counts[i] = ps->latency[i];
+        total += counts[i];
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    target = (total * percent + 99) / 100;
+    for (i = 0; i < STATS_BUCKETS - 1; i++) {
+        seen += counts[i];
+        if (seen >= target) {
+            break;
+        }
+    }
+
+    return (DWORD)1 << i;
+}
+
+/**
+ * Describes the counters of a port, one group per line.
+ *
+ * @param PortStats* ps     The port statistics.
+ * @param LPTSTR text       Receives the description.
+ * @param size_t len        The size of text in characters.
+ * @returns none
+ */
+void StatsFormat(PortStats* ps, LPTSTR text, size_t len) {
+    LONGLONG in = StatsGet64(&ps->bytesIn);
+    LONGLONG out = StatsGet64(&ps->bytesOut);
+    LONG reads = ps->reads;
+    LONG samples = 0;
+    DWORD elapsed = GetTickCount() - ps->start;
+    DWORD i = 0;
+
+    for (i = 0; i < STATS_BUCKETS; i++) {
+        samples += ps->latency[i];
+    }
+
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+
+    StringCchPrintf(text, len,
+            TEXT("Bytes in: %I64d (%I64d bytes/sec)\r\n")
+            TEXT("Bytes out: %I64d (%I64d bytes/sec)\r\n")
+            TEXT("Reads: %ld (%lu/sec, %I64d bytes each)\r\n")
+            TEXT("Writes: %ld\r\n")
+            TEXT("Overruns: %ld  Buffer overflows: %ld  Decoder overruns: %ld bytes\r\n")
+            TEXT("Framing errors: %ld  Parity errors: %ld  Breaks: %ld\r\n")
+            TEXT("Receive queue: %ld bytes (peak %ld)\r\n")
+            TEXT("Transmit queue: %ld bytes (peak %ld)\r\n")
+            TEXT("Receive to paint: 50%% < %lu us, 90%% < %lu us, 99%% < %lu us (%ld samples)\r\n"),
+            in, (in * 1000) / elapsed,
+            out, (out * 1000) / elapsed,
+            reads, (DWORD)(((ULONGLONG)reads * 1000) / elapsed),
+            (reads > 0) ? in / reads : 0,
+            ps->writes,
+            ps->overruns, ps->rxOverflows, ps->hostOverruns,
+            ps->frameErrors, ps->parityErrors, ps->breaks,
+            ps->rxQueue, ps->rxQueueMax,
+            ps->txQueue, ps->txQueueMax,
+            StatsPercentile(ps, 50), StatsPercentile(ps, 90),
+            StatsPercentile(ps, 99), samples);
+}
+
+/**
+ * Appends the counters of a port to a file, with the time they were taken
+ * and the full latency histogram.
+ *
+ * @param PortStats* ps     The port statistics.
+ * @param LPCTSTR path      The file to append to.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int StatsDump(PortStats* ps, LPCTSTR path) {
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    SYSTEMTIME now;
+    TCHAR text[2048];
+    CHAR data[2048];
+    size_t used = 0;
+    DWORD len = 0;
+    DWORD written = 0;
+    DWORD i = 0;
+
+    GetLocalTime(&now);
+    StringCchPrintf(text, 2048, TEXT("%04u-%02u-%02u %02u:%02u:%02u\r\n"),
+            now.wYear, now.wMonth, now.wDay,
+            now.wHour, now.wMinute, now.wSecond);
+
+    StringCchLength(text, 2048, &used);
+    StatsFormat(ps, text + used, 2048 - used);
+
+    for (i = 0; i < STATS_BUCKETS; i++) {
+        if (ps->latency[i] > 0) {
+            StringCchLength(text, 2048, &used);
+            StringCchPrintf(text + used, 2048 - used,
+                    TEXT("  < %lu us: %ld\r\n"), (DWORD)1 << i, ps->latency[i]);
+        }
+    }
+    StringCchCat(text, 2048, TEXT("\r\n"));
+
+#ifdef UNICODE
+    len = WideCharToMultiByte(CP_ACP, 0, text, -1, data, 2048, NULL, NULL);
+    if (len == 0) {
+        return 1;
+    }
+    len--;
+#else
+    StringCchCopyA(data, 2048, text);
+    len = (DWORD)strlen(data);
+#endif
+
+    hFile = CreateFile(path, FILE_APPEND_DATA, FILE_SHARE_READ, NULL,
+            OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return 2;
+    }
+
+    if (!WriteFile(hFile, data, len, &written, NULL) || written != len) {
+        CloseHandle(hFile);
+        return 3;
+    }
+
+    CloseHandle(hFile);
+    return 0;
+}
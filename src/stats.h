@@ -0,0 +1,114 @@
+/**
+ * @filename stats.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 30
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the serial port
+ * statistics: byte and call counts, line errors, queue depths and the time
+ * from data arriving to it being painted.
+ *
+ * Counters are updated by the read and transmit threads with interlocked
+ * operations and read by the window thread without taking a lock.
+ */
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+
+/* Latency buckets; bucket n counts samples under 2^n microseconds */
+#define STATS_BUCKETS 32
+
+/**
+ * The PortStats structure contains the counters for one serial port.
+ *
+ * @member LONGLONG bytesIn         The number of bytes read
+ * @member LONGLONG bytesOut        The number of bytes written
+ * @member LONG reads               The number of reads that returned data
+ * @member LONG writes              The number of writes completed
+ * @member LONG overruns            Characters lost by the UART (CE_OVERRUN)
+ * @member LONG rxOverflows         Characters lost by the driver (CE_RXOVER)
+ * @member LONG frameErrors         Framing errors (CE_FRAME)
+ * @member LONG parityErrors        Parity errors (CE_RXPARITY)
+ * @member LONG breaks              Breaks detected (CE_BREAK)
+ * @member LONG rxQueue             Bytes waiting in the driver at the last read
+ * @member LONG rxQueueMax          The most bytes seen waiting in the driver
+ * @member LONG txQueue             Bytes in the transmit queue after the last write
+ * @member LONG txQueueMax          The most bytes seen in the transmit queue
+ * @member LONG hostOverruns        Bytes dropped on the way through the decoder host
+ * @member LONG latency[]           Receive to paint times, in log2 buckets
+ * @member LONGLONG frequency       The performance counter frequency
+ * @member DWORD start              The tick count when the port was opened
+ */
+typedef struct _PortStats {
+    volatile LONGLONG bytesIn;
+    volatile LONGLONG bytesOut;
+    volatile LONG reads;
+    volatile LONG writes;
+    volatile LONG overruns;
+    volatile LONG rxOverflows;
+    volatile LONG frameErrors;
+    volatile LONG parityErrors;
+    volatile LONG breaks;
+    volatile LONG rxQueue;
+    volatile LONG rxQueueMax;
+    volatile LONG txQueue;
+    volatile LONG txQueueMax;
+    volatile LONG hostOverruns;
+    volatile LONG latency[STATS_BUCKETS];
+    LONGLONG frequency;
+    DWORD start;
+} PortStats;
+
+/**
+ * Clears the counters of a port.
+ * @implementation stats.c
+ */
+void StatsReset(PortStats* ps);
+
+/**
+ * Counts a read and the line errors reported with it.
+ * @implementation stats.c
+ */
+void StatsRead(PortStats* ps, DWORD bytes, DWORD errors, DWORD inque);
+
+/**
+ * Counts a completed write.
+ * @implementation stats.c
+ */
+void StatsWrite(PortStats* ps, DWORD bytes, DWORD queued);
+
+/**
+ * Counts received bytes dropped on the way through the decoder host.
+ * @implementation stats.c
+ */
+void StatsDropped(PortStats* ps, DWORD bytes);
+
+/**
+ * Records the time taken to receive and paint a block of data.
+ * @implementation stats.c
+ */
+void StatsLatency(PortStats* ps, LONGLONG ticks);
+
+/**
+ * Estimates a latency percentile in microseconds.
+ * @implementation stats.c
+ */
+DWORD StatsPercentile(PortStats* ps, DWORD percent);
+
+/**
+ * Describes the counters of a port.
+ * @implementation stats.c
+ */
+void StatsFormat(PortStats* ps, LPTSTR text, size_t len);
+
+/**
+ * Appends the counters of a port to a file.
+ * @implementation stats.c
+ */
+int StatsDump(PortStats* ps, LPCTSTR path);
+
+#endif
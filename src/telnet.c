@@ -0,0 +1,365 @@
+/**
+ * @filename telnet.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for the telnet protocol.
+ *
+ * Only what a terminal needs is agreed to: binary mode and suppress
+ * go-ahead both ways, echo from the server, and the terminal type and
+ * window size from this side. Everything else is refused. Answers are only
+ * sent when an option changes state, so the two sides cannot loop.
+ *
+ * None of these functions touch the connection; decoding and encoding work
+ * on buffers, and the caller sends the replies they produce.
+ */
+#include "telnet.h"
+
+/* DECODER STATES */
+enum telnet_state {
+    kTnData = 0,        /* Plain data */
+    kTnIac = 1,         /* After IAC */
+    kTnOption = 2,      /* After IAC WILL, WONT, DO or DONT */
+    kTnSb = 3,          /* Inside IAC SB ... */
+    kTnSbIac = 4,       /* After IAC inside a subnegotiation */
+    kTnCr = 5           /* After a CR, which may be followed by a NUL */
+};
+
+/**
+ * Gets whether an option is enabled.
+ *
+ * @param BYTE* set     The local or remote option bit set.
+ * @param BYTE option   The option.
+ * @returns TRUE if the option is enabled.
+ */
+static BOOLEAN TelnetGet(const BYTE* set, BYTE option) {
+    return (set[option >> 3] >> (option & 7)) & 1;
+}
+
+/**
+ * Enables or disables an option.
+ *
+ * @param BYTE* set     The local or remote option bit set.
+ * @param BYTE option   The option.
+ * @param BOOLEAN on    TRUE to enable the option.
+ * @returns none
+ */
+static void TelnetSet(BYTE* set, BYTE option, BOOLEAN on) {
+    if (on) {
+        set[option >> 3] |= (BYTE)(1 << (option & 7));
+    } else {
+        set[option >> 3] &= (BYTE)~(1 << (option & 7));
+    }
+}
+
+/**
+ * Appends bytes to the replies. A reply that does not fit is dropped
+ * whole, rather than sent in part.
+ *
+ * @param BYTE* reply       The replies.
+ * @param DWORD size        The size of the reply buffer.
+ * @param LPDWORD replied   The length of the replies so far.
+ * @param BYTE* bytes       The bytes to append.
+ * @param DWORD len         The number of bytes.
+ * @returns none
+ */
+static void TelnetReply(BYTE* reply, DWORD size, LPDWORD replied,
+        const BYTE* bytes, DWORD len) {
+    if (*replied + len > size) {
+        return;
+    }
+
+    CopyMemory(reply + *replied, bytes, len);
+    *replied += len;
+}
+
+/**
+ * Appends the window size subnegotiation to the replies.
+ *
+ * @param Telnet* tn        The telnet state.
+ * @param BYTE* reply       The replies.
+ * @param DWORD size        The size of the reply buffer.
+ * @param LPDWORD replied   The length of the replies so far.
+ * @returns none
+ */
+static void TelnetSize(Telnet* tn, BYTE* reply, DWORD size, LPDWORD replied) {
+    BYTE sb[16];
+    BYTE values[4];
+    DWORD len = 0;
+    DWORD i = 0;
+
+    values[0] = (BYTE)(tn->cols >> 8);
+    values[1] = (BYTE)tn->cols;
+    values[2] = (BYTE)(tn->rows >> 8);
+    values[3] = (BYTE)tn->rows;
+
+    sb[len++] = TN_IAC;
+    sb[len++] = TN_SB;
+    sb[len++] = TN_NAWS;
+    for (i = 0; i < 4; i++) {
+        /* A 255 in the size has to be escaped like any other */
+        if (values[i] == TN_IAC) {
+            sb[len++] = TN_IAC;
+        }
+        sb[len++] = values[i];
+    }
+    sb[len++] = TN_IAC;
+    sb[len++] = TN_SE;
+
+    TelnetReply(reply, size, replied, sb, len);
+}
+
+/**
+ * Answers an option request from the server.
+ *
+ * @param Telnet* tn        The telnet state.
+ * @param BYTE command      TN_WILL, TN_WONT, TN_DO or TN_DONT.
+ * @param BYTE option       The option.
+ * @param BYTE* reply       The replies.
+ * @param DWORD size        The size of the reply buffer.
+ * @param LPDWORD replied   The length of the replies so far.
+ * @returns none
+ */
+static void TelnetOption(Telnet* tn, BYTE command, BYTE option, BYTE* reply,
+        DWORD size, LPDWORD replied) {
+    BYTE answer[3];
+
+    answer[0] = TN_IAC;
+    answer[1] = 0;
+    answer[2] = option;
+
+    switch (command) {
+    case TN_WILL:
+        if (!TelnetGet(tn->remote, option)) {
+            if (option == TN_BINARY || option == TN_ECHO || option == TN_SGA) {
+                TelnetSet(tn->remote, option, TRUE);
+                answer[1] = TN_DO;
+            } else {
+                answer[1] = TN_DONT;
+            }
+        }
+        break;
+    case TN_WONT:
+        if (TelnetGet(tn->remote, option)) {
+            TelnetSet(tn->remote, option, FALSE);
+            answer[1] = TN_DONT;
+        }
+        break;
+    case TN_DO:
+        if (!TelnetGet(tn->local, option)) {
+            if (option == TN_BINARY || option == TN_SGA ||
+                    option == TN_TTYPE || option == TN_NAWS) {
+                TelnetSet(tn->local, option, TRUE);
+                answer[1] = TN_WILL;
+            } else {
+                answer[1] = TN_WONT;
+            }
+        }
+        break;
+    case TN_DONT:
+        if (TelnetGet(tn->local, option)) {
+            TelnetSet(tn->local, option, FALSE);
+            answer[1] = TN_WONT;
+        }
+        break;
+    }
+
+    if (answer[1] != 0) {
+        TelnetReply(reply, size, replied, answer, 3);
+    }
+
+    /* The size is sent as soon as the server asks for it */
+    if (answer[1] == TN_WILL && option == TN_NAWS) {
+        TelnetSize(tn, reply, size, replied);
+    }
+}
+
+/**
+ * Answers a subnegotiation from the server. Only a request for the
+ * terminal type is understood.
+ *
+ * @param Telnet* tn        The telnet state.
+ * @param BYTE* reply       The replies.
+ * @param DWORD size        The size of the reply buffer.
+ * @param LPDWORD replied   The length of the replies so far.
+ * @returns none
+ */
+static void TelnetSubnegotiation(Telnet* tn, BYTE* reply, DWORD size,
+        LPDWORD replied) {
+    BYTE sb[TELNET_TTYPE_MAX + 6];
+    DWORD len = 0;
+    DWORD i = 0;
+
+    /* IAC SB TTYPE SEND IAC SE */
+    if (tn->sblen < 2 || tn->sb[0] != TN_TTYPE || tn->sb[1] != 1 ||
+            !TelnetGet(tn->local, TN_TTYPE)) {
+        return;
+    }
+
+    sb[len++] = TN_IAC;
+    sb[len++] = TN_SB;
+    sb[len++] = TN_TTYPE;
+    sb[len++] = 0;
+    for (i = 0; tn->ttype[i] != 0; i++) {
+        sb[len++] = (BYTE)tn->ttype[i];
+    }
+    sb[len++] = TN_IAC;
+    sb[len++] = TN_SE;
+
+    TelnetReply(reply, size, replied, sb, len);
+}
+
+/**
+ * Sets up the telnet state for a new connection and makes the opening
+ * request, asking the server to suppress go-ahead.
+ *
+ * @param Telnet* tn        The telnet state.
+ * @param LPCSTR ttype      The terminal type to report, e.g. "VT100".
+ * @param WORD cols         The width of the terminal.
+ * @param WORD rows         The height of the terminal.
+ * @param BYTE* reply       Receives the opening request.
+ * @param DWORD size        The size of the reply buffer.
+ * @returns The length of the opening request.
+ */
+DWORD TelnetInit(Telnet* tn, LPCSTR ttype, WORD cols, WORD rows,
+        BYTE* reply, DWORD size) {
+    static const BYTE kOpening[] = { TN_IAC, TN_DO, TN_SGA };
+    DWORD replied = 0;
+
+    ZeroMemory(tn, sizeof(Telnet));
+    StringCchCopyA(tn->ttype, TELNET_TTYPE_MAX, ttype);
+    tn->cols = cols;
+    tn->rows = rows;
+
+    /* Counted as agreed, so the server's WILL needs no answer */
+    TelnetSet(tn->remote, TN_SGA, TRUE);
+    TelnetReply(reply, size, &replied, kOpening, sizeof(kOpening));
+
+    return replied;
+}
+
+/**
+ * Removes telnet commands from received data, in place, and answers them.
+ * Commands split across reads are picked up where they left off.
+ *
+ * @param Telnet* tn        The telnet state.
+ * @param BYTE* data        The received data; receives the plain data.
+ * @param DWORD len         The length of the received data.
+ * @param BYTE* reply       Receives the replies to send to the server.
+ * @param DWORD size        The size of the reply buffer.
+ * @param LPDWORD replied   Receives the length of the replies.
+ * @returns The length of the plain data.
+ */
+DWORD TelnetDecode(Telnet* tn, BYTE* data, DWORD len, BYTE* reply,
+        DWORD size, LPDWORD replied) {
+    DWORD in = 0;
+    DWORD out = 0;
+
+    *replied = 0;
+
+    for (in = 0; in < len; in++) {
+        BYTE c = data[in];
+
+        switch (tn->state) {
+        case kTnCr:
+            tn->state = kTnData;
+            /* Outside binary mode a bare CR is sent as CR NUL */
+            if (c == 0) {
+                break;
+            }
+            /* Fall through */
+        case kTnData:
+            if (c == TN_IAC) {
+                tn->state = kTnIac;
+            } else {
+                data[out++] = c;
+                if (c == '\r' && !TelnetGet(tn->remote, TN_BINARY)) {
+                    tn->state = kTnCr;
+                }
+            }
+            break;
+        case kTnIac:
+            switch (c) {
+            case TN_IAC:
+                data[out++] = c;
+                tn->state = kTnData;
+                break;
+            case TN_WILL:
+            case TN_WONT:
+            case TN_DO:
+            case TN_DONT:
+                tn->command = c;
+                tn->state = kTnOption;
+                break;
+            case TN_SB:
+                tn->sblen = 0;
+                tn->state = kTnSb;
+                break;
+            default:
+                /* NOP, GA, AYT and the rest carry nothing for a terminal */
+                tn->state = kTnData;
+                break;
+            }
+            break;
+        case kTnOption:
+            TelnetOption(tn, tn->command, c, reply, size, replied);
+            tn->state = kTnData;
+            break;
+        case kTnSb:
+            if (c == TN_IAC) {
+                tn->state = kTnSbIac;
+            } else if (tn->sblen < TELNET_SB_MAX) {
+                tn->sb[tn->sblen++] = c;
+            }
+            break;
+        case kTnSbIac:
+            if (c == TN_SE) {
+                TelnetSubnegotiation(tn, reply, size, replied);
+                tn->state = kTnData;
+            } else {
+                if (tn->sblen < TELNET_SB_MAX) {
+                    tn->sb[tn->sblen++] = c;
+                }
+                tn->state = kTnSb;
+            }
+            break;
+        }
+    }
+
+    return out;
+}
+
+/**
+ * Escapes data to be sent over a telnet connection: IAC is doubled, and
+ * outside binary mode a CR that is not followed by LF is sent as CR NUL.
+ *
+ * @param Telnet* tn        The telnet state.
+ * @param BYTE* data        The data to send.
+ * @param DWORD len         The length of the data.
+ * @param BYTE* out         Receives the escaped data.
+ * @param DWORD size        The size of out; twice len always fits.
+ * @param LPDWORD used      Receives how much of the data was escaped.
+ * @returns The length of the escaped data.
+ */
+DWORD TelnetEncode(Telnet* tn, const BYTE* data, DWORD len, BYTE* out,
+        DWORD size, LPDWORD used) {
+    BOOLEAN binary = TelnetGet(tn->local, TN_BINARY);
+    DWORD in = 0;
+    DWORD o = 0;
+
+    for (in = 0; in < len && o + 2 <= size; in++) {
+        BYTE c = data[in];
+
+        out[o++] = c;
+        if (c == TN_IAC) {
+            out[o++] = TN_IAC;
+        } else if (c == '\r' && !binary && (in + 1 == len || data[in + 1] != '\n')) {
+            out[o++] = 0;
+        }
+    }
+
+    *used = in;
+    return o;
+}
@@ -0,0 +1,87 @@
+/**
+ * @filename telnet.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the telnet
+ * protocol (RFC 854), used to talk to terminal servers.
+ */
+#ifndef _TELNET_H_
+#define _TELNET_H_
+
+#include <Windows.h>
+#include <strsafe.h>
+
+/* Commands */
+#define TN_SE 240
+#define TN_NOP 241
+#define TN_SB 250
+#define TN_WILL 251
+#define TN_WONT 252
+#define TN_DO 253
+#define TN_DONT 254
+#define TN_IAC 255
+
+/* Options */
+#define TN_BINARY 0
+#define TN_ECHO 1
+#define TN_SGA 3
+#define TN_TTYPE 24
+#define TN_NAWS 31
+
+/* Longest subnegotiation kept; longer ones are cut short */
+#define TELNET_SB_MAX 64
+/* Longest terminal type name */
+#define TELNET_TTYPE_MAX 32
+
+/**
+ * The Telnet structure contains the state of the telnet protocol on one
+ * connection: where the decoder is in a command, and which options each
+ * side has agreed to.
+ *
+ * @member BYTE state       Where the decoder is in a command
+ * @member BYTE command     The WILL, WONT, DO or DONT being decoded
+ * @member BYTE sb[]        The subnegotiation being decoded
+ * @member DWORD sblen      The length of sb
+ * @member BYTE local[]     Bit set of options enabled on this side
+ * @member BYTE remote[]    Bit set of options enabled on the server
+ * @member CHAR ttype[]     The terminal type sent to the server
+ * @member WORD cols        The window width sent to the server
+ * @member WORD rows        The window height sent to the server
+ */
+typedef struct _Telnet {
+    BYTE state;
+    BYTE command;
+    BYTE sb[TELNET_SB_MAX];
+    DWORD sblen;
+    BYTE local[32];
+    BYTE remote[32];
+    CHAR ttype[TELNET_TTYPE_MAX];
+    WORD cols;
+    WORD rows;
+} Telnet;
+
+/**
+ * Sets up the telnet state for a new connection.
+ * @implementation telnet.c
+ */
+DWORD TelnetInit(Telnet* tn, LPCSTR ttype, WORD cols, WORD rows,
+        BYTE* reply, DWORD size);
+
+/**
+ * Removes telnet commands from received data and answers them.
+ * @implementation telnet.c
+ */
+DWORD TelnetDecode(Telnet* tn, BYTE* data, DWORD len, BYTE* reply,
+        DWORD size, LPDWORD replied);
+
+/**
+ * Escapes data to be sent over a telnet connection.
+ * @implementation telnet.c
+ */
+DWORD TelnetEncode(Telnet* tn, const BYTE* data, DWORD len, BYTE* out,
+        DWORD size, LPDWORD used);
+
+#endif
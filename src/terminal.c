@@ -1,227 +1,1647 @@
-/**
- * @filename terminal.c
- * @author Darryl Pogue
- * @designer Darryl Pogue
- * @date 2010 11 10
- * @project Terminal Emulator
- *
- * This file contains the implementations of all general (mode, error handling,
- * and threading) functions for the terminal emulator.
- */
-#include "terminal.h"
-#include "emulation_none.h"
-
-/**
- * Reports a system error to the user in a MessageBox.
- *
- * @param DWORD dwError     The system error number, often retrieved with
- *                          GetLastError()
- * @returns none
- *
- * Code largely duplicated from
- * @reference http://msdn.microsoft.com/en-us/library/ms679351(VS.85).aspx
- */
-void ReportError(DWORD dwError) {
-    LPVOID lpMsgBuf = NULL;
-
-    FormatMessage(
-        FORMAT_MESSAGE_ALLOCATE_BUFFER |
-        FORMAT_MESSAGE_FROM_SYSTEM |
-        FORMAT_MESSAGE_IGNORE_INSERTS,
-        NULL,
-        dwError,
-        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
-        (LPTSTR)&lpMsgBuf,
-        0, NULL);
-
-    MessageBox(NULL, (LPCTSTR)lpMsgBuf, APPNAME, MB_ICONERROR);
-
-    LocalFree(lpMsgBuf);
-}
-
-/**
- * Enters command mode, closing any open ports and enabling the connect menu.
- *
- * @param HWND hwnd   The handle to the application window.
- * @return none
- */
-void CommandMode(HWND hwnd) {
-    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
-    HMENU menubar = GetMenu(hwnd);
-    HMENU connectmenu = CreateMenu();
-    DWORD ports[10] = {0, 1, 2, 3, 4};
-    DWORD max = 5;
-    DWORD i = 0;
-
-    /* If a port is already open, we should close it */
-    if (ti->dwMode == kModeConnect) {
-        if (EMULATOR_HAS_FUNC(ti->hEmulator[ti->e_idx], on_disconnect)) {
-            ti->hEmulator[ti->e_idx]->on_disconnect(
-                (LPVOID)ti->hEmulator[ti->e_idx]->emulator_data);
-        }
-
-        ti->dwMode = kModeCommand;
-        if (ClosePort(&ti->hCommDev) != 0) {
-            DWORD dwError = GetLastError();
-            ReportError(dwError);
-        }
-    }
-
-    EnableMenuItem(menubar, ID_DISCONNECT, MF_GRAYED);
-
-    /* In an ideal world, there would be an easy way to get a list of all
-       available COM ports */
-    for (i = 0; i < max; i++) {
-        TCHAR name[32];
-        MENUITEMINFO mii;
-
-        _stprintf_s(name, 32, TEXT("Communication Port COM&%d"), ports[i]);
-
-        mii.cbSize = sizeof(MENUITEMINFO);
-        mii.fMask = MIIM_ID | MIIM_STRING | MIIM_FTYPE | MIIM_STATE;
-        mii.fType = MFT_STRING;
-        mii.fState = MFS_ENABLED;
-        mii.wID = ID_COM_START + ports[i];
-        mii.dwTypeData = name;
-
-        InsertMenuItem(connectmenu, i, TRUE, &mii);
-        EnableMenuItem(menubar, ID_COM_START + ports[i], MF_ENABLED);
-    }
-
-    for (i = 0; i < ti->e_count; i++) {
-        EnableMenuItem(menubar, ID_EMU_START + i, MF_ENABLED);
-    }
-
-    ModifyMenu(menubar, ID_CONNECT, MF_BYCOMMAND | MF_POPUP, (UINT_PTR)connectmenu, TEXT("&Connect"));
-    EnableMenuItem(menubar, ID_CONNECT, MF_GRAYED);
-
-    ti->dwMode = kModeCommand;
-}
-
-/**
- * The thread procedure for reading characters from the serial port in a loop
- *
- * @param LPVOID lpParameter    Pointer to a structure of data
- * @returns 0 if the thread exited successfully.
- */
-static DWORD WINAPI ReadLoop(LPVOID lpParameter) {
-    TermInfo* ti = (TermInfo*)lpParameter;
-
-    while (ti->dwMode == kModeConnect) {
-        if (ReadData(&ti->hCommDev, ti->hwnd) != 0) {
-            DWORD dwError = GetLastError();
-            ReportError(dwError);
-        }
-    }
-
-    return 0;
-}
-
-/**
- * Enters connect mode, connecting to the specified port number.
- *
- * @param HWND hwnd     The handle to the application window
- * @param DWORD port    The number of the COM port to open
- * @returns none
- */
-void ConnectMode(HWND hwnd, DWORD port) {
-    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
-    HMENU menubar = GetMenu(hwnd);
-    TCHAR comport[8];
-    DWORD i = 0;
-
-    _stprintf_s(comport, 8, TEXT("COM%d"), port);
-
-    if (OpenPort(comport, &ti->hCommDev, ti->hwnd) != 0) {
-        DWORD dwError = GetLastError();
-        ReportError(dwError);
-        CommandMode(hwnd);
-        return;
-    }
-
-    EnableMenuItem(menubar, ID_DISCONNECT, MF_ENABLED);
-    EnableMenuItem(menubar, ID_CONNECT, MF_GRAYED);
-    for (i = 0; i < 256; i++) {
-        EnableMenuItem(menubar, ID_COM_START + i, MF_GRAYED);
-    }
-    ti->dwMode = kModeConnect;
-
-    InvalidateRect(hwnd, NULL, TRUE);
-
-    ti->hReadLoop = CreateThread(NULL, 0, &ReadLoop, (LPVOID)ti, 0, 0);
-
-    if (EMULATOR_HAS_FUNC(ti->hEmulator[ti->e_idx], on_connect)) {
-        ti->hEmulator[ti->e_idx]->on_connect((LPVOID)ti->hEmulator[ti->e_idx]->emulator_data);
-    }
-}
-
-Emulator* FindPlugins(HWND hwnd, TermInfo* ti) {
-    WIN32_FIND_DATA ffd;
-    TCHAR szAppPath[MAX_PATH];
-    TCHAR szDir[MAX_PATH];
-    HANDLE hFind = INVALID_HANDLE_VALUE;
-    DWORD i = 1;
-
-    ti->hEmulator = (Emulator**)malloc(sizeof(Emulator)* 8);
-    ti->hEmulator[0] = none_init(hwnd);
-    ti->e_idx = 0;
-    ti->e_count = 1;
-
-    GetModuleFileName(0, szAppPath, sizeof(szAppPath) - 1);
-    StringCchCopy(szDir, _tcsrchr(szAppPath, '\\') - szAppPath + 1, szAppPath);
-    StringCchCat(szDir, MAX_PATH, TEXT("\\emulation\\"));
-
-    StringCchCopy(szAppPath, MAX_PATH, szDir);
-    StringCchCat(szDir, MAX_PATH, TEXT("*.dll"));
-
-    hFind = FindFirstFile(szDir, &ffd);
-    if (INVALID_HANDLE_VALUE == hFind) {
-        DWORD dwError = GetLastError();
-        ReportError(dwError);
-        return NULL;
-    }
-
-    do
-    {
-        if ((ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
-            TCHAR plgName[MAX_PATH];
-            HMODULE lib;
-            typedef BOOLEAN (*init_plugin)(HWND hwnd, Emulator** e);
-
-            StringCchCopy(plgName, MAX_PATH, szAppPath);
-            StringCchCat(plgName, MAX_PATH, ffd.cFileName);
-
-            if ((lib = LoadLibrary(plgName)) != 0) {
-                init_plugin ip = (init_plugin)GetProcAddress(lib, "emulator_init_plugin");
-                if (ip != NULL) {
-                    Emulator* e = (Emulator*)malloc(sizeof(Emulator));
-                    if (ip(hwnd, &e)) {
-                        LoadPlugin(hwnd, e, i);
-                        ti->hEmulator[i] = e;
-                        i++;
-                        ti->e_count++;
-                    }
-                }
-            }
-        }
-    }
-    while (FindNextFile(hFind, &ffd) != 0);
-
-    FindClose(hFind);
-
-    return NULL;
-}
-
-void LoadPlugin(HWND hwnd, Emulator* emu, DWORD i) {
-    HMENU menubar = GetMenu(hwnd);
-    HMENU emulation = GetSubMenu(menubar, 1);
-    MENUITEMINFO mii;
-    mii.cbSize = sizeof(MENUITEMINFO);
-    mii.fMask = MIIM_ID | MIIM_STRING | MIIM_FTYPE | MIIM_STATE;
-    mii.fType = MFT_STRING;
-    mii.fState = MFS_ENABLED;
-    mii.wID = ID_EMU_START + i;
-    mii.dwTypeData = (LPTSTR)emu->emulation_name();
-
-    InsertMenuItem(emulation, 1, TRUE, &mii);
-}
+/**
+ * @filename terminal.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 10
+ * @project Terminal Emulator
+ *
+ * This file contains the implementations of all general (session, mode,
+ * error handling, and threading) functions for the terminal emulator.
+ *
+ * Each session is a child window of the application window, shown under
+ * its own tab, with its own TermInfo, port and emulator instance. Only the
+ * session shown has the menu; the others keep their state and update it
+ * when they are shown again.
+ */
+#include "terminal.h"
+#include "emulation_none.h"
+
+/**
+ * Reports a system error to the user in a MessageBox.
+ *
+ * @param DWORD dwError     The system error number, often retrieved with
+ *                          GetLastError()
+ * @returns none
+ *
+ * Code largely duplicated from
+ * @reference http://msdn.microsoft.com/en-us/library/ms679351(VS.85).aspx
+ */
+void ReportError(DWORD dwError) {
+    LPVOID lpMsgBuf = NULL;
+
+    FormatMessage(
+        FORMAT_MESSAGE_ALLOCATE_BUFFER |
+        FORMAT_MESSAGE_FROM_SYSTEM |
+        FORMAT_MESSAGE_IGNORE_INSERTS,
+        NULL,
+        dwError,
+        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+        (LPTSTR)&lpMsgBuf,
+        0, NULL);
+
+    MessageBox(NULL, (LPCTSTR)lpMsgBuf, APPNAME, MB_ICONERROR);
+
+    LocalFree(lpMsgBuf);
+}
+
+/**
+ * Gets the position of a session in the application window's tabs.
+ *
+ * @param TermInfo* ti  The session.
+ * @returns The index of the session, or the session count if it has none.
+ */
+static DWORD SessionIndex(TermInfo* ti) {
+    DWORD i;
+
+    for (i = 0; i < ti->frame->count; i++) {
+        if (ti->frame->sessions[i] == ti) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/**
+ * Gives back a session's emulator instance. The shared instance of a plugin
+ * older than version 5 belongs to the registry, which leaves it alone.
+ *
+ * @param TermInfo* ti  The session.
+ * @returns none
+ */
+static void ReleaseEmulator(TermInfo* ti) {
+    PluginDestroy(&ti->frame->plugins, ti->e_idx, ti->emu);
+    ti->emu = NULL;
+}
+
+/**
+ * Opens a new session in a new tab, in command mode with no emulator, and
+ * shows it.
+ *
+ * @param FrameInfo* frame  The application window.
+ * @returns The new session, or NULL if it could not be made.
+ */
+TermInfo* OpenSession(FrameInfo* frame) {
+    TermInfo* ti = NULL;
+    HWND hwnd = NULL;
+    TCITEM tie;
+    DWORD i = 0;
+
+    if (frame->count == frame->capacity) {
+        DWORD capacity = (frame->capacity == 0) ? SESSION_GROW : frame->capacity * 2;
+        TermInfo** sessions = (TermInfo**)realloc(frame->sessions,
+                sizeof(TermInfo*) * capacity);
+
+        if (sessions == NULL) {
+            return NULL;
+        }
+        frame->sessions = sessions;
+        frame->capacity = capacity;
+    }
+
+    hwnd = CreateWindow(SESSION_CLASS, APPNAME, WS_CHILD | WS_CLIPSIBLINGS,
+            0, 0, 0, 0, frame->hwnd, NULL,
+            (HINSTANCE)GetWindowLongPtr(frame->hwnd, GWLP_HINSTANCE),
+            (LPVOID)frame);
+    if (hwnd == NULL) {
+        return NULL;
+    }
+
+    ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    i = frame->count;
+    frame->sessions[frame->count++] = ti;
+
+    tie.mask = TCIF_TEXT;
+    tie.pszText = TEXT("Not connected");
+    TabCtrl_InsertItem(frame->hTabs, i, &tie);
+
+    SelectEmulator(hwnd, 0);
+    if (ti->emu == NULL) {
+        CloseSession(frame, i);
+        return NULL;
+    }
+
+    CommandMode(hwnd);
+    ShowSession(frame, i);
+
+    return ti;
+}
+
+/**
+ * Closes a session: its port is closed, its emulator instance freed, and
+ * its tab removed. The next tab along is shown in its place.
+ *
+ * @param FrameInfo* frame  The application window.
+ * @param DWORD i           The index of the session.
+ * @returns none
+ */
+void CloseSession(FrameInfo* frame, DWORD i) {
+    TermInfo* ti = NULL;
+
+    if (i >= frame->count) {
+        return;
+    }
+
+    ti = frame->sessions[i];
+    /* The port is only waiting for a benchmark; nothing to reconnect */
+    BenchStop(&ti->bench);
+    CommandMode(ti->hwnd);
+    CaptureStop(&ti->capture);
+    HostStop(&ti->host);
+    if (ti->hStats != NULL) {
+        /* Owned by the application window, so not destroyed with the session */
+        DestroyWindow(ti->hStats);
+    }
+    ReleaseEmulator(ti);
+    TxQueueFree(&ti->held);
+
+    MoveMemory(&frame->sessions[i], &frame->sessions[i + 1],
+            sizeof(TermInfo*) * (frame->count - i - 1));
+    frame->count--;
+    TabCtrl_DeleteItem(frame->hTabs, i);
+
+    DestroyWindow(ti->hwnd);
+    free(ti);
+
+    if (frame->count > 0) {
+        ShowSession(frame, (frame->active > i) ? frame->active - 1
+                : min(frame->active, frame->count - 1));
+    }
+}
+
+/**
+ * Shows a session, hiding the others, and sets the menus for it.
+ *
+ * @param FrameInfo* frame  The application window.
+ * @param DWORD i           The index of the session.
+ * @returns none
+ */
+void ShowSession(FrameInfo* frame, DWORD i) {
+    DWORD j;
+
+    if (i >= frame->count) {
+        return;
+    }
+
+    frame->active = i;
+    TabCtrl_SetCurSel(frame->hTabs, i);
+    LayoutSessions(frame);
+
+    for (j = 0; j < frame->count; j++) {
+        ShowWindow(frame->sessions[j]->hwnd, (j == i) ? SW_SHOW : SW_HIDE);
+    }
+
+    SetFocus(frame->sessions[i]->hwnd);
+    SyncSession(frame->sessions[i]->hwnd);
+}
+
+/**
+ * Fits the tab control to the application window, and the sessions to the
+ * display area of the tab control.
+ *
+ * @param FrameInfo* frame  The application window.
+ * @returns none
+ */
+void LayoutSessions(FrameInfo* frame) {
+    RECT r;
+    DWORD i;
+
+    GetClientRect(frame->hwnd, &r);
+    MoveWindow(frame->hTabs, 0, 0, r.right, r.bottom, TRUE);
+    TabCtrl_AdjustRect(frame->hTabs, FALSE, &r);
+
+    for (i = 0; i < frame->count; i++) {
+        MoveWindow(frame->sessions[i]->hwnd, r.left, r.top,
+                r.right - r.left, r.bottom - r.top, TRUE);
+    }
+}
+
+/**
+ * Tells whether a session is the one shown.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @returns TRUE if the session is shown.
+ */
+BOOLEAN SessionShown(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    FrameInfo* frame = ti->frame;
+
+    return frame->active < frame->count && frame->sessions[frame->active] == ti;
+}
+
+/**
+ * Gets the menu of a session. The menu belongs to the application window,
+ * and only the session shown may change it.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @returns The menu, or NULL if the session is not shown.
+ */
+HMENU SessionMenu(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    if (!SessionShown(hwnd)) {
+        return NULL;
+    }
+
+    return GetMenu(ti->frame->hwnd);
+}
+
+/**
+ * Brings the session's tab up to date with its mode, and if it is the
+ * session shown, the caption and menus too. Called whenever the mode
+ * changes and when the session is shown.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @returns none
+ */
+void SyncSession(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    FrameInfo* frame = ti->frame;
+    HMENU menubar = SessionMenu(hwnd);
+    UINT connected = (ti->dwMode == kModeConnect ||
+            ti->dwMode == kModeReconnect) ? MF_ENABLED : MF_GRAYED;
+    TCHAR title[SERIAL_NAME + 64];
+    TCITEM tie;
+    DWORD i = 0;
+
+    /* The tab shows what the session is connected to */
+    tie.mask = TCIF_TEXT;
+    tie.pszText = (ti->dwMode == kModeCommand) ? TEXT("Not connected")
+            : (LPTSTR)PortShortName(ti->port.name);
+    TabCtrl_SetItem(frame->hTabs, SessionIndex(ti), &tie);
+
+    if (menubar == NULL) {
+        return;
+    }
+
+    GetWindowText(hwnd, title, SERIAL_NAME + 64);
+    SetWindowText(frame->hwnd, title);
+
+    EnableMenuItem(menubar, ID_DISCONNECT, connected);
+    EnableMenuItem(menubar, ID_SENDFILE, connected);
+    EnableMenuItem(menubar, ID_PASTE, connected);
+    /* Only a COM port can be benchmarked */
+    EnableMenuItem(menubar, ID_BENCH, (connected == MF_ENABLED &&
+            ti->port.transport->type == kTransportSerial) ? MF_ENABLED : MF_GRAYED);
+    for (i = ID_ZMODEM_SEND; i <= ID_XFER_CANCEL; i++) {
+        EnableMenuItem(menubar, i, connected);
+    }
+    EnableMenuItem(menubar, ID_CLOSE_SESSION,
+            (frame->count > 1) ? MF_ENABLED : MF_GRAYED);
+    CheckMenuItem(menubar, ID_CAPTURE,
+            (ti->capture.hFile != INVALID_HANDLE_VALUE) ? MF_CHECKED : MF_UNCHECKED);
+    CheckMenuItem(menubar, ID_DECODER,
+            HostRunning(&ti->host) ? MF_CHECKED : MF_UNCHECKED);
+
+    /* Flow control and the emulator are chosen for each session */
+    if (ti->dwFlow == kFlowPort) {
+        for (i = ID_FLOW_NONE; i <= ID_FLOW_XONXOFF; i++) {
+            CheckMenuItem(menubar, i, MF_UNCHECKED);
+        }
+    } else {
+        CheckMenuRadioItem(menubar, ID_FLOW_NONE, ID_FLOW_XONXOFF,
+                ID_FLOW_NONE + (ti->dwFlow - kFlowNone), MF_BYCOMMAND);
+    }
+    for (i = 0; i < frame->plugins.count; i++) {
+        CheckMenuItem(menubar, ID_EMU_START + i,
+                (i == ti->e_idx) ? MF_CHECKED : MF_UNCHECKED);
+    }
+
+    UpdatePorts(hwnd);
+    UpdateProfiles(hwnd);
+}
+
+/**
+ * Enters command mode, closing any open ports and enabling the connect menu.
+ *
+ * @param HWND hwnd   The handle to the application window.
+ * @return none
+ */
+void CommandMode(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    /* If a port is already open, we should close it */
+    if (ti->dwMode == kModeConnect || ti->dwMode == kModeReconnect) {
+        IoPoolDetach(&ti->port);
+        KillTimer(hwnd, RECONNECT_TIMER);
+
+        if (EMULATOR_HAS_FUNC_SINCE(CurrentEmulator(ti), on_disconnect, 3)) {
+            CurrentEmulator(ti)->on_disconnect(
+                (LPVOID)CurrentEmulator(ti)->emulator_data);
+        }
+
+        BulkSendStop(&ti->send);
+        TransferCancel(&ti->xfer, FALSE);
+        TxQueueConsume(&ti->held, ti->held.count);
+        SetWindowText(hwnd, APPNAME);
+
+        /* A port being reconnected is already closed */
+        if (ti->dwMode == kModeConnect && ClosePort(&ti->port) != 0) {
+            DWORD dwError = GetLastError();
+            ReportError(dwError);
+        }
+        ti->dwMode = kModeCommand;
+    }
+
+    ti->dwMode = kModeCommand;
+    SyncSession(hwnd);
+}
+
+/**
+ * Rebuilds the Connect menu from the serial ports present on the system.
+ * The list is cached, and only read again after a device change.
+ *
+ * @param HWND hwnd   The handle to the application window.
+ * @return none
+ */
+void UpdatePorts(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    HMENU menubar = SessionMenu(hwnd);
+    HMENU terminal = NULL;
+    HMENU connectmenu = NULL;
+    DWORD i = 0;
+
+    PortListUpdate(&ti->ports);
+
+    if (menubar == NULL) {
+        return;
+    }
+    terminal = GetSubMenu(menubar, 0);
+    connectmenu = CreatePopupMenu();
+
+    for (i = 0; i < ti->ports.count; i++) {
+        TCHAR name[96];
+        MENUITEMINFO mii;
+
+        /* The device name is shown on the right, like an accelerator */
+        StringCchPrintf(name, 96, TEXT("Communication Port COM&%lu\t%s"),
+                ti->ports.ports[i].number, ti->ports.ports[i].device);
+
+        mii.cbSize = sizeof(MENUITEMINFO);
+        mii.fMask = MIIM_ID | MIIM_STRING | MIIM_FTYPE | MIIM_STATE;
+        mii.fType = MFT_STRING;
+        mii.fState = MFS_ENABLED;
+        mii.wID = ID_COM_START + ti->ports.ports[i].number;
+        mii.dwTypeData = name;
+
+        InsertMenuItem(connectmenu, i, TRUE, &mii);
+    }
+
+    if (ti->ports.count == 0) {
+        AppendMenu(connectmenu, MF_STRING | MF_GRAYED, 0, TEXT("No ports found"));
+    }
+
+    /* The Connect item is first in the Terminal menu. Replacing it also
+       destroys the old port menu */
+    ModifyMenu(terminal, 0, MF_BYPOSITION | MF_STRING | MF_POPUP,
+            (UINT_PTR)connectmenu, TEXT("&Connect"));
+    EnableMenuItem(terminal, 0, MF_BYPOSITION |
+            ((ti->dwMode == kModeCommand) ? MF_ENABLED : MF_GRAYED));
+    DrawMenuBar(ti->frame->hwnd);
+}
+
+/**
+ * Rebuilds the Connect to Profile menu from the saved profiles. The file is
+ * read again each time, so profiles can be edited while the program runs.
+ *
+ * @param HWND hwnd   The handle to the application window.
+ * @return none
+ */
+void UpdateProfiles(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    HMENU menubar = SessionMenu(hwnd);
+    HMENU terminal = NULL;
+    HMENU profilemenu = NULL;
+    DWORD i = 0;
+
+    ti->p_count = ProfileNames(ti->profiles, PROFILE_MAX);
+
+    if (menubar == NULL) {
+        return;
+    }
+    terminal = GetSubMenu(menubar, 0);
+    profilemenu = CreatePopupMenu();
+
+    for (i = 0; i < ti->p_count; i++) {
+        AppendMenu(profilemenu, MF_STRING, ID_PROFILE_START + i,
+                ti->profiles[i]);
+    }
+
+    if (ti->p_count == 0) {
+        AppendMenu(profilemenu, MF_STRING | MF_GRAYED, 0,
+                TEXT("No profiles found"));
+    }
+
+    /* The Connect to Profile item is second in the Terminal menu */
+    ModifyMenu(terminal, 1, MF_BYPOSITION | MF_STRING | MF_POPUP,
+            (UINT_PTR)profilemenu, TEXT("Connect to &Profile"));
+    EnableMenuItem(terminal, 1, MF_BYPOSITION |
+            ((ti->dwMode == kModeCommand) ? MF_ENABLED : MF_GRAYED));
+    DrawMenuBar(ti->frame->hwnd);
+}
+
+/**
+ * Starts the session on a port that has just been opened: sets the menus
+ * for connect mode, starts reading the port on the I/O pool and tells the
+ * emulator. The session only enters connect mode once the port is
+ * attached; if it can't be, the port is closed again.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @param DWORD port    The number of the COM port that was opened, or 0
+ *                      for a network connection
+ * @returns none
+ */
+static void StartSession(HWND hwnd, DWORD port) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    ti->dwPort = port;
+    ti->dwRetry = RECONNECT_MIN;
+
+    if (SetPortFlow(&ti->port, ti->dwFlow) != 0) {
+        /* Carry on with the flow control from the port settings */
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+    }
+
+    if (IoPoolAttach(&ti->frame->pool, &ti->port) != 0) {
+        DWORD dwError = GetLastError();
+
+        /* Never connected, so there is nothing to detach or tell the
+           emulator; only the port is closed */
+        ClosePort(&ti->port);
+        ReportError(dwError);
+        CommandMode(hwnd);
+        return;
+    }
+
+    ti->dwMode = kModeConnect;
+    SyncSession(hwnd);
+    InvalidateRect(hwnd, NULL, TRUE);
+
+    if (EMULATOR_HAS_FUNC_SINCE(CurrentEmulator(ti), on_connect, 2)) {
+        CurrentEmulator(ti)->on_connect((LPVOID)CurrentEmulator(ti)->emulator_data);
+    }
+}
+
+/**
+ * Enters connect mode, connecting to the specified port number.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @param DWORD port    The number of the COM port to open
+ * @returns none
+ */
+void ConnectMode(HWND hwnd, DWORD port) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    TCHAR comport[SERIAL_DEVICE];
+
+    PortDeviceName(port, comport, SERIAL_DEVICE);
+
+    if (OpenPort(comport, &ti->port, ti->hwnd) != 0) {
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+        CommandMode(hwnd);
+        return;
+    }
+
+    StartSession(hwnd, port);
+}
+
+/**
+ * Shows why a profile could not be connected in the title bar, for a
+ * profile opened from the command line with nobody there to dismiss a
+ * message box. Either a reason or a system error code is given.
+ *
+ * @param HWND hwnd         The handle to the application window
+ * @param LPCTSTR name      The name of the profile
+ * @param LPCTSTR reason    Why the profile failed, or NULL
+ * @param DWORD dwError     The system error code, if reason is NULL
+ * @returns none
+ */
+static void ProfileFailed(HWND hwnd, LPCTSTR name, LPCTSTR reason, DWORD dwError) {
+    TCHAR text[128];
+    TCHAR title[PROFILE_NAME + 192];
+    size_t len = 0;
+
+    if (reason == NULL) {
+        if (FormatMessage(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+                NULL, dwError, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+                text, 128, NULL) == 0) {
+            StringCchPrintf(text, 128, TEXT("error %lu"), dwError);
+        }
+
+        /* System messages end in a line break */
+        StringCchLength(text, 128, &len);
+        while (len > 0 && (text[len - 1] == '\r' || text[len - 1] == '\n')) {
+            text[--len] = 0;
+        }
+        reason = text;
+    }
+
+    StringCchPrintf(title, PROFILE_NAME + 192, TEXT("%s - %s: not connected (%s)"),
+            APPNAME, name, reason);
+    SetWindowText(hwnd, title);
+}
+
+/**
+ * Enters connect mode using the settings of a saved profile, without
+ * showing the port configuration dialog. The profile may be for a COM
+ * port or for a terminal server on the network. The profile's flow control and
+ * emulator are chosen as if picked from the menus.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @param LPCTSTR name  The name of the profile
+ * @param BOOLEAN quiet TRUE to show errors in the title bar rather than in
+ *                      a message box, for profiles opened unattended
+ * @returns 0 on success, greater than 0 otherwise
+ */
+int ConnectProfile(HWND hwnd, LPCTSTR name, BOOLEAN quiet) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    Profile profile;
+    TCHAR comport[SERIAL_DEVICE];
+    int ret = 0;
+
+    if (ti->dwMode != kModeCommand) {
+        return 1;
+    }
+
+    if (ProfileLoad(name, &profile) != 0) {
+        TCHAR text[128];
+
+        if (quiet) {
+            ProfileFailed(hwnd, name, TEXT("no such profile"), 0);
+            return 2;
+        }
+
+        StringCchPrintf(text, 128, TEXT("There is no profile named \"%s\" in %s."),
+                name, PROFILE_FILE);
+        MessageBox(hwnd, text, APPNAME, MB_ICONERROR);
+        return 2;
+    }
+
+    if (profile.flow != kFlowPort) {
+        SetFlowControl(hwnd, profile.flow);
+    }
+
+    if (profile.emulator[0] != 0) {
+        DWORD idx = PluginFind(&ti->frame->plugins, profile.emulator);
+
+        if (idx != PLUGIN_NONE) {
+            SelectEmulator(hwnd, idx);
+        }
+    }
+
+    if (profile.host[0] != 0) {
+        /* The terminal type is the emulator's name */
+        LPCTSTR ttype = (ti->e_idx == 0) ? TEXT("DUMB")
+                : ti->frame->plugins.plugins[ti->e_idx].name;
+
+        ret = OpenNet(profile.host, &ti->port, ti->hwnd, profile.telnet,
+                profile.nodelay, profile.rxqueue, profile.txqueue, ttype);
+    } else {
+        PortDeviceName(profile.port, comport, SERIAL_DEVICE);
+
+        ret = OpenPortSettings(comport, &ti->port, ti->hwnd, profile.settings,
+                profile.rxqueue, profile.txqueue, &profile.timeouts);
+    }
+
+    if (ret != 0) {
+        DWORD dwError = GetLastError();
+
+        if (quiet) {
+            CommandMode(hwnd);
+            ProfileFailed(hwnd, name, NULL, dwError);
+        } else {
+            ReportError(dwError);
+            CommandMode(hwnd);
+        }
+        return 3;
+    }
+
+    StartSession(hwnd, profile.port);
+    return 0;
+}
+
+/**
+ * Shows that the port has been lost and sets the timer for the next
+ * attempt to reopen it.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @returns none
+ */
+static void ScheduleReconnect(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    TCHAR title[SERIAL_NAME + 64];
+
+    StringCchPrintf(title, SERIAL_NAME + 64, TEXT("%s - %s lost, retrying in %lu.%lu s"),
+            APPNAME, PortShortName(ti->port.name), ti->dwRetry / 1000, (ti->dwRetry % 1000) / 100);
+    SetWindowText(hwnd, title);
+
+    SetTimer(hwnd, RECONNECT_TIMER, ti->dwRetry, NULL);
+}
+
+/**
+ * Handles the loss of the serial port, usually because a USB adapter was
+ * unplugged. The port is closed and reopened on a timer, backing off from
+ * RECONNECT_MIN to RECONNECT_MAX between attempts. The emulator is left
+ * alone, so the screen is kept for when the port comes back.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @returns none
+ */
+void PortLost(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    /* Both the I/O pool and a device notice may report the same loss */
+    if (ti->dwMode != kModeConnect) {
+        return;
+    }
+
+    IoPoolDetach(&ti->port);
+    BulkSendStop(&ti->send);
+    TransferCancel(&ti->xfer, FALSE);
+    TxQueueConsume(&ti->held, ti->held.count);
+    ClosePort(&ti->port);
+
+    ti->dwMode = kModeReconnect;
+    ti->dwRetry = RECONNECT_MIN;
+    ScheduleReconnect(hwnd);
+}
+
+/**
+ * Tries to reopen a lost serial port with the settings it had before.
+ * Called by the reconnect timer, and when a port device is plugged in.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @returns none
+ */
+void Reconnect(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    KillTimer(hwnd, RECONNECT_TIMER);
+
+    if (ti->dwMode != kModeReconnect) {
+        return;
+    }
+
+    if (ReopenPort(&ti->port, ti->hwnd) != 0) {
+        ti->dwRetry = (ti->dwRetry * 2 > RECONNECT_MAX)
+                ? RECONNECT_MAX : ti->dwRetry * 2;
+        ScheduleReconnect(hwnd);
+        return;
+    }
+
+    ti->dwMode = kModeConnect;
+    ti->dwRetry = RECONNECT_MIN;
+    SetWindowText(hwnd, APPNAME);
+
+    if (IoPoolAttach(&ti->frame->pool, &ti->port) != 0) {
+        PortLost(hwnd);
+    }
+}
+
+/**
+ * Asks for a file and starts sending it out the serial port. The rest of
+ * the file is queued as the transmit thread reports each completed write.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @returns none
+ */
+void SendFile(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    OPENFILENAME ofn;
+    TCHAR szFile[MAX_PATH];
+
+    if (ti->dwMode != kModeConnect) {
+        return;
+    }
+
+    szFile[0] = 0;
+    ZeroMemory(&ofn, sizeof(OPENFILENAME));
+    ofn.lStructSize = sizeof(OPENFILENAME);
+    ofn.hwndOwner = hwnd;
+    ofn.lpstrFilter = TEXT("All Files\0*.*\0");
+    ofn.lpstrFile = szFile;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.lpstrTitle = TEXT("Send File");
+    ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST;
+
+    if (!GetOpenFileName(&ofn)) {
+        return;
+    }
+
+    if (BulkSendFile(&ti->send, szFile) != 0 ||
+            BulkSendPump(&ti->send, &ti->port) != 0) {
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+    }
+}
+
+/**
+ * Starts sending the text on the clipboard out the serial port. Line
+ * breaks are sent as a single carriage return, as if typed.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @returns none
+ */
+void PasteClipboard(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    HANDLE hData = NULL;
+    LPCSTR text = NULL;
+
+    if (ti->dwMode != kModeConnect || !IsClipboardFormatAvailable(CF_TEXT)) {
+        return;
+    }
+
+    if (!OpenClipboard(hwnd)) {
+        return;
+    }
+
+    hData = GetClipboardData(CF_TEXT);
+    if (hData != NULL && (text = (LPCSTR)GlobalLock(hData)) != NULL) {
+        size_t len = strlen(text);
+        CHAR* data = (CHAR*)malloc(len + 1);
+        DWORD i = 0;
+        DWORD j = 0;
+
+        if (data != NULL) {
+            for (i = 0; i < len; i++) {
+                if (text[i] == '\r' && text[i + 1] == '\n') {
+                    continue;
+                }
+                data[j++] = (text[i] == '\n') ? '\r' : text[i];
+            }
+
+            if (BulkSendText(&ti->send, data, j) != 0 ||
+                    BulkSendPump(&ti->send, &ti->port) != 0) {
+                DWORD dwError = GetLastError();
+                ReportError(dwError);
+            }
+            free(data);
+        }
+
+        GlobalUnlock(hData);
+    }
+
+    CloseClipboard();
+}
+
+/**
+ * Starts capturing received data to a file the user picks, or stops the
+ * capture in progress. The capture goes at the front of the pipeline, so it
+ * gets everything that arrives, and lasts until it is stopped or the session
+ * is closed.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @returns none
+ */
+void ToggleCapture(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    OPENFILENAME ofn;
+    TCHAR szFile[MAX_PATH];
+
+    if (ti->capture.hFile != INVALID_HANDLE_VALUE) {
+        PipelineRemove(&ti->rx, &ti->capture);
+        CaptureStop(&ti->capture);
+        CheckMenuItem(SessionMenu(hwnd), ID_CAPTURE, MF_UNCHECKED);
+        return;
+    }
+
+    StringCchCopy(szFile, MAX_PATH, TEXT("capture.log"));
+    ZeroMemory(&ofn, sizeof(OPENFILENAME));
+    ofn.lStructSize = sizeof(OPENFILENAME);
+    ofn.hwndOwner = hwnd;
+    ofn.lpstrFilter = TEXT("Log Files\0*.log\0All Files\0*.*\0");
+    ofn.lpstrFile = szFile;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.lpstrTitle = TEXT("Capture to File");
+    ofn.lpstrDefExt = TEXT("log");
+    ofn.Flags = OFN_PATHMUSTEXIST;
+
+    if (!GetSaveFileName(&ofn)) {
+        return;
+    }
+
+    if (CaptureStart(&ti->capture, szFile) != 0) {
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+        return;
+    }
+
+    if (PipelineInsert(&ti->rx, 0, CaptureStage, &ti->capture) != 0) {
+        CaptureStop(&ti->capture);
+        MessageBox(hwnd, TEXT("No more stages can be added to this session."),
+                APPNAME, MB_ICONERROR);
+        return;
+    }
+
+    CheckMenuItem(SessionMenu(hwnd), ID_CAPTURE, MF_CHECKED);
+}
+
+/**
+ * Starts decoding received data with a decoder plugin the user picks, run
+ * in the plugin host, or stops the decoder in use. The decoder goes at the
+ * end of the pipeline, so it sees only what the other stages pass on, and
+ * what it decodes goes to the emulator.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @returns none
+ */
+void ToggleDecoder(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    OPENFILENAME ofn;
+    TCHAR szFile[MAX_PATH];
+
+    if (HostRunning(&ti->host)) {
+        PipelineRemove(&ti->rx, &ti->host);
+        HostStop(&ti->host);
+        CheckMenuItem(SessionMenu(hwnd), ID_DECODER, MF_UNCHECKED);
+        return;
+    }
+
+    szFile[0] = TEXT('\0');
+    ZeroMemory(&ofn, sizeof(OPENFILENAME));
+    ofn.lStructSize = sizeof(OPENFILENAME);
+    ofn.hwndOwner = hwnd;
+    ofn.lpstrFilter = TEXT("Decoder Plugins\0*.dll\0");
+    ofn.lpstrFile = szFile;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.lpstrTitle = TEXT("Decode with Plugin");
+    ofn.Flags = OFN_FILEMUSTEXIST | OFN_HIDEREADONLY;
+
+    if (!GetOpenFileName(&ofn)) {
+        return;
+    }
+
+    if (HostStart(&ti->host, szFile) != 0) {
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+        return;
+    }
+
+    if (PipelineInsert(&ti->rx, PIPELINE_MAX, HostStage, &ti->host) != 0) {
+        HostStop(&ti->host);
+        MessageBox(hwnd, TEXT("No more stages can be added to this session."),
+                APPNAME, MB_ICONERROR);
+        return;
+    }
+
+    CheckMenuItem(SessionMenu(hwnd), ID_DECODER, MF_CHECKED);
+}
+
+/**
+ * Changes the flow control used on the serial port. The choice is kept for
+ * later connections.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @param DWORD flow    One of the flow enumeration values
+ * @returns none
+ */
+void SetFlowControl(HWND hwnd, DWORD flow) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    ti->dwFlow = flow;
+    CheckMenuRadioItem(SessionMenu(hwnd), ID_FLOW_NONE, ID_FLOW_XONXOFF,
+            ID_FLOW_NONE + (flow - kFlowNone), MF_BYCOMMAND);
+
+    if (ti->dwMode == kModeConnect && SetPortFlow(&ti->port, flow) != 0) {
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+    }
+}
+
+/**
+ * Hands data that has been read but not yet shown to the emulator in use,
+ * so that it has seen everything read before a switch and the replay
+ * buffer holds all of it.
+ *
+ * TWM_RXDATA is sent by the I/O pool, not posted, so it never waits in the
+ * queue; at most the pool is blocked sending the port's next read, which
+ * is delivered by peeking for sent messages, as IoPoolDetach does. Decoded
+ * data from the plugin host is posted, and is taken from the queue.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @returns none
+ */
+static void DrainReceived(HWND hwnd) {
+    MSG msg;
+
+    PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE | PM_QS_SENDMESSAGE);
+
+    while (PeekMessage(&msg, hwnd, TWM_HOSTDATA, TWM_HOSTDATA, PM_REMOVE)) {
+        DispatchMessage(&msg);
+    }
+}
+
+/**
+ * Shows a new emulator the last of the data the old one was given, so it
+ * can rebuild the screen, and paints the whole of it. Emulators older than
+ * version 6 cannot be replayed to, and start blank.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @returns none
+ */
+static void ReplayEmulator(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    Emulator* emu = CurrentEmulator(ti);
+    BYTE* data = NULL;
+    DWORD len = 0;
+
+    if (EMULATOR_HAS_FUNC_SINCE(emu, replay, 6) &&
+            (data = (BYTE*)malloc(REPLAY_SIZE)) != NULL) {
+        len = ReplayCopy(&ti->replay, data);
+        emu->replay(emu->emulator_data, data, len);
+        free(data);
+    }
+
+    InvalidateRect(hwnd, NULL, TRUE);
+}
+
+/**
+ * Changes the emulator used to display the session, and checks it in the
+ * Emulation menu. The session gets an instance of its own; a plugin older
+ * than version 5 has only one, which every session using it shares.
+ *
+ * If the session is connected, the switch happens without closing the
+ * port: data already read is given to the old emulator, the old one is
+ * disconnected and the new one connected, and the new one is shown the
+ * recent data to rebuild the screen from. A session waiting to reconnect
+ * counts as connected, since its emulator is only disconnected by
+ * CommandMode.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @param DWORD idx     The index of the emulator
+ * @returns none
+ */
+void SelectEmulator(HWND hwnd, DWORD idx) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    PluginRegistry* pr = &ti->frame->plugins;
+    HMENU menubar = SessionMenu(hwnd);
+    Emulator* emu = NULL;
+    BOOLEAN connected = FALSE;
+
+    /* Plugins are loaded the first time they are chosen. The shared
+       instance of one older than version 5 is made for the application
+       window, which passes what it sends on to the session shown */
+    if (PluginLoad(pr, idx, ti->frame->hwnd) == 0) {
+        emu = PluginCreate(pr, idx, hwnd);
+    }
+
+    if (emu == NULL) {
+        TCHAR text[128];
+
+        ManifestForget(pr->plugins[idx].path);
+        StringCchPrintf(text, 128, TEXT("The %s emulator could not be loaded."),
+                pr->plugins[idx].name);
+        MessageBox(hwnd, text, APPNAME, MB_ICONERROR);
+        return;
+    }
+
+    if (ti->emu != NULL) {
+        DrainReceived(hwnd);
+        connected = (ti->dwMode == kModeConnect ||
+                ti->dwMode == kModeReconnect);
+
+        if (connected && EMULATOR_HAS_FUNC_SINCE(ti->emu, on_disconnect, 3)) {
+            ti->emu->on_disconnect((LPVOID)ti->emu->emulator_data);
+        }
+    }
+
+    ReleaseEmulator(ti);
+    CheckMenuItem(menubar, ID_EMU_START + ti->e_idx, MF_UNCHECKED);
+    ti->e_idx = idx;
+    ti->emu = emu;
+    CheckMenuItem(menubar, ID_EMU_START + idx, MF_CHECKED);
+
+    /* Damage reported by the old emulator means nothing to the new one */
+    ZeroMemory(&ti->damage, sizeof(EmulatorDamage));
+
+    if (connected) {
+        if (EMULATOR_HAS_FUNC_SINCE(emu, on_connect, 2)) {
+            emu->on_connect((LPVOID)emu->emulator_data);
+        }
+        ReplayEmulator(hwnd);
+    }
+}
+
+/**
+ * The end of a session's pipeline: passes what is left to the emulator.
+ *
+ * @param LPVOID data   The handle to the session window
+ * @param BYTE* rx      The data left by the stages
+ * @param DWORD len     The length of the data
+ * @returns none
+ */
+static void EmulatorSink(LPVOID data, BYTE* rx, DWORD len) {
+    ReceiveData((HWND)data, rx, len);
+}
+
+/**
+ * Passes received data through the session's pipeline: a capture, if one
+ * is running, then the file transfer, then any other stages, and what they
+ * leave goes to the emulator. Nothing is copied on the way, unless a
+ * decoder is in use, which sends it back later decoded (see HostData).
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @param BYTE* rx      The received data
+ * @param DWORD len     The length of the received data
+ * @returns none
+ */
+void RouteData(HWND hwnd, BYTE* rx, DWORD len) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    PipelineRun(&ti->rx, rx, len, EmulatorSink, (LPVOID)hwnd);
+}
+
+/**
+ * Passes data decoded by the session's plugin host through the stages
+ * after it to the emulator. Data decoded after the decoder was stopped, or
+ * the port closed, is dropped.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @param BYTE* data    The decoded data
+ * @param DWORD len     The length of the decoded data
+ * @returns none
+ */
+void HostData(HWND hwnd, BYTE* data, DWORD len) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    if (ti->dwMode == kModeConnect && HostRunning(&ti->host)) {
+        PipelineResume(&ti->rx, &ti->host, data, len, EmulatorSink,
+                (LPVOID)hwnd);
+    }
+}
+
+/**
+ * Starts a session's plugin host again after it exited or was killed for
+ * hanging. The port stays open; what arrived in the meantime is decoded by
+ * the new host. If the host keeps dying, or broke the memory shared with
+ * it, the decoder is stopped.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @returns none
+ */
+void HostLost(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    int ret = HostRestart(&ti->host);
+
+    if (ret == 0) {
+        return;
+    }
+
+    PipelineRemove(&ti->rx, &ti->host);
+    HostStop(&ti->host);
+    CheckMenuItem(SessionMenu(hwnd), ID_DECODER, MF_UNCHECKED);
+    MessageBox(hwnd, (ret == 3) ?
+            TEXT("The decoder corrupted its shared memory and has been stopped.") :
+            TEXT("The decoder keeps failing and has been stopped."),
+            APPNAME, MB_ICONERROR);
+}
+
+/**
+ * Records the time from the arrival of received data to its paint in the
+ * port statistics. Data that came back from the decoder host has no
+ * arrival time, and isn't counted.
+ *
+ * @param TermInfo* ti              The session.
+ * @param LARGE_INTEGER* arrived    When the data arrived, 0 if not known.
+ * @returns none
+ */
+static void PaintLatency(TermInfo* ti, LARGE_INTEGER* arrived) {
+    LARGE_INTEGER painted;
+
+    if (arrived->QuadPart == 0) {
+        return;
+    }
+
+    QueryPerformanceCounter(&painted);
+    StatsLatency(&ti->port.stats, painted.QuadPart - arrived->QuadPart);
+}
+
+/**
+ * Passes received data to the emulator. Emulators from version 4 on report
+ * what changed, and the repaint is put off until the message queue is
+ * empty, so a burst of reads is painted once. While data keeps arriving
+ * the screen is still painted about once a frame. Older emulators are
+ * painted after every read, as they always were.
+ *
+ * The receive to paint latency is measured from the oldest read a paint
+ * shows, so it includes the time a paint is put off.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @param BYTE* rx      The received data
+ * @param DWORD len     The length of the received data
+ * @returns none
+ */
+void ReceiveData(HWND hwnd, BYTE* rx, DWORD len) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    Emulator* emu = CurrentEmulator(ti);
+    EmulatorDamage damage;
+
+    ReplayAppend(&ti->replay, rx, len);
+
+    if (!EMULATOR_HAS_FUNC_SINCE(emu, receive_damage, 4)) {
+        emu->receive(emu->emulator_data, rx, len);
+
+        if (emu->paint(hwnd, emu->emulator_data, NULL, FALSE) != 0) {
+            /* An error occurred while painting the text */
+            DWORD dwError = GetLastError();
+            ReportError(dwError);
+        }
+        PaintLatency(ti, &ti->rxarrived);
+        return;
+    }
+
+    ZeroMemory(&damage, sizeof(EmulatorDamage));
+    emu->receive_damage(emu->emulator_data, rx, len, &damage);
+
+    /* However many bells were in the block, one beep is enough */
+    if (damage.dwFlags & DAMAGE_BELL) {
+        MessageBeep(MB_OK);
+    }
+
+    if (ti->damage.dwFlags == 0 || ti->damaged.QuadPart == 0) {
+        ti->damaged = ti->rxarrived;
+    }
+
+    if (damage.dwFlags & DAMAGE_ROWS) {
+        if (!(ti->damage.dwFlags & DAMAGE_ROWS)) {
+            ti->damage.left = damage.left;
+            ti->damage.right = damage.right;
+        }
+        ti->damage.left = min(ti->damage.left, damage.left);
+        ti->damage.right = max(ti->damage.right, damage.right);
+        ti->damage.rows |= damage.rows;
+    }
+    if (damage.dwFlags & DAMAGE_CURSOR) {
+        ti->damage.cursor_x = damage.cursor_x;
+        ti->damage.cursor_y = damage.cursor_y;
+    }
+    ti->damage.dwFlags |= damage.dwFlags & ~DAMAGE_BELL;
+
+    if (ti->damage.dwFlags == 0) {
+        return;
+    }
+
+    if (!ti->paintPending) {
+        ti->paintPending = TRUE;
+        PostMessage(hwnd, TWM_PAINT, 0, 0);
+    } else if (GetTickCount() - ti->dwPainted >= PAINT_INTERVAL) {
+        PaintDamage(hwnd);
+    }
+}
+
+/**
+ * Paints the damage the emulator has reported since the last paint, the
+ * whole screen if it asked for that. Called for every TWM_PAINT.
+ * Emulators from version 7 on are given the damage, and draw only the rows
+ * and columns in it; older ones decide for themselves what to draw.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @returns none
+ */
+void PaintDamage(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    Emulator* emu = CurrentEmulator(ti);
+    EmulatorDamage damage = ti->damage;
+    LARGE_INTEGER damaged = ti->damaged;
+    DWORD ret = 0;
+
+    ti->paintPending = FALSE;
+    ZeroMemory(&ti->damage, sizeof(EmulatorDamage));
+    ti->damaged.QuadPart = 0;
+
+    if (damage.dwFlags == 0 || ti->dwMode == kModeCommand) {
+        return;
+    }
+
+    ti->dwPainted = GetTickCount();
+    if (EMULATOR_HAS_FUNC_SINCE(emu, paint_damage, 7)) {
+        ret = emu->paint_damage(hwnd, emu->emulator_data, NULL, &damage);
+    } else {
+        ret = emu->paint(hwnd, emu->emulator_data, NULL,
+                (damage.dwFlags & DAMAGE_ALL) != 0);
+    }
+    if (ret != 0) {
+        /* An error occurred while painting the text */
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+    }
+    PaintLatency(ti, &damaged);
+}
+
+/**
+ * Queues typed or emulator data to be sent, and returns without waiting.
+ * What does not fit in the transmit queue is held back and queued by
+ * SendHeld as the transmit thread makes room, so a flooded link never
+ * blocks the window. Anything sent while data is held goes behind it, to
+ * keep it in order.
+ *
+ * @param HWND hwnd         The handle to the session window
+ * @param const BYTE* data  The data to send.
+ * @param DWORD len         The length of the data.
+ * @returns 0 on success, 1 if the held data is full and some was dropped.
+ */
+int QueueInput(HWND hwnd, const BYTE* data, DWORD len) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    DWORD queued = 0;
+
+    if (ti->held.count == 0) {
+        queued = QueueData(&ti->port, (LPVOID)data, len);
+    }
+
+    if (TxQueuePut(&ti->held, data + queued, len - queued) < len - queued) {
+        SetLastError(ERROR_BUFFER_OVERFLOW);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Moves held data into the transmit queue as far as it will go. Called for
+ * every TWM_TXDONE.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @returns none
+ */
+void SendHeld(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    BYTE* run = NULL;
+    DWORD len = 0;
+
+    if (ti->dwMode != kModeConnect) {
+        return;
+    }
+
+    while ((len = TxQueuePeek(&ti->held, &run, ti->held.size)) > 0) {
+        DWORD queued = QueueData(&ti->port, run, len);
+
+        TxQueueConsume(&ti->held, queued);
+        if (queued < len) {
+            break;
+        }
+    }
+}
+
+/**
+ * Keeps a file or paste moving into the transmit queue and shows its
+ * progress in the title bar. Called for every TWM_TXDONE.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @param DWORD queued  The number of bytes still in the transmit queue
+ * @returns none
+ */
+void ReportSendProgress(HWND hwnd, DWORD queued) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    BOOLEAN finished = FALSE;
+
+    if (ti->dwMode != kModeConnect || !ti->send.active) {
+        return;
+    }
+
+    finished = (ti->send.sent == ti->send.size && queued == 0);
+
+    if (finished || GetTickCount() - ti->send.lastreport >= BULKSEND_REPORT) {
+        TCHAR status[96];
+        TCHAR title[128];
+
+        BulkSendStatus(&ti->send, queued, status, 96);
+        StringCchPrintf(title, 128, TEXT("%s - %s"), APPNAME, status);
+        SetWindowText(hwnd, title);
+        ti->send.lastreport = GetTickCount();
+    }
+
+    if (finished) {
+        BulkSendStop(&ti->send);
+    } else if (BulkSendPump(&ti->send, &ti->port) != 0) {
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+    }
+}
+
+/**
+ * Starts an XMODEM, YMODEM or ZMODEM transfer from the Transfer menu, or
+ * cancels the current one. A bulk send in progress is stopped first, since
+ * its data would corrupt the transfer.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @param DWORD id      The ID of the chosen menu item
+ * @returns none
+ */
+void StartTransfer(HWND hwnd, DWORD id) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    int ret = 0;
+
+    if (ti->dwMode != kModeConnect) {
+        return;
+    }
+
+    if (id == ID_XFER_CANCEL) {
+        TransferCancel(&ti->xfer, TRUE);
+        return;
+    }
+
+    BulkSendStop(&ti->send);
+
+    switch (id) {
+    case ID_ZMODEM_SEND:
+        ret = TransferSend(&ti->xfer, kXferZmodem);
+        break;
+    case ID_YMODEM_SEND:
+        ret = TransferSend(&ti->xfer, kXferYmodem);
+        break;
+    case ID_XMODEM_SEND:
+        ret = TransferSend(&ti->xfer, kXferXmodem);
+        break;
+    case ID_ZMODEM_RECV:
+        ret = TransferReceive(&ti->xfer, kXferZmodem);
+        break;
+    case ID_YMODEM_RECV:
+        ret = TransferReceive(&ti->xfer, kXferYmodem);
+        break;
+    case ID_XMODEM_RECV:
+        ret = TransferReceive(&ti->xfer, kXferXmodem);
+        break;
+    }
+
+    if (ret != 0) {
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+    }
+}
+
+/**
+ * Shows the statistics window for the serial port, or brings it to the
+ * front if it is already open. The window refreshes itself every
+ * STATS_REFRESH milliseconds.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @returns none
+ */
+void ShowStats(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    if (ti->hStats != NULL) {
+        SetForegroundWindow(ti->hStats);
+        return;
+    }
+
+    ti->hStats = CreateWindow(STATS_CLASS, TEXT("Statistics"),
+            WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU,
+            CW_USEDEFAULT, CW_USEDEFAULT, 480, 220,
+            hwnd, NULL, (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE),
+            (LPVOID)ti);
+    if (ti->hStats == NULL) {
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+        return;
+    }
+
+    ShowWindow(ti->hStats, SW_SHOWNORMAL);
+}
+
+/**
+ * Asks for a file and appends the serial port statistics to it, with the
+ * time they were taken.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @returns none
+ */
+void SaveStats(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    OPENFILENAME ofn;
+    TCHAR szFile[MAX_PATH];
+
+    StringCchCopy(szFile, MAX_PATH, TEXT("stats.txt"));
+    ZeroMemory(&ofn, sizeof(OPENFILENAME));
+    ofn.lStructSize = sizeof(OPENFILENAME);
+    ofn.hwndOwner = hwnd;
+    ofn.lpstrFilter = TEXT("Text Files\0*.txt\0All Files\0*.*\0");
+    ofn.lpstrFile = szFile;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.lpstrTitle = TEXT("Save Statistics");
+    ofn.lpstrDefExt = TEXT("txt");
+    ofn.Flags = OFN_PATHMUSTEXIST;
+
+    if (!GetSaveFileName(&ofn)) {
+        return;
+    }
+
+    if (StatsDump(&ti->port.stats, szFile) != 0) {
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+    }
+}
+
+/**
+ * Benchmarks the connected serial port over a loopback, trying a range of
+ * buffer sizes and read timeouts at the current line settings, and appends
+ * the results to a file. The port is closed while the benchmark runs on
+ * its own thread, and reopened by BenchmarkDone when it ends.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @returns none
+ */
+void BenchmarkPort(HWND hwnd) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    OPENFILENAME ofn;
+    TCHAR szFile[MAX_PATH];
+    TCHAR comport[SERIAL_DEVICE];
+    TCHAR text[256];
+    DCB dcb;
+    DWORD port = ti->dwPort;
+
+    if (ti->dwMode != kModeConnect ||
+            ti->port.transport->type != kTransportSerial) {
+        return;
+    }
+
+    StringCchCopy(szFile, MAX_PATH, TEXT("bench.txt"));
+    ZeroMemory(&ofn, sizeof(OPENFILENAME));
+    ofn.lStructSize = sizeof(OPENFILENAME);
+    ofn.hwndOwner = hwnd;
+    ofn.lpstrFilter = TEXT("Text Files\0*.txt\0All Files\0*.*\0");
+    ofn.lpstrFile = szFile;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.lpstrTitle = TEXT("Save Benchmark Results");
+    ofn.lpstrDefExt = TEXT("txt");
+    ofn.Flags = OFN_PATHMUSTEXIST;
+
+    if (!GetSaveFileName(&ofn)) {
+        return;
+    }
+
+    StringCchPrintf(text, 256, TEXT("Connect the transmit and receive lines ")
+            TEXT("of COM%lu together, then press OK.\n\n")
+            TEXT("The benchmark takes about half a minute."), port);
+    if (MessageBox(hwnd, text, APPNAME, MB_OKCANCEL | MB_ICONINFORMATION) != IDOK) {
+        return;
+    }
+
+    /* The benchmark needs the port to itself */
+    dcb = ti->port.dcb;
+    CommandMode(hwnd);
+
+    PortDeviceName(port, comport, SERIAL_DEVICE);
+    if (BenchStart(&ti->bench, comport, &dcb, szFile, hwnd) != 0) {
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+        BenchmarkDone(hwnd, 0, 0);
+        return;
+    }
+
+    /* Nothing else may open the port until the benchmark is done */
+    ti->dwMode = kModeBench;
+    SyncSession(hwnd);
+}
+
+/**
+ * Shows the progress of the benchmark in the session's title, as the
+ * benchmark thread starts each run.
+ *
+ * @param HWND hwnd     The handle to the session window
+ * @param DWORD run     The run starting, from 1
+ * @param DWORD runs    The number of runs in the benchmark
+ * @returns none
+ */
+void BenchmarkStep(HWND hwnd, DWORD run, DWORD runs) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+    TCHAR title[64];
+
+    if (ti->dwMode != kModeBench) {
+        return;
+    }
+
+    StringCchPrintf(title, 64, TEXT("%s - Benchmark %lu of %lu"),
+            ti->bench.port, run, runs);
+    SetWindowText(hwnd, title);
+}
+
+/**
+ * Reports the end of the benchmark and reconnects the port with the
+ * settings it had before.
+ *
+ * @param HWND hwnd         The handle to the session window
+ * @param int ret           What the benchmark returned, 0 on success
+ * @param DWORD dwError     The error the benchmark failed with
+ * @returns none
+ */
+void BenchmarkDone(HWND hwnd, int ret, DWORD dwError) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    BenchStop(&ti->bench);
+    SetWindowText(hwnd, APPNAME);
+
+    if (ret != 0) {
+        ReportError(dwError);
+    }
+
+    /* Carry on with the settings the port had before */
+    ti->dwMode = kModeCommand;
+    if (ReopenPort(&ti->port, ti->hwnd) != 0) {
+        dwError = GetLastError();
+        ReportError(dwError);
+        CommandMode(hwnd);
+        return;
+    }
+
+    StartSession(hwnd, ti->dwPort);
+}
+
+/**
+ * Finds the emulation plugins and adds them to the Emulation menu. Names
+ * are taken from the plugin manifest where it can be trusted, and those
+ * plugins are not loaded until they are chosen. Plugins not in the
+ * manifest are loaded to learn their names, and are then cached.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @param PluginRegistry* pr    The registry to fill
+ * @returns NULL
+ */
+Emulator* FindPlugins(HWND hwnd, PluginRegistry* pr) {
+    WIN32_FIND_DATA ffd;
+    TCHAR szAppPath[MAX_PATH];
+    TCHAR szDir[MAX_PATH];
+    HANDLE hFind = INVALID_HANDLE_VALUE;
+
+    PluginInit(pr);
+    PluginBuiltin(pr, hwnd, none_init_plugin, none_free);
+
+    GetModuleFileName(0, szAppPath, sizeof(szAppPath) - 1);
+    StringCchCopy(szDir, _tcsrchr(szAppPath, '\\') - szAppPath + 1, szAppPath);
+    StringCchCat(szDir, MAX_PATH, TEXT("\\emulation\\"));
+
+    StringCchCopy(szAppPath, MAX_PATH, szDir);
+    StringCchCat(szDir, MAX_PATH, TEXT("*.dll"));
+
+    hFind = FindFirstFile(szDir, &ffd);
+    if (INVALID_HANDLE_VALUE == hFind) {
+        DWORD dwError = GetLastError();
+        ReportError(dwError);
+        return NULL;
+    }
+
+    do
+    {
+        /* Menu IDs are 16 bits, which is as many plugins as can be chosen */
+        if (ID_EMU_START + pr->count > 0xFFFF) {
+            break;
+        }
+
+        if ((ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+            TCHAR plgName[MAX_PATH];
+            TCHAR name[MANIFEST_NAME];
+            DWORD i = PLUGIN_NONE;
+
+            StringCchCopy(plgName, MAX_PATH, szAppPath);
+            StringCchCat(plgName, MAX_PATH, ffd.cFileName);
+
+            if (ManifestLookup(plgName, name)) {
+                i = PluginAdd(pr, name, plgName, NULL);
+            } else {
+                i = PluginProbe(pr, plgName, hwnd);
+            }
+
+            if (i != PLUGIN_NONE) {
+                AddEmulatorMenu(hwnd, pr->plugins[i].name, i);
+            }
+        }
+    }
+    while (FindNextFile(hFind, &ffd) != 0);
+
+    FindClose(hFind);
+
+    return NULL;
+}
+
+/**
+ * Gets the emulator in use in a session, which is always loaded.
+ *
+ * @param TermInfo* ti  The session
+ * @returns The session's instance of the emulator in use.
+ */
+Emulator* CurrentEmulator(TermInfo* ti) {
+    return ti->emu;
+}
+
+/**
+ * Adds an emulator to the Emulation menu.
+ *
+ * @param HWND hwnd     The handle to the application window
+ * @param LPCTSTR name  The name of the emulator
+ * @param DWORD i       The index of the plugin
+ * @returns none
+ */
+void AddEmulatorMenu(HWND hwnd, LPCTSTR name, DWORD i) {
+    HMENU menubar = GetMenu(hwnd);
+    HMENU emulation = GetSubMenu(menubar, 1);
+    MENUITEMINFO mii;
+    mii.cbSize = sizeof(MENUITEMINFO);
+    mii.fMask = MIIM_ID | MIIM_STRING | MIIM_FTYPE | MIIM_STATE;
+    mii.fType = MFT_STRING;
+    mii.fState = MFS_ENABLED;
+    mii.wID = ID_EMU_START + i;
+    mii.dwTypeData = (LPTSTR)name;
+
+    InsertMenuItem(emulation, 1, TRUE, &mii);
+}
@@ -1,91 +1,430 @@
-/**
- * @filename terminal.h
- * @author Darryl Pogue
- * @designer Darryl Pogue
- * @date 2010 11 10
- * @project Terminal Emulator
- *
- * This file contains the definitions and prototypes for the terminal
- * window.
- */
-#ifndef _TERMINAL_H_
-#define _TERMINAL_H_
-
-#include <Windows.h>
-#include <tchar.h>
-#include <strsafe.h>
-#include "defines.h"
-#include "serial.h"
-#include "emulation.h"
-
-/* MENU ITEM ID DEFINES */
-#define ID_EXIT 100
-#define ID_DISCONNECT 101
-#define ID_CONNECT 102
-#define ID_COM_START 110
-#define ID_EMU_START 150
-
-/* ENUMERATION DECLARATIONS */
-enum modes {
-    kModeCommand = 0,
-    kModeConnect = 1,
-};
-
-/**
- * The TermInfo structure contains information regarding the current state of
- * the terminal emulator application.
- *
- * @member DWORD dwMode     The current application mode (command or connect)
- * @member HWND hwnd        The handle to the application window
- * @member HANDLE hCommDev  The handle to the serial port device
- * @member HANDLE hReadLoop The handle to the read thread
- * @member TCHAR screen[][] The screen buffer (25 lines, 80 chars per line)
- */
-typedef struct _TermInfo {
-    DWORD dwMode;
-    HWND hwnd;
-    HANDLE hCommDev;
-    HANDLE hReadLoop;
-    Emulator** hEmulator;
-    size_t e_idx;
-    size_t e_count;
-} TermInfo;
-
-/* FUNCTION PROTOTYPES */
-/**
- * Message handling for Windows messages.
- * @implementation terminal_win.c
- */
-LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
-
-/**
- * Reports a system error to the user in a MessageBox.
- * @implementation terminal.c
- */
-void ReportError(DWORD dwError);
-
-/**
- * Enters command mode, closing any open ports and enabling the connect menu.
- * @implementation terminal.c
- */
-void CommandMode(HWND hwnd);
-
-/**
- * Enters connect mode, connecting to the specified port number.
- * @implementation terminal.c
- */
-void ConnectMode(HWND hwnd, DWORD port);
-
-/**
- * Find all of the emulation plugins and probe them.
- * @implementation terminal.c
- */
-Emulator* FindPlugins(HWND hwnd, TermInfo* ti);
-
-/**
- * Load an emulation mode from a plugin.
- * @implementation terminal.c
- */
-void LoadPlugin(HWND hwnd, Emulator* emu, DWORD i);
-
-#endif
+/**
+ * @filename terminal.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 10
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the terminal
+ * window.
+ */
+#ifndef _TERMINAL_H_
+#define _TERMINAL_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+#include <Dbt.h>
+#include <CommCtrl.h>
+#include "defines.h"
+#include "serial.h"
+#include "net.h"
+#include "portlist.h"
+#include "profile.h"
+#include "plugin.h"
+#include "iopool.h"
+#include "bench.h"
+#include "bulksend.h"
+#include "transfer.h"
+#include "capture.h"
+#include "host.h"
+#include "replay.h"
+#include "emulation.h"
+
+/* MENU ITEM ID DEFINES */
+#define ID_EXIT 100
+#define ID_DISCONNECT 101
+#define ID_CONNECT 102
+#define ID_SENDFILE 103
+#define ID_PASTE 104
+#define ID_FLOW_NONE 105
+#define ID_FLOW_RTSCTS 106
+#define ID_FLOW_XONXOFF 107
+#define ID_STATS 108
+#define ID_STATS_SAVE 109
+#define ID_PROFILES 110
+#define ID_BENCH 111
+#define ID_NEW_SESSION 112
+#define ID_CLOSE_SESSION 113
+#define ID_CAPTURE 114
+#define ID_DECODER 115
+#define ID_COM_START 200
+#define ID_PROFILE_START 460
+#define ID_ZMODEM_SEND 600
+#define ID_YMODEM_SEND 601
+#define ID_XMODEM_SEND 602
+#define ID_ZMODEM_RECV 603
+#define ID_YMODEM_RECV 604
+#define ID_XMODEM_RECV 605
+#define ID_XFER_CANCEL 606
+/* Emulators take every ID from here up */
+#define ID_EMU_START 1000
+
+/* Window class of a session, one for each tab */
+#define SESSION_CLASS TEXT("Terminal Session")
+/* Room made for sessions at first; it doubles when full */
+#define SESSION_GROW 8
+
+/* Window class of the statistics window */
+#define STATS_CLASS TEXT("Terminal Statistics")
+/* Statistics window refresh timer and interval (ms) */
+#define STATS_TIMER 1
+#define STATS_REFRESH 1000
+
+/* Reconnect timer, and the shortest and longest waits (ms) between tries */
+#define RECONNECT_TIMER 2
+#define RECONNECT_MIN 500
+#define RECONNECT_MAX 30000
+
+/* Longest wait (ms) for a paint while data keeps arriving: about a frame */
+#define PAINT_INTERVAL 16
+
+/* Most typed or emulator data (bytes) held back while the transmit queue
+   is full */
+#define HELD_SIZE 4096
+
+/* ENUMERATION DECLARATIONS */
+enum modes {
+    kModeCommand = 0,
+    kModeConnect = 1,
+    kModeReconnect = 2,     /* The port was lost and is being reopened */
+    kModeBench = 3,         /* The port is closed for a benchmark */
+};
+
+/**
+ * The TermInfo structure contains the state of one session: a tab of the
+ * application window, with its own port and emulator.
+ *
+ * @member DWORD dwMode     The current session mode (command or connect)
+ * @member HWND hwnd        The handle to the session window
+ * @member FrameInfo* frame The application window the session is in
+ * @member SerialPort port  The open serial port and its transmit queue
+ * @member TxQueue held     Data to send that did not fit in the transmit queue
+ * @member DWORD dwPort     The number of the COM port connected to
+ * @member DWORD dwRetry    The wait (ms) before the next reconnect attempt
+ * @member PortList ports   The serial ports present on the system
+ * @member TCHAR profiles[][]   The names of the saved profiles in the menu
+ * @member DWORD p_count    The number of saved profiles in the menu
+ * @member BulkSend send    The file or paste being sent
+ * @member DWORD dwFlow     The flow control chosen from the menu
+ * @member Transfer xfer    The XMODEM, YMODEM or ZMODEM transfer
+ * @member Capture capture  The file received data is captured to
+ * @member Host host        The decoder plugin run out of process, if any
+ * @member Pipeline rx      The stages received data passes through
+ * @member HWND hStats      The statistics window, or NULL if it is closed
+ * @member HWND hBaud       The window to tell when a baud rate change is
+ *                          made, or NULL
+ * @member Bench bench      The benchmark of the port, while one runs
+ * @member LARGE_INTEGER rxarrived  When the data being handled arrived,
+ *                                  0 if it isn't known
+ * @member EmulatorDamage damage    Damage received but not yet painted
+ * @member LARGE_INTEGER damaged    When the oldest data in damage arrived
+ * @member BOOLEAN paintPending     TRUE if a TWM_PAINT has been posted
+ * @member DWORD dwPainted  The tick count of the last paint
+ * @member DWORD e_idx      The emulator in use
+ * @member Emulator* emu    The session's instance of the emulator
+ * @member Replay replay    The last data the emulator was given
+ */
+typedef struct _TermInfo {
+    DWORD dwMode;
+    HWND hwnd;
+    FrameInfo* frame;
+    SerialPort port;
+    TxQueue held;
+    DWORD dwPort;
+    DWORD dwRetry;
+    PortList ports;
+    TCHAR profiles[PROFILE_MAX][PROFILE_NAME];
+    DWORD p_count;
+    BulkSend send;
+    DWORD dwFlow;
+    Transfer xfer;
+    Capture capture;
+    Host host;
+    Pipeline rx;
+    HWND hStats;
+    HWND hBaud;
+    Bench bench;
+    LARGE_INTEGER rxarrived;
+    EmulatorDamage damage;
+    LARGE_INTEGER damaged;
+    BOOLEAN paintPending;
+    DWORD dwPainted;
+    DWORD e_idx;
+    Emulator* emu;
+    Replay replay;
+} TermInfo;
+
+/**
+ * The FrameInfo structure contains the state of the application window,
+ * which holds the menu, a tab for each session, and what the sessions
+ * share.
+ *
+ * @member HWND hwnd            The handle to the application window
+ * @member HWND hTabs           The tab control
+ * @member TermInfo** sessions  The sessions, in the order of their tabs
+ * @member DWORD count          The number of sessions
+ * @member DWORD capacity       The room in sessions
+ * @member DWORD active         The session shown
+ * @member PluginRegistry plugins   The emulators found
+ * @member IoPool pool          The threads reading every session's port
+ */
+typedef struct _FrameInfo {
+    HWND hwnd;
+    HWND hTabs;
+    TermInfo** sessions;
+    DWORD count;
+    DWORD capacity;
+    DWORD active;
+    PluginRegistry plugins;
+    IoPool pool;
+} FrameInfo;
+
+/* FUNCTION PROTOTYPES */
+/**
+ * Message handling for the application window.
+ * @implementation terminal_win.c
+ */
+LRESULT CALLBACK FrameProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
+/**
+ * Message handling for a session window.
+ * @implementation terminal_win.c
+ */
+LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
+/**
+ * Message handling for the statistics window.
+ * @implementation terminal_win.c
+ */
+LRESULT CALLBACK StatsWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
+/**
+ * Reports a system error to the user in a MessageBox.
+ * @implementation terminal.c
+ */
+void ReportError(DWORD dwError);
+
+/**
+ * Opens a new session in a new tab and shows it.
+ * @implementation terminal.c
+ */
+TermInfo* OpenSession(FrameInfo* frame);
+
+/**
+ * Closes a session and its tab.
+ * @implementation terminal.c
+ */
+void CloseSession(FrameInfo* frame, DWORD i);
+
+/**
+ * Shows a session and sets the menus for it.
+ * @implementation terminal.c
+ */
+void ShowSession(FrameInfo* frame, DWORD i);
+
+/**
+ * Fits the tab control and the session shown to the application window.
+ * @implementation terminal.c
+ */
+void LayoutSessions(FrameInfo* frame);
+
+/**
+ * Brings the menus, tab and caption up to date with a session.
+ * @implementation terminal.c
+ */
+void SyncSession(HWND hwnd);
+
+/**
+ * Tells whether a session is the one shown.
+ * @implementation terminal.c
+ */
+BOOLEAN SessionShown(HWND hwnd);
+
+/**
+ * Gets the menu of a session, which only the session shown has.
+ * @implementation terminal.c
+ */
+HMENU SessionMenu(HWND hwnd);
+
+/**
+ * Enters command mode, closing any open ports and enabling the connect menu.
+ * @implementation terminal.c
+ */
+void CommandMode(HWND hwnd);
+
+/**
+ * Rebuilds the Connect menu from the serial ports present on the system.
+ * @implementation terminal.c
+ */
+void UpdatePorts(HWND hwnd);
+
+/**
+ * Enters connect mode, connecting to the specified port number.
+ * @implementation terminal.c
+ */
+void ConnectMode(HWND hwnd, DWORD port);
+
+/**
+ * Rebuilds the Connect to Profile menu from the saved profiles.
+ * @implementation terminal.c
+ */
+void UpdateProfiles(HWND hwnd);
+
+/**
+ * Enters connect mode using the settings of a saved profile.
+ * @implementation terminal.c
+ */
+int ConnectProfile(HWND hwnd, LPCTSTR name, BOOLEAN quiet);
+
+/**
+ * Closes a port whose device has gone away and starts reconnecting.
+ * @implementation terminal.c
+ */
+void PortLost(HWND hwnd);
+
+/**
+ * Tries to reopen a lost port.
+ * @implementation terminal.c
+ */
+void Reconnect(HWND hwnd);
+
+/**
+ * Asks for a file and starts sending it out the serial port.
+ * @implementation terminal.c
+ */
+void SendFile(HWND hwnd);
+
+/**
+ * Starts sending the text on the clipboard out the serial port.
+ * @implementation terminal.c
+ */
+void PasteClipboard(HWND hwnd);
+
+/**
+ * Starts or stops capturing received data to a file.
+ * @implementation terminal.c
+ */
+void ToggleCapture(HWND hwnd);
+
+/**
+ * Starts or stops decoding received data with a decoder plugin.
+ * @implementation terminal.c
+ */
+void ToggleDecoder(HWND hwnd);
+
+/**
+ * Passes data decoded by the session's plugin host on to the emulator.
+ * @implementation terminal.c
+ */
+void HostData(HWND hwnd, BYTE* data, DWORD len);
+
+/**
+ * Starts a session's plugin host again after it died.
+ * @implementation terminal.c
+ */
+void HostLost(HWND hwnd);
+
+/**
+ * Changes the flow control used on the serial port.
+ * @implementation terminal.c
+ */
+void SetFlowControl(HWND hwnd, DWORD flow);
+
+/**
+ * Changes the emulator used to display the terminal.
+ * @implementation terminal.c
+ */
+void SelectEmulator(HWND hwnd, DWORD idx);
+
+/**
+ * Passes received data through the session's pipeline to the emulator.
+ * @implementation terminal.c
+ */
+void RouteData(HWND hwnd, BYTE* rx, DWORD len);
+
+/**
+ * Passes received data to the emulator and schedules the repaint.
+ * @implementation terminal.c
+ */
+void ReceiveData(HWND hwnd, BYTE* rx, DWORD len);
+
+/**
+ * Paints the damage the emulator has reported since the last paint.
+ * @implementation terminal.c
+ */
+void PaintDamage(HWND hwnd);
+
+/**
+ * Queues typed or emulator data to be sent without waiting.
+ * @implementation terminal.c
+ */
+int QueueInput(HWND hwnd, const BYTE* data, DWORD len);
+
+/**
+ * Moves held data into the transmit queue as it makes room.
+ * @implementation terminal.c
+ */
+void SendHeld(HWND hwnd);
+
+/**
+ * Reports the progress of a file or paste being sent.
+ * @implementation terminal.c
+ */
+void ReportSendProgress(HWND hwnd, DWORD queued);
+
+/**
+ * Starts an XMODEM, YMODEM or ZMODEM transfer, or cancels the current one.
+ * @implementation terminal.c
+ */
+void StartTransfer(HWND hwnd, DWORD id);
+
+/**
+ * Shows the statistics window for the serial port.
+ * @implementation terminal.c
+ */
+void ShowStats(HWND hwnd);
+
+/**
+ * Asks for a file and appends the serial port statistics to it.
+ * @implementation terminal.c
+ */
+void SaveStats(HWND hwnd);
+
+/**
+ * Benchmarks the serial port with a loopback and reconnects afterwards.
+ * @implementation terminal.c
+ */
+void BenchmarkPort(HWND hwnd);
+
+/**
+ * Shows the progress of the benchmark in the session's title.
+ * @implementation terminal.c
+ */
+void BenchmarkStep(HWND hwnd, DWORD run, DWORD runs);
+
+/**
+ * Reports the end of the benchmark and reconnects the port.
+ * @implementation terminal.c
+ */
+void BenchmarkDone(HWND hwnd, int ret, DWORD dwError);
+
+/**
+ * Find all of the emulation plugins and probe them.
+ * @implementation terminal.c
+ */
+Emulator* FindPlugins(HWND hwnd, PluginRegistry* pr);
+
+/**
+ * Gets the emulator in use.
+ * @implementation terminal.c
+ */
+Emulator* CurrentEmulator(TermInfo* ti);
+
+/**
+ * Add an emulation mode to the Emulation menu.
+ * @implementation terminal.c
+ */
+void AddEmulatorMenu(HWND hwnd, LPCTSTR name, DWORD i);
+
+#endif
@@ -1,243 +1,698 @@
-/**
- * @filename terminal_win.c
- * @author Darryl Pogue
- * @designer Darryl Pogue
- * @date 2010 11 10
- * @project Terminal Emulator
- *
- * This file contains the implementations of all WIN32 functions for the
- * terminal window.
- */
-#include "terminal.h"
-
-/**
- * The application entry point.
- *
- * @param HINSTANCE hInstance       The handle to the application instance
- * @param HINSTANCE hPrevInstance   The handle to the previous instance
- * @param LPSTR lspszCmdParam       The command line arguments to the app
- * @param int iCmdShow              The default window display state
- * @returns zero on success, non-zero on failure
- */
-int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hprevInstance,
-                          LPSTR lspszCmdParam, int iCmdShow) {
-    HWND hwnd;
-    MSG msg;
-    WNDCLASS wndclass;
-    TermInfo* wndData;
-
-    wndclass.style         = CS_HREDRAW | CS_VREDRAW;
-    wndclass.lpfnWndProc   = WndProc;
-    wndclass.cbClsExtra    = 0;
-    wndclass.cbWndExtra    = sizeof(TermInfo*);
-    wndclass.hInstance     = hInstance;
-    wndclass.hIcon         = LoadIcon (NULL, IDI_APPLICATION);
-    wndclass.hCursor       = LoadCursor (NULL, IDC_ARROW);
-    wndclass.hbrBackground = (HBRUSH) GetStockObject (BLACK_BRUSH);
-    wndclass.lpszMenuName  = TEXT("TerminalMenu");
-    wndclass.lpszClassName = APPNAME;
-
-    if (!RegisterClass (&wndclass))
-    {
-        MessageBox(NULL, TEXT("The application was unable to run"), 
-                      APPNAME, MB_ICONERROR);
-        return 1;
-    }
-
-    hwnd = CreateWindow(APPNAME, APPNAME,
-                         WS_OVERLAPPEDWINDOW & ~(WS_SIZEBOX | WS_MAXIMIZEBOX),
-                         CW_USEDEFAULT, CW_USEDEFAULT, 500, 100,
-                         NULL, NULL, hInstance, NULL);
-
-    wndData = (TermInfo*)malloc(sizeof(TermInfo));
-    wndData->dwMode = kModeCommand;
-    wndData->hwnd = hwnd;
-    wndData->hReadLoop = NULL;
-    SetWindowLongPtr(hwnd, 0, (LONG)wndData);
-
-    ShowWindow(hwnd, iCmdShow);
-    UpdateWindow(hwnd);
-
-    FindPlugins(hwnd, wndData);
-    CommandMode(hwnd);
-
-    while (GetMessage (&msg, NULL, 0, 0))
-    {
-        if (EMULATOR_HAS_FUNC(wndData->hEmulator[wndData->e_idx], wnd_proc_override)) {
-            if (wndData->hEmulator[wndData->e_idx]->wnd_proc_override(
-                    wndData->hEmulator[wndData->e_idx]->emulator_data, &msg)) {
-                continue;
-            }
-        }
-
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
-    }
-
-    return 0;
-}
-
-/**
- * Message handling for Windows messages.
- *
- * @param HWND hwnd     The handle to the window which received the event
- * @param UINT msg      The numeric value of the Windows message
- * @param WPARAM wParam Additional message data depending on the message type
- * @param LPARAM lParam Additional message data depending on the message type
- * @return zero if the message was handled, non-zero otherwise
- */
-LRESULT CALLBACK WndProc (HWND hwnd, UINT message,
-                          WPARAM wParam, LPARAM lParam) {
-    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
-
-    switch(message) {
-    case WM_SIZE:
-        {
-            HDC hdc;
-            TEXTMETRIC tm;
-            HFONT monospace;
-            DWORD height;
-            DWORD width;
-
-            hdc = GetDC(hwnd);
-            monospace = (HFONT)GetStockObject(ANSI_FIXED_FONT);
-            SelectObject(hdc, monospace);
-            GetTextMetrics(hdc, &tm);
-
-            width = (tm.tmMaxCharWidth * 81) + 78; /* Add 1 for bold padding */
-
-            /* We need to take window borders and menu bars into account */
-            height = (tm.tmExternalLeading + tm.tmHeight) * 25;
-            height += GetSystemMetrics(SM_CYMENU);
-            height += GetSystemMetrics(SM_CYCAPTION);
-            height -= 2 * GetSystemMetrics(SM_CYFIXEDFRAME);
-
-            SetWindowPos(hwnd, NULL, 100, 100, width, height, 0);
-            ReleaseDC(hwnd, hdc);
-        }
-        return 0;
-    case WM_COMMAND:
-        switch (LOWORD(wParam)){
-        case ID_EXIT:
-            DestroyWindow(hwnd);
-            break;
-        case ID_DISCONNECT:
-            CommandMode(hwnd);
-            InvalidateRect(hwnd, NULL, TRUE);
-            break;
-        default:
-            {
-                if (LOWORD(wParam) < ID_EMU_START) {
-                    DWORD port = LOWORD(wParam) - ID_COM_START;
-
-                    ConnectMode(hwnd, port);
-                } else {
-                    DWORD emu_idx = LOWORD(wParam) - ID_EMU_START;
-                    CheckMenuItem(GetMenu(hwnd), ID_EMU_START + ti->e_idx, MF_UNCHECKED);
-                    ti->e_idx = emu_idx;
-
-                    CheckMenuItem(GetMenu(hwnd), LOWORD(wParam), MF_CHECKED);
-                }
-            }
-            break;
-        }
-        return 0;
-    case WM_PAINT:
-        {
-            HDC hdc;
-            PAINTSTRUCT ps;
-
-            hdc = BeginPaint(hwnd, &ps);
-            if (ti->dwMode == kModeCommand) {
-                HBRUSH bg = CreateSolidBrush(RGB(64, 64, 64));
-                RECT r;
-                GetClientRect(hwnd, &r);
-
-                FillRect(hdc, &r, bg);
-                DeleteObject(bg);
-            } else {
-                DWORD ret = 0;
-
-                if ((ret = ti->hEmulator[ti->e_idx]->paint(hwnd,
-                        (LPVOID)ti->hEmulator[ti->e_idx]->emulator_data, hdc, TRUE)) != 0) {
-                    /* An error occurred while painting the text */
-                    DWORD dwError = GetLastError();
-                    ReportError(dwError);
-                }
-            }
-
-            EndPaint (hwnd, &ps);
-        }
-        return 0;
-    case WM_CHAR:
-        {
-            if (ti->dwMode == kModeConnect) {
-                size_t datalen = 0;
-                StringCchLength((LPCTSTR)&wParam, 1024, &datalen);
-                if (SendData(&ti->hCommDev, (LPVOID)&wParam, datalen) != 0) {
-                    DWORD dwError = GetLastError();
-                    ReportError(dwError);
-                }
-            }
-        }
-        return 0;
-    case WM_KEYUP:
-        {
-            if (ti->dwMode == kModeConnect) {
-                LPCSTR data = ti->hEmulator[ti->e_idx]->escape_input(
-                        (LPVOID)ti->hEmulator[ti->e_idx]->emulator_data, wParam);
-                if (data == NULL)
-                    return 0;
-
-                if (SendData(&ti->hCommDev, (LPVOID)data, strlen(data)) != 0) {
-                    DWORD dwError = GetLastError();
-                    ReportError(dwError);
-                }
-            }
-        }
-        return 0;
-    case TWM_RXDATA:
-        {
-            if (ti->dwMode == kModeConnect) {
-                DWORD ret = 0;
-
-                ti->hEmulator[ti->e_idx]->receive(ti->hEmulator[ti->e_idx]->emulator_data, (BYTE*)wParam, lParam);
-                free((BYTE*)wParam);
-                
-                if ((ret = ti->hEmulator[ti->e_idx]->paint(hwnd,
-                        (LPVOID)ti->hEmulator[ti->e_idx]->emulator_data, NULL, FALSE)) != 0) {
-                    /* An error occurred while painting the text */
-                    DWORD dwError = GetLastError();
-                    ReportError(dwError);
-                }
-            }
-        }
-        return 0;
-    case TWM_TXDATA:
-        {
-            if (ti->dwMode == kModeConnect) {
-                BYTE* data = (BYTE*)wParam;
-                if (data == NULL)
-                    return 0;
-
-                if (SendData(&ti->hCommDev, (LPVOID)data, lParam) != 0) {
-                    DWORD dwError = GetLastError();
-                    ReportError(dwError);
-                }
-
-                free(data);
-            }
-        }
-        return 0;
-    case WM_DESTROY:
-        {
-            CommandMode(hwnd);
-            if (ti->hReadLoop != NULL) {
-                CloseHandle(ti->hReadLoop);
-            }
-            PostQuitMessage(0);
-        }
-        return 0;
-    }
-    return DefWindowProc (hwnd, message, wParam, lParam);
-}
+/**
+ * @filename terminal_win.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 10
+ * @project Terminal Emulator
+ *
+ * This file contains the implementations of all WIN32 functions for the
+ * terminal window.
+ */
+#include "terminal.h"
+
+#pragma comment(lib, "comctl32.lib")
+
+/**
+ * Connects straight away for each /profile:Name on the command line, each
+ * in a tab of its own. The first uses the session the window opened with.
+ * A profile that fails says why in its title bar.
+ *
+ * @param FrameInfo* frame      The application window
+ * @param LPSTR lspszCmdParam   The command line arguments to the app
+ * @returns none
+ */
+static void OpenProfiles(FrameInfo* frame, LPSTR lspszCmdParam) {
+    LPSTR arg = lspszCmdParam;
+    BOOLEAN first = TRUE;
+
+    for (;;) {
+        TCHAR profile[PROFILE_NAME];
+        TermInfo* ti = NULL;
+        LPSTR name = NULL;
+        BOOLEAN quoted = FALSE;
+        size_t len = 0;
+
+        arg += strspn(arg, " ");
+        if (*arg == 0) {
+            break;
+        }
+
+        if (_strnicmp(arg, "/profile:", 9) != 0) {
+            arg += strcspn(arg, " ");
+            continue;
+        }
+
+        /* The name may be quoted if it has spaces in it */
+        name = arg + 9;
+        if (*name == '"') {
+            quoted = TRUE;
+            name++;
+        }
+        len = strcspn(name, quoted ? "\"" : " ");
+        arg = name + len + ((quoted && name[len] == '"') ? 1 : 0);
+
+#ifdef UNICODE
+        profile[MultiByteToWideChar(CP_ACP, 0, name, (int)min(len, PROFILE_NAME - 1),
+                profile, PROFILE_NAME - 1)] = 0;
+#else
+        StringCchCopyN(profile, PROFILE_NAME, name, len);
+#endif
+
+        ti = first ? frame->sessions[0] : OpenSession(frame);
+        first = FALSE;
+        if (ti != NULL) {
+            /* Nobody may be there to answer a message box */
+            ConnectProfile(ti->hwnd, profile, TRUE);
+        }
+    }
+}
+
+/**
+ * The application entry point.
+ *
+ * @param HINSTANCE hInstance       The handle to the application instance
+ * @param HINSTANCE hPrevInstance   The handle to the previous instance
+ * @param LPSTR lspszCmdParam       The command line arguments to the app
+ * @param int iCmdShow              The default window display state
+ * @returns zero on success, non-zero on failure
+ */
+int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hprevInstance,
+                          LPSTR lspszCmdParam, int iCmdShow) {
+    HWND hwnd;
+    MSG msg;
+    WNDCLASS wndclass;
+    FrameInfo* frame;
+
+    wndclass.style         = CS_HREDRAW | CS_VREDRAW;
+    wndclass.lpfnWndProc   = FrameProc;
+    wndclass.cbClsExtra    = 0;
+    wndclass.cbWndExtra    = sizeof(FrameInfo*);
+    wndclass.hInstance     = hInstance;
+    wndclass.hIcon         = LoadIcon (NULL, IDI_APPLICATION);
+    wndclass.hCursor       = LoadCursor (NULL, IDC_ARROW);
+    wndclass.hbrBackground = (HBRUSH) (COLOR_BTNFACE + 1);
+    wndclass.lpszMenuName  = TEXT("TerminalMenu");
+    wndclass.lpszClassName = APPNAME;
+
+    if (!RegisterClass (&wndclass))
+    {
+        MessageBox(NULL, TEXT("The application was unable to run"), 
+                      APPNAME, MB_ICONERROR);
+        return 1;
+    }
+
+    wndclass.lpfnWndProc   = WndProc;
+    wndclass.cbWndExtra    = sizeof(TermInfo*);
+    wndclass.hbrBackground = (HBRUSH) GetStockObject (BLACK_BRUSH);
+    wndclass.lpszMenuName  = NULL;
+    wndclass.lpszClassName = SESSION_CLASS;
+    RegisterClass(&wndclass);
+
+    wndclass.lpfnWndProc   = StatsWndProc;
+    wndclass.hbrBackground = (HBRUSH) (COLOR_WINDOW + 1);
+    wndclass.lpszClassName = STATS_CLASS;
+    RegisterClass(&wndclass);
+
+    frame = (FrameInfo*)malloc(sizeof(FrameInfo));
+    if (frame == NULL) {
+        return 1;
+    }
+    frame->hTabs = NULL;
+    frame->sessions = NULL;
+    frame->count = 0;
+    frame->capacity = 0;
+    frame->active = 0;
+    PluginInit(&frame->plugins);
+    frame->pool.hPort = NULL;
+    frame->pool.count = 0;
+
+    hwnd = CreateWindow(APPNAME, APPNAME,
+                         WS_OVERLAPPEDWINDOW & ~(WS_SIZEBOX | WS_MAXIMIZEBOX),
+                         CW_USEDEFAULT, CW_USEDEFAULT, 500, 100,
+                         NULL, NULL, hInstance, (LPVOID)frame);
+    if (hwnd == NULL) {
+        MessageBox(NULL, TEXT("The application was unable to run"),
+                      APPNAME, MB_ICONERROR);
+        free(frame);
+        return 1;
+    }
+
+    ShowWindow(hwnd, iCmdShow);
+    UpdateWindow(hwnd);
+
+    OpenProfiles(frame, lspszCmdParam);
+
+    while (GetMessage (&msg, NULL, 0, 0))
+    {
+        BOOLEAN handled = FALSE;
+        DWORD i;
+
+        /* Any session's emulator may have a dialog open */
+        for (i = 0; i < frame->count && !handled; i++) {
+            Emulator* emu = CurrentEmulator(frame->sessions[i]);
+
+            if (EMULATOR_HAS_FUNC(emu, wnd_proc_override)) {
+                handled = emu->wnd_proc_override(emu->emulator_data, &msg);
+            }
+        }
+
+        if (handled) {
+            continue;
+        }
+
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+
+    free(frame);
+    return 0;
+}
+
+/**
+ * Sizes the application window so a session shows 80 columns and 25 rows
+ * of the fixed font under the tabs.
+ *
+ * @param FrameInfo* frame  The application window
+ * @returns none
+ */
+static void FitFrame(FrameInfo* frame) {
+    HDC hdc;
+    TEXTMETRIC tm;
+    RECT r;
+
+    hdc = GetDC(frame->hwnd);
+    SelectObject(hdc, GetStockObject(ANSI_FIXED_FONT));
+    GetTextMetrics(hdc, &tm);
+    ReleaseDC(frame->hwnd, hdc);
+
+    r.left = 0;
+    r.top = 0;
+    r.right = tm.tmMaxCharWidth * 81; /* Add 1 for bold padding */
+    r.bottom = (tm.tmExternalLeading + tm.tmHeight) * 25;
+
+    /* Add the tabs, then the window borders and menu bar */
+    TabCtrl_AdjustRect(frame->hTabs, TRUE, &r);
+    AdjustWindowRect(&r, GetWindowLong(frame->hwnd, GWL_STYLE), TRUE);
+
+    SetWindowPos(frame->hwnd, NULL, 0, 0, r.right - r.left, r.bottom - r.top,
+            SWP_NOMOVE | SWP_NOZORDER);
+}
+
+/**
+ * Message handling for the application window, which holds the menu and a
+ * tab for each session. Menu commands go to the session shown.
+ *
+ * @param HWND hwnd     The handle to the window which received the event
+ * @param UINT msg      The numeric value of the Windows message
+ * @param WPARAM wParam Additional message data depending on the message type
+ * @param LPARAM lParam Additional message data depending on the message type
+ * @return zero if the message was handled, non-zero otherwise
+ */
+LRESULT CALLBACK FrameProc (HWND hwnd, UINT message,
+                            WPARAM wParam, LPARAM lParam) {
+    FrameInfo* frame = (FrameInfo*)GetWindowLongPtr(hwnd, 0);
+    HWND active = NULL;
+
+    if (frame != NULL && frame->active < frame->count) {
+        active = frame->sessions[frame->active]->hwnd;
+    }
+
+    switch(message) {
+    case WM_CREATE:
+        {
+            CREATESTRUCT* cs = (CREATESTRUCT*)lParam;
+            INITCOMMONCONTROLSEX icc;
+
+            frame = (FrameInfo*)cs->lpCreateParams;
+            frame->hwnd = hwnd;
+            SetWindowLongPtr(hwnd, 0, (LONG_PTR)frame);
+
+            icc.dwSize = sizeof(INITCOMMONCONTROLSEX);
+            icc.dwICC = ICC_TAB_CLASSES;
+            InitCommonControlsEx(&icc);
+
+            frame->hTabs = CreateWindow(WC_TABCONTROL, NULL,
+                    WS_CHILD | WS_CLIPSIBLINGS | WS_VISIBLE, 0, 0, 0, 0,
+                    hwnd, NULL, cs->hInstance, NULL);
+            if (frame->hTabs == NULL || IoPoolStart(&frame->pool) != 0) {
+                return -1;
+            }
+            SendMessage(frame->hTabs, WM_SETFONT,
+                    (WPARAM)GetStockObject(DEFAULT_GUI_FONT), FALSE);
+
+            FindPlugins(hwnd, &frame->plugins);
+            FitFrame(frame);
+
+            if (OpenSession(frame) == NULL) {
+                return -1;
+            }
+        }
+        return 0;
+    case WM_SIZE:
+        if (frame != NULL && frame->hTabs != NULL) {
+            LayoutSessions(frame);
+        }
+        return 0;
+    case WM_SETFOCUS:
+        if (active != NULL) {
+            SetFocus(active);
+        }
+        return 0;
+    case WM_NOTIFY:
+        {
+            NMHDR* nm = (NMHDR*)lParam;
+
+            if (nm->hwndFrom == frame->hTabs && nm->code == TCN_SELCHANGE) {
+                ShowSession(frame, TabCtrl_GetCurSel(frame->hTabs));
+            }
+        }
+        return 0;
+    case WM_COMMAND:
+        switch (LOWORD(wParam)) {
+        case ID_EXIT:
+            DestroyWindow(hwnd);
+            break;
+        case ID_NEW_SESSION:
+            if (OpenSession(frame) == NULL) {
+                DWORD dwError = GetLastError();
+                ReportError(dwError);
+            }
+            break;
+        case ID_CLOSE_SESSION:
+            /* There is always a session to show */
+            if (frame->count > 1) {
+                CloseSession(frame, frame->active);
+            }
+            break;
+        default:
+            if (active != NULL) {
+                SendMessage(active, WM_COMMAND, wParam, lParam);
+            }
+            break;
+        }
+        return 0;
+    case TWM_TXDATA:
+    case TWM_SETBAUD:
+        /* From the shared instance of an emulator older than version 5,
+           which can only mean the session shown */
+        if (active != NULL) {
+            return SendMessage(active, message, wParam, lParam);
+        }
+        if (message == TWM_TXDATA) {
+            free((BYTE*)wParam);
+        }
+        return 0;
+    case WM_DEVICECHANGE:
+        {
+            DWORD i;
+
+            /* Only top-level windows are told; every session has a port */
+            for (i = 0; frame != NULL && i < frame->count; i++) {
+                SendMessage(frame->sessions[i]->hwnd, message, wParam, lParam);
+            }
+        }
+        return TRUE;
+    case WM_DESTROY:
+        if (frame != NULL) {
+            while (frame->count > 0) {
+                CloseSession(frame, frame->count - 1);
+            }
+            free(frame->sessions);
+            frame->sessions = NULL;
+            frame->capacity = 0;
+
+            PluginFree(&frame->plugins);
+            IoPoolStop(&frame->pool);
+        }
+        PostQuitMessage(0);
+        return 0;
+    }
+    return DefWindowProc (hwnd, message, wParam, lParam);
+}
+
+/**
+ * Message handling for a session window, which shows the emulator's screen
+ * and takes the keyboard while it is the session shown.
+ *
+ * @param HWND hwnd     The handle to the window which received the event
+ * @param UINT msg      The numeric value of the Windows message
+ * @param WPARAM wParam Additional message data depending on the message type
+ * @param LPARAM lParam Additional message data depending on the message type
+ * @return zero if the message was handled, non-zero otherwise
+ */
+LRESULT CALLBACK WndProc (HWND hwnd, UINT message,
+                          WPARAM wParam, LPARAM lParam) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    switch(message) {
+    case WM_CREATE:
+        {
+            CREATESTRUCT* cs = (CREATESTRUCT*)lParam;
+
+            if ((ti = (TermInfo*)malloc(sizeof(TermInfo))) == NULL) {
+                return -1;
+            }
+            if (!TxQueueInit(&ti->held, HELD_SIZE)) {
+                free(ti);
+                return -1;
+            }
+
+            ti->dwMode = kModeCommand;
+            ti->hwnd = hwnd;
+            ti->frame = (FrameInfo*)cs->lpCreateParams;
+            ti->dwPort = 0;
+            ti->dwRetry = RECONNECT_MIN;
+            PortListInvalidate(&ti->ports);
+            ti->p_count = 0;
+            ti->port.hTxThread = NULL;
+            ti->bench.hThread = NULL;
+            ti->port.hRxIdle = NULL;
+            ti->port.transport = NULL;
+            ti->port.sock = INVALID_SOCKET;
+            ti->send.hFile = INVALID_HANDLE_VALUE;
+            ti->send.hMap = NULL;
+            ti->send.view = NULL;
+            ti->send.active = FALSE;
+            ti->dwFlow = kFlowPort;
+            TransferInit(&ti->xfer, hwnd, &ti->port);
+            CaptureInit(&ti->capture);
+            HostInit(&ti->host, hwnd, &ti->port.stats);
+            PipelineInit(&ti->rx);
+            PipelineInsert(&ti->rx, PIPELINE_MAX, TransferStage, &ti->xfer);
+            ti->hStats = NULL;
+            ti->rxarrived.QuadPart = 0;
+            ZeroMemory(&ti->damage, sizeof(EmulatorDamage));
+            ti->damaged.QuadPart = 0;
+            ti->paintPending = FALSE;
+            ti->dwPainted = 0;
+            ti->e_idx = 0;
+            ti->emu = NULL;
+            ReplayInit(&ti->replay);
+            StatsReset(&ti->port.stats);
+            SetWindowLongPtr(hwnd, 0, (LONG_PTR)ti);
+        }
+        return 0;
+    case WM_SETTEXT:
+        {
+            LRESULT ret = DefWindowProc(hwnd, message, wParam, lParam);
+
+            /* The caption shows the title of the session shown */
+            if (ti != NULL && SessionShown(hwnd)) {
+                SetWindowText(ti->frame->hwnd, (LPCTSTR)lParam);
+            }
+            return ret;
+        }
+    case WM_LBUTTONDOWN:
+        /* Take the keyboard back from the tabs */
+        SetFocus(hwnd);
+        return 0;
+    case WM_COMMAND:
+        switch (LOWORD(wParam)){
+        case ID_DISCONNECT:
+            CommandMode(hwnd);
+            InvalidateRect(hwnd, NULL, TRUE);
+            break;
+        case ID_SENDFILE:
+            SendFile(hwnd);
+            break;
+        case ID_PASTE:
+            PasteClipboard(hwnd);
+            break;
+        case ID_CAPTURE:
+            ToggleCapture(hwnd);
+            break;
+        case ID_DECODER:
+            ToggleDecoder(hwnd);
+            break;
+        case ID_FLOW_NONE:
+        case ID_FLOW_RTSCTS:
+        case ID_FLOW_XONXOFF:
+            SetFlowControl(hwnd, kFlowNone + (LOWORD(wParam) - ID_FLOW_NONE));
+            break;
+        case ID_STATS:
+            ShowStats(hwnd);
+            break;
+        case ID_STATS_SAVE:
+            SaveStats(hwnd);
+            break;
+        case ID_BENCH:
+            BenchmarkPort(hwnd);
+            break;
+        case ID_ZMODEM_SEND:
+        case ID_YMODEM_SEND:
+        case ID_XMODEM_SEND:
+        case ID_ZMODEM_RECV:
+        case ID_YMODEM_RECV:
+        case ID_XMODEM_RECV:
+        case ID_XFER_CANCEL:
+            StartTransfer(hwnd, LOWORD(wParam));
+            break;
+        default:
+            {
+                if (LOWORD(wParam) >= ID_COM_START &&
+                        LOWORD(wParam) < ID_COM_START + PORTLIST_MAX) {
+                    DWORD port = LOWORD(wParam) - ID_COM_START;
+
+                    ConnectMode(hwnd, port);
+                } else if (LOWORD(wParam) >= ID_PROFILE_START &&
+                        LOWORD(wParam) < ID_PROFILE_START + ti->p_count) {
+                    DWORD profile = LOWORD(wParam) - ID_PROFILE_START;
+
+                    ConnectProfile(hwnd, ti->profiles[profile], FALSE);
+                } else if (LOWORD(wParam) >= ID_EMU_START &&
+                        LOWORD(wParam) < ID_EMU_START + ti->frame->plugins.count) {
+                    DWORD emu_idx = LOWORD(wParam) - ID_EMU_START;
+
+                    SelectEmulator(hwnd, emu_idx);
+                }
+            }
+            break;
+        }
+        return 0;
+    case WM_PAINT:
+        {
+            HDC hdc;
+            PAINTSTRUCT ps;
+
+            hdc = BeginPaint(hwnd, &ps);
+            if (ti->dwMode == kModeCommand) {
+                HBRUSH bg = CreateSolidBrush(RGB(64, 64, 64));
+                RECT r;
+                GetClientRect(hwnd, &r);
+
+                FillRect(hdc, &r, bg);
+                DeleteObject(bg);
+            } else {
+                DWORD ret = 0;
+
+                if ((ret = CurrentEmulator(ti)->paint(hwnd,
+                        (LPVOID)CurrentEmulator(ti)->emulator_data, hdc, TRUE)) != 0) {
+                    /* An error occurred while painting the text */
+                    DWORD dwError = GetLastError();
+                    ReportError(dwError);
+                }
+            }
+
+            EndPaint (hwnd, &ps);
+        }
+        return 0;
+    case WM_CHAR:
+        {
+            if (ti->dwMode == kModeConnect) {
+                size_t datalen = 0;
+                StringCchLength((LPCTSTR)&wParam, 1024, &datalen);
+                if (QueueInput(hwnd, (const BYTE*)&wParam, datalen) != 0) {
+                    DWORD dwError = GetLastError();
+                    ReportError(dwError);
+                }
+            }
+        }
+        return 0;
+    case WM_KEYUP:
+        {
+            if (ti->dwMode == kModeConnect) {
+                LPCSTR data = CurrentEmulator(ti)->escape_input(
+                        (LPVOID)CurrentEmulator(ti)->emulator_data, wParam);
+                if (data == NULL)
+                    return 0;
+
+                if (QueueInput(hwnd, (const BYTE*)data, strlen(data)) != 0) {
+                    DWORD dwError = GetLastError();
+                    ReportError(dwError);
+                }
+            }
+        }
+        return 0;
+    case TWM_RXDATA:
+        {
+            if (ti->dwMode == kModeConnect) {
+                BYTE* rx = (BYTE*)wParam;
+
+                /* The pool thread waits on this, so the stamp holds still */
+                ti->rxarrived = ti->port.rxarrived;
+                RouteData(hwnd, rx, (DWORD)lParam);
+                ti->rxarrived.QuadPart = 0;
+                free(rx);
+            } else {
+                /* Data that arrived as the port was closing is dropped */
+                free((BYTE*)wParam);
+            }
+        }
+        return 0;
+    case TWM_PAINT:
+        PaintDamage(hwnd);
+        return 0;
+    case TWM_HOSTDATA:
+        HostData(hwnd, (BYTE*)wParam, (DWORD)lParam);
+        free((BYTE*)wParam);
+        return 0;
+    case TWM_HOSTLOST:
+        HostLost(hwnd);
+        return 0;
+    case TWM_TXDATA:
+        {
+            if (ti->dwMode == kModeConnect) {
+                BYTE* data = (BYTE*)wParam;
+                if (data == NULL)
+                    return 0;
+
+                if (QueueInput(hwnd, data, (DWORD)lParam) != 0) {
+                    DWORD dwError = GetLastError();
+                    ReportError(dwError);
+                }
+
+                free(data);
+            }
+        }
+        return 0;
+    case TWM_SETBAUD:
+        {
+            DWORD previous = 0;
+
+            if (ti->dwMode != kModeConnect) {
+                return 0;
+            }
+
+            if (SetPortBaud(&ti->port, (DWORD)wParam, &previous) != 0) {
+                return 0;
+            }
+
+            if (wParam != 0) {
+                ti->hBaud = (HWND)lParam;
+            }
+            return previous;
+        }
+    case TWM_BAUDDONE:
+        if (ti->hBaud != NULL) {
+            PostMessage(ti->hBaud, TWM_BAUDDONE, wParam, lParam);
+            ti->hBaud = NULL;
+        }
+        return 0;
+    case TWM_TXDONE:
+        SendHeld(hwnd);
+        ReportSendProgress(hwnd, (DWORD)lParam);
+        TransferPump(&ti->xfer);
+        return 0;
+    case WM_TIMER:
+        if (wParam == XFER_TIMER) {
+            TransferTimeout(&ti->xfer);
+        } else if (wParam == RECONNECT_TIMER) {
+            Reconnect(hwnd);
+        }
+        return 0;
+    case TWM_PORTLOST:
+        PortLost(hwnd);
+        return 0;
+    case TWM_BENCHSTEP:
+        BenchmarkStep(hwnd, (DWORD)wParam, (DWORD)lParam);
+        return 0;
+    case TWM_BENCHDONE:
+        BenchmarkDone(hwnd, (int)wParam, (DWORD)lParam);
+        return 0;
+    case WM_DEVICECHANGE:
+        {
+            DEV_BROADCAST_HDR* hdr = (DEV_BROADCAST_HDR*)lParam;
+
+            /* Only arrivals and removals carry a device header */
+            if ((wParam != DBT_DEVICEARRIVAL && wParam != DBT_DEVICEREMOVECOMPLETE) ||
+                    hdr == NULL || hdr->dbch_devicetype != DBT_DEVTYP_PORT) {
+                return TRUE;
+            }
+
+            PortListInvalidate(&ti->ports);
+            if (ti->dwMode == kModeCommand) {
+                UpdatePorts(hwnd);
+            }
+
+            if (wParam == DBT_DEVICEARRIVAL && ti->dwMode == kModeReconnect) {
+                /* Don't wait out the backoff when a port appears */
+                Reconnect(hwnd);
+            } else if (wParam == DBT_DEVICEREMOVECOMPLETE &&
+                    ti->dwMode == kModeConnect) {
+                DEV_BROADCAST_PORT* dbp = (DEV_BROADCAST_PORT*)lParam;
+
+                /* Notifications name the port without its device prefix */
+                if (_tcsicmp(dbp->dbcp_name, PortShortName(ti->port.name)) == 0) {
+                    PortLost(hwnd);
+                }
+            }
+        }
+        return TRUE;
+    }
+    return DefWindowProc (hwnd, message, wParam, lParam);
+}
+
+/**
+ * Message handling for the statistics window, which shows the counters of
+ * the serial port and refreshes them on a timer.
+ *
+ * @param HWND hwnd     The handle to the statistics window
+ * @param UINT msg      The numeric value of the Windows message
+ * @param WPARAM wParam Additional message data depending on the message type
+ * @param LPARAM lParam Additional message data depending on the message type
+ * @return zero if the message was handled, non-zero otherwise
+ */
+LRESULT CALLBACK StatsWndProc (HWND hwnd, UINT message,
+                               WPARAM wParam, LPARAM lParam) {
+    TermInfo* ti = (TermInfo*)GetWindowLongPtr(hwnd, 0);
+
+    switch(message) {
+    case WM_CREATE:
+        {
+            CREATESTRUCT* cs = (CREATESTRUCT*)lParam;
+
+            SetWindowLongPtr(hwnd, 0, (LONG_PTR)cs->lpCreateParams);
+            SetTimer(hwnd, STATS_TIMER, STATS_REFRESH, NULL);
+        }
+        return 0;
+    case WM_TIMER:
+        InvalidateRect(hwnd, NULL, TRUE);
+        return 0;
+    case WM_PAINT:
+        {
+            HDC hdc;
+            PAINTSTRUCT ps;
+            RECT r;
+            TCHAR text[1024];
+
+            StatsFormat(&ti->port.stats, text, 1024);
+
+            hdc = BeginPaint(hwnd, &ps);
+            GetClientRect(hwnd, &r);
+            InflateRect(&r, -8, -8);
+            SelectObject(hdc, GetStockObject(DEFAULT_GUI_FONT));
+            SetBkMode(hdc, TRANSPARENT);
+            DrawText(hdc, text, -1, &r, DT_LEFT | DT_TOP);
+            EndPaint(hwnd, &ps);
+        }
+        return 0;
+    case WM_DESTROY:
+        KillTimer(hwnd, STATS_TIMER);
+        if (ti != NULL) {
+            ti->hStats = NULL;
+            ti->hBaud = NULL;
+        }
+        return 0;
+    }
+    return DefWindowProc (hwnd, message, wParam, lParam);
+}
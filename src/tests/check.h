@@ -0,0 +1,28 @@
+/**
+ * @filename check.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the check used by the unit tests. A failed check is
+ * printed with its file and line and counted in failures, and the test
+ * carries on; a test's main returns failures as its exit code, so 0 means
+ * it passed.
+ */
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * @filename crctest.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 29
+ * @project Terminal Emulator
+ *
+ * This file contains the tests of the checksums used by the file transfer
+ * protocols: the standard check values of CRC-16/XMODEM and CRC-32, and
+ * that the slicing-by-8 CRC-32 agrees with the plain bitwise method
+ * whatever the length, alignment and chaining of the data.
+ *
+ * The bitwise CRC-32 below is the reference; it shares no tables with
+ * crc.c, so a mistake in generating them can't pass unnoticed. The
+ * Makefile here runs it with the other plain C tests.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "../../crc.h"
+#include "../check.h"
+
+/* The input of the standard check values */
+static const BYTE kCheck[] = "123456789";
+
+/**
+ * Computes the CRC-32 of a block of data one bit at a time, the slowest
+ * and plainest way, to check the tables against.
+ *
+ * @param const BYTE* data  The data.
+ * @param DWORD len         The number of bytes of data.
+ * @returns The CRC-32.
+ */
+static DWORD crc32_bitwise(const BYTE* data, DWORD len) {
+    DWORD crc = 0xFFFFFFFFUL;
+    DWORD i = 0;
+    int bit = 0;
+
+    for (i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320UL : (crc >> 1);
+        }
+    }
+
+    return ~crc;
+}
+
+/**
+ * Checks the standard check values of both checksums.
+ *
+ * @returns none
+ */
+static void test_check_values(void) {
+    CHECK(Crc32(0, kCheck, 9) == 0xCBF43926UL);
+    CHECK(Crc16(0, kCheck, 9) == 0x31C3);
+    CHECK(Crc32(0, kCheck, 0) == 0);
+}
+
+/**
+ * Checks the slicing-by-8 CRC-32 against the bitwise one for every length
+ * up to a few steps of eight, starting at every alignment.
+ *
+ * @returns none
+ */
+static void test_lengths(void) {
+    BYTE data[80];
+    DWORD offset = 0;
+    DWORD len = 0;
+    DWORD i = 0;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (BYTE)(i * 29 + 7);
+    }
+
+    for (offset = 0; offset < 8; offset++) {
+        for (len = 0; len + offset <= 64 + 8; len++) {
+            DWORD want = crc32_bitwise(data + offset, len);
+            DWORD got = Crc32(0, data + offset, len);
+
+            if (got != want) {
+                printf("offset %lu length %lu: %08lX, want %08lX\n",
+                        (unsigned long)offset, (unsigned long)len,
+                        (unsigned long)got, (unsigned long)want);
+            }
+            CHECK(got == want);
+        }
+    }
+}
+
+/**
+ * Checks that a CRC chained over two calls, split at every point, is the
+ * CRC of the whole, as ZMODEM computes it over a subpacket and its end.
+ *
+ * @returns none
+ */
+static void test_chaining(void) {
+    BYTE data[256];
+    DWORD whole32 = 0;
+    WORD whole16 = 0;
+    DWORD split = 0;
+    DWORD i = 0;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (BYTE)(i ^ 0x5A);
+    }
+
+    whole32 = Crc32(0, data, sizeof(data));
+    whole16 = Crc16(0, data, sizeof(data));
+    CHECK(whole32 == crc32_bitwise(data, sizeof(data)));
+
+    for (split = 0; split <= sizeof(data); split++) {
+        CHECK(Crc32(Crc32(0, data, split), data + split,
+                sizeof(data) - split) == whole32);
+        CHECK(Crc16(Crc16(0, data, split), data + split,
+                sizeof(data) - split) == whole16);
+    }
+}
+
+int main(void) {
+    test_check_values();
+    test_lengths();
+    test_chaining();
+
+    printf("crctest: %d failed\n", failures);
+    return failures;
+}
@@ -0,0 +1,278 @@
+/**
+ * @filename hosttest.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the tests of running a decoder in the plugin host.
+ * The passthrough decoder is started in pluginhost.exe exactly as a
+ * session starts one, data is handed to it through the host stage, and
+ * what comes back with TWM_HOSTDATA is compared with what went in. It
+ * checks:
+ *
+ *   that data larger than a decoder chunk comes back whole and in order
+ *
+ *   that a host that is killed is started again, and that what is handed
+ *   to it afterwards comes back
+ *
+ *   that a host whose ring counters have been scribbled on is given up on
+ *   rather than started again
+ *
+ * pluginhost.exe and passthrough.dll are expected next to the test, where
+ * the solution builds them. Every exchange is waited on for at most
+ * HOSTTEST_TIMEOUT, so a test that hangs fails instead of stopping the run.
+ */
+#include <stdio.h>
+#include "../../host.h"
+#include "../check.h"
+
+/* Window class of the session */
+#define HOSTTEST_CLASS TEXT("Host Test")
+/* The decoder, found next to the test */
+#define HOSTTEST_DECODER TEXT("passthrough.dll")
+/* Longest wait (ms) for an exchange to finish */
+#define HOSTTEST_TIMEOUT 5000
+/* Bytes handed to the host in each test, and in each call of the stage */
+#define HOSTTEST_DATA 65536
+#define HOSTTEST_SLICE 1000
+
+/**
+ * The HostEnd structure contains the session's side of the host and what
+ * it has been sent.
+ *
+ * @member HWND hwnd        The window that gets the host's messages
+ * @member Host host        The host
+ * @member PortStats stats  The counters the host reports dropped data to
+ * @member BYTE rx[]        The decoded data
+ * @member DWORD rxlen      The length of rx
+ * @member DWORD lost       The number of TWM_HOSTLOST messages
+ * @member int restart      What HostRestart returned for the last one
+ */
+typedef struct _HostEnd {
+    HWND hwnd;
+    Host host;
+    PortStats stats;
+    BYTE rx[HOSTTEST_DATA];
+    DWORD rxlen;
+    DWORD lost;
+    int restart;
+} HostEnd;
+
+/**
+ * Message handling for the window of the session. Keeps the decoded data,
+ * and starts the host again when it is lost, as a session does.
+ *
+ * @param HWND hwnd         The window.
+ * @param UINT message      The message.
+ * @param WPARAM wParam     The first parameter of the message.
+ * @param LPARAM lParam     The second parameter of the message.
+ * @returns The result of the message.
+ */
+static LRESULT CALLBACK HostProc(HWND hwnd, UINT message, WPARAM wParam,
+        LPARAM lParam) {
+    HostEnd* end = (HostEnd*)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+
+    if (end == NULL) {
+        return DefWindowProc(hwnd, message, wParam, lParam);
+    }
+
+    switch (message) {
+    case TWM_HOSTDATA:
+        {
+            DWORD len = min((DWORD)lParam, HOSTTEST_DATA - end->rxlen);
+
+            CopyMemory(end->rx + end->rxlen, (BYTE*)wParam, len);
+            end->rxlen += len;
+            free((BYTE*)wParam);
+        }
+        return 0;
+    case TWM_HOSTLOST:
+        end->lost++;
+        end->restart = HostRestart(&end->host);
+        return 0;
+    }
+
+    return DefWindowProc(hwnd, message, wParam, lParam);
+}
+
+/**
+ * Fills a buffer with a pattern that differs from one offset to the next.
+ *
+ * @param BYTE* data    The buffer.
+ * @param DWORD len     The length of the buffer.
+ * @param DWORD seed    Where in the pattern to start.
+ * @returns none
+ */
+static void fill(BYTE* data, DWORD len, DWORD seed) {
+    DWORD i;
+
+    for (i = 0; i < len; i++) {
+        data[i] = (BYTE)((seed + i) * 7 + 3);
+    }
+}
+
+/**
+ * Runs the window's messages until it has been sent want bytes of decoded
+ * data, or lost the host lost times, or the exchange times out.
+ *
+ * @param HostEnd* end  The session's side.
+ * @param DWORD want    The bytes the window should be sent.
+ * @param DWORD lost    The TWM_HOSTLOST messages it should be sent.
+ * @returns none
+ */
+static void TestPump(HostEnd* end, DWORD want, DWORD lost) {
+    DWORD began = GetTickCount();
+
+    while ((end->rxlen < want || end->lost < lost) &&
+            GetTickCount() - began < HOSTTEST_TIMEOUT) {
+        MSG msg;
+
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+            DispatchMessage(&msg);
+        }
+        Sleep(10);
+    }
+}
+
+/**
+ * Hands data to the host through the host stage, in slices as the pipeline
+ * would, and checks that it all comes back as it went in.
+ *
+ * @param HostEnd* end  The session's side.
+ * @param DWORD seed    Where in the pattern the data starts.
+ * @returns none
+ */
+static void TestSend(HostEnd* end, DWORD seed) {
+    BYTE* in = (BYTE*)malloc(HOSTTEST_DATA);
+    RxSlice slice;
+    DWORD off = 0;
+
+    CHECK(in != NULL);
+    if (in == NULL) {
+        return;
+    }
+    fill(in, HOSTTEST_DATA, seed);
+    end->rxlen = 0;
+
+    while (off < HOSTTEST_DATA) {
+        slice.data = in + off;
+        slice.len = min(HOSTTEST_SLICE, HOSTTEST_DATA - off);
+        CHECK(HostStage(&end->host, &slice, NULL, 0) == 0);
+        off += slice.len;
+    }
+
+    TestPump(end, HOSTTEST_DATA, 0);
+    CHECK(end->rxlen == HOSTTEST_DATA);
+    CHECK(memcmp(end->rx, in, HOSTTEST_DATA) == 0);
+    CHECK(end->stats.hostOverruns == 0);
+
+    free(in);
+}
+
+/**
+ * Checks that data comes back through the host unchanged.
+ *
+ * @param HostEnd* end  The session's side, with the host running.
+ * @returns none
+ */
+static void test_roundtrip(HostEnd* end) {
+    TestSend(end, 0);
+    CHECK(end->lost == 0);
+}
+
+/**
+ * Checks that a host that is killed is started again, and decodes what is
+ * handed to it afterwards.
+ *
+ * @param HostEnd* end  The session's side, with the host running.
+ * @returns none
+ */
+static void test_restart(HostEnd* end) {
+    DWORD lost = end->lost;
+
+    TerminateProcess(end->host.hProcess, 1);
+    TestPump(end, 0, lost + 1);
+    CHECK(end->lost == lost + 1);
+    CHECK(end->restart == 0);
+    CHECK(HostRunning(&end->host));
+
+    TestSend(end, 1000);
+}
+
+/**
+ * Checks that a host is killed and given up on once the counters of its
+ * ring are more than HOST_RING apart, and that the data handed to it is
+ * counted as dropped.
+ *
+ * @param HostEnd* end  The session's side, with the host running.
+ * @returns none
+ */
+static void test_broken(HostEnd* end) {
+    BYTE in[16];
+    RxSlice slice;
+    DWORD lost = end->lost;
+
+    fill(in, 16, 0);
+    slice.data = in;
+    slice.len = 16;
+
+    end->host.shm->in.head = end->host.shm->in.tail + HOST_RING + 1;
+    CHECK(HostStage(&end->host, &slice, NULL, 0) == 0);
+    CHECK(end->stats.hostOverruns == 16);
+
+    TestPump(end, 0, lost + 1);
+    CHECK(end->lost == lost + 1);
+    CHECK(end->restart == 3);
+}
+
+int _tmain(int argc, TCHAR* argv[]) {
+    WNDCLASS wc;
+    TCHAR path[MAX_PATH];
+    LPTSTR slash = NULL;
+    HostEnd* end = (HostEnd*)calloc(1, sizeof(HostEnd));
+
+    if (end == NULL) {
+        printf("hosttest: out of memory\n");
+        return 1;
+    }
+
+    ZeroMemory(&wc, sizeof(WNDCLASS));
+    wc.lpfnWndProc = HostProc;
+    wc.hInstance = GetModuleHandle(NULL);
+    wc.lpszClassName = HOSTTEST_CLASS;
+    RegisterClass(&wc);
+
+    end->hwnd = CreateWindow(HOSTTEST_CLASS, TEXT(""), 0, 0, 0, 0, 0,
+            HWND_MESSAGE, NULL, GetModuleHandle(NULL), NULL);
+    if (end->hwnd == NULL) {
+        printf("hosttest: can't make a window\n");
+        return 1;
+    }
+    SetWindowLongPtr(end->hwnd, GWLP_USERDATA, (LONG_PTR)end);
+
+    GetModuleFileName(NULL, path, MAX_PATH);
+    slash = _tcsrchr(path, TEXT('\\'));
+    slash = (slash != NULL) ? slash + 1 : path;
+    *slash = TEXT('\0');
+    StringCchCat(path, MAX_PATH, HOSTTEST_DECODER);
+
+    StatsReset(&end->stats);
+    HostInit(&end->host, end->hwnd, &end->stats);
+    if (HostStart(&end->host, path) != 0) {
+        _tprintf(TEXT("hosttest: can't start %s with %s (error %lu)\n"),
+                HOST_EXE, path, GetLastError());
+        return 1;
+    }
+
+    test_roundtrip(end);
+    test_restart(end);
+    test_broken(end);
+
+    HostStop(&end->host);
+    DestroyWindow(end->hwnd);
+    free(end);
+
+    printf("hosttest: %d failed\n", failures);
+    return failures;
+}
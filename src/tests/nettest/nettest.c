@@ -0,0 +1,404 @@
+/**
+ * @filename nettest.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the tests of network connections. The test listens
+ * on 127.0.0.1, connects to itself with OpenNet, and plays the terminal
+ * server from the accepted socket, while the connection is read by the
+ * I/O pool exactly as a session's is. It checks:
+ *
+ *   that the opening request and the answers to option negotiation are
+ *   the ones expected, and that agreed options are not answered again
+ *
+ *   that IAC is escaped going out and unescaped coming in, and that a raw
+ *   connection passes it through untouched
+ *
+ *   that TCP_NODELAY is set as asked
+ *
+ * Every exchange is waited on for at most NETTEST_TIMEOUT, so a test that
+ * hangs fails instead of stopping the run. It needs Winsock and a
+ * loopback interface, so it is only built in the solution.
+ */
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <stdio.h>
+#include "../../net.h"
+#include "../../iopool.h"
+#include "../check.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+/* Window class of the connection */
+#define NETTEST_CLASS TEXT("Network Test")
+/* Longest wait (ms) for an exchange to finish */
+#define NETTEST_TIMEOUT 5000
+
+/**
+ * The NetEnd structure contains the terminal's end of the connection and
+ * what it has received.
+ *
+ * @member HWND hwnd        The window that gets the connection's messages
+ * @member SerialPort port  The connection
+ * @member BYTE rx[]        The data passed on to the window
+ * @member DWORD rxlen      The length of rx
+ * @member BOOLEAN lost     TRUE if the connection failed
+ */
+typedef struct _NetEnd {
+    HWND hwnd;
+    SerialPort port;
+    BYTE rx[256];
+    DWORD rxlen;
+    BOOLEAN lost;
+} NetEnd;
+
+/**
+ * Message handling for the window of the connection. Keeps what would be
+ * given to the emulator.
+ *
+ * @param HWND hwnd         The window.
+ * @param UINT message      The message.
+ * @param WPARAM wParam     The first parameter of the message.
+ * @param LPARAM lParam     The second parameter of the message.
+ * @returns The result of the message.
+ */
+static LRESULT CALLBACK NetProc(HWND hwnd, UINT message, WPARAM wParam,
+        LPARAM lParam) {
+    NetEnd* end = (NetEnd*)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+
+    if (end == NULL) {
+        return DefWindowProc(hwnd, message, wParam, lParam);
+    }
+
+    switch (message) {
+    case TWM_RXDATA:
+        {
+            DWORD len = min((DWORD)lParam, sizeof(end->rx) - end->rxlen);
+
+            CopyMemory(end->rx + end->rxlen, (BYTE*)wParam, len);
+            end->rxlen += len;
+            free((BYTE*)wParam);
+        }
+        return 0;
+    case TWM_PORTLOST:
+        end->lost = TRUE;
+        return 0;
+    }
+
+    return DefWindowProc(hwnd, message, wParam, lParam);
+}
+
+/**
+ * Opens a listening socket on 127.0.0.1 at a port chosen by the system.
+ *
+ * @param LPTSTR address    Receives the address to connect to.
+ * @returns The socket, or INVALID_SOCKET on failure.
+ */
+static SOCKET TestListen(LPTSTR address) {
+    SOCKET sock = INVALID_SOCKET;
+    struct sockaddr_in sin;
+    int len = sizeof(sin);
+
+    ZeroMemory(&sin, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin.sin_port = 0;
+
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET) {
+        return sock;
+    }
+
+    if (bind(sock, (struct sockaddr*)&sin, sizeof(sin)) != 0 ||
+            getsockname(sock, (struct sockaddr*)&sin, &len) != 0 ||
+            listen(sock, 1) != 0) {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+
+    StringCchPrintf(address, SERIAL_NAME, TEXT("127.0.0.1:%u"),
+            ntohs(sin.sin_port));
+    return sock;
+}
+
+/**
+ * Connects to the listening socket with OpenNet, reads the connection on
+ * the pool, and accepts the server's end.
+ *
+ * @param NetEnd* end       The terminal's end.
+ * @param IoPool* pool      The I/O pool.
+ * @param SOCKET listener   The listening socket.
+ * @param LPCTSTR address   The address it listens on.
+ * @param BOOLEAN telnet    TRUE to speak telnet.
+ * @param BOOLEAN nodelay   TRUE to turn off Nagle's algorithm.
+ * @returns The server's end, or INVALID_SOCKET on failure.
+ */
+static SOCKET TestOpen(NetEnd* end, IoPool* pool, SOCKET listener,
+        LPCTSTR address, BOOLEAN telnet, BOOLEAN nodelay) {
+    SOCKET server = INVALID_SOCKET;
+
+    ZeroMemory(end, sizeof(NetEnd));
+    end->port.sock = INVALID_SOCKET;
+
+    end->hwnd = CreateWindow(NETTEST_CLASS, address, 0, 0, 0, 0, 0,
+            HWND_MESSAGE, NULL, GetModuleHandle(NULL), NULL);
+    if (end->hwnd == NULL) {
+        return INVALID_SOCKET;
+    }
+    SetWindowLongPtr(end->hwnd, GWLP_USERDATA, (LONG_PTR)end);
+
+    /* The backlog takes the connection before accept is called */
+    if (OpenNet(address, &end->port, end->hwnd, telnet, nodelay, 0, 0,
+            TEXT("VT100")) != 0) {
+        return INVALID_SOCKET;
+    }
+
+    server = accept(listener, NULL, NULL);
+    if (server == INVALID_SOCKET) {
+        ClosePort(&end->port);
+        return INVALID_SOCKET;
+    }
+
+    if (IoPoolAttach(pool, &end->port) != 0) {
+        closesocket(server);
+        ClosePort(&end->port);
+        return INVALID_SOCKET;
+    }
+
+    return server;
+}
+
+/**
+ * Stops reading the terminal's end of the connection and closes both.
+ *
+ * @param NetEnd* end       The terminal's end.
+ * @param SOCKET server     The server's end.
+ * @returns none
+ */
+static void TestClose(NetEnd* end, SOCKET server) {
+    if (end->port.hRxIdle != NULL) {
+        IoPoolDetach(&end->port);
+        ClosePort(&end->port);
+    }
+    if (server != INVALID_SOCKET) {
+        closesocket(server);
+    }
+    if (end->hwnd != NULL) {
+        DestroyWindow(end->hwnd);
+    }
+}
+
+/**
+ * Runs the window's messages and reads the server's end until the terminal
+ * has been given rxwant bytes and the server has read srvwant, or the
+ * exchange times out. The pool thread sends TWM_RXDATA, so messages are
+ * pumped between reads rather than blocking on the socket.
+ *
+ * @param NetEnd* end       The terminal's end.
+ * @param SOCKET server     The server's end.
+ * @param DWORD rxwant      The bytes the terminal should be given.
+ * @param BYTE* srv         Receives what the server reads.
+ * @param DWORD srvwant     The bytes the server should read.
+ * @returns The number of bytes the server read.
+ */
+static DWORD TestExchange(NetEnd* end, SOCKET server, DWORD rxwant, BYTE* srv,
+        DWORD srvwant) {
+    DWORD began = GetTickCount();
+    DWORD got = 0;
+
+    while ((end->rxlen < rxwant || got < srvwant) && !end->lost &&
+            GetTickCount() - began < NETTEST_TIMEOUT) {
+        struct timeval tv = { 0, 10000 };
+        fd_set readable;
+        MSG msg;
+
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+            DispatchMessage(&msg);
+        }
+
+        FD_ZERO(&readable);
+        FD_SET(server, &readable);
+        if (got < srvwant && select(0, &readable, NULL, NULL, &tv) == 1) {
+            int len = recv(server, (char*)srv + got, (int)(srvwant - got), 0);
+
+            if (len <= 0) {
+                break;
+            }
+            got += len;
+        } else if (got >= srvwant) {
+            Sleep(10);
+        }
+    }
+
+    /* Anything more would be an answer that should not have been sent */
+    {
+        struct timeval tv = { 0, 100000 };
+        fd_set readable;
+        char extra[16];
+
+        FD_ZERO(&readable);
+        FD_SET(server, &readable);
+        if (select(0, &readable, NULL, NULL, &tv) == 1 &&
+                recv(server, extra, sizeof(extra), 0) > 0) {
+            got = srvwant + 1;
+        }
+    }
+
+    return got;
+}
+
+/**
+ * Checks the opening request and the answers to the server's options and
+ * to its request for the terminal type.
+ *
+ * @param NetEnd* end       The terminal's end.
+ * @param SOCKET server     The server's end.
+ * @returns none
+ */
+static void test_negotiate(NetEnd* end, SOCKET server) {
+    static const BYTE kOpening[] = { TN_IAC, TN_DO, TN_SGA };
+    static const BYTE kOffer[] = {
+        TN_IAC, TN_WILL, TN_SGA,            /* agreed already: no answer */
+        TN_IAC, TN_WILL, TN_ECHO,
+        TN_IAC, TN_DO, TN_TTYPE,
+        TN_IAC, TN_DO, TN_NAWS,
+        TN_IAC, TN_DO, 39,                  /* NEW-ENVIRON: refused */
+        TN_IAC, TN_SB, TN_TTYPE, 1, TN_IAC, TN_SE
+    };
+    static const BYTE kAnswer[] = {
+        TN_IAC, TN_DO, TN_ECHO,
+        TN_IAC, TN_WILL, TN_TTYPE,
+        TN_IAC, TN_WILL, TN_NAWS,
+        TN_IAC, TN_SB, TN_NAWS, 0, NET_COLS, 0, NET_ROWS, TN_IAC, TN_SE,
+        TN_IAC, TN_WONT, 39,
+        TN_IAC, TN_SB, TN_TTYPE, 0, 'V', 'T', '1', '0', '0', TN_IAC, TN_SE
+    };
+    BYTE srv[64];
+
+    CHECK(TestExchange(end, server, 0, srv, sizeof(kOpening)) == sizeof(kOpening));
+    CHECK(memcmp(srv, kOpening, sizeof(kOpening)) == 0);
+
+    send(server, (const char*)kOffer, sizeof(kOffer), 0);
+    CHECK(TestExchange(end, server, 0, srv, sizeof(kAnswer)) == sizeof(kAnswer));
+    CHECK(memcmp(srv, kAnswer, sizeof(kAnswer)) == 0);
+
+    /* Commands are not data */
+    CHECK(end->rxlen == 0);
+}
+
+/**
+ * Checks that IAC is doubled going out and undoubled coming in, and that
+ * a bare CR goes out as CR NUL outside binary mode.
+ *
+ * @param NetEnd* end       The terminal's end.
+ * @param SOCKET server     The server's end.
+ * @returns none
+ */
+static void test_escape(NetEnd* end, SOCKET server) {
+    static const BYTE kIn[] = { 'a', TN_IAC, TN_IAC, 'b', TN_IAC, TN_NOP, 'c' };
+    static const BYTE kInPlain[] = { 'a', TN_IAC, 'b', 'c' };
+    static const BYTE kOut[] = { 'x', TN_IAC, 'y', '\r', '\r', '\n' };
+    static const BYTE kOutWire[] = { 'x', TN_IAC, TN_IAC, 'y', '\r', 0, '\r', '\n' };
+    BYTE srv[32];
+
+    end->rxlen = 0;
+    send(server, (const char*)kIn, sizeof(kIn), 0);
+    CHECK(TestExchange(end, server, sizeof(kInPlain), srv, 0) == 0);
+    CHECK(end->rxlen == sizeof(kInPlain));
+    CHECK(memcmp(end->rx, kInPlain, sizeof(kInPlain)) == 0);
+
+    CHECK(SendData(&end->port, (LPVOID)kOut, sizeof(kOut)) == 0);
+    CHECK(TestExchange(end, server, 0, srv, sizeof(kOutWire)) == sizeof(kOutWire));
+    CHECK(memcmp(srv, kOutWire, sizeof(kOutWire)) == 0);
+}
+
+/**
+ * Checks that a raw connection sends and receives IAC as it is.
+ *
+ * @param NetEnd* end       The terminal's end, opened without telnet.
+ * @param SOCKET server     The server's end.
+ * @returns none
+ */
+static void test_raw(NetEnd* end, SOCKET server) {
+    static const BYTE kData[] = { 'a', TN_IAC, TN_DO, TN_SGA, '\r', 'b' };
+    BYTE srv[32];
+
+    send(server, (const char*)kData, sizeof(kData), 0);
+    CHECK(TestExchange(end, server, sizeof(kData), srv, 0) == 0);
+    CHECK(end->rxlen == sizeof(kData));
+    CHECK(memcmp(end->rx, kData, sizeof(kData)) == 0);
+
+    CHECK(SendData(&end->port, (LPVOID)kData, sizeof(kData)) == 0);
+    CHECK(TestExchange(end, server, 0, srv, sizeof(kData)) == sizeof(kData));
+    CHECK(memcmp(srv, kData, sizeof(kData)) == 0);
+}
+
+/**
+ * Checks that TCP_NODELAY on the connection is what was asked for.
+ *
+ * @param NetEnd* end       The terminal's end.
+ * @param BOOLEAN nodelay   What OpenNet was asked for.
+ * @returns none
+ */
+static void test_nodelay(NetEnd* end, BOOLEAN nodelay) {
+    BOOL value = !nodelay;
+    int len = sizeof(BOOL);
+
+    CHECK(getsockopt(end->port.sock, IPPROTO_TCP, TCP_NODELAY, (char*)&value,
+            &len) == 0);
+    CHECK((value != 0) == (nodelay != 0));
+}
+
+int _tmain(int argc, TCHAR* argv[]) {
+    WSADATA wsa;
+    WNDCLASS wc;
+    IoPool pool;
+    NetEnd end;
+    TCHAR address[SERIAL_NAME];
+    SOCKET listener = INVALID_SOCKET;
+    SOCKET server = INVALID_SOCKET;
+
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        printf("nettest: can't start winsock\n");
+        return 1;
+    }
+
+    ZeroMemory(&wc, sizeof(WNDCLASS));
+    wc.lpfnWndProc = NetProc;
+    wc.hInstance = GetModuleHandle(NULL);
+    wc.lpszClassName = NETTEST_CLASS;
+    RegisterClass(&wc);
+
+    if ((listener = TestListen(address)) == INVALID_SOCKET ||
+            IoPoolStart(&pool) != 0) {
+        printf("nettest: can't listen on 127.0.0.1 (error %lu)\n",
+                (DWORD)WSAGetLastError());
+        return 1;
+    }
+
+    server = TestOpen(&end, &pool, listener, address, TRUE, TRUE);
+    CHECK(server != INVALID_SOCKET);
+    if (server != INVALID_SOCKET) {
+        test_nodelay(&end, TRUE);
+        test_negotiate(&end, server);
+        test_escape(&end, server);
+    }
+    TestClose(&end, server);
+
+    server = TestOpen(&end, &pool, listener, address, FALSE, FALSE);
+    CHECK(server != INVALID_SOCKET);
+    if (server != INVALID_SOCKET) {
+        test_nodelay(&end, FALSE);
+        test_raw(&end, server);
+    }
+    TestClose(&end, server);
+
+    IoPoolStop(&pool);
+    closesocket(listener);
+    WSACleanup();
+
+    printf("nettest: %d failed\n", failures);
+    return failures;
+}
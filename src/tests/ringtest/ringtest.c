@@ -0,0 +1,223 @@
+/**
+ * @filename ringtest.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the tests of the rings shared with the plugin host:
+ * that the counters wrap past 2^32 without losing data, that reads and
+ * writes split at the end of the buffer and stop short when they must,
+ * that data waiting when the host dies is there for the next one, and that
+ * counters the other side has scribbled on are refused rather than used.
+ *
+ * The ring is an ordinary allocation here rather than shared memory, and
+ * its counters are set directly to reach the wrap without writing 4GB.
+ * The Makefile here runs it with the other plain C tests.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../hostring.h"
+#include "../check.h"
+
+/**
+ * Fills a buffer with a pattern that differs from one offset to the next.
+ *
+ * @param BYTE* data    The buffer.
+ * @param DWORD len     The length of the buffer.
+ * @param DWORD seed    Where in the pattern to start.
+ * @returns none
+ */
+static void fill(BYTE* data, DWORD len, DWORD seed) {
+    DWORD i;
+
+    for (i = 0; i < len; i++) {
+        data[i] = (BYTE)((seed + i) * 7 + 3);
+    }
+}
+
+/**
+ * Checks that data written across the point where the counters wrap
+ * past 2^32 is counted and read back in order.
+ *
+ * @param HostRing* r   The ring to use.
+ * @returns none
+ */
+static void test_counter_wrap(HostRing* r) {
+    BYTE in[64];
+    BYTE out[64];
+
+    RingInit(r);
+    r->head = 0xFFFFFFF0;
+    r->tail = 0xFFFFFFF0;
+    CHECK(RingUsed(r) == 0);
+
+    fill(in, 64, 0);
+    CHECK(RingWrite(r, in, 64) == 64);
+    CHECK(r->head == 0x30);
+    CHECK(RingUsed(r) == 64);
+
+    CHECK(RingRead(r, out, 64) == 64);
+    CHECK(memcmp(in, out, 64) == 0);
+    CHECK(r->tail == 0x30);
+    CHECK(RingUsed(r) == 0);
+
+    /* Only the difference matters, so a full ring across the wrap is full */
+    r->head = 0x10;
+    r->tail = 0x10 - HOST_RING;
+    CHECK(RingUsed(r) == HOST_RING);
+    CHECK(RingWrite(r, in, 1) == 0);
+}
+
+/**
+ * Checks that reads and writes split at the end of the buffer, and that
+ * a write takes only what fits and a read only what is waiting.
+ *
+ * @param HostRing* r   The ring to use.
+ * @returns none
+ */
+static void test_edge(HostRing* r) {
+    BYTE in[16];
+    BYTE out[16];
+    BYTE* big = NULL;
+
+    RingInit(r);
+    r->head = HOST_RING - 4;
+    r->tail = HOST_RING - 4;
+
+    /* 4 bytes at the end of the buffer and 6 at the start */
+    fill(in, 10, 100);
+    CHECK(RingWrite(r, in, 10) == 10);
+    CHECK(memcmp(r->data + HOST_RING - 4, in, 4) == 0);
+    CHECK(memcmp(r->data, in + 4, 6) == 0);
+
+    /* A short read stops before the edge, the next one crosses it */
+    CHECK(RingRead(r, out, 3) == 3);
+    CHECK(memcmp(out, in, 3) == 0);
+    CHECK(RingRead(r, out, 16) == 7);
+    CHECK(memcmp(out, in + 3, 7) == 0);
+    CHECK(RingRead(r, out, 16) == 0);
+
+    /* Leave room for 5 bytes, ending at the edge */
+    big = (BYTE*)malloc(HOST_RING);
+    CHECK(big != NULL);
+    if (big == NULL) {
+        return;
+    }
+    RingInit(r);
+    r->head = 5;
+    r->tail = 5;
+    fill(big, HOST_RING - 5, 0);
+    CHECK(RingWrite(r, big, HOST_RING - 5) == HOST_RING - 5);
+    CHECK(r->head == HOST_RING);
+
+    fill(in, 10, 200);
+    CHECK(RingWrite(r, in, 10) == 5);
+    CHECK(RingUsed(r) == HOST_RING);
+    CHECK(RingWrite(r, in + 5, 5) == 0);
+
+    /* What was taken comes out last, from the start of the buffer */
+    CHECK(RingRead(r, big, HOST_RING - 5) == HOST_RING - 5);
+    CHECK(RingRead(r, out, 16) == 5);
+    CHECK(memcmp(out, in, 5) == 0);
+
+    free(big);
+}
+
+/**
+ * Checks that data waiting in the ring when the host dies, including what
+ * arrives while it is restarting, is read in order by the next host. The
+ * ring lives in the shared memory, which outlives the host process, and
+ * a new host does not empty it.
+ *
+ * @param HostRing* r   The ring to use.
+ * @returns none
+ */
+static void test_restart(HostRing* r) {
+    BYTE in[300];
+    BYTE out[300];
+
+    RingInit(r);
+    r->head = 0xFFFFFF00;
+    r->tail = 0xFFFFFF00;
+    fill(in, 300, 7);
+
+    /* The first host reads part of the data and dies */
+    CHECK(RingWrite(r, in, 200) == 200);
+    CHECK(RingRead(r, out, 120) == 120);
+    CHECK(memcmp(out, in, 120) == 0);
+
+    /* Data keeps arriving while no host is reading */
+    CHECK(RingWrite(r, in + 200, 100) == 100);
+    CHECK(RingUsed(r) == 180);
+
+    /* The next host picks up where the first stopped */
+    CHECK(RingRead(r, out, 300) == 180);
+    CHECK(memcmp(out, in + 120, 180) == 0);
+    CHECK(RingUsed(r) == 0);
+}
+
+/**
+ * Checks that a ring whose counters are more than HOST_RING apart, as
+ * only a host that has scribbled on the shared memory could leave them, is
+ * reported as broken, and that nothing is copied or moved.
+ *
+ * @param HostRing* r   The ring to use.
+ * @returns none
+ */
+static void test_poisoned(HostRing* r) {
+    BYTE in[16];
+    BYTE out[16];
+
+    fill(in, 16, 300);
+
+    /* head too far ahead of tail: a read would copy past the buffer */
+    RingInit(r);
+    r->tail = 0x100;
+    r->head = 0x100 + HOST_RING + 1;
+    memset(r->data, 0xAA, 16);
+    memset(out, 0x55, 16);
+    CHECK(RingUsed(r) == RING_BROKEN);
+    CHECK(RingRead(r, out, 16) == RING_BROKEN);
+    CHECK(RingWrite(r, in, 16) == RING_BROKEN);
+    CHECK(r->head == 0x100 + HOST_RING + 1);
+    CHECK(r->tail == 0x100);
+    CHECK(out[0] == 0x55 && out[15] == 0x55);
+    CHECK(r->data[1] == 0xAA && r->data[15] == 0xAA);
+
+    /* tail ahead of head: the difference wraps to nearly 2^32 */
+    r->head = 0x100;
+    r->tail = 0x110;
+    CHECK(RingUsed(r) == RING_BROKEN);
+    CHECK(RingRead(r, out, 16) == RING_BROKEN);
+    CHECK(RingWrite(r, in, 16) == RING_BROKEN);
+    CHECK(r->head == 0x100);
+    CHECK(r->tail == 0x110);
+    CHECK(out[0] == 0x55 && out[15] == 0x55);
+    CHECK(r->data[0] == 0xAA && r->data[15] == 0xAA);
+
+    /* Exactly full is still a ring */
+    r->head = 0x100 + HOST_RING;
+    r->tail = 0x100;
+    CHECK(RingUsed(r) == HOST_RING);
+    CHECK(RingWrite(r, in, 16) == 0);
+}
+
+int main(void) {
+    HostRing* r = (HostRing*)malloc(sizeof(HostRing));
+
+    if (r == NULL) {
+        printf("ringtest: out of memory\n");
+        return 1;
+    }
+
+    test_counter_wrap(r);
+    test_edge(r);
+    test_restart(r);
+    test_poisoned(r);
+
+    free(r);
+    printf("ringtest: %d failed\n", failures);
+    return failures;
+}
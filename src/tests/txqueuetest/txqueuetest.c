@@ -0,0 +1,157 @@
+/**
+ * @filename txqueuetest.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 27
+ * @project Terminal Emulator
+ *
+ * This file contains the tests of the transmit queue: that small sends are
+ * coalesced into one run, that data wraps around the end of the ring in
+ * order, that a full queue takes only what fits, and that draining it
+ * starts the ring over.
+ *
+ * Each test makes a queue of a few bytes, so the wrap and the full queue
+ * are reached without large buffers. The Makefile here runs it with the
+ * other plain C tests.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "../../txqueue.h"
+#include "../check.h"
+
+/**
+ * Checks that several small sends come back as a single run.
+ *
+ * @returns none
+ */
+static void test_coalesce(void) {
+    TxQueue q;
+    BYTE* run = NULL;
+    DWORD i;
+
+    CHECK(TxQueueInit(&q, 64));
+
+    for (i = 0; i < 10; i++) {
+        BYTE c = (BYTE)('a' + i);
+        CHECK(TxQueuePut(&q, &c, 1) == 1);
+    }
+
+    CHECK(TxQueuePeek(&q, &run, 64) == 10);
+    CHECK(memcmp(run, "abcdefghij", 10) == 0);
+
+    /* A write may take less than the whole run */
+    CHECK(TxQueuePeek(&q, &run, 4) == 4);
+    TxQueueConsume(&q, 4);
+    CHECK(TxQueuePeek(&q, &run, 64) == 6);
+    CHECK(memcmp(run, "efghij", 6) == 0);
+
+    TxQueueFree(&q);
+}
+
+/**
+ * Checks that data wrapping past the end of the ring comes out in order,
+ * as the run up to the end and then the rest from the start.
+ *
+ * @returns none
+ */
+static void test_wrap(void) {
+    TxQueue q;
+    BYTE* run = NULL;
+    BYTE out[16];
+    DWORD got = 0;
+    DWORD len = 0;
+
+    CHECK(TxQueueInit(&q, 16));
+
+    CHECK(TxQueuePut(&q, (const BYTE*)"0123456789", 10) == 10);
+    TxQueueConsume(&q, 8);
+    CHECK(TxQueuePut(&q, (const BYTE*)"ABCDEFGHIJ", 10) == 10);
+    CHECK(q.count == 12);
+
+    /* From offset 8 to the end of the ring */
+    CHECK(TxQueuePeek(&q, &run, 16) == 8);
+    CHECK(memcmp(run, "89ABCDEF", 8) == 0);
+
+    while ((len = TxQueuePeek(&q, &run, 16)) > 0) {
+        memcpy(out + got, run, len);
+        got += len;
+        TxQueueConsume(&q, len);
+    }
+    CHECK(got == 12);
+    CHECK(memcmp(out, "89ABCDEFGHIJ", 12) == 0);
+
+    TxQueueFree(&q);
+}
+
+/**
+ * Checks that a full queue takes only what fits, and nothing more until
+ * some is consumed.
+ *
+ * @returns none
+ */
+static void test_full(void) {
+    TxQueue q;
+    BYTE* run = NULL;
+
+    CHECK(TxQueueInit(&q, 8));
+
+    CHECK(TxQueuePut(&q, (const BYTE*)"0123456789", 10) == 8);
+    CHECK(TxQueueSpace(&q) == 0);
+    CHECK(TxQueuePut(&q, (const BYTE*)"X", 1) == 0);
+
+    TxQueueConsume(&q, 3);
+    CHECK(TxQueueSpace(&q) == 3);
+    CHECK(TxQueuePut(&q, (const BYTE*)"XYZW", 4) == 3);
+    CHECK(TxQueueSpace(&q) == 0);
+
+    CHECK(TxQueuePeek(&q, &run, 8) == 5);
+    CHECK(memcmp(run, "34567", 5) == 0);
+    TxQueueConsume(&q, 5);
+    CHECK(TxQueuePeek(&q, &run, 8) == 3);
+    CHECK(memcmp(run, "XYZ", 3) == 0);
+
+    TxQueueFree(&q);
+}
+
+/**
+ * Checks that draining the queue starts the ring over, so the next run is
+ * as long as it can be, and that consuming too much only empties it.
+ *
+ * @returns none
+ */
+static void test_drain(void) {
+    TxQueue q;
+    BYTE* run = NULL;
+
+    CHECK(TxQueueInit(&q, 8));
+
+    CHECK(TxQueuePut(&q, (const BYTE*)"01234", 5) == 5);
+    TxQueueConsume(&q, 100);
+    CHECK(q.count == 0);
+    CHECK(q.head == 0);
+    CHECK(TxQueuePeek(&q, &run, 8) == 0);
+
+    /* Without the restart this would wrap after 3 bytes */
+    CHECK(TxQueuePut(&q, (const BYTE*)"ABCDEFGH", 8) == 8);
+    CHECK(TxQueuePeek(&q, &run, 8) == 8);
+    CHECK(memcmp(run, "ABCDEFGH", 8) == 0);
+
+    TxQueueFree(&q);
+    CHECK(q.data == NULL);
+    CHECK(q.size == 0);
+
+    /* 0 asks for the default size */
+    CHECK(TxQueueInit(&q, 0));
+    CHECK(TxQueueSpace(&q) == TXQUEUE_SIZE);
+    TxQueueFree(&q);
+}
+
+int main(void) {
+    test_coalesce();
+    test_wrap();
+    test_full();
+    test_drain();
+
+    printf("txqueuetest: %d failed\n", failures);
+    return failures;
+}
@@ -0,0 +1,303 @@
+/**
+ * @filename vt100diff.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the differential test of the VT100 parser. Every
+ * recorded session (*.vt) in a corpus directory is parsed into a screen
+ * made without a window, and the snapshot of the screen is compared with
+ * the reference snapshot kept beside it (the same name, ending .snap).
+ * Each file is also parsed a byte at a time, which must give the same
+ * snapshot as parsing it in one read.
+ *
+ *   vt100diff dir [/record]
+ *
+ * /record writes the reference snapshots instead of checking them. Record
+ * them with a build of the parser known to be right, such as the one
+ * before a change, then run the changed one against them. Where a
+ * snapshot differs, the first differing field is named: the line and
+ * column of a cell, a cursor, a mode or a tab stop. The exit code is the
+ * number of files that differ.
+ */
+#include <stdio.h>
+#include "../../emulation/vt100/vt100.h"
+
+/* The recorded sessions in a corpus */
+#define DIFF_INPUT TEXT("*.vt")
+/* The ending of a reference snapshot, in place of .vt */
+#define DIFF_SNAP TEXT(".snap")
+/* Largest recorded session read */
+#define DIFF_MAX 16777216
+
+/* Bytes in a line of a snapshot: the weight and four for each column */
+#define DIFF_LINE (1 + 80 * 4)
+/* Offset of the cursors in a snapshot, and the bytes in each */
+#define DIFF_CURSORS (1 + 24 * DIFF_LINE)
+#define DIFF_CURSOR 5
+/* Offset of the modes in a snapshot, and of the tab stops after them */
+#define DIFF_MODES (DIFF_CURSORS + 2 * DIFF_CURSOR)
+#define DIFF_TABS (DIFF_MODES + 7)
+
+static const TCHAR* kCellFields[] = {
+    TEXT("character"), TEXT("attributes"), TEXT("foreground"), TEXT("background")
+};
+static const TCHAR* kCursorFields[] = {
+    TEXT("column"), TEXT("line"), TEXT("attributes"), TEXT("foreground"),
+    TEXT("background")
+};
+static const TCHAR* kModes[] = {
+    TEXT("origin line"), TEXT("scroll top"), TEXT("scroll bottom"),
+    TEXT("autowrap"), TEXT("relative origin"), TEXT("cursor mode"),
+    TEXT("reverse screen")
+};
+
+/**
+ * Reads the whole of a file.
+ *
+ * @param LPCTSTR path  The file.
+ * @param DWORD* len    Receives the length of the file.
+ * @returns The contents, to be freed, or NULL if the file can't be read.
+ */
+static BYTE* DiffRead(LPCTSTR path, DWORD* len) {
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    BYTE* data = NULL;
+    DWORD size = 0;
+    DWORD read = 0;
+
+    hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    size = GetFileSize(hFile, NULL);
+    if (size != INVALID_FILE_SIZE && size <= DIFF_MAX) {
+        data = (BYTE*)malloc(size + 1);
+    }
+
+    if (data != NULL && (!ReadFile(hFile, data, size, &read, NULL) || read != size)) {
+        free(data);
+        data = NULL;
+    }
+
+    CloseHandle(hFile);
+    *len = size;
+    return data;
+}
+
+/**
+ * Writes a file, replacing it if it exists.
+ *
+ * @param LPCTSTR path      The file.
+ * @param const BYTE* data  The contents.
+ * @param DWORD len         The length of the contents.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static int DiffWrite(LPCTSTR path, const BYTE* data, DWORD len) {
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    DWORD written = 0;
+    int ret = 0;
+
+    hFile = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+
+    if (!WriteFile(hFile, data, len, &written, NULL) || written != len) {
+        ret = 2;
+    }
+
+    CloseHandle(hFile);
+    return ret;
+}
+
+/**
+ * Parses data into a new screen in reads of up to a given size, and takes
+ * a snapshot of it.
+ *
+ * @param const BYTE* data  The data.
+ * @param DWORD len         The length of the data.
+ * @param DWORD read        The most bytes given to the parser at once.
+ * @param BYTE* snap        Receives the snapshot; VT100_SNAPSHOT_SIZE bytes.
+ * @returns The length of the snapshot, or 0 if the screen can't be made.
+ */
+static DWORD DiffParse(const BYTE* data, DWORD len, DWORD read, BYTE* snap) {
+    VT100_Data* vt = vt100_screen_create(NULL);
+    DWORD off = 0;
+    DWORD snaplen = 0;
+
+    if (vt == NULL) {
+        return 0;
+    }
+
+    while (off < len) {
+        DWORD n = (len - off < read) ? len - off : read;
+
+        vt100_parse(vt, data + off, n);
+        off += n;
+    }
+
+    snaplen = vt100_snapshot(vt, snap, VT100_SNAPSHOT_SIZE);
+    vt100_screen_free(vt);
+
+    return snaplen;
+}
+
+/**
+ * Reports the first field in which two snapshots differ.
+ *
+ * @param LPCTSTR name      The recorded session.
+ * @param LPCTSTR what      What the snapshot was compared with.
+ * @param const BYTE* got   The snapshot taken.
+ * @param const BYTE* want  The snapshot it should match.
+ * @returns none
+ */
+static void DiffReport(LPCTSTR name, LPCTSTR what, const BYTE* got, const BYTE* want) {
+    DWORD at = 0;
+    DWORD i = 0;
+
+    while (at < VT100_SNAPSHOT_SIZE - 1 && got[at] == want[at]) {
+        at++;
+    }
+
+    _tprintf(TEXT("%s: differs from %s in "), name, what);
+
+    if (at == 0) {
+        _tprintf(TEXT("the snapshot version"));
+    } else if (at < DIFF_CURSORS) {
+        i = (at - 1) % DIFF_LINE;
+        if (i == 0) {
+            _tprintf(TEXT("the weight of line %lu"), (at - 1) / DIFF_LINE + 1);
+        } else {
+            _tprintf(TEXT("the %s at line %lu, column %lu"),
+                    kCellFields[(i - 1) % 4], (at - 1) / DIFF_LINE + 1,
+                    (i - 1) / 4 + 1);
+        }
+    } else if (at < DIFF_MODES) {
+        i = at - DIFF_CURSORS;
+        _tprintf(TEXT("the %s of the %s"), kCursorFields[i % DIFF_CURSOR],
+                (i < DIFF_CURSOR) ? TEXT("cursor") : TEXT("saved cursor"));
+    } else if (at < DIFF_TABS) {
+        _tprintf(TEXT("the %s"), kModes[at - DIFF_MODES]);
+    } else {
+        _tprintf(TEXT("the tab stop at column %lu"), at - DIFF_TABS + 1);
+    }
+
+    _tprintf(TEXT(": %u, not %u\n"), got[at], want[at]);
+}
+
+/**
+ * Checks one recorded session against its reference snapshot, or records
+ * the reference.
+ *
+ * @param LPCTSTR dir       The corpus directory, ending in a backslash.
+ * @param LPCTSTR name      The recorded session.
+ * @param BOOLEAN record    TRUE to write the reference instead.
+ * @returns 0 if the session matches, 1 if not, 2 if it can't be checked.
+ */
+static int DiffFile(LPCTSTR dir, LPCTSTR name, BOOLEAN record) {
+    TCHAR path[MAX_PATH];
+    TCHAR snappath[MAX_PATH];
+    BYTE whole[VT100_SNAPSHOT_SIZE];
+    BYTE split[VT100_SNAPSHOT_SIZE];
+    BYTE* data = NULL;
+    BYTE* ref = NULL;
+    DWORD len = 0;
+    DWORD reflen = 0;
+    int ret = 0;
+
+    StringCchCopy(path, MAX_PATH, dir);
+    StringCchCat(path, MAX_PATH, name);
+    StringCchCopy(snappath, MAX_PATH, path);
+    *_tcsrchr(snappath, '.') = '\0';
+    StringCchCat(snappath, MAX_PATH, DIFF_SNAP);
+
+    data = DiffRead(path, &len);
+    if (data == NULL) {
+        _tprintf(TEXT("%s: cannot be read\n"), name);
+        return 2;
+    }
+
+    if (DiffParse(data, len, len, whole) != VT100_SNAPSHOT_SIZE ||
+            DiffParse(data, len, 1, split) != VT100_SNAPSHOT_SIZE) {
+        _tprintf(TEXT("%s: cannot be parsed\n"), name);
+        free(data);
+        return 2;
+    }
+    free(data);
+
+    if (memcmp(whole, split, VT100_SNAPSHOT_SIZE) != 0) {
+        DiffReport(name, TEXT("itself read a byte at a time"), split, whole);
+        ret = 1;
+    }
+
+    if (record) {
+        if (DiffWrite(snappath, whole, VT100_SNAPSHOT_SIZE) != 0) {
+            _tprintf(TEXT("%s: the reference cannot be written\n"), name);
+            return 2;
+        }
+        return ret;
+    }
+
+    ref = DiffRead(snappath, &reflen);
+    if (ref == NULL) {
+        _tprintf(TEXT("%s: has no reference\n"), name);
+        return 2;
+    }
+
+    if (reflen != VT100_SNAPSHOT_SIZE || ref[0] != VT100_SNAPSHOT_VERSION) {
+        _tprintf(TEXT("%s: the reference is from another snapshot version\n"), name);
+        ret = 2;
+    } else if (memcmp(whole, ref, VT100_SNAPSHOT_SIZE) != 0) {
+        DiffReport(name, TEXT("the reference"), whole, ref);
+        ret = 1;
+    }
+
+    free(ref);
+    return ret;
+}
+
+int _tmain(int argc, TCHAR* argv[]) {
+    WIN32_FIND_DATA ffd;
+    HANDLE hFind = INVALID_HANDLE_VALUE;
+    TCHAR dir[MAX_PATH];
+    TCHAR pattern[MAX_PATH];
+    BOOLEAN record = FALSE;
+    DWORD files = 0;
+    int failed = 0;
+
+    if (argc < 2) {
+        _tprintf(TEXT("usage: vt100diff dir [/record]\n"));
+        return 1;
+    }
+    record = (argc > 2 && _tcsicmp(argv[2], TEXT("/record")) == 0);
+
+    StringCchCopy(dir, MAX_PATH, argv[1]);
+    if (dir[_tcslen(dir) - 1] != '\\') {
+        StringCchCat(dir, MAX_PATH, TEXT("\\"));
+    }
+    StringCchCopy(pattern, MAX_PATH, dir);
+    StringCchCat(pattern, MAX_PATH, DIFF_INPUT);
+
+    hFind = FindFirstFile(pattern, &ffd);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        _tprintf(TEXT("No recorded sessions in %s\n"), argv[1]);
+        return 1;
+    }
+
+    do {
+        if ((ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+            if (DiffFile(dir, ffd.cFileName, record) != 0) {
+                failed++;
+            }
+            files++;
+        }
+    } while (FindNextFile(hFind, &ffd));
+    FindClose(hFind);
+
+    _tprintf(TEXT("vt100diff: %lu files, %d differ\n"), files, failed);
+    return failed;
+}
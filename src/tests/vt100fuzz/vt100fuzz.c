@@ -0,0 +1,159 @@
+/**
+ * @filename vt100fuzz.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the fuzzing harness of the VT100 parser. Each input
+ * is parsed into a screen made without a window, once in a single read and
+ * once split into reads of a size taken from the first byte, since a
+ * sequence split across reads takes a different path through the parser.
+ * After every read the cursor and scrolling region must be on the screen,
+ * and at the end both screens must give the same snapshot. A check that
+ * fails aborts, which the fuzzer reports as a crash.
+ *
+ * Built with VT100FUZZ_LIBFUZZER defined and libFuzzer linked in (clang-cl
+ * /fsanitize=fuzzer,address), LLVMFuzzerTestOneInput is the entry point.
+ * Otherwise, as in the project and for AFL, it is called once for each
+ * file named on the command line, or for standard input if none are:
+ *
+ *   vt100fuzz [file...]
+ *
+ * Crashes the fuzzer finds can be replayed the same way.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <io.h>
+#include <fcntl.h>
+#include "../../emulation/vt100/vt100.h"
+
+/* Longest input parsed; the rest of a longer one is ignored */
+#define FUZZ_MAX 65536
+/* Largest read the first byte of an input can ask for */
+#define FUZZ_READ_MAX 64
+
+#define FUZZ_CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            abort(); \
+        } \
+    } while (0)
+
+/**
+ * Checks that the parser has left a screen in a state it can be drawn in.
+ *
+ * @param VT100_Data* vt    The screen.
+ * @returns none
+ */
+static void fuzz_check(VT100_Data* vt) {
+    /* Column 80 is where the cursor waits to wrap */
+    FUZZ_CHECK(vt->current.x <= 80);
+    FUZZ_CHECK(vt->current.y < 24);
+    FUZZ_CHECK(vt->saved.x <= 80);
+    FUZZ_CHECK(vt->saved.y < 24);
+    FUZZ_CHECK(vt->scroll_top <= vt->scroll_bottom);
+    FUZZ_CHECK(vt->scroll_bottom < 24);
+}
+
+/**
+ * Parses data into a new screen in reads of up to a given size, checking
+ * the screen after each, and takes a snapshot of it.
+ *
+ * @param const BYTE* data  The data.
+ * @param DWORD len         The length of the data.
+ * @param DWORD read        The most bytes given to the parser at once.
+ * @param BYTE* snap        Receives the snapshot; VT100_SNAPSHOT_SIZE bytes.
+ * @returns The length of the snapshot.
+ */
+static DWORD fuzz_parse(const BYTE* data, DWORD len, DWORD read, BYTE* snap) {
+    VT100_Data* vt = vt100_screen_create(NULL);
+    DWORD off = 0;
+    DWORD n = 0;
+    DWORD snaplen = 0;
+
+    FUZZ_CHECK(vt != NULL);
+
+    while (off < len) {
+        n = (len - off < read) ? len - off : read;
+        vt100_parse(vt, data + off, n);
+        fuzz_check(vt);
+        off += n;
+    }
+
+    snaplen = vt100_snapshot(vt, snap, VT100_SNAPSHOT_SIZE);
+    vt100_screen_free(vt);
+
+    return snaplen;
+}
+
+/**
+ * Runs one input: the first byte picks the size of the split reads, and
+ * the rest is the data parsed.
+ *
+ * @param const BYTE* data  The input.
+ * @param size_t size       The length of the input.
+ * @returns 0
+ */
+int LLVMFuzzerTestOneInput(const BYTE* data, size_t size) {
+    BYTE whole[VT100_SNAPSHOT_SIZE];
+    BYTE split[VT100_SNAPSHOT_SIZE];
+    DWORD len = 0;
+    DWORD read = 0;
+
+    if (size < 1) {
+        return 0;
+    }
+
+    read = data[0] % FUZZ_READ_MAX + 1;
+    len = (size - 1 > FUZZ_MAX) ? FUZZ_MAX : (DWORD)(size - 1);
+
+    FUZZ_CHECK(fuzz_parse(data + 1, len, len, whole) == VT100_SNAPSHOT_SIZE);
+    FUZZ_CHECK(fuzz_parse(data + 1, len, read, split) == VT100_SNAPSHOT_SIZE);
+    FUZZ_CHECK(memcmp(whole, split, VT100_SNAPSHOT_SIZE) == 0);
+
+    return 0;
+}
+
+#ifndef VT100FUZZ_LIBFUZZER
+/**
+ * Reads an input, up to the most the harness parses, and runs it.
+ *
+ * @param FILE* f   The input, opened in binary mode.
+ * @returns none
+ */
+static void fuzz_file(FILE* f) {
+    BYTE* data = (BYTE*)malloc(FUZZ_MAX + 1);
+    size_t len = 0;
+
+    FUZZ_CHECK(data != NULL);
+
+    len = fread(data, 1, FUZZ_MAX + 1, f);
+    LLVMFuzzerTestOneInput(data, len);
+    free(data);
+}
+
+int main(int argc, char* argv[]) {
+    FILE* f = NULL;
+    int i;
+
+    if (argc < 2) {
+        _setmode(_fileno(stdin), _O_BINARY);
+        fuzz_file(stdin);
+        return 0;
+    }
+
+    for (i = 1; i < argc; i++) {
+        if (fopen_s(&f, argv[i], "rb") != 0) {
+            fprintf(stderr, "vt100fuzz: cannot open %s\n", argv[i]);
+            return 1;
+        }
+        fuzz_file(f);
+        fclose(f);
+    }
+
+    return 0;
+}
+#endif
@@ -0,0 +1,302 @@
+/**
+ * @filename vt100golden.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator
+ *
+ * This file contains the golden-screen regression suite of the VT100
+ * parser. Each recorded session in the corpus manifest (golden.txt) is
+ * parsed into a screen made without a window, and the hash of the screen
+ * (vt100_hash) must match the one in the manifest. Each session is parsed
+ * repeatedly for a while as well, and the time per pass and the rate are
+ * reported, so a change to the parser is checked and timed in one run.
+ *
+ *   vt100golden [dir] [/update]
+ *
+ * dir is the corpus, by default the corpus directory under the current
+ * one. /update rewrites the manifest with the hashes of every *.vt file
+ * in it, after a deliberate change to what the parser shows or to the
+ * snapshot layout. The exit code is the number of sessions that fail.
+ */
+#include <stdio.h>
+#include "../../emulation/vt100/vt100.h"
+
+/* The corpus used when none is given */
+#define GOLDEN_DIR TEXT("corpus")
+/* The manifest in the corpus, and the sessions /update lists in it */
+#define GOLDEN_MANIFEST TEXT("golden.txt")
+#define GOLDEN_INPUT TEXT("*.vt")
+/* Longest session name in the manifest */
+#define GOLDEN_NAME 64
+/* Largest recorded session read */
+#define GOLDEN_MAX 16777216
+/* Size of the reads the parser is given, as from a fast port */
+#define GOLDEN_READ 1024
+/* Time (ms) each session is parsed for, to time it */
+#define GOLDEN_TIME 250
+
+/**
+ * Reads the whole of a file.
+ *
+ * @param LPCTSTR path  The file.
+ * @param DWORD* len    Receives the length of the file.
+ * @returns The contents, to be freed, or NULL if the file can't be read.
+ */
+static BYTE* GoldenRead(LPCTSTR path, DWORD* len) {
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    BYTE* data = NULL;
+    DWORD size = 0;
+    DWORD read = 0;
+
+    hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    size = GetFileSize(hFile, NULL);
+    if (size != INVALID_FILE_SIZE && size <= GOLDEN_MAX) {
+        data = (BYTE*)malloc(size + 1);
+    }
+
+    if (data != NULL && (!ReadFile(hFile, data, size, &read, NULL) || read != size)) {
+        free(data);
+        data = NULL;
+    }
+
+    CloseHandle(hFile);
+    *len = size;
+    return data;
+}
+
+/**
+ * Parses data into a new screen in reads of GOLDEN_READ bytes.
+ *
+ * @param const BYTE* data  The data.
+ * @param DWORD len         The length of the data.
+ * @returns The hash of the screen.
+ */
+static DWORD GoldenParse(const BYTE* data, DWORD len) {
+    VT100_Data* vt = vt100_screen_create(NULL);
+    DWORD off = 0;
+    DWORD hash = 0;
+
+    if (vt == NULL) {
+        return 0;
+    }
+
+    while (off < len) {
+        DWORD n = (len - off < GOLDEN_READ) ? len - off : GOLDEN_READ;
+
+        vt100_parse(vt, data + off, n);
+        off += n;
+    }
+
+    hash = vt100_hash(vt);
+    vt100_screen_free(vt);
+
+    return hash;
+}
+
+/**
+ * Hashes the screen a recorded session leaves, and times parsing it.
+ *
+ * @param LPCTSTR dir       The corpus directory, ending in a backslash.
+ * @param LPCTSTR name      The recorded session.
+ * @param DWORD* hash       Receives the hash of the screen.
+ * @param DWORD* len        Receives the length of the session.
+ * @param double* us        Receives the time per pass, in microseconds.
+ * @returns 0 on success, greater than 0 if the session can't be read.
+ */
+static int GoldenRun(LPCTSTR dir, LPCTSTR name, DWORD* hash, DWORD* len, double* us) {
+    TCHAR path[MAX_PATH];
+    LARGE_INTEGER freq;
+    LARGE_INTEGER start;
+    LARGE_INTEGER now;
+    LONGLONG limit = 0;
+    DWORD passes = 0;
+    BYTE* data = NULL;
+
+    StringCchCopy(path, MAX_PATH, dir);
+    StringCchCat(path, MAX_PATH, name);
+
+    data = GoldenRead(path, len);
+    if (data == NULL) {
+        return 1;
+    }
+
+    QueryPerformanceFrequency(&freq);
+    limit = (freq.QuadPart * GOLDEN_TIME) / 1000;
+
+    QueryPerformanceCounter(&start);
+    *hash = GoldenParse(data, *len);
+    passes = 1;
+
+    for (;;) {
+        QueryPerformanceCounter(&now);
+        if (now.QuadPart - start.QuadPart >= limit) {
+            break;
+        }
+        GoldenParse(data, *len);
+        passes++;
+    }
+
+    *us = ((double)(now.QuadPart - start.QuadPart) * 1000000.0) /
+            ((double)freq.QuadPart * passes);
+
+    free(data);
+    return 0;
+}
+
+/**
+ * Prints the result of one session: its hash and how long it took.
+ *
+ * @param LPCTSTR name      The recorded session.
+ * @param DWORD hash        The hash of the screen.
+ * @param LPCTSTR result    Whether the hash matched.
+ * @param DWORD len         The length of the session.
+ * @param double us         The time per pass, in microseconds.
+ * @returns none
+ */
+static void GoldenReport(LPCTSTR name, DWORD hash, LPCTSTR result, DWORD len, double us) {
+    _tprintf(TEXT("%-16s %08lx %-8s %8lu bytes %10.1f us %8.2f MB/s\n"),
+            name, hash, result, len, us,
+            (us > 0) ? (double)len / us : 0.0);
+}
+
+/**
+ * Checks every session in the manifest against its hash.
+ *
+ * @param LPCTSTR dir   The corpus directory, ending in a backslash.
+ * @returns The number of sessions that fail, or -1 with no manifest.
+ */
+static int GoldenCheck(LPCTSTR dir) {
+    TCHAR path[MAX_PATH];
+    TCHAR line[256];
+    TCHAR name[GOLDEN_NAME];
+    FILE* f = NULL;
+    DWORD want = 0;
+    DWORD hash = 0;
+    DWORD len = 0;
+    DWORD count = 0;
+    double us = 0;
+    double total = 0;
+    int failed = 0;
+
+    StringCchCopy(path, MAX_PATH, dir);
+    StringCchCat(path, MAX_PATH, GOLDEN_MANIFEST);
+    if (_tfopen_s(&f, path, TEXT("rt")) != 0) {
+        _tprintf(TEXT("No manifest in %s\n"), dir);
+        return -1;
+    }
+
+    while (_fgetts(line, 256, f) != NULL) {
+        if (line[0] == '#' ||
+                _stscanf(line, TEXT("%63s %lx"), name, &want) != 2) {
+            continue;
+        }
+        count++;
+
+        if (GoldenRun(dir, name, &hash, &len, &us) != 0) {
+            _tprintf(TEXT("%-16s cannot be read\n"), name);
+            failed++;
+            continue;
+        }
+
+        if (hash != want) {
+            GoldenReport(name, hash, TEXT("FAILED"), len, us);
+            _tprintf(TEXT("%-16s %08lx expected\n"), TEXT(""), want);
+            failed++;
+        } else {
+            GoldenReport(name, hash, TEXT("ok"), len, us);
+        }
+        total += us;
+    }
+    fclose(f);
+
+    _tprintf(TEXT("vt100golden: %lu sessions, %d failed, %.1f us a pass in all\n"),
+            count, failed, total);
+    return failed;
+}
+
+/**
+ * Rewrites the manifest with the hash of every session in the corpus.
+ *
+ * @param LPCTSTR dir   The corpus directory, ending in a backslash.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static int GoldenUpdate(LPCTSTR dir) {
+    WIN32_FIND_DATA ffd;
+    HANDLE hFind = INVALID_HANDLE_VALUE;
+    TCHAR path[MAX_PATH];
+    FILE* f = NULL;
+    DWORD hash = 0;
+    DWORD len = 0;
+    double us = 0;
+    int ret = 0;
+
+    StringCchCopy(path, MAX_PATH, dir);
+    StringCchCat(path, MAX_PATH, GOLDEN_INPUT);
+    hFind = FindFirstFile(path, &ffd);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        _tprintf(TEXT("No recorded sessions in %s\n"), dir);
+        return 1;
+    }
+
+    StringCchCopy(path, MAX_PATH, dir);
+    StringCchCat(path, MAX_PATH, GOLDEN_MANIFEST);
+    if (_tfopen_s(&f, path, TEXT("wt")) != 0) {
+        _tprintf(TEXT("Cannot write %s\n"), path);
+        FindClose(hFind);
+        return 2;
+    }
+
+    _ftprintf(f, TEXT("# The hash (vt100_hash) of the screen each recorded session leaves.\n"));
+    _ftprintf(f, TEXT("# Written by vt100golden /update; see vt100golden.c.\n"));
+
+    do {
+        if ((ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+            continue;
+        }
+
+        if (GoldenRun(dir, ffd.cFileName, &hash, &len, &us) != 0) {
+            _tprintf(TEXT("%-16s cannot be read\n"), ffd.cFileName);
+            ret = 3;
+            continue;
+        }
+
+        _ftprintf(f, TEXT("%s %08lx\n"), ffd.cFileName, hash);
+        GoldenReport(ffd.cFileName, hash, TEXT("written"), len, us);
+    } while (FindNextFile(hFind, &ffd));
+
+    FindClose(hFind);
+    fclose(f);
+    return ret;
+}
+
+int _tmain(int argc, TCHAR* argv[]) {
+    TCHAR dir[MAX_PATH];
+    BOOLEAN update = FALSE;
+    int i;
+
+    StringCchCopy(dir, MAX_PATH, GOLDEN_DIR);
+
+    for (i = 1; i < argc; i++) {
+        if (_tcsicmp(argv[i], TEXT("/update")) == 0) {
+            update = TRUE;
+        } else {
+            StringCchCopy(dir, MAX_PATH, argv[i]);
+        }
+    }
+
+    if (dir[_tcslen(dir) - 1] != '\\') {
+        StringCchCat(dir, MAX_PATH, TEXT("\\"));
+    }
+
+    if (update) {
+        return GoldenUpdate(dir);
+    }
+
+    return GoldenCheck(dir);
+}
@@ -0,0 +1,356 @@
+/**
+ * @filename zmbench.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 29
+ * @project Terminal Emulator
+ *
+ * This file contains a benchmark of ZMODEM file transfers. A file is sent
+ * out one serial port and received on another, both ends run by the
+ * terminal's own transfer engine, serial layer and I/O pool, and the
+ * effective throughput is reported against the line rate.
+ *
+ * The two ports must be connected to each other: by a null-modem cable, or
+ * as the two ends of a com0com pair, the same pair rfidsim is run on.
+ *
+ *   zmbench COM5 COM6 [bytes] [settings]
+ *
+ * The receiving end is started the way the terminal starts one, by
+ * noticing the sender's ZRQINIT. The received file is compared with the
+ * one sent, and the exit code is 0 only if they match.
+ */
+#include <stdio.h>
+#include "../../transfer.h"
+#include "../../iopool.h"
+
+/* Window class of each end */
+#define ZMBENCH_CLASS TEXT("ZMODEM Benchmark")
+/* Size of the file sent when none is given */
+#define ZMBENCH_BYTES 1048576
+/* Line settings used when none are given */
+#define ZMBENCH_SETTINGS TEXT("baud=115200 parity=N data=8 stop=1")
+/* Longest run (ms) before the benchmark gives up */
+#define ZMBENCH_TIMEOUT 600000
+
+/**
+ * The BenchEnd structure contains one end of the link.
+ *
+ * @member HWND hwnd        The window that gets the port's messages
+ * @member SerialPort port  The serial port
+ * @member Transfer xfer    The transfer run on the port
+ * @member BOOLEAN lost     TRUE if reading the port failed
+ */
+typedef struct _BenchEnd {
+    HWND hwnd;
+    SerialPort port;
+    Transfer xfer;
+    BOOLEAN lost;
+} BenchEnd;
+
+/**
+ * Message handling for the window of one end. It does what a session
+ * window does with the same messages, without an emulator.
+ *
+ * @param HWND hwnd         The window.
+ * @param UINT message      The message.
+ * @param WPARAM wParam     The first parameter of the message.
+ * @param LPARAM lParam     The second parameter of the message.
+ * @returns The result of the message.
+ */
+static LRESULT CALLBACK BenchProc(HWND hwnd, UINT message, WPARAM wParam,
+        LPARAM lParam) {
+    BenchEnd* end = (BenchEnd*)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+
+    if (end == NULL) {
+        return DefWindowProc(hwnd, message, wParam, lParam);
+    }
+
+    switch (message) {
+    case TWM_RXDATA:
+        TransferInput(&end->xfer, (BYTE*)wParam, (DWORD)lParam);
+        free((BYTE*)wParam);
+        return 0;
+    case TWM_TXDONE:
+        TransferPump(&end->xfer);
+        return 0;
+    case WM_TIMER:
+        if (wParam == XFER_TIMER) {
+            TransferTimeout(&end->xfer);
+        }
+        return 0;
+    case TWM_PORTLOST:
+        end->lost = TRUE;
+        TransferCancel(&end->xfer, FALSE);
+        return 0;
+    case WM_SETTEXT:
+        /* The transfer's progress and result */
+        _tprintf(TEXT("%s: %s\n"), end->port.name, (LPCTSTR)lParam);
+        break;
+    }
+
+    return DefWindowProc(hwnd, message, wParam, lParam);
+}
+
+/**
+ * Opens one end of the link and starts reading it on the pool.
+ *
+ * @param BenchEnd* end     The end.
+ * @param IoPool* pool      The I/O pool.
+ * @param LPCTSTR port      The name of the serial port.
+ * @param LPCTSTR settings  The line settings.
+ * @param LPCTSTR dir       The folder files received on this end go in.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static int BenchOpen(BenchEnd* end, IoPool* pool, LPCTSTR port,
+        LPCTSTR settings, LPCTSTR dir) {
+    ZeroMemory(end, sizeof(BenchEnd));
+    end->port.sock = INVALID_SOCKET;
+
+    end->hwnd = CreateWindow(ZMBENCH_CLASS, port, 0, 0, 0, 0, 0,
+            HWND_MESSAGE, NULL, GetModuleHandle(NULL), NULL);
+    if (end->hwnd == NULL) {
+        return 1;
+    }
+    SetWindowLongPtr(end->hwnd, GWLP_USERDATA, (LONG_PTR)end);
+
+    TransferInit(&end->xfer, end->hwnd, &end->port);
+    StringCchCopy(end->xfer.szDir, MAX_PATH, dir);
+
+    if (OpenPortSettings(port, &end->port, end->hwnd, settings, 0, 0,
+            NULL) != 0) {
+        return 2;
+    }
+
+    if (IoPoolAttach(pool, &end->port) != 0) {
+        ClosePort(&end->port);
+        return 3;
+    }
+
+    return 0;
+}
+
+/**
+ * Stops reading one end of the link and closes it.
+ *
+ * @param BenchEnd* end     The end.
+ * @returns none
+ */
+static void BenchClose(BenchEnd* end) {
+    TransferCancel(&end->xfer, FALSE);
+    if (end->port.hRxIdle != NULL) {
+        IoPoolDetach(&end->port);
+        ClosePort(&end->port);
+    }
+    if (end->hwnd != NULL) {
+        DestroyWindow(end->hwnd);
+    }
+}
+
+/**
+ * Writes the file to be sent, of bytes that cover every value and every
+ * ZMODEM escape.
+ *
+ * @param LPCTSTR path  The file.
+ * @param DWORD size    Its size in bytes.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static int BenchMakeFile(LPCTSTR path, DWORD size) {
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    BYTE block[4096];
+    DWORD done = 0;
+    DWORD i = 0;
+
+    hFile = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+
+    while (done < size) {
+        DWORD len = min(size - done, sizeof(block));
+        DWORD written = 0;
+
+        for (i = 0; i < len; i++) {
+            block[i] = (BYTE)((done + i) * 7 + ((done + i) >> 9));
+        }
+
+        if (!WriteFile(hFile, block, len, &written, NULL) || written != len) {
+            CloseHandle(hFile);
+            return 2;
+        }
+        done += len;
+    }
+
+    CloseHandle(hFile);
+    return 0;
+}
+
+/**
+ * Checks that two files have the same contents.
+ *
+ * @param LPCTSTR one   The first file.
+ * @param LPCTSTR two   The second file.
+ * @returns TRUE if they match, FALSE if not or if either can't be read.
+ */
+static BOOLEAN BenchSameFile(LPCTSTR one, LPCTSTR two) {
+    HANDLE h1 = INVALID_HANDLE_VALUE;
+    HANDLE h2 = INVALID_HANDLE_VALUE;
+    BYTE b1[4096];
+    BYTE b2[4096];
+    BOOLEAN same = FALSE;
+
+    h1 = CreateFile(one, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    h2 = CreateFile(two, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (h1 != INVALID_HANDLE_VALUE && h2 != INVALID_HANDLE_VALUE) {
+        for (;;) {
+            DWORD r1 = 0;
+            DWORD r2 = 0;
+
+            if (!ReadFile(h1, b1, sizeof(b1), &r1, NULL) ||
+                    !ReadFile(h2, b2, sizeof(b2), &r2, NULL) ||
+                    r1 != r2 || memcmp(b1, b2, r1) != 0) {
+                break;
+            }
+            if (r1 == 0) {
+                same = TRUE;
+                break;
+            }
+        }
+    }
+
+    if (h1 != INVALID_HANDLE_VALUE) {
+        CloseHandle(h1);
+    }
+    if (h2 != INVALID_HANDLE_VALUE) {
+        CloseHandle(h2);
+    }
+
+    return same;
+}
+
+int _tmain(int argc, TCHAR* argv[]) {
+    WNDCLASS wc;
+    IoPool pool;
+    BenchEnd sender;
+    BenchEnd receiver;
+    DCB dcb;
+    LARGE_INTEGER freq;
+    LARGE_INTEGER start;
+    LARGE_INTEGER end;
+    TCHAR temp[MAX_PATH];
+    TCHAR dir[MAX_PATH];
+    TCHAR sent[MAX_PATH];
+    TCHAR got[MAX_PATH];
+    LPCTSTR settings = ZMBENCH_SETTINGS;
+    DWORD size = ZMBENCH_BYTES;
+    DWORD began = 0;
+    DWORD ms = 0;
+    DWORD rate = 0;
+    BOOLEAN same = FALSE;
+
+    if (argc < 3) {
+        _tprintf(TEXT("usage: zmbench sendport receiveport [bytes] [settings]\n"));
+        return 2;
+    }
+    if (argc > 3) {
+        size = _tcstoul(argv[3], NULL, 10);
+    }
+    if (argc > 4) {
+        settings = argv[4];
+    }
+
+    ZeroMemory(&dcb, sizeof(DCB));
+    dcb.DCBlength = sizeof(DCB);
+    if (!BuildCommDCB(settings, &dcb) || dcb.BaudRate == 0) {
+        _tprintf(TEXT("zmbench: bad settings \"%s\"\n"), settings);
+        return 2;
+    }
+
+    GetTempPath(MAX_PATH, temp);
+    StringCchPrintf(sent, MAX_PATH, TEXT("%szmbench.bin"), temp);
+    StringCchPrintf(dir, MAX_PATH, TEXT("%szmbench\\"), temp);
+    StringCchPrintf(got, MAX_PATH, TEXT("%szmbench.bin"), dir);
+    CreateDirectory(dir, NULL);
+    DeleteFile(got);
+
+    if (BenchMakeFile(sent, size) != 0) {
+        _tprintf(TEXT("zmbench: can't write %s\n"), sent);
+        return 2;
+    }
+
+    ZeroMemory(&wc, sizeof(WNDCLASS));
+    wc.lpfnWndProc = BenchProc;
+    wc.hInstance = GetModuleHandle(NULL);
+    wc.lpszClassName = ZMBENCH_CLASS;
+    RegisterClass(&wc);
+
+    if (IoPoolStart(&pool) != 0) {
+        _tprintf(TEXT("zmbench: can't start the I/O pool\n"));
+        return 2;
+    }
+
+    if (BenchOpen(&sender, &pool, argv[1], settings, temp) != 0 ||
+            BenchOpen(&receiver, &pool, argv[2], settings, dir) != 0) {
+        _tprintf(TEXT("zmbench: can't open the ports (error %lu)\n"),
+                GetLastError());
+        BenchClose(&sender);
+        BenchClose(&receiver);
+        IoPoolStop(&pool);
+        return 2;
+    }
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    began = GetTickCount();
+
+    if (TransferSendFile(&sender.xfer, kXferZmodem, sent) != 0) {
+        _tprintf(TEXT("zmbench: can't send %s\n"), sent);
+        sender.lost = TRUE;
+    }
+
+    /* Both ends are done once each has finished a transfer */
+    while (sender.xfer.protocol != kXferNone ||
+            receiver.xfer.protocol != kXferNone ||
+            (receiver.xfer.files == 0 && !receiver.lost && !sender.lost)) {
+        MSG msg;
+
+        if (GetTickCount() - began > ZMBENCH_TIMEOUT) {
+            _tprintf(TEXT("zmbench: gave up after %lu s\n"),
+                    ZMBENCH_TIMEOUT / 1000);
+            break;
+        }
+
+        if (MsgWaitForMultipleObjects(0, NULL, FALSE, XFER_TICK,
+                QS_ALLINPUT) == WAIT_OBJECT_0) {
+            while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+                DispatchMessage(&msg);
+            }
+        }
+    }
+    QueryPerformanceCounter(&end);
+
+    BenchClose(&sender);
+    BenchClose(&receiver);
+    IoPoolStop(&pool);
+
+    ms = (DWORD)(((end.QuadPart - start.QuadPart) * 1000) / freq.QuadPart);
+    if (ms == 0) {
+        ms = 1;
+    }
+    rate = (DWORD)(((ULONGLONG)size * 1000) / ms);
+    same = BenchSameFile(sent, got);
+
+    _tprintf(TEXT("%lu bytes in %lu.%03lu s at %lu baud: %lu bytes/sec, ")
+            TEXT("%lu%% of the line rate, %s\n"),
+            size, ms / 1000, ms % 1000, dcb.BaudRate, rate,
+            (DWORD)(((ULONGLONG)rate * 1000) / dcb.BaudRate),
+            same ? TEXT("received intact") : TEXT("RECEIVED FILE DIFFERS"));
+
+    DeleteFile(sent);
+    DeleteFile(got);
+
+    return same ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+/**
+ * @filename passthrough.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator: Passthrough Decoder
+ *
+ * This file contains a decoder plugin that gives back what it is given.
+ * It is the smallest decoder the plugin host will run, and hosttest uses it
+ * to check that data comes back through the host unchanged; it also shows
+ * what a decoder has to provide (see decoder.h).
+ */
+#include <Windows.h>
+#include "../../decoder.h"
+
+/* The passthrough decoder keeps no state, but create must not return NULL */
+static BYTE state = 0;
+
+/**
+ * Makes the decoder's state.
+ *
+ * @returns The state.
+ */
+static LPVOID passthrough_create(void) {
+    return &state;
+}
+
+/**
+ * Copies the data as it is.
+ *
+ * @param LPVOID data       The decoder's state.
+ * @param const BYTE* in    The data.
+ * @param DWORD len         The length of the data.
+ * @param BYTE* out         Receives the same data.
+ * @returns len
+ */
+static DWORD passthrough_decode(LPVOID data, const BYTE* in, DWORD len, BYTE* out) {
+    CopyMemory(out, in, len);
+    return len;
+}
+
+/**
+ * Frees the decoder's state.
+ *
+ * @param LPVOID data   The decoder's state.
+ * @returns none
+ */
+static void passthrough_destroy(LPVOID data) {
+}
+
+static Decoder kPassthrough = {
+    DECODER_VERSION,
+    passthrough_create,
+    passthrough_decode,
+    passthrough_destroy
+};
+
+DECODER_EXPORT(kPassthrough)
@@ -0,0 +1,150 @@
+/**
+ * @filename pluginhost.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 12 01
+ * @project Terminal Emulator: Plugin Host
+ *
+ * This file contains the plugin host, which runs a decoder plugin for one
+ * session of the terminal in a process of its own. Received data comes in
+ * through a ring in shared memory and the decoded data goes back out
+ * through another (see hostring.h), so a decoder that is slow, hangs or
+ * crashes cannot take the terminal with it. The terminal starts the host,
+ * and starts it again if it dies.
+ *
+ * Usage: pluginhost <name> <pid> <decoder>
+ *   name       The name of the shared memory; its events are named
+ *              name.in, name.out and name.quit
+ *   pid        The terminal's process ID; the host exits with it
+ *   decoder    The path of the decoder DLL
+ */
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+#include <stdio.h>
+#include "../../hostring.h"
+#include "../../decoder.h"
+
+/* Longest name of an object shared with the terminal */
+#define HOST_NAME 96
+
+/**
+ * Opens one of the events shared with the terminal.
+ *
+ * @param LPCTSTR name      The name of the shared memory.
+ * @param LPCTSTR suffix    Which event.
+ * @returns The event, or NULL on error.
+ */
+static HANDLE host_event(LPCTSTR name, LPCTSTR suffix) {
+    TCHAR full[HOST_NAME];
+
+    StringCchPrintf(full, HOST_NAME, TEXT("%s.%s"), name, suffix);
+    return OpenEvent(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE, full);
+}
+
+/**
+ * Writes all of the decoded data to the out ring. If the terminal has
+ * fallen behind and the ring is full, this waits for room, giving up if
+ * the terminal exits or asks the host to, or the ring is broken.
+ *
+ * @param HostRing* r       The out ring.
+ * @param BYTE* data        The decoded data.
+ * @param DWORD len         The length of the data.
+ * @param HANDLE hOut       Set when there is data in the ring.
+ * @param HANDLE waits[]    The terminal's process and the quit event.
+ * @returns 0 on success, 1 if the host should exit.
+ */
+static int host_write(HostRing* r, BYTE* data, DWORD len, HANDLE hOut,
+        HANDLE* waits) {
+    DWORD done = 0;
+
+    for (;;) {
+        DWORD n = RingWrite(r, data + done, len - done);
+
+        if (n == RING_BROKEN) {
+            return 1;
+        }
+        done += n;
+        SetEvent(hOut);
+        if (done == len) {
+            return 0;
+        }
+
+        /* Rare enough that polling for room will do */
+        if (WaitForMultipleObjects(2, waits, FALSE, 1) != WAIT_TIMEOUT) {
+            return 1;
+        }
+    }
+}
+
+int _tmain(int argc, TCHAR** argv) {
+    HANDLE hMap = NULL;
+    HostShared* shm = NULL;
+    HANDLE waits[3] = {NULL, NULL, NULL};
+    HANDLE hOut = NULL;
+    HMODULE hDll = NULL;
+    get_decoder_func get_decoder = NULL;
+    Decoder* dec = NULL;
+    LPVOID state = NULL;
+    BYTE in[DECODER_CHUNK];
+    BYTE out[DECODER_CHUNK * DECODER_EXPAND];
+    int ret = 0;
+
+    if (argc < 4) {
+        _tprintf(TEXT("Usage: %s <name> <pid> <decoder>\n"), argv[0]);
+        return 1;
+    }
+
+    hMap = OpenFileMapping(FILE_MAP_WRITE, FALSE, argv[1]);
+    shm = (hMap != NULL) ? (HostShared*)MapViewOfFile(hMap, FILE_MAP_WRITE,
+            0, 0, sizeof(HostShared)) : NULL;
+    waits[0] = OpenProcess(SYNCHRONIZE, FALSE, _tcstoul(argv[2], NULL, 10));
+    waits[1] = host_event(argv[1], TEXT("quit"));
+    waits[2] = host_event(argv[1], TEXT("in"));
+    hOut = host_event(argv[1], TEXT("out"));
+    if (shm == NULL || shm->dwVersion != HOST_VERSION || waits[0] == NULL ||
+            waits[1] == NULL || waits[2] == NULL || hOut == NULL) {
+        _tprintf(TEXT("Unable to open %s (error %lu)\n"), argv[1], GetLastError());
+        return 2;
+    }
+
+    hDll = LoadLibrary(argv[3]);
+    get_decoder = (hDll != NULL) ?
+            (get_decoder_func)GetProcAddress(hDll, "get_decoder") : NULL;
+    dec = (get_decoder != NULL) ? get_decoder() : NULL;
+    if (dec == NULL || dec->dwVersion > DECODER_VERSION ||
+            (state = dec->create()) == NULL) {
+        _tprintf(TEXT("Unable to load %s (error %lu)\n"), argv[3], GetLastError());
+        return 3;
+    }
+
+    /* Until the terminal exits or asks the host to */
+    while (WaitForMultipleObjects(3, waits, FALSE, INFINITE) == WAIT_OBJECT_0 + 2) {
+        DWORD len = 0;
+
+        while (ret == 0 && (len = RingRead(&shm->in, in, DECODER_CHUNK)) > 0) {
+            /* The counters can't be trusted; nothing more can be done */
+            if (len == RING_BROKEN) {
+                ret = 1;
+                break;
+            }
+            len = dec->decode(state, in, len, out);
+            ret = host_write(&shm->out, out, len, hOut, waits);
+        }
+
+        if (ret != 0) {
+            break;
+        }
+    }
+
+    dec->destroy(state);
+    FreeLibrary(hDll);
+    UnmapViewOfFile(shm);
+    CloseHandle(hMap);
+    CloseHandle(hOut);
+    CloseHandle(waits[0]);
+    CloseHandle(waits[1]);
+    CloseHandle(waits[2]);
+
+    return 0;
+}
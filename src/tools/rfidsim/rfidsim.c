@@ -0,0 +1,561 @@
+/**
+ * @filename rfidsim.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 25
+ * @project Terminal Emulator: RFID Reader Simulator
+ *
+ * This file contains a simulator for the TI RFID reader used by the RFID
+ * plugin. It answers the same framed commands (RFID_Header ... RFID_BCC) as
+ * the real reader so that the plugin can be exercised and load tested
+ * without the hardware.
+ *
+ * The simulator opens one end of a serial port pair (a null-modem cable or
+ * a virtual pair such as com0com) while the terminal opens the other.
+ *
+ * Usage: rfidsim <port> [options]
+ *   /tags:N        Number of distinct tags in the population (default 16)
+ *   /present:P     Percentage of polls that find a tag (default 50)
+ *   /latency:MS    Delay before each response in milliseconds (default 0)
+ *   /corrupt:P     Percentage of responses with a corrupted byte (default 0)
+ *   /fragment:P    Percentage of responses written in pieces (default 0)
+ *   /seed:N        Seed for the random number generator
+ *   /drop:S        Close the port every S seconds, as if unplugged (default 0)
+ *   /down:MS       How long the port stays closed each time (default 2000)
+ *
+ * /drop exercises the terminal's reconnect handling. Run the pair with
+ * com0com's PlugInMode=yes on the terminal's end, and that end disappears
+ * whenever the simulator's end is closed, exactly as a USB adapter does
+ * when it is pulled out. The simulator keeps its baud rate across a drop,
+ * so a terminal that reopens with its saved settings can talk to it again,
+ * and one that falls back to the defaults can't.
+ */
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+#include <stdio.h>
+#include "../../emulation/rfid/rfid.h"
+
+#define SIM_MAX_FRAME 256
+
+typedef struct _sim_tag {
+    BYTE entity;
+    BYTE uidlen;
+    BYTE uid[8];
+} SimTag;
+
+typedef struct _sim_config {
+    DWORD tags;
+    DWORD present;
+    DWORD latency;
+    DWORD corrupt;
+    DWORD fragment;
+    DWORD seed;
+    DWORD drop;
+    DWORD down;
+} SimConfig;
+
+typedef struct _sim_stats {
+    DWORD commands;
+    DWORD responses;
+    DWORD found;
+    DWORD corrupted;
+    DWORD fragmented;
+    DWORD badframes;
+    DWORD drops;
+} SimStats;
+
+static DWORD sim_rand_state = 1;
+
+/* rfid_util.c looks for rfid.ini beside this module; here, the simulator */
+HINSTANCE rfid_module = NULL;
+
+/**
+ * Returns the next number from a xorshift generator, so that runs can be
+ * repeated with the same seed.
+ *
+ * @returns A pseudo-random 32-bit number.
+ */
+static DWORD sim_rand(void) {
+    sim_rand_state ^= sim_rand_state << 13;
+    sim_rand_state ^= sim_rand_state >> 17;
+    sim_rand_state ^= sim_rand_state << 5;
+    return sim_rand_state;
+}
+
+/**
+ * Returns TRUE with the given percentage chance.
+ *
+ * @param DWORD percent     The chance out of 100.
+ * @returns TRUE or FALSE.
+ */
+static BOOLEAN sim_chance(DWORD percent) {
+    return (sim_rand() % 100) < percent;
+}
+
+/**
+ * Converts an RFID_Baud code to a baud rate.
+ *
+ * @param BYTE code     The RFID_Baud code.
+ * @returns The baud rate, or 0 if the code is unknown.
+ */
+static DWORD sim_baud_rate(BYTE code) {
+    switch (code) {
+    case RFID_BAUD_9600:
+        return CBR_9600;
+    case RFID_BAUD_19200:
+        return CBR_19200;
+    case RFID_BAUD_38400:
+        return CBR_38400;
+    case RFID_BAUD_57600:
+        return CBR_57600;
+    case RFID_BAUD_115200:
+        return CBR_115200;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Fills in the header and BCC of a response frame. The payload must already
+ * be in place after the header.
+ *
+ * @param BYTE* frame       The response frame.
+ * @param BYTE* request     The request frame being answered.
+ * @param WORD length       The total length of the response.
+ * @returns none
+ */
+static void sim_finish_frame(BYTE* frame, BYTE* request, WORD length) {
+    RFID_Header* head = (RFID_Header*)frame;
+    RFID_BCC bcc;
+
+    head->soframe = 0x1;
+    head->length = length;
+    head->deviceID = request[3];
+    head->command1 = request[4];
+    head->command2 = request[5];
+
+    bcc = rfid_calc_bcc(frame, length - sizeof(RFID_BCC));
+    frame[length - 2] = bcc.lrc;
+    frame[length - 1] = bcc.i_lrc;
+}
+
+/**
+ * Writes a response, optionally corrupting it or splitting it into several
+ * writes to exercise the plugin's frame reassembly.
+ *
+ * @param HANDLE port       The serial port.
+ * @param BYTE* frame       The response frame.
+ * @param WORD length       The length of the frame.
+ * @param SimConfig* cfg    The simulator settings.
+ * @param SimStats* stats   The simulator statistics.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static DWORD sim_send(HANDLE port, BYTE* frame, WORD length, SimConfig* cfg,
+        SimStats* stats) {
+    DWORD written = 0;
+    WORD pos = 0;
+
+    if (cfg->latency > 0) {
+        Sleep(cfg->latency);
+    }
+
+    if (cfg->corrupt > 0 && sim_chance(cfg->corrupt)) {
+        frame[sim_rand() % length] ^= (BYTE)(1 << (sim_rand() % 8));
+        stats->corrupted++;
+    }
+
+    if (cfg->fragment > 0 && length > 1 && sim_chance(cfg->fragment)) {
+        stats->fragmented++;
+        while (pos < length) {
+            WORD piece = (WORD)(1 + sim_rand() % (length - pos));
+
+            if (!WriteFile(port, frame + pos, piece, &written, NULL)) {
+                return 1;
+            }
+            pos += piece;
+            Sleep(1);
+        }
+    } else if (!WriteFile(port, frame, length, &written, NULL)) {
+        return 1;
+    }
+
+    stats->responses++;
+    return 0;
+}
+
+/**
+ * Changes the baud rate of the simulator's end of the link.
+ *
+ * @param HANDLE port       The serial port.
+ * @param DWORD baud        The new baud rate.
+ * @returns TRUE on success, FALSE otherwise.
+ */
+static BOOL sim_set_baud(HANDLE port, DWORD baud) {
+    DCB dcb;
+
+    if (!GetCommState(port, &dcb)) {
+        return FALSE;
+    }
+    dcb.BaudRate = baud;
+
+    return SetCommState(port, &dcb);
+}
+
+/**
+ * Builds and sends the response to a single request frame.
+ *
+ * @param HANDLE port       The serial port.
+ * @param BYTE* req         The request frame (BCC already verified).
+ * @param SimTag* tags      The tag population.
+ * @param SimConfig* cfg    The simulator settings.
+ * @param SimStats* stats   The simulator statistics.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static DWORD sim_respond(HANDLE port, BYTE* req, SimTag* tags,
+        SimConfig* cfg, SimStats* stats) {
+    BYTE frame[SIM_MAX_FRAME];
+    WORD length = 0;
+    DWORD newbaud = 0;
+    DWORD ret = 0;
+
+    stats->commands++;
+
+    switch (req[5]) {
+    case 0x40: /* GetVersion */
+        {
+            static const BYTE entities[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 };
+            WORD pos = sizeof(RFID_Header) + 1;
+            DWORD i = 0;
+
+            frame[sizeof(RFID_Header)] = RFIDERROR_NONE;
+            for (i = 0; i < sizeof(entities); i++) {
+                frame[pos++] = entities[i];
+                frame[pos++] = 0x01;
+                frame[pos++] = 0x23;
+            }
+            /* The reader pads the version list with a reserved byte */
+            frame[pos++] = 0x00;
+            length = pos + sizeof(RFID_BCC);
+        }
+        break;
+    case 0x41: /* FindToken */
+        {
+            WORD pos = sizeof(RFID_Header);
+
+            if (cfg->tags > 0 && sim_chance(cfg->present)) {
+                SimTag* tag = &tags[sim_rand() % cfg->tags];
+
+                frame[pos++] = RFIDERROR_NONE;
+                frame[pos++] = tag->entity;
+                CopyMemory(frame + pos, tag->uid, tag->uidlen);
+                pos += tag->uidlen;
+                stats->found++;
+            } else {
+                frame[pos++] = RFIDERROR_TOKEN_NOT_PRESENT;
+                frame[pos++] = 0x00;
+            }
+            length = pos + sizeof(RFID_BCC);
+        }
+        break;
+    case 0x46: /* SetBaud */
+        {
+            newbaud = sim_baud_rate(req[sizeof(RFID_Header)]);
+            frame[sizeof(RFID_Header)] = (newbaud != 0) ? RFIDERROR_NONE
+                    : RFIDERROR_ILLEGAL_ACTION;
+            length = sizeof(RFID_Header) + 1 + sizeof(RFID_BCC);
+        }
+        break;
+    case 0x43: /* SetDriver */
+    case 0x48: /* TransOn */
+    case 0x49: /* TransOff */
+        {
+            frame[sizeof(RFID_Header)] = RFIDERROR_NONE;
+            length = sizeof(RFID_Header) + 1 + sizeof(RFID_BCC);
+        }
+        break;
+    default:
+        {
+            frame[sizeof(RFID_Header)] = RFIDERROR_ILLEGAL_ACTION;
+            length = sizeof(RFID_Header) + 1 + sizeof(RFID_BCC);
+        }
+        break;
+    }
+
+    sim_finish_frame(frame, req, length);
+    ret = sim_send(port, frame, length, cfg, stats);
+
+    if (newbaud != 0) {
+        /* Like the reader, switch only once the reply has gone out */
+        FlushFileBuffers(port);
+        sim_set_baud(port, newbaud);
+        _tprintf(TEXT("Switched to %lu baud\n"), newbaud);
+    }
+
+    return ret;
+}
+
+/**
+ * Creates a random tag population spread over the reader's entities.
+ *
+ * @param DWORD count       The number of tags to create.
+ * @returns The array of tags.
+ */
+static SimTag* sim_make_tags(DWORD count) {
+    SimTag* tags = (SimTag*)malloc(sizeof(SimTag) * (count > 0 ? count : 1));
+    DWORD i = 0;
+    BYTE j = 0;
+
+    for (i = 0; i < count; i++) {
+        tags[i].entity = (BYTE)(0x02 + sim_rand() % 5);
+        tags[i].uidlen = (tags[i].entity == 0x02) ? 7 : 8;
+        for (j = 0; j < tags[i].uidlen; j++) {
+            tags[i].uid[j] = (BYTE)sim_rand();
+        }
+    }
+
+    return tags;
+}
+
+/**
+ * Opens the simulator's serial port.
+ *
+ * @param LPCTSTR name      The name of the port, e.g. COM5.
+ * @returns The port handle, or INVALID_HANDLE_VALUE on failure.
+ */
+static HANDLE sim_open(LPCTSTR name) {
+    TCHAR path[32];
+    HANDLE port = INVALID_HANDLE_VALUE;
+    COMMTIMEOUTS timeouts;
+    DCB dcb;
+
+    StringCchPrintf(path, 32, TEXT("\\\\.\\%s"), name);
+
+    port = CreateFile(path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+            OPEN_EXISTING, 0, NULL);
+    if (port == INVALID_HANDLE_VALUE) {
+        return port;
+    }
+
+    if (GetCommState(port, &dcb)) {
+        dcb.BaudRate = CBR_9600;
+        dcb.ByteSize = 8;
+        dcb.Parity = NOPARITY;
+        dcb.StopBits = ONESTOPBIT;
+        SetCommState(port, &dcb);
+    }
+
+    /* Return as soon as any bytes arrive, or after 100ms of nothing */
+    timeouts.ReadIntervalTimeout = MAXDWORD;
+    timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+    timeouts.ReadTotalTimeoutConstant = 100;
+    timeouts.WriteTotalTimeoutMultiplier = 0;
+    timeouts.WriteTotalTimeoutConstant = 0;
+    SetCommTimeouts(port, &timeouts);
+
+    return port;
+}
+
+/**
+ * Closes the simulator's serial port for a while and opens it again with
+ * the same settings, to look like a device that was unplugged and plugged
+ * back in.
+ *
+ * @param HANDLE port       The serial port, which is closed.
+ * @param LPCTSTR name      The name of the port.
+ * @param DWORD down        How long (ms) to leave it closed.
+ * @returns The reopened port handle, or INVALID_HANDLE_VALUE on failure.
+ */
+static HANDLE sim_drop(HANDLE port, LPCTSTR name, DWORD down) {
+    DCB dcb;
+    BOOL saved = GetCommState(port, &dcb);
+    DWORD tries = 0;
+
+    CloseHandle(port);
+    _tprintf(TEXT("Dropped %s for %lu ms\n"), name, down);
+    Sleep(down);
+
+    /* The terminal may be holding the port for a moment as it goes away */
+    while ((port = sim_open(name)) == INVALID_HANDLE_VALUE && ++tries < 50) {
+        Sleep(100);
+    }
+    if (port == INVALID_HANDLE_VALUE) {
+        return port;
+    }
+
+    if (saved) {
+        SetCommState(port, &dcb);
+    }
+    _tprintf(TEXT("Back on %s\n"), name);
+
+    return port;
+}
+
+/**
+ * Parses the command line options.
+ *
+ * @param int argc          The number of arguments.
+ * @param TCHAR** argv      The arguments.
+ * @param SimConfig* cfg    The settings to fill in.
+ * @returns none
+ */
+static void sim_parse_args(int argc, TCHAR** argv, SimConfig* cfg) {
+    int i = 0;
+
+    cfg->tags = 16;
+    cfg->present = 50;
+    cfg->latency = 0;
+    cfg->corrupt = 0;
+    cfg->fragment = 0;
+    cfg->seed = GetTickCount();
+    cfg->drop = 0;
+    cfg->down = 2000;
+
+    for (i = 2; i < argc; i++) {
+        TCHAR* value = _tcschr(argv[i], ':');
+        DWORD n = 0;
+
+        if (value == NULL) {
+            continue;
+        }
+        n = _tcstoul(value + 1, NULL, 10);
+
+        if (_tcsnicmp(argv[i], TEXT("/tags:"), 6) == 0) {
+            cfg->tags = n;
+        } else if (_tcsnicmp(argv[i], TEXT("/present:"), 9) == 0) {
+            cfg->present = n;
+        } else if (_tcsnicmp(argv[i], TEXT("/latency:"), 9) == 0) {
+            cfg->latency = n;
+        } else if (_tcsnicmp(argv[i], TEXT("/corrupt:"), 9) == 0) {
+            cfg->corrupt = n;
+        } else if (_tcsnicmp(argv[i], TEXT("/fragment:"), 10) == 0) {
+            cfg->fragment = n;
+        } else if (_tcsnicmp(argv[i], TEXT("/seed:"), 6) == 0) {
+            cfg->seed = n;
+        } else if (_tcsnicmp(argv[i], TEXT("/drop:"), 6) == 0) {
+            cfg->drop = n;
+        } else if (_tcsnicmp(argv[i], TEXT("/down:"), 6) == 0) {
+            cfg->down = n;
+        }
+    }
+
+    if (cfg->seed == 0) {
+        cfg->seed = 1;
+    }
+}
+
+int _tmain(int argc, TCHAR** argv) {
+    SimConfig cfg;
+    SimStats stats;
+    SimTag* tags = NULL;
+    HANDLE port = INVALID_HANDLE_VALUE;
+    BYTE frame[SIM_MAX_FRAME];
+    WORD have = 0;
+    DWORD lastreport = 0;
+    DWORD lastdrop = 0;
+
+    if (argc < 2) {
+        _tprintf(TEXT("Usage: %s <port> [/tags:N] [/present:P] [/latency:MS]")
+                TEXT(" [/corrupt:P] [/fragment:P] [/seed:N] [/drop:S]")
+                TEXT(" [/down:MS]\n"), argv[0]);
+        return 1;
+    }
+
+    sim_parse_args(argc, argv, &cfg);
+    sim_rand_state = cfg.seed;
+    tags = sim_make_tags(cfg.tags);
+    ZeroMemory(&stats, sizeof(SimStats));
+
+    if ((port = sim_open(argv[1])) == INVALID_HANDLE_VALUE) {
+        _tprintf(TEXT("Unable to open %s (error %lu)\n"), argv[1], GetLastError());
+        free(tags);
+        return 2;
+    }
+
+    _tprintf(TEXT("Simulating reader on %s: %lu tags, seed %lu\n"),
+            argv[1], cfg.tags, cfg.seed);
+    lastreport = GetTickCount();
+    lastdrop = lastreport;
+
+    for (;;) {
+        DWORD read = 0;
+
+        if (cfg.drop > 0 && GetTickCount() - lastdrop >= cfg.drop * 1000) {
+            port = sim_drop(port, argv[1], cfg.down);
+            if (port == INVALID_HANDLE_VALUE) {
+                _tprintf(TEXT("Unable to reopen %s (error %lu)\n"), argv[1],
+                        GetLastError());
+                break;
+            }
+
+            /* Whatever was half read went with the old connection */
+            have = 0;
+            stats.drops++;
+            lastdrop = GetTickCount();
+        }
+
+        if (!ReadFile(port, frame + have, SIM_MAX_FRAME - have, &read, NULL)) {
+            _tprintf(TEXT("Read failed (error %lu)\n"), GetLastError());
+            break;
+        }
+        have += (WORD)read;
+
+        /* Handle every complete frame in the buffer */
+        while (have > 0) {
+            WORD length = 0;
+            RFID_BCC bcc;
+
+            if (frame[0] != 0x01) {
+                /* Resynchronise on the next start of frame */
+                MoveMemory(frame, frame + 1, --have);
+                stats.badframes++;
+                continue;
+            }
+
+            if (have < sizeof(RFID_Header)) {
+                break;
+            }
+
+            length = ((RFID_Header*)frame)->length;
+            if (length < sizeof(RFID_Header) + sizeof(RFID_BCC)
+                    || length > SIM_MAX_FRAME) {
+                MoveMemory(frame, frame + 1, --have);
+                stats.badframes++;
+                continue;
+            }
+
+            if (have < length) {
+                break;
+            }
+
+            bcc = rfid_calc_bcc(frame, length - sizeof(RFID_BCC));
+            if (frame[length - 2] == bcc.lrc && frame[length - 1] == bcc.i_lrc) {
+                if (sim_respond(port, frame, tags, &cfg, &stats) != 0) {
+                    _tprintf(TEXT("Write failed (error %lu)\n"), GetLastError());
+                }
+            } else {
+                stats.badframes++;
+            }
+
+            have -= length;
+            MoveMemory(frame, frame + length, have);
+        }
+
+        if (GetTickCount() - lastreport >= 1000) {
+            _tprintf(TEXT("%lu cmds  %lu resps  %lu tags  %lu corrupt  ")
+                    TEXT("%lu fragmented  %lu bad  %lu drops\n"),
+                    stats.commands, stats.responses, stats.found,
+                    stats.corrupted, stats.fragmented, stats.badframes,
+                    stats.drops);
+            ZeroMemory(&stats, sizeof(SimStats));
+            lastreport = GetTickCount();
+        }
+    }
+
+    if (port != INVALID_HANDLE_VALUE) {
+        CloseHandle(port);
+    }
+    free(tags);
+
+    return 0;
+}
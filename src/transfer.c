@@ -0,0 +1,678 @@
+/**
+ * @filename transfer.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 29
+ * @project Terminal Emulator
+ *
+ * This file contains the parts of the file transfer engine shared by the
+ * XMODEM, YMODEM and ZMODEM protocols: starting and ending transfers, the
+ * files being transferred, output, timeouts and progress reports.
+ *
+ * Transfers run on the window thread. Received data is handed to the
+ * transfer before the emulator sees it, and output goes into the transmit
+ * queue without waiting; whatever doesn't fit is kept in out[] and moved
+ * across on the next TWM_TXDONE, even after the transfer has ended. While
+ * no transfer is running, received data is watched for a ZMODEM ZRQINIT so
+ * a transfer started with "sz" on the other end begins on its own.
+ */
+#include "transfer.h"
+
+/* The start of a ZRQINIT hex header */
+static const BYTE kAutoStart[] = { '*', '*', 0x18, 'B', '0', '0' };
+
+/* Names of the protocols, indexed by xfer_protocol */
+static const LPCTSTR kProtocolNames[] = {
+    TEXT(""), TEXT("XMODEM"), TEXT("YMODEM"), TEXT("ZMODEM")
+};
+
+/**
+ * Resets the transfer state and starts the timeout timer.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param BYTE protocol     The protocol to use.
+ * @param BYTE direction    kXferReceive or kXferSend.
+ * @returns none
+ */
+static void TransferBegin(Transfer* xf, BYTE protocol, BYTE direction) {
+    xf->protocol = protocol;
+    xf->direction = direction;
+    xf->state = 0;
+    xf->parse = 0;
+    xf->size = 0;
+    xf->offset = 0;
+    xf->acked = 0;
+    xf->total = 0;
+    xf->files = 0;
+    xf->start = GetTickCount();
+    xf->lastreport = 0;
+    xf->lastrx = xf->start;
+    xf->retries = 0;
+    xf->window = 0;
+    xf->blocklen = 0;
+    xf->block = 0;
+    xf->crc32 = FALSE;
+    xf->checksum = FALSE;
+    xf->discard = FALSE;
+    xf->eot = FALSE;
+    xf->escape = FALSE;
+    xf->cancount = 0;
+    xf->autostart = 0;
+    xf->skipOO = 0;
+    xf->inlen = 0;
+    xf->lastlen = 0;
+    xf->pendlen = 0;
+
+    SetTimer(xf->hwnd, XFER_TIMER, XFER_TICK, NULL);
+}
+
+/**
+ * Moves as much of out[] as will fit into the transmit queue.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+static void TransferFlush(Transfer* xf) {
+    DWORD queued = 0;
+
+    if (xf->outlen == 0) {
+        return;
+    }
+
+    queued = QueueData(xf->port, xf->out, xf->outlen);
+    if (queued > 0 && queued < xf->outlen) {
+        memmove(xf->out, xf->out + queued, xf->outlen - queued);
+    }
+    xf->outlen -= queued;
+}
+
+/**
+ * Prepares the transfer engine for use with a serial port. Received files
+ * are saved in a Downloads folder beside the program.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param HWND hwnd         The window that shows progress and owns the timer.
+ * @param SerialPort* sp    The serial port to transfer over.
+ * @returns none
+ */
+void TransferInit(Transfer* xf, HWND hwnd, SerialPort* sp) {
+    TCHAR szAppPath[MAX_PATH];
+
+    ZeroMemory(xf, sizeof(Transfer));
+    xf->protocol = kXferNone;
+    xf->hwnd = hwnd;
+    xf->port = sp;
+    xf->hFile = INVALID_HANDLE_VALUE;
+
+    GetModuleFileName(0, szAppPath, MAX_PATH - 1);
+    StringCchCopy(xf->szDir, _tcsrchr(szAppPath, '\\') - szAppPath + 2, szAppPath);
+    StringCchCat(xf->szDir, MAX_PATH, TEXT("Downloads\\"));
+}
+
+/**
+ * Starts receiving a file. XMODEM sends no file name, so the user is asked
+ * where to save it; YMODEM and ZMODEM files go in the download folder.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param BYTE protocol     The protocol to use.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int TransferReceive(Transfer* xf, BYTE protocol) {
+    if (xf->protocol != kXferNone) {
+        TransferCancel(xf, TRUE);
+    }
+
+    if (protocol == kXferXmodem) {
+        OPENFILENAME ofn;
+
+        xf->szPath[0] = 0;
+        ZeroMemory(&ofn, sizeof(OPENFILENAME));
+        ofn.lStructSize = sizeof(OPENFILENAME);
+        ofn.hwndOwner = xf->hwnd;
+        ofn.lpstrFilter = TEXT("All Files\0*.*\0");
+        ofn.lpstrFile = xf->szPath;
+        ofn.nMaxFile = MAX_PATH;
+        ofn.lpstrTitle = TEXT("Receive File");
+        ofn.Flags = OFN_OVERWRITEPROMPT | OFN_PATHMUSTEXIST;
+
+        if (!GetSaveFileName(&ofn)) {
+            return 0;
+        }
+
+        xf->hFile = CreateFile(xf->szPath, GENERIC_WRITE, 0, NULL,
+                CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (xf->hFile == INVALID_HANDLE_VALUE) {
+            return 1;
+        }
+    } else {
+        if (!CreateDirectory(xf->szDir, NULL) &&
+                GetLastError() != ERROR_ALREADY_EXISTS) {
+            return 2;
+        }
+    }
+
+    TransferBegin(xf, protocol, kXferReceive);
+    TransferReport(xf, TRUE);
+
+    if (protocol == kXferZmodem) {
+        ZmReceiveStart(xf);
+    } else {
+        XyReceiveStart(xf);
+    }
+
+    return 0;
+}
+
+/**
+ * Asks for a file and starts sending it.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param BYTE protocol     The protocol to use.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int TransferSend(Transfer* xf, BYTE protocol) {
+    OPENFILENAME ofn;
+
+    if (xf->protocol != kXferNone) {
+        TransferCancel(xf, TRUE);
+    }
+
+    xf->szPath[0] = 0;
+    ZeroMemory(&ofn, sizeof(OPENFILENAME));
+    ofn.lStructSize = sizeof(OPENFILENAME);
+    ofn.hwndOwner = xf->hwnd;
+    ofn.lpstrFilter = TEXT("All Files\0*.*\0");
+    ofn.lpstrFile = xf->szPath;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.lpstrTitle = TEXT("Send File");
+    ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST;
+
+    if (!GetOpenFileName(&ofn)) {
+        return 0;
+    }
+
+    return TransferSendFile(xf, protocol, xf->szPath);
+}
+
+/**
+ * Starts sending a file without asking for it.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param BYTE protocol     The protocol to use.
+ * @param LPCTSTR path      The file to send.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int TransferSendFile(Transfer* xf, BYTE protocol, LPCTSTR path) {
+    LARGE_INTEGER size;
+
+    if (xf->protocol != kXferNone) {
+        TransferCancel(xf, TRUE);
+    }
+
+    if (path != xf->szPath) {
+        StringCchCopy(xf->szPath, MAX_PATH, path);
+    }
+
+    xf->hFile = CreateFile(xf->szPath, GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (xf->hFile == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+
+    if (!GetFileSizeEx(xf->hFile, &size)) {
+        CloseHandle(xf->hFile);
+        xf->hFile = INVALID_HANDLE_VALUE;
+        return 2;
+    }
+
+    TransferBegin(xf, protocol, kXferSend);
+    xf->size = (ULONGLONG)size.QuadPart;
+    TransferReport(xf, TRUE);
+
+    if (protocol == kXferZmodem) {
+        ZmSendStart(xf);
+    } else {
+        XySendStart(xf);
+    }
+
+    return 0;
+}
+
+/**
+ * Passes received data to the transfer in progress. While no transfer is
+ * running, the data is watched for a ZRQINIT and a ZMODEM receive is
+ * started when one arrives.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @param BYTE* rx      The received data.
+ * @param DWORD len     The number of bytes received.
+ * @returns The number of bytes used by the transfer. The rest belongs to
+ *          the emulator.
+ */
+DWORD TransferInput(Transfer* xf, BYTE* rx, DWORD len) {
+    DWORD used = 0;
+    DWORD i = 0;
+
+    if (xf->protocol != kXferNone) {
+        xf->lastrx = GetTickCount();
+
+        if (xf->protocol == kXferZmodem) {
+            used = ZmInput(xf, rx, len);
+        } else {
+            used = XyInput(xf, rx, len);
+        }
+
+        /* The transfer ended part way through; look at the rest again */
+        if (used < len) {
+            used += TransferInput(xf, rx + used, len - used);
+        }
+        return used;
+    }
+
+    /* A ZMODEM sender ends with "OO" after we acknowledge its ZFIN */
+    while (used < len && xf->skipOO > 0 && rx[used] == 'O') {
+        xf->skipOO--;
+        used++;
+    }
+    if (used < len) {
+        xf->skipOO = 0;
+    }
+
+    for (i = used; i < len; i++) {
+        if (rx[i] == kAutoStart[xf->autostart]) {
+            if (++xf->autostart == sizeof(kAutoStart)) {
+                xf->autostart = 0;
+                if (TransferReceive(xf, kXferZmodem) == 0) {
+                    /* The sender repeats ZRQINIT until it hears from us */
+                    return len;
+                }
+            }
+        } else {
+            xf->autostart = (rx[i] == kAutoStart[0]) ? 1 : 0;
+        }
+    }
+
+    return used;
+}
+
+/**
+ * The receive pipeline stage of a transfer. What the transfer uses is
+ * consumed, and the rest is passed on to the emulator.
+ *
+ * @param LPVOID data   The Transfer.
+ * @param RxSlice* in   The received data.
+ * @param RxSlice* out  Receives what is left for the emulator.
+ * @param DWORD max     The room in out.
+ * @returns 1 if any data is left, 0 otherwise.
+ */
+DWORD TransferStage(LPVOID data, RxSlice* in, RxSlice* out, DWORD max) {
+    DWORD used = TransferInput((Transfer*)data, in->data, in->len);
+
+    if (used >= in->len) {
+        return 0;
+    }
+
+    out[0].data = in->data + used;
+    out[0].len = in->len - used;
+    return 1;
+}
+
+/**
+ * Moves pending output into the transmit queue, and lets a ZMODEM sender
+ * queue more of the file. Called for every TWM_TXDONE. Output left by a
+ * transfer that has ended, such as its last acknowledgement, is moved too.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+void TransferPump(Transfer* xf) {
+    TransferFlush(xf);
+
+    if (xf->protocol == kXferZmodem && xf->direction == kXferSend) {
+        ZmPump(xf);
+    }
+}
+
+/**
+ * Handles a tick of the transfer timer, retrying the last step if the
+ * other end has been silent for XFER_TIMEOUT.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+void TransferTimeout(Transfer* xf) {
+    DWORD now = GetTickCount();
+
+    if (xf->protocol == kXferNone) {
+        KillTimer(xf->hwnd, XFER_TIMER);
+        return;
+    }
+
+    TransferFlush(xf);
+
+    if (now - xf->lastrx < XFER_TIMEOUT) {
+        return;
+    }
+    xf->lastrx = now;
+
+    if (xf->protocol == kXferZmodem) {
+        ZmTimeout(xf);
+    } else {
+        XyTimeout(xf);
+    }
+}
+
+/**
+ * Stops the transfer in progress.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param BOOLEAN notify    TRUE to tell the other end, FALSE if the port is
+ *                          going away anyway.
+ * @returns none
+ */
+void TransferCancel(Transfer* xf, BOOLEAN notify) {
+    if (xf->protocol == kXferNone) {
+        return;
+    }
+
+    if (notify) {
+        TransferFail(xf, TEXT("Cancelled"));
+    } else {
+        xf->outlen = 0;
+        TransferEnd(xf, FALSE, TEXT("Cancelled"));
+    }
+}
+
+/**
+ * Cancels the transfer in progress after an error. Eight CANs stop any of
+ * the protocols; the backspaces erase them if the other end was a shell.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param LPCTSTR reason    Why the transfer failed.
+ * @returns none
+ */
+void TransferFail(Transfer* xf, LPCTSTR reason) {
+    static const BYTE abort[] = {
+        0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18,
+        0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08
+    };
+
+    /* Anything not yet sent is no longer wanted */
+    xf->outlen = 0;
+    TransferOut(xf, abort, sizeof(abort));
+    TransferEnd(xf, FALSE, reason);
+}
+
+/**
+ * Ends the transfer in progress and shows the result in the title bar.
+ * Output still in out[], such as the last acknowledgement, is left for
+ * TransferPump to send.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param BOOLEAN ok        TRUE if the transfer succeeded.
+ * @param LPCTSTR reason    Why the transfer failed, if it did.
+ * @returns none
+ */
+void TransferEnd(Transfer* xf, BOOLEAN ok, LPCTSTR reason) {
+    TCHAR title[160];
+    DWORD elapsed = GetTickCount() - xf->start;
+    ULONGLONG total = 0;
+
+    KillTimer(xf->hwnd, XFER_TIMER);
+
+    if (xf->hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(xf->hFile);
+        xf->hFile = INVALID_HANDLE_VALUE;
+        if (!ok && xf->direction == kXferReceive) {
+            /* Don't leave half a file behind */
+            DeleteFile(xf->szPath);
+        }
+    }
+
+    total = xf->total;
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+
+    if (ok) {
+        StringCchPrintf(title, 160,
+                TEXT("%s - %s: %lu file(s), %I64u bytes in %lu.%03lu s (%I64u bytes/sec)"),
+                APPNAME, kProtocolNames[xf->protocol], xf->files, total,
+                elapsed / 1000, elapsed % 1000, (total * 1000) / elapsed);
+    } else {
+        StringCchPrintf(title, 160, TEXT("%s - %s: transfer failed (%s)"),
+                APPNAME, kProtocolNames[xf->protocol], reason);
+    }
+    SetWindowText(xf->hwnd, title);
+
+    xf->protocol = kXferNone;
+    xf->autostart = 0;
+}
+
+/**
+ * Shows the progress and throughput of the transfer in the title bar, at
+ * most once every XFER_REPORT milliseconds unless forced.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param BOOLEAN force     TRUE to report regardless of the last report.
+ * @returns none
+ */
+void TransferReport(Transfer* xf, BOOLEAN force) {
+    TCHAR title[160];
+    TCHAR name[MAX_PATH];
+    LPCTSTR base = NULL;
+    DWORD now = GetTickCount();
+    DWORD elapsed = now - xf->start;
+    ULONGLONG done = xf->total + xf->offset;
+
+    if (!force && now - xf->lastreport < XFER_REPORT) {
+        return;
+    }
+    xf->lastreport = now;
+
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+
+    StringCchCopy(name, MAX_PATH, xf->szPath);
+    base = _tcsrchr(name, '\\');
+    base = (base != NULL) ? base + 1 : name;
+
+    if (xf->hFile == INVALID_HANDLE_VALUE) {
+        StringCchPrintf(title, 160, TEXT("%s - %s: Waiting for the other end"),
+                APPNAME, kProtocolNames[xf->protocol]);
+    } else if (xf->size != 0) {
+        StringCchPrintf(title, 160,
+                TEXT("%s - %s: %s %s - %I64u of %I64u bytes (%I64u bytes/sec)"),
+                APPNAME, kProtocolNames[xf->protocol],
+                (xf->direction == kXferSend) ? TEXT("Sending") : TEXT("Receiving"),
+                base, xf->offset, xf->size, (done * 1000) / elapsed);
+    } else {
+        StringCchPrintf(title, 160,
+                TEXT("%s - %s: %s %s - %I64u bytes (%I64u bytes/sec)"),
+                APPNAME, kProtocolNames[xf->protocol],
+                (xf->direction == kXferSend) ? TEXT("Sending") : TEXT("Receiving"),
+                base, xf->offset, (done * 1000) / elapsed);
+    }
+    SetWindowText(xf->hwnd, title);
+}
+
+/**
+ * Appends data to the output and moves as much as will fit into the
+ * transmit queue. Nothing waits for the queue to drain: if out[] can't
+ * hold the data either, the other end has stopped taking it and the
+ * transfer fails. Output after the transfer has ended is dropped.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param const BYTE* data  The data to send.
+ * @param DWORD len         The number of bytes to send.
+ * @returns none
+ */
+void TransferOut(Transfer* xf, const BYTE* data, DWORD len) {
+    if (xf->protocol == kXferNone) {
+        return;
+    }
+
+    if (xf->outlen + len > XFER_OUT) {
+        TransferFlush(xf);
+    }
+
+    if (xf->outlen + len > XFER_OUT) {
+        TransferFail(xf, TEXT("Output not taken"));
+        return;
+    }
+
+    memcpy(xf->out + xf->outlen, data, len);
+    xf->outlen += len;
+    TransferFlush(xf);
+}
+
+/**
+ * Creates a file in the download folder for a name sent by the other end.
+ * Any folders in the name are dropped.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @param LPCSTR name   The name of the file.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int TransferCreate(Transfer* xf, LPCSTR name) {
+    LPCSTR base = name;
+    LPCSTR p = NULL;
+    TCHAR file[MAX_PATH];
+
+    for (p = name; *p != 0; p++) {
+        if (*p == '/' || *p == '\\' || *p == ':') {
+            base = p + 1;
+        }
+    }
+
+    if (*base == 0 || strcmp(base, ".") == 0 || strcmp(base, "..") == 0) {
+        return 1;
+    }
+
+#ifdef UNICODE
+    if (MultiByteToWideChar(CP_ACP, 0, base, -1, file, MAX_PATH) == 0) {
+        return 2;
+    }
+#else
+    StringCchCopy(file, MAX_PATH, base);
+#endif
+
+    if (xf->hFile != INVALID_HANDLE_VALUE) {
+        /* The other end repeated its file header; start the file again */
+        CloseHandle(xf->hFile);
+        xf->hFile = INVALID_HANDLE_VALUE;
+    }
+
+    StringCchCopy(xf->szPath, MAX_PATH, xf->szDir);
+    if (FAILED(StringCchCat(xf->szPath, MAX_PATH, file))) {
+        return 3;
+    }
+
+    xf->hFile = CreateFile(xf->szPath, GENERIC_WRITE, 0, NULL,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (xf->hFile == INVALID_HANDLE_VALUE) {
+        return 4;
+    }
+
+    xf->offset = 0;
+    xf->size = 0;
+
+    return 0;
+}
+
+/**
+ * Writes received data to the file.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param const BYTE* data  The data to write.
+ * @param DWORD len         The number of bytes to write.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int TransferWrite(Transfer* xf, const BYTE* data, DWORD len) {
+    DWORD written = 0;
+
+    if (!WriteFile(xf->hFile, data, len, &written, NULL) || written != len) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads the next data to send from the file.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @param BYTE* data    Receives the data.
+ * @param DWORD len     The number of bytes to read.
+ * @returns The number of bytes read.
+ */
+DWORD TransferRead(Transfer* xf, BYTE* data, DWORD len) {
+    DWORD read = 0;
+
+    if (!ReadFile(xf->hFile, data, len, &read, NULL)) {
+        return 0;
+    }
+
+    return read;
+}
+
+/**
+ * Moves the position in the file being sent, for a ZMODEM restart.
+ *
+ * @param Transfer* xf          The transfer state.
+ * @param ULONGLONG offset      The new position.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+int TransferSeek(Transfer* xf, ULONGLONG offset) {
+    LARGE_INTEGER pos;
+
+    pos.QuadPart = (LONGLONG)offset;
+    if (!SetFilePointerEx(xf->hFile, pos, NULL, FILE_BEGIN)) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Closes the file being transferred and counts it as finished.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+void TransferClose(Transfer* xf) {
+    if (xf->hFile == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    CloseHandle(xf->hFile);
+    xf->hFile = INVALID_HANDLE_VALUE;
+
+    xf->total += xf->offset;
+    xf->files++;
+    xf->offset = 0;
+}
+
+/**
+ * Gets the name of the file being sent, without its folder, as the other
+ * end should see it.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @param LPSTR name    Receives the name.
+ * @param DWORD len     The size of name in bytes.
+ * @returns none
+ */
+void TransferName(Transfer* xf, LPSTR name, DWORD len) {
+    LPCTSTR base = _tcsrchr(xf->szPath, '\\');
+
+    base = (base != NULL) ? base + 1 : xf->szPath;
+
+#ifdef UNICODE
+    if (WideCharToMultiByte(CP_ACP, 0, base, -1, name, len, NULL, NULL) == 0) {
+        name[0] = 0;
+    }
+#else
+    StringCchCopyA(name, len, base);
+#endif
+}
@@ -0,0 +1,315 @@
+/**
+ * @filename transfer.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 29
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the file transfer
+ * engine (XMODEM, YMODEM and ZMODEM).
+ */
+#ifndef _TRANSFER_H_
+#define _TRANSFER_H_
+
+#include <Windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+#include "defines.h"
+#include "serial.h"
+#include "crc.h"
+#include "pipeline.h"
+
+/* Window timer used for protocol timeouts */
+#define XFER_TIMER 1
+/* Milliseconds between timer ticks */
+#define XFER_TICK 1000
+/* Milliseconds of silence before a retry */
+#define XFER_TIMEOUT 5000
+/* Retries before a transfer is given up */
+#define XFER_RETRIES 10
+/* Largest X/YMODEM block, and the size of the ZMODEM subpackets we send */
+#define XFER_BLOCK 1024
+/* Largest ZMODEM subpacket we accept */
+#define XFER_ZMAX 8192
+/* Size of the output buffer; room for an encoded subpacket and a header */
+#define XFER_OUT (XFER_BLOCK * 2 + 64)
+/* Milliseconds between progress reports */
+#define XFER_REPORT 500
+/* Most unacknowledged ZMODEM data in flight */
+#define XFER_ZWINDOW 32768
+
+/* ENUMERATION DECLARATIONS */
+enum xfer_protocol {
+    kXferNone = 0,
+    kXferXmodem = 1,
+    kXferYmodem = 2,
+    kXferZmodem = 3
+};
+
+enum xfer_direction {
+    kXferReceive = 0,
+    kXferSend = 1
+};
+
+/**
+ * The Transfer structure contains the state of a file transfer.
+ *
+ * @member BYTE protocol        The protocol in use (kXferNone when idle)
+ * @member BYTE direction       kXferReceive or kXferSend
+ * @member BYTE state           The protocol state
+ * @member BYTE parse           The input parser state
+ * @member HWND hwnd            The window that shows progress and owns the timer
+ * @member SerialPort* port     The serial port to transfer over
+ * @member HANDLE hFile         The file being sent or received
+ * @member TCHAR szDir[]        The folder received files are saved in
+ * @member TCHAR szPath[]       The path of the file being transferred
+ * @member ULONGLONG size       The size of the file, 0 if unknown
+ * @member ULONGLONG offset     The number of bytes sent or received
+ * @member ULONGLONG acked      The number of bytes the receiver has confirmed
+ * @member ULONGLONG total      The number of bytes in files already finished
+ * @member DWORD files          The number of files already finished
+ * @member DWORD start          The tick count when the transfer started
+ * @member DWORD lastreport     The tick count of the last progress report
+ * @member DWORD lastrx         The tick count of the last byte received
+ * @member DWORD retries        The number of retries since the last success
+ * @member DWORD window         The receiver's buffer size (ZMODEM), 0 for none
+ * @member DWORD blocklen       The number of file bytes in the last block sent
+ * @member BYTE block           The next X/YMODEM block number
+ * @member BOOLEAN crc32        Send ZMODEM frames with CRC-32
+ * @member BOOLEAN checksum     Use the X/YMODEM 8-bit checksum, not CRC-16
+ * @member BOOLEAN discard      Ignore ZMODEM data until the next header
+ * @member BOOLEAN eot          An YMODEM EOT has been seen once
+ * @member BOOLEAN escape       The last byte received was ZDLE
+ * @member BYTE cancount        The number of CANs received in a row
+ * @member BYTE format          The format of the last ZMODEM header
+ * @member BYTE autostart       The number of ZRQINIT bytes matched so far
+ * @member BYTE skipOO          The number of "OO" bytes still to swallow
+ * @member BYTE frameend        The end of the ZMODEM subpacket being received
+ * @member BYTE hdr[]           The last ZMODEM header received
+ * @member BYTE in[]            The block or subpacket being received
+ * @member DWORD inlen          The number of bytes in in[]
+ * @member DWORD need           The number of bytes the parser wants
+ * @member DWORD got            The number of those bytes received so far
+ * @member BYTE out[]           Output waiting for room in the transmit queue
+ * @member DWORD outlen         The number of bytes in out[]
+ * @member BYTE last[]          The last frame sent, kept for retries
+ * @member DWORD lastlen        The number of bytes in last[]
+ * @member BYTE pending[]       The last XMODEM block, held until EOT
+ * @member DWORD pendlen        The number of bytes in pending[]
+ */
+typedef struct _Transfer {
+    BYTE protocol;
+    BYTE direction;
+    BYTE state;
+    BYTE parse;
+    HWND hwnd;
+    SerialPort* port;
+    HANDLE hFile;
+    TCHAR szDir[MAX_PATH];
+    TCHAR szPath[MAX_PATH];
+    ULONGLONG size;
+    ULONGLONG offset;
+    ULONGLONG acked;
+    ULONGLONG total;
+    DWORD files;
+    DWORD start;
+    DWORD lastreport;
+    DWORD lastrx;
+    DWORD retries;
+    DWORD window;
+    DWORD blocklen;
+    BYTE block;
+    BOOLEAN crc32;
+    BOOLEAN checksum;
+    BOOLEAN discard;
+    BOOLEAN eot;
+    BOOLEAN escape;
+    BYTE cancount;
+    BYTE format;
+    BYTE autostart;
+    BYTE skipOO;
+    BYTE frameend;
+    BYTE hdr[5];
+    BYTE in[XFER_ZMAX + 8];
+    DWORD inlen;
+    DWORD need;
+    DWORD got;
+    BYTE out[XFER_OUT];
+    DWORD outlen;
+    BYTE last[XFER_BLOCK + 64];
+    DWORD lastlen;
+    BYTE pending[XFER_BLOCK];
+    DWORD pendlen;
+} Transfer;
+
+/* FUNCTION PROTOTYPES */
+/**
+ * Prepares the transfer engine for use with a serial port.
+ * @implementation transfer.c
+ */
+void TransferInit(Transfer* xf, HWND hwnd, SerialPort* sp);
+
+/**
+ * Starts receiving a file.
+ * @implementation transfer.c
+ */
+int TransferReceive(Transfer* xf, BYTE protocol);
+
+/**
+ * Asks for a file and starts sending it.
+ * @implementation transfer.c
+ */
+int TransferSend(Transfer* xf, BYTE protocol);
+
+/**
+ * Starts sending a file without asking for it.
+ * @implementation transfer.c
+ */
+int TransferSendFile(Transfer* xf, BYTE protocol, LPCTSTR path);
+
+/**
+ * Passes received data to the transfer in progress, or watches it for the
+ * start of a ZMODEM transfer.
+ * @implementation transfer.c
+ */
+DWORD TransferInput(Transfer* xf, BYTE* rx, DWORD len);
+
+/**
+ * The receive pipeline stage of a transfer.
+ * @implementation transfer.c
+ */
+DWORD TransferStage(LPVOID data, RxSlice* in, RxSlice* out, DWORD max);
+
+/**
+ * Moves pending output into the transmit queue.
+ * @implementation transfer.c
+ */
+void TransferPump(Transfer* xf);
+
+/**
+ * Handles a tick of the transfer timer.
+ * @implementation transfer.c
+ */
+void TransferTimeout(Transfer* xf);
+
+/**
+ * Stops the transfer in progress.
+ * @implementation transfer.c
+ */
+void TransferCancel(Transfer* xf, BOOLEAN notify);
+
+/**
+ * Cancels the transfer in progress after an error.
+ * @implementation transfer.c
+ */
+void TransferFail(Transfer* xf, LPCTSTR reason);
+
+/**
+ * Ends the transfer in progress and reports the result.
+ * @implementation transfer.c
+ */
+void TransferEnd(Transfer* xf, BOOLEAN ok, LPCTSTR reason);
+
+/**
+ * Shows the progress of the transfer in the title bar.
+ * @implementation transfer.c
+ */
+void TransferReport(Transfer* xf, BOOLEAN force);
+
+/**
+ * Appends data to the output and sends as much of it as will fit.
+ * @implementation transfer.c
+ */
+void TransferOut(Transfer* xf, const BYTE* data, DWORD len);
+
+/**
+ * Creates a file in the download folder for a name sent by the peer.
+ * @implementation transfer.c
+ */
+int TransferCreate(Transfer* xf, LPCSTR name);
+
+/**
+ * Writes received data to the file.
+ * @implementation transfer.c
+ */
+int TransferWrite(Transfer* xf, const BYTE* data, DWORD len);
+
+/**
+ * Reads the next data to send from the file.
+ * @implementation transfer.c
+ */
+DWORD TransferRead(Transfer* xf, BYTE* data, DWORD len);
+
+/**
+ * Moves the position in the file being sent.
+ * @implementation transfer.c
+ */
+int TransferSeek(Transfer* xf, ULONGLONG offset);
+
+/**
+ * Closes the file being transferred.
+ * @implementation transfer.c
+ */
+void TransferClose(Transfer* xf);
+
+/**
+ * Gets the name of the file being sent, as the peer should see it.
+ * @implementation transfer.c
+ */
+void TransferName(Transfer* xf, LPSTR name, DWORD len);
+
+/**
+ * Starts a ZMODEM receive.
+ * @implementation zmodem.c
+ */
+void ZmReceiveStart(Transfer* xf);
+
+/**
+ * Starts a ZMODEM send.
+ * @implementation zmodem.c
+ */
+void ZmSendStart(Transfer* xf);
+
+/**
+ * Parses ZMODEM input.
+ * @implementation zmodem.c
+ */
+DWORD ZmInput(Transfer* xf, const BYTE* rx, DWORD len);
+
+/**
+ * Queues more ZMODEM data while the receiver's window allows it.
+ * @implementation zmodem.c
+ */
+void ZmPump(Transfer* xf);
+
+/**
+ * Retries the last ZMODEM step after a timeout.
+ * @implementation zmodem.c
+ */
+void ZmTimeout(Transfer* xf);
+
+/**
+ * Starts an XMODEM or YMODEM receive.
+ * @implementation xymodem.c
+ */
+void XyReceiveStart(Transfer* xf);
+
+/**
+ * Starts an XMODEM or YMODEM send.
+ * @implementation xymodem.c
+ */
+void XySendStart(Transfer* xf);
+
+/**
+ * Parses XMODEM or YMODEM input.
+ * @implementation xymodem.c
+ */
+DWORD XyInput(Transfer* xf, const BYTE* rx, DWORD len);
+
+/**
+ * Retries the last XMODEM or YMODEM step after a timeout.
+ * @implementation xymodem.c
+ */
+void XyTimeout(Transfer* xf);
+
+#endif
@@ -0,0 +1,127 @@
+/**
+ * @filename txqueue.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 27
+ * @project Terminal Emulator
+ *
+ * This file contains the function implementations for the transmit queue.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "txqueue.h"
+
+/**
+ * Allocates the storage for a transmit queue.
+ *
+ * @param TxQueue* q    The queue to initialise.
+ * @param DWORD size    The capacity in bytes (0 for TXQUEUE_SIZE).
+ * @returns TRUE if the storage was allocated, FALSE otherwise.
+ */
+BOOLEAN TxQueueInit(TxQueue* q, DWORD size) {
+    q->size = (size == 0) ? TXQUEUE_SIZE : size;
+    q->head = 0;
+    q->count = 0;
+    q->data = (BYTE*)malloc(q->size);
+
+    return q->data != NULL;
+}
+
+/**
+ * Appends as many bytes as will fit to the queue. Bytes that are already
+ * queued are never moved, so a run returned by TxQueuePeek stays valid
+ * while new data is added.
+ *
+ * @param TxQueue* q        The queue.
+ * @param const BYTE* data  The bytes to queue.
+ * @param DWORD len         The number of bytes to queue.
+ * @returns The number of bytes queued, which may be less than len.
+ */
+DWORD TxQueuePut(TxQueue* q, const BYTE* data, DWORD len) {
+    DWORD tail = 0;
+    DWORD first = 0;
+
+    if (len > q->size - q->count) {
+        len = q->size - q->count;
+    }
+
+    tail = (q->head + q->count) % q->size;
+    first = q->size - tail;
+    if (first > len) {
+        first = len;
+    }
+
+    memcpy(q->data + tail, data, first);
+    memcpy(q->data, data + first, len - first);
+    q->count += len;
+
+    return len;
+}
+
+/**
+ * Gets the longest contiguous run of queued bytes starting at the front of
+ * the queue. The bytes stay queued until TxQueueConsume is called.
+ *
+ * @param TxQueue* q    The queue.
+ * @param BYTE** data   Receives a pointer to the first queued byte.
+ * @param DWORD max     The largest run to return.
+ * @returns The number of bytes in the run, 0 if the queue is empty.
+ */
+DWORD TxQueuePeek(TxQueue* q, BYTE** data, DWORD max) {
+    DWORD run = q->size - q->head;
+
+    if (run > q->count) {
+        run = q->count;
+    }
+    if (run > max) {
+        run = max;
+    }
+
+    *data = q->data + q->head;
+    return run;
+}
+
+/**
+ * Removes bytes from the front of the queue once they have been sent.
+ *
+ * @param TxQueue* q    The queue.
+ * @param DWORD len     The number of bytes to remove.
+ * @returns none
+ */
+void TxQueueConsume(TxQueue* q, DWORD len) {
+    if (len > q->count) {
+        len = q->count;
+    }
+
+    q->head = (q->head + len) % q->size;
+    q->count -= len;
+
+    if (q->count == 0) {
+        /* Start over so the next run is as long as possible */
+        q->head = 0;
+    }
+}
+
+/**
+ * Gets the number of bytes that can still be queued.
+ *
+ * @param TxQueue* q    The queue.
+ * @returns The free space in bytes.
+ */
+DWORD TxQueueSpace(TxQueue* q) {
+    return q->size - q->count;
+}
+
+/**
+ * Frees the storage of a transmit queue.
+ *
+ * @param TxQueue* q    The queue.
+ * @returns none
+ */
+void TxQueueFree(TxQueue* q) {
+    free(q->data);
+    q->data = NULL;
+    q->size = 0;
+    q->head = 0;
+    q->count = 0;
+}
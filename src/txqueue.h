@@ -0,0 +1,81 @@
+/**
+ * @filename txqueue.h
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 27
+ * @project Terminal Emulator
+ *
+ * This file contains the definitions and prototypes for the transmit queue,
+ * a bounded byte ring that the serial layer drains with one write per
+ * contiguous run, so many small sends are coalesced into a few writes.
+ *
+ * The queue does no locking and makes no system calls; the serial layer
+ * guards it with its own lock.
+ */
+#ifndef _TXQUEUE_H_
+#define _TXQUEUE_H_
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+/* The queue is plain C, so its tests also build and run off Windows */
+typedef unsigned char BYTE;
+typedef unsigned char BOOLEAN;
+typedef unsigned int DWORD;
+#endif
+
+/* Default queue capacity in bytes */
+#define TXQUEUE_SIZE 65536
+
+/**
+ * The TxQueue structure is a fixed-size ring of bytes waiting to be sent.
+ *
+ * @member BYTE* data       The ring storage
+ * @member DWORD size       The capacity of the ring
+ * @member DWORD head       The offset of the oldest queued byte
+ * @member DWORD count      The number of bytes queued
+ */
+typedef struct _TxQueue {
+    BYTE* data;
+    DWORD size;
+    DWORD head;
+    DWORD count;
+} TxQueue;
+
+/**
+ * Allocates the storage for a transmit queue.
+ * @implementation txqueue.c
+ */
+BOOLEAN TxQueueInit(TxQueue* q, DWORD size);
+
+/**
+ * Appends as many bytes as will fit to the queue.
+ * @implementation txqueue.c
+ */
+DWORD TxQueuePut(TxQueue* q, const BYTE* data, DWORD len);
+
+/**
+ * Gets the longest contiguous run of queued bytes.
+ * @implementation txqueue.c
+ */
+DWORD TxQueuePeek(TxQueue* q, BYTE** data, DWORD max);
+
+/**
+ * Removes bytes from the front of the queue once they have been sent.
+ * @implementation txqueue.c
+ */
+void TxQueueConsume(TxQueue* q, DWORD len);
+
+/**
+ * Gets the number of bytes that can still be queued.
+ * @implementation txqueue.c
+ */
+DWORD TxQueueSpace(TxQueue* q);
+
+/**
+ * Frees the storage of a transmit queue.
+ * @implementation txqueue.c
+ */
+void TxQueueFree(TxQueue* q);
+
+#endif
@@ -0,0 +1,538 @@
+/**
+ * @filename xymodem.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 29
+ * @project Terminal Emulator
+ *
+ * This file contains the XMODEM and YMODEM protocols for the file transfer
+ * engine, for devices that don't speak ZMODEM.
+ *
+ * Both use CRC-16 when the receiver asks for it with 'C', and fall back to
+ * the original 8-bit checksum when it sends NAK instead. XMODEM sends
+ * 128 byte blocks and pads the last one with SUB; YMODEM sends 1K blocks
+ * after a block 0 carrying the file name and size, and ends the batch with
+ * an empty block 0.
+ */
+#include "transfer.h"
+
+#define SOH 0x01
+#define STX 0x02
+#define EOT 0x04
+#define ACK 0x06
+#define NAK 0x15
+#define CAN 0x18
+#define SUB 0x1A
+#define CRC 'C'
+
+/* Start requests with 'C' before falling back to NAK */
+#define XY_CRC_TRIES 3
+
+/* ENUMERATION DECLARATIONS */
+enum xy_parse {
+    kXpStart = 0,   /* Waiting for SOH, STX or EOT */
+    kXpBlock = 1    /* Collecting a block */
+};
+
+enum xy_state {
+    kXyRecvHeader = 0,  /* YMODEM: waiting for block 0 */
+    kXyRecvData = 1,    /* Waiting for data blocks */
+    kXySendStart = 2,   /* Waiting for 'C' or NAK */
+    kXySendHeader = 3,  /* YMODEM: sent block 0 */
+    kXySendAck = 4,     /* Sent a block */
+    kXySendEot = 5,     /* Sent EOT */
+    kXySendEnd = 6,     /* YMODEM: waiting for 'C' before the empty block 0 */
+    kXySendFinal = 7    /* YMODEM: sent the empty block 0 */
+};
+
+/**
+ * Sends a single control byte.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @param BYTE c        The byte to send.
+ * @returns none
+ */
+static void XySendByte(Transfer* xf, BYTE c) {
+    TransferOut(xf, &c, 1);
+}
+
+/**
+ * Builds and sends a block, keeping it for retries.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param BYTE block        The block number.
+ * @param const BYTE* data  The block data.
+ * @param DWORD len         The number of bytes of data.
+ * @param DWORD size        The block size (128 or 1024).
+ * @param BYTE pad          The byte used to fill a short block.
+ * @returns none
+ */
+static void XySendBlock(Transfer* xf, BYTE block, const BYTE* data, DWORD len,
+        DWORD size, BYTE pad) {
+    BYTE* b = xf->last;
+
+    b[0] = (size == 1024) ? STX : SOH;
+    b[1] = block;
+    b[2] = (BYTE)~block;
+    memcpy(b + 3, data, len);
+    memset(b + 3 + len, pad, size - len);
+
+    if (xf->checksum) {
+        BYTE sum = 0;
+        DWORD i = 0;
+
+        for (i = 0; i < size; i++) {
+            sum += b[3 + i];
+        }
+        b[3 + size] = sum;
+        xf->lastlen = size + 4;
+    } else {
+        WORD crc = Crc16(0, b + 3, size);
+
+        b[3 + size] = (BYTE)(crc >> 8);
+        b[4 + size] = (BYTE)crc;
+        xf->lastlen = size + 5;
+    }
+
+    TransferOut(xf, xf->last, xf->lastlen);
+}
+
+/**
+ * Sends YMODEM block 0 with the name and size of the file, or an empty
+ * block 0 to end the batch.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @param BOOLEAN empty TRUE to end the batch.
+ * @returns none
+ */
+static void XySendHeader(Transfer* xf, BOOLEAN empty) {
+    BYTE info[128];
+    DWORD len = 0;
+
+    ZeroMemory(info, 128);
+
+    if (!empty) {
+        TransferName(xf, (LPSTR)info, 100);
+        len = (DWORD)strlen((LPCSTR)info) + 1;
+        StringCchPrintfA((LPSTR)(info + len), 128 - len, "%I64u", xf->size);
+    }
+
+    XySendBlock(xf, 0, info, 128, 128, 0);
+}
+
+/**
+ * Sends the next block of the file, or EOT at the end of the file.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+static void XySendNext(Transfer* xf) {
+    BYTE data[XFER_BLOCK];
+    DWORD size = (xf->protocol == kXferYmodem) ? 1024 : 128;
+    DWORD len = 0;
+
+    if (xf->offset >= xf->size) {
+        xf->lastlen = 0;
+        XySendByte(xf, EOT);
+        xf->state = kXySendEot;
+        return;
+    }
+
+    /* A short tail goes in a 128 byte block to save padding */
+    if (xf->size - xf->offset <= 128) {
+        size = 128;
+    }
+
+    len = (xf->size - xf->offset > size) ? size : (DWORD)(xf->size - xf->offset);
+    if (TransferRead(xf, data, len) != len) {
+        TransferFail(xf, TEXT("Could not read the file"));
+        return;
+    }
+
+    xf->blocklen = len;
+    XySendBlock(xf, xf->block, data, len, size, SUB);
+    xf->state = kXySendAck;
+}
+
+/**
+ * Asks the sender to start (or resend) with 'C', or NAK once it has
+ * ignored 'C' a few times.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+static void XyRequest(Transfer* xf) {
+    if (!xf->checksum && xf->offset == 0 && xf->retries >= XY_CRC_TRIES &&
+            xf->protocol == kXferXmodem) {
+        xf->checksum = TRUE;
+    }
+
+    XySendByte(xf, (BYTE)(xf->checksum ? NAK : CRC));
+}
+
+/**
+ * Writes out the XMODEM block held back until EOT, without the SUB padding
+ * of the last block.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @param BOOLEAN last  TRUE if this is the final block.
+ * @returns 0 on success, greater than 0 otherwise.
+ */
+static int XyFlushPending(Transfer* xf, BOOLEAN last) {
+    DWORD len = xf->pendlen;
+
+    if (last) {
+        while (len > 0 && xf->pending[len - 1] == SUB) {
+            len--;
+        }
+    }
+
+    xf->pendlen = 0;
+    if (len == 0) {
+        return 0;
+    }
+
+    xf->offset += len;
+    return TransferWrite(xf, xf->pending, len);
+}
+
+/**
+ * Handles a complete block as the receiver.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+static void XyBlock(Transfer* xf) {
+    DWORD size = xf->need - (xf->checksum ? 3 : 4);
+    BYTE block = xf->in[0];
+    BYTE* data = xf->in + 2;
+    BOOLEAN ok = (block == (BYTE)~xf->in[1]);
+
+    if (ok && xf->checksum) {
+        BYTE sum = 0;
+        DWORD i = 0;
+
+        for (i = 0; i < size; i++) {
+            sum += data[i];
+        }
+        ok = (sum == data[size]);
+    } else if (ok) {
+        ok = (Crc16(0, data, size) == (WORD)((data[size] << 8) | data[size + 1]));
+    }
+
+    if (!ok) {
+        if (++xf->retries > XFER_RETRIES) {
+            TransferFail(xf, TEXT("Too many errors"));
+            return;
+        }
+        XySendByte(xf, NAK);
+        return;
+    }
+
+    if (block == (BYTE)(xf->block - 1) && xf->state == kXyRecvData) {
+        /* Our ACK was lost and the sender repeated the block */
+        XySendByte(xf, ACK);
+        return;
+    }
+
+    if (block != xf->block) {
+        TransferFail(xf, TEXT("Lost block sequence"));
+        return;
+    }
+
+    xf->retries = 0;
+
+    if (xf->state == kXyRecvHeader) {
+        /* YMODEM block 0: name NUL size ... */
+        LPCSTR name = (LPCSTR)data;
+
+        data[size - 1] = 0;
+        if (name[0] == 0) {
+            /* An empty name ends the batch */
+            XySendByte(xf, ACK);
+            TransferEnd(xf, TRUE, NULL);
+            return;
+        }
+
+        if (TransferCreate(xf, name) != 0) {
+            TransferFail(xf, TEXT("Could not create the file"));
+            return;
+        }
+
+        xf->size = _strtoui64(name + strlen(name) + 1, NULL, 10);
+        xf->block = 1;
+        xf->state = kXyRecvData;
+        TransferReport(xf, TRUE);
+
+        XySendByte(xf, ACK);
+        XySendByte(xf, CRC);
+        return;
+    }
+
+    if (xf->protocol == kXferYmodem && xf->size != 0) {
+        /* YMODEM knows the size, so the padding can be dropped now */
+        DWORD len = (xf->size - xf->offset > size)
+                ? size : (DWORD)(xf->size - xf->offset);
+
+        if (TransferWrite(xf, data, len) != 0) {
+            TransferFail(xf, TEXT("Could not write the file"));
+            return;
+        }
+        xf->offset += len;
+    } else {
+        /* Hold each block until the next arrives, so the padding of the
+           last one can be removed */
+        if (XyFlushPending(xf, FALSE) != 0) {
+            TransferFail(xf, TEXT("Could not write the file"));
+            return;
+        }
+        memcpy(xf->pending, data, size);
+        xf->pendlen = size;
+    }
+
+    xf->block++;
+    XySendByte(xf, ACK);
+    TransferReport(xf, FALSE);
+}
+
+/**
+ * Handles EOT as the receiver.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+static void XyEot(Transfer* xf) {
+    if (xf->state != kXyRecvData) {
+        return;
+    }
+
+    if (xf->protocol == kXferYmodem && !xf->eot) {
+        /* YMODEM confirms EOT by asking for it twice */
+        xf->eot = TRUE;
+        XySendByte(xf, NAK);
+        return;
+    }
+
+    if (XyFlushPending(xf, TRUE) != 0) {
+        TransferFail(xf, TEXT("Could not write the file"));
+        return;
+    }
+
+    XySendByte(xf, ACK);
+    TransferReport(xf, TRUE);
+    TransferClose(xf);
+
+    if (xf->protocol == kXferXmodem) {
+        TransferEnd(xf, TRUE, NULL);
+        return;
+    }
+
+    /* Ask for the next file in the batch */
+    xf->eot = FALSE;
+    xf->block = 0;
+    xf->state = kXyRecvHeader;
+    XySendByte(xf, CRC);
+}
+
+/**
+ * Handles a byte from the receiver as the sender.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @param BYTE c        The received byte.
+ * @returns none
+ */
+static void XySenderByte(Transfer* xf, BYTE c) {
+    /* A receiver asks for block 0 or the first data block again with 'C'
+       rather than NAK */
+    if ((c == NAK && xf->state == kXySendAck) || (c == CRC &&
+            xf->state == kXySendAck && xf->offset == 0) || ((c == NAK ||
+            c == CRC) && (xf->state == kXySendHeader || xf->state == kXySendFinal))) {
+        if (++xf->retries > XFER_RETRIES) {
+            TransferFail(xf, TEXT("Too many errors"));
+            return;
+        }
+        TransferOut(xf, xf->last, xf->lastlen);
+        return;
+    }
+
+    switch (xf->state) {
+    case kXySendStart:
+        if (c != CRC && c != NAK) {
+            break;
+        }
+        /* The receiver's first request picks CRC-16 or the checksum */
+        xf->checksum = (c == NAK);
+        xf->retries = 0;
+
+        if (xf->protocol == kXferYmodem && xf->block == 0) {
+            XySendHeader(xf, FALSE);
+            xf->state = kXySendHeader;
+        } else {
+            XySendNext(xf);
+        }
+        break;
+    case kXySendHeader:
+        if (c == ACK) {
+            /* The receiver sends 'C' again when it is ready for the data */
+            xf->retries = 0;
+            xf->block = 1;
+            xf->state = kXySendStart;
+        }
+        break;
+    case kXySendAck:
+        if (c != ACK) {
+            break;
+        }
+        xf->retries = 0;
+        xf->offset += xf->blocklen;
+        xf->block++;
+        TransferReport(xf, FALSE);
+        XySendNext(xf);
+        break;
+    case kXySendEot:
+        if (c == NAK) {
+            XySendByte(xf, EOT);
+        } else if (c == ACK) {
+            TransferReport(xf, TRUE);
+            TransferClose(xf);
+
+            if (xf->protocol == kXferYmodem) {
+                xf->state = kXySendEnd;
+            } else {
+                TransferEnd(xf, TRUE, NULL);
+            }
+        }
+        break;
+    case kXySendEnd:
+        if (c == CRC) {
+            XySendHeader(xf, TRUE);
+            xf->state = kXySendFinal;
+        }
+        break;
+    case kXySendFinal:
+        if (c == ACK) {
+            TransferEnd(xf, TRUE, NULL);
+        }
+        break;
+    }
+}
+
+/**
+ * Starts an XMODEM or YMODEM receive by asking the sender to start.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+void XyReceiveStart(Transfer* xf) {
+    xf->parse = kXpStart;
+    xf->pendlen = 0;
+
+    if (xf->protocol == kXferYmodem) {
+        xf->block = 0;
+        xf->state = kXyRecvHeader;
+    } else {
+        xf->block = 1;
+        xf->state = kXyRecvData;
+    }
+
+    XyRequest(xf);
+}
+
+/**
+ * Starts an XMODEM or YMODEM send. Nothing is sent until the receiver asks
+ * for the first block.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+void XySendStart(Transfer* xf) {
+    xf->parse = kXpStart;
+    xf->block = (xf->protocol == kXferYmodem) ? 0 : 1;
+    xf->state = kXySendStart;
+}
+
+/**
+ * Parses XMODEM or YMODEM input.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param const BYTE* rx    The received data.
+ * @param DWORD len         The number of bytes received.
+ * @returns The number of bytes used; less than len if the transfer ended.
+ */
+DWORD XyInput(Transfer* xf, const BYTE* rx, DWORD len) {
+    DWORD i = 0;
+    BYTE protocol = xf->protocol;
+
+    for (i = 0; i < len && xf->protocol == protocol; i++) {
+        BYTE c = rx[i];
+
+        if (xf->parse == kXpStart) {
+            /* Two CANs in a row cancel the transfer */
+            if (c == CAN) {
+                if (++xf->cancount >= 2) {
+                    TransferEnd(xf, FALSE, TEXT("Cancelled by the other end"));
+                    return i + 1;
+                }
+                continue;
+            }
+            xf->cancount = 0;
+        }
+
+        if (xf->direction == kXferSend) {
+            XySenderByte(xf, c);
+            continue;
+        }
+
+        switch (xf->parse) {
+        case kXpStart:
+            if (c == SOH || c == STX) {
+                xf->inlen = 0;
+                xf->need = 2 + ((c == STX) ? 1024 : 128) + (xf->checksum ? 1 : 2);
+                xf->parse = kXpBlock;
+            } else if (c == EOT) {
+                XyEot(xf);
+            }
+            break;
+        case kXpBlock:
+            xf->in[xf->inlen++] = c;
+            if (xf->inlen == xf->need) {
+                xf->parse = kXpStart;
+                XyBlock(xf);
+            }
+            break;
+        }
+    }
+
+    return i;
+}
+
+/**
+ * Retries the last step after the other end has been silent too long. Only
+ * the receiver retries; the sender just gives up after XFER_RETRIES.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+void XyTimeout(Transfer* xf) {
+    if (++xf->retries > XFER_RETRIES) {
+        TransferFail(xf, TEXT("Timed out"));
+        return;
+    }
+
+    /* Whatever was half received is lost */
+    xf->parse = kXpStart;
+
+    if (xf->direction == kXferReceive) {
+        if (xf->state == kXyRecvHeader || (xf->offset == 0 && xf->pendlen == 0 &&
+                xf->block == 1)) {
+            XyRequest(xf);
+        } else {
+            XySendByte(xf, NAK);
+        }
+        return;
+    }
+
+    /* The sender doesn't repeat itself: the receiver NAKs on its own
+       timeout, and a second copy of a block would draw a second ACK that
+       could be taken for the next block's */
+}
@@ -0,0 +1,964 @@
+/**
+ * @filename zmodem.c
+ * @author Darryl Pogue
+ * @designer Darryl Pogue
+ * @date 2010 11 29
+ * @project Terminal Emulator
+ *
+ * This file contains the ZMODEM protocol for the file transfer engine.
+ *
+ * As a receiver, we answer ZRQINIT with ZRINIT, advertising full duplex,
+ * overlapped I/O and CRC-32, so the sender can stream a whole file in one
+ * ZDATA frame. A garbled subpacket is answered with ZRPOS and everything up
+ * to the next ZDATA header is discarded.
+ *
+ * As a sender, we stream 1K subpackets with ZCRCG and ask for a ZACK with
+ * ZCRCQ every quarter window. No more than XFER_ZWINDOW bytes (or the
+ * receiver's buffer size, if it gave one) are sent ahead of the last ZACK.
+ * New subpackets are made only when the previous one has been queued, so
+ * the transmit queue is kept full without blocking the window.
+ */
+#include "transfer.h"
+
+#define ZPAD '*'
+#define ZDLE 0x18
+#define ZBIN 'A'
+#define ZHEX 'B'
+#define ZBIN32 'C'
+
+/* Frame types */
+#define ZRQINIT 0
+#define ZRINIT 1
+#define ZSINIT 2
+#define ZACK 3
+#define ZFILE 4
+#define ZSKIP 5
+#define ZNAK 6
+#define ZABORT 7
+#define ZFIN 8
+#define ZRPOS 9
+#define ZDATA 10
+#define ZEOF 11
+#define ZFERR 12
+#define ZCAN 16
+#define ZCOMMAND 18
+#define ZCOMPL 15
+
+/* Subpacket ends */
+#define ZCRCE 'h'
+#define ZCRCG 'i'
+#define ZCRCQ 'j'
+#define ZCRCW 'k'
+#define ZRUB0 'l'
+#define ZRUB1 'm'
+
+/* ZRINIT capabilities (ZF0) */
+#define CANFDX 0x01
+#define CANOVIO 0x02
+#define CANFC32 0x20
+
+/* ZFILE conversion option (ZF0): binary */
+#define ZCBIN 1
+
+#define XON 0x11
+#define XOFF 0x13
+
+/* ENUMERATION DECLARATIONS */
+enum zm_parse {
+    kZpSync = 0,    /* Looking for ZPAD */
+    kZpPad = 1,     /* Seen ZPAD; looking for ZDLE */
+    kZpFormat = 2,  /* Seen ZDLE; next is the header format */
+    kZpHeader = 3,  /* Collecting the header */
+    kZpData = 4,    /* Collecting a data subpacket */
+    kZpCrc = 5      /* Collecting the CRC of a data subpacket */
+};
+
+enum zm_state {
+    kZmReceiving = 0,
+    kZmWaitRinit = 1,   /* Sent ZRQINIT */
+    kZmWaitRpos = 2,    /* Sent ZFILE */
+    kZmStreaming = 3,   /* Sending ZDATA */
+    kZmWaitAck = 4,     /* Sent ZCRCW; waiting for ZACK before resuming */
+    kZmWaitEof = 5,     /* Sent ZEOF; waiting for ZRINIT */
+    kZmWaitFin = 6      /* Sent ZFIN; waiting for ZFIN */
+};
+
+enum zm_unescape {
+    kZuNone = 0,    /* Nothing yet (ZDLE or flow control) */
+    kZuByte = 1,    /* A data byte */
+    kZuEnd = 2,     /* The end of a subpacket */
+    kZuError = 3    /* An invalid escape */
+};
+
+/**
+ * Escapes a byte for sending inside a binary header or subpacket. ZDLE and
+ * the flow control characters are escaped, as is CR so that telnet and
+ * modems don't see "@\r" command sequences.
+ *
+ * @param BYTE c        The byte to escape.
+ * @param BYTE* out     Receives the escaped byte(s).
+ * @returns The number of bytes written to out (1 or 2).
+ */
+static DWORD ZmEscape(BYTE c, BYTE* out) {
+    switch (c) {
+    case ZDLE:
+    case 0x10:
+    case 0x90:
+    case XON:
+    case 0x91:
+    case XOFF:
+    case 0x93:
+    case 0x0D:
+    case 0x8D:
+        out[0] = ZDLE;
+        out[1] = c ^ 0x40;
+        return 2;
+    }
+
+    out[0] = c;
+    return 1;
+}
+
+/**
+ * Removes the escaping from a received byte.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @param BYTE c        The received byte.
+ * @param BYTE* out     Receives the data byte or subpacket end.
+ * @returns One of the zm_unescape values.
+ */
+static int ZmUnescape(Transfer* xf, BYTE c, BYTE* out) {
+    if (xf->escape) {
+        xf->escape = FALSE;
+
+        switch (c) {
+        case ZCRCE:
+        case ZCRCG:
+        case ZCRCQ:
+        case ZCRCW:
+            *out = c;
+            return kZuEnd;
+        case ZRUB0:
+            *out = 0x7F;
+            return kZuByte;
+        case ZRUB1:
+            *out = 0xFF;
+            return kZuByte;
+        }
+
+        if ((c & 0x60) != 0x40) {
+            return kZuError;
+        }
+
+        *out = c ^ 0x40;
+        return kZuByte;
+    }
+
+    if (c == ZDLE) {
+        xf->escape = TRUE;
+        return kZuNone;
+    }
+
+    if ((c & 0x7F) == XON || (c & 0x7F) == XOFF) {
+        /* Flow control added along the way */
+        return kZuNone;
+    }
+
+    *out = c;
+    return kZuByte;
+}
+
+/**
+ * Stores a file position in the four header bytes (least significant
+ * first).
+ *
+ * @param BYTE* p           The header bytes.
+ * @param ULONGLONG pos     The position.
+ * @returns none
+ */
+static void ZmPosition(BYTE* p, ULONGLONG pos) {
+    p[0] = (BYTE)pos;
+    p[1] = (BYTE)(pos >> 8);
+    p[2] = (BYTE)(pos >> 16);
+    p[3] = (BYTE)(pos >> 24);
+}
+
+/**
+ * Gets the file position carried by the last header received.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns The position.
+ */
+static ULONGLONG ZmHeaderPosition(Transfer* xf) {
+    return (ULONGLONG)((DWORD)xf->hdr[1] | ((DWORD)xf->hdr[2] << 8) |
+            ((DWORD)xf->hdr[3] << 16) | ((DWORD)xf->hdr[4] << 24));
+}
+
+/**
+ * Builds a hex header.
+ *
+ * @param BYTE type     The frame type.
+ * @param const BYTE* p The four header bytes.
+ * @param BYTE* buf     Receives the header (at least 24 bytes).
+ * @returns The length of the header.
+ */
+static DWORD ZmHexHeader(BYTE type, const BYTE* p, BYTE* buf) {
+    static const char digits[] = "0123456789abcdef";
+    BYTE h[7];
+    WORD crc = 0;
+    DWORD n = 0;
+    DWORD i = 0;
+
+    h[0] = type;
+    memcpy(h + 1, p, 4);
+    crc = Crc16(0, h, 5);
+    h[5] = (BYTE)(crc >> 8);
+    h[6] = (BYTE)crc;
+
+    buf[n++] = ZPAD;
+    buf[n++] = ZPAD;
+    buf[n++] = ZDLE;
+    buf[n++] = ZHEX;
+    for (i = 0; i < 7; i++) {
+        buf[n++] = digits[h[i] >> 4];
+        buf[n++] = digits[h[i] & 0xF];
+    }
+    buf[n++] = '\r';
+    buf[n++] = 0x8A;
+
+    if (type != ZFIN && type != ZACK) {
+        buf[n++] = XON;
+    }
+
+    return n;
+}
+
+/**
+ * Builds a binary header, with CRC-32 if the receiver asked for it.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @param BYTE type     The frame type.
+ * @param const BYTE* p The four header bytes.
+ * @param BYTE* buf     Receives the header (at least 21 bytes).
+ * @returns The length of the header.
+ */
+static DWORD ZmBinHeader(Transfer* xf, BYTE type, const BYTE* p, BYTE* buf) {
+    BYTE h[5];
+    DWORD n = 0;
+    DWORD i = 0;
+
+    h[0] = type;
+    memcpy(h + 1, p, 4);
+
+    buf[n++] = ZPAD;
+    buf[n++] = ZDLE;
+    buf[n++] = xf->crc32 ? ZBIN32 : ZBIN;
+    for (i = 0; i < 5; i++) {
+        n += ZmEscape(h[i], buf + n);
+    }
+
+    if (xf->crc32) {
+        DWORD crc = Crc32(0, h, 5);
+        for (i = 0; i < 4; i++) {
+            n += ZmEscape((BYTE)(crc >> (8 * i)), buf + n);
+        }
+    } else {
+        WORD crc = Crc16(0, h, 5);
+        n += ZmEscape((BYTE)(crc >> 8), buf + n);
+        n += ZmEscape((BYTE)crc, buf + n);
+    }
+
+    return n;
+}
+
+/**
+ * Builds a data subpacket.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param const BYTE* data  The data.
+ * @param DWORD len         The number of bytes of data.
+ * @param BYTE end          The subpacket end (ZCRCE, ZCRCG, ZCRCQ or ZCRCW).
+ * @param BYTE* buf         Receives the subpacket (at least 2 * len + 11).
+ * @returns The length of the subpacket.
+ */
+static DWORD ZmSubpacket(Transfer* xf, const BYTE* data, DWORD len, BYTE end,
+        BYTE* buf) {
+    DWORD n = 0;
+    DWORD i = 0;
+
+    for (i = 0; i < len; i++) {
+        n += ZmEscape(data[i], buf + n);
+    }
+    buf[n++] = ZDLE;
+    buf[n++] = end;
+
+    if (xf->crc32) {
+        DWORD crc = Crc32(Crc32(0, data, len), &end, 1);
+        for (i = 0; i < 4; i++) {
+            n += ZmEscape((BYTE)(crc >> (8 * i)), buf + n);
+        }
+    } else {
+        WORD crc = Crc16(Crc16(0, data, len), &end, 1);
+        n += ZmEscape((BYTE)(crc >> 8), buf + n);
+        n += ZmEscape((BYTE)crc, buf + n);
+    }
+
+    if (end == ZCRCW) {
+        buf[n++] = XON;
+    }
+
+    return n;
+}
+
+/**
+ * Sends a frame and keeps a copy so it can be sent again after a timeout.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param const BYTE* buf   The frame.
+ * @param DWORD len         The length of the frame.
+ * @returns none
+ */
+static void ZmSend(Transfer* xf, const BYTE* buf, DWORD len) {
+    if (len <= sizeof(xf->last)) {
+        memcpy(xf->last, buf, len);
+        xf->lastlen = len;
+    }
+
+    TransferOut(xf, buf, len);
+}
+
+/**
+ * Sends a hex header carrying a file position (or zero).
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param BYTE type         The frame type.
+ * @param ULONGLONG pos     The position.
+ * @returns none
+ */
+static void ZmSendPosition(Transfer* xf, BYTE type, ULONGLONG pos) {
+    BYTE p[4];
+    BYTE buf[24];
+
+    ZmPosition(p, pos);
+    ZmSend(xf, buf, ZmHexHeader(type, p, buf));
+}
+
+/**
+ * Tells the sender we are ready for a file.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+static void ZmSendRinit(Transfer* xf) {
+    BYTE p[4] = { 0, 0, 0, CANFDX | CANOVIO | CANFC32 };
+    BYTE buf[24];
+
+    ZmSend(xf, buf, ZmHexHeader(ZRINIT, p, buf));
+}
+
+/**
+ * Offers the file to the receiver.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+static void ZmSendFile(Transfer* xf) {
+    BYTE p[4] = { 0, 0, 0, ZCBIN };
+    BYTE info[MAX_PATH + 64];
+    BYTE buf[(MAX_PATH + 64) * 2 + 40];
+    DWORD len = 0;
+    DWORD n = 0;
+
+    /* name NUL length mtime mode serial files-left bytes-left NUL */
+    TransferName(xf, (LPSTR)info, MAX_PATH);
+    len = (DWORD)strlen((LPCSTR)info) + 1;
+    StringCchPrintfA((LPSTR)(info + len), 64, "%I64u 0 100644 0 1 %I64u",
+            xf->size, xf->size);
+    len += (DWORD)strlen((LPCSTR)(info + len)) + 1;
+
+    n = ZmBinHeader(xf, ZFILE, p, buf);
+    n += ZmSubpacket(xf, info, len, ZCRCW, buf + n);
+    ZmSend(xf, buf, n);
+
+    xf->state = kZmWaitRpos;
+}
+
+/**
+ * Starts (or restarts) streaming the file from a position.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param ULONGLONG pos     The position to send from.
+ * @returns none
+ */
+static void ZmRestart(Transfer* xf, ULONGLONG pos) {
+    BYTE p[4];
+    BYTE buf[24];
+
+    if (pos > xf->size || TransferSeek(xf, pos) != 0) {
+        TransferFail(xf, TEXT("Bad file position"));
+        return;
+    }
+
+    /* A partly queued subpacket is useless now; the receiver resyncs on
+       the new header */
+    xf->outlen = 0;
+    xf->offset = pos;
+    xf->acked = pos;
+
+    ZmPosition(p, pos);
+    TransferOut(xf, buf, ZmBinHeader(xf, ZDATA, p, buf));
+
+    xf->state = kZmStreaming;
+    ZmPump(xf);
+}
+
+/**
+ * Handles a garbled subpacket or header while receiving file data.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+static void ZmReceiveError(Transfer* xf) {
+    xf->parse = kZpSync;
+    xf->inlen = 0;
+
+    if (xf->direction != kXferReceive || xf->hFile == INVALID_HANDLE_VALUE ||
+            xf->discard) {
+        return;
+    }
+
+    if (++xf->retries > XFER_RETRIES) {
+        TransferFail(xf, TEXT("Too many errors"));
+        return;
+    }
+
+    /* Ask for the data again and ignore everything until it comes */
+    xf->discard = TRUE;
+    ZmSendPosition(xf, ZRPOS, xf->offset);
+}
+
+/**
+ * Handles a header as the receiver.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param BYTE type         The frame type.
+ * @param ULONGLONG pos     The position carried by the header.
+ * @returns none
+ */
+static void ZmReceiverHeader(Transfer* xf, BYTE type, ULONGLONG pos) {
+    BYTE p[4] = { 0, 0, 0, 0 };
+    BYTE buf[24];
+
+    switch (type) {
+    case ZRQINIT:
+        if (xf->hFile == INVALID_HANDLE_VALUE) {
+            ZmSendRinit(xf);
+        }
+        break;
+    case ZSINIT:
+    case ZFILE:
+    case ZCOMMAND:
+        xf->parse = kZpData;
+        break;
+    case ZDATA:
+        if (xf->hFile == INVALID_HANDLE_VALUE) {
+            break;
+        }
+        if (pos != xf->offset) {
+            xf->discard = TRUE;
+            ZmSendPosition(xf, ZRPOS, xf->offset);
+            break;
+        }
+        xf->discard = FALSE;
+        xf->parse = kZpData;
+        break;
+    case ZEOF:
+        /* A ZEOF that doesn't match what we have is stale; ignore it */
+        if (xf->hFile != INVALID_HANDLE_VALUE && pos == xf->offset) {
+            TransferReport(xf, TRUE);
+            TransferClose(xf);
+            ZmSendRinit(xf);
+        }
+        break;
+    case ZFIN:
+        TransferOut(xf, buf, ZmHexHeader(ZFIN, p, buf));
+        xf->skipOO = 2;
+        TransferEnd(xf, TRUE, NULL);
+        break;
+    case ZNAK:
+        TransferOut(xf, xf->last, xf->lastlen);
+        break;
+    }
+}
+
+/**
+ * Handles a complete data subpacket as the receiver.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @param BYTE end      The subpacket end.
+ * @returns none
+ */
+static void ZmReceiverData(Transfer* xf, BYTE end) {
+    switch (xf->hdr[0]) {
+    case ZSINIT:
+        ZmSendPosition(xf, ZACK, 0);
+        break;
+    case ZCOMMAND:
+        /* We don't run commands for the other end */
+        ZmSendPosition(xf, ZCOMPL, 1);
+        break;
+    case ZFILE:
+        {
+            LPCSTR name = (LPCSTR)xf->in;
+            DWORD namelen = 0;
+
+            xf->in[xf->inlen] = 0;
+            namelen = (DWORD)strlen(name);
+
+            if (TransferCreate(xf, name) != 0) {
+                ZmSendPosition(xf, ZSKIP, 0);
+                break;
+            }
+
+            xf->size = (namelen + 1 < xf->inlen)
+                    ? _strtoui64(name + namelen + 1, NULL, 10) : 0;
+            xf->discard = FALSE;
+            xf->retries = 0;
+            TransferReport(xf, TRUE);
+            ZmSendPosition(xf, ZRPOS, 0);
+        }
+        break;
+    case ZDATA:
+        if (xf->discard) {
+            break;
+        }
+
+        if (TransferWrite(xf, xf->in, xf->inlen) != 0) {
+            TransferFail(xf, TEXT("Could not write the file"));
+            break;
+        }
+        xf->offset += xf->inlen;
+        xf->retries = 0;
+
+        if (end == ZCRCQ || end == ZCRCW) {
+            ZmSendPosition(xf, ZACK, xf->offset);
+        }
+        TransferReport(xf, FALSE);
+        break;
+    }
+}
+
+/**
+ * Handles a header as the sender.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param BYTE type         The frame type.
+ * @param ULONGLONG pos     The position carried by the header.
+ * @returns none
+ */
+static void ZmSenderHeader(Transfer* xf, BYTE type, ULONGLONG pos) {
+    BYTE p[4] = { 0, 0, 0, 0 };
+    BYTE buf[24];
+
+    switch (type) {
+    case ZRINIT:
+        xf->window = (DWORD)xf->hdr[1] | ((DWORD)xf->hdr[2] << 8);
+        xf->crc32 = (xf->hdr[4] & CANFC32) != 0;
+
+        if (xf->state == kZmWaitRinit || xf->state == kZmWaitRpos) {
+            ZmSendFile(xf);
+        } else if (xf->state == kZmWaitEof) {
+            /* The receiver has the whole file */
+            TransferReport(xf, TRUE);
+            TransferClose(xf);
+            ZmSend(xf, buf, ZmHexHeader(ZFIN, p, buf));
+            xf->state = kZmWaitFin;
+        }
+        break;
+    case ZRPOS:
+        if (xf->state == kZmWaitRinit || xf->state == kZmWaitFin) {
+            break;
+        }
+        if (xf->state != kZmWaitRpos && ++xf->retries > XFER_RETRIES) {
+            TransferFail(xf, TEXT("Too many errors"));
+            break;
+        }
+        ZmRestart(xf, pos);
+        break;
+    case ZACK:
+        if (pos > xf->acked && pos <= xf->offset) {
+            xf->acked = pos;
+            xf->retries = 0;
+        }
+        if (xf->state == kZmWaitAck) {
+            BYTE d[4];
+            ZmPosition(d, xf->offset);
+            TransferOut(xf, buf, ZmBinHeader(xf, ZDATA, d, buf));
+            xf->state = kZmStreaming;
+        }
+        ZmPump(xf);
+        break;
+    case ZSKIP:
+        TransferClose(xf);
+        ZmSend(xf, buf, ZmHexHeader(ZFIN, p, buf));
+        xf->state = kZmWaitFin;
+        break;
+    case ZFIN:
+        if (xf->state == kZmWaitFin) {
+            TransferOut(xf, (const BYTE*)"OO", 2);
+            TransferEnd(xf, TRUE, NULL);
+        }
+        break;
+    case ZNAK:
+        TransferOut(xf, xf->last, xf->lastlen);
+        break;
+    }
+}
+
+/**
+ * Checks and dispatches a complete header.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+static void ZmHeaderDone(Transfer* xf) {
+    BOOLEAN ok = FALSE;
+    BYTE type = 0;
+
+    if (xf->format == ZBIN32) {
+        ok = Crc32(0, xf->in, 5) == ((DWORD)xf->in[5] | ((DWORD)xf->in[6] << 8) |
+                ((DWORD)xf->in[7] << 16) | ((DWORD)xf->in[8] << 24));
+    } else {
+        ok = Crc16(0, xf->in, 5) == (WORD)((xf->in[5] << 8) | xf->in[6]);
+    }
+
+    xf->parse = kZpSync;
+    xf->inlen = 0;
+
+    if (!ok) {
+        ZmReceiveError(xf);
+        return;
+    }
+
+    memcpy(xf->hdr, xf->in, 5);
+    type = xf->hdr[0];
+
+    if (type == ZCAN || type == ZABORT || type == ZFERR) {
+        TransferEnd(xf, FALSE, TEXT("Cancelled by the other end"));
+        return;
+    }
+
+    if (xf->direction == kXferReceive) {
+        ZmReceiverHeader(xf, type, ZmHeaderPosition(xf));
+    } else {
+        ZmSenderHeader(xf, type, ZmHeaderPosition(xf));
+    }
+}
+
+/**
+ * Checks and dispatches a complete data subpacket.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+static void ZmDataDone(Transfer* xf) {
+    BYTE* crc = xf->in + xf->inlen;
+    BOOLEAN ok = FALSE;
+
+    if (xf->format == ZBIN32) {
+        ok = Crc32(Crc32(0, xf->in, xf->inlen), &xf->frameend, 1) ==
+                ((DWORD)crc[0] | ((DWORD)crc[1] << 8) |
+                 ((DWORD)crc[2] << 16) | ((DWORD)crc[3] << 24));
+    } else {
+        ok = Crc16(Crc16(0, xf->in, xf->inlen), &xf->frameend, 1) ==
+                (WORD)((crc[0] << 8) | crc[1]);
+    }
+
+    if (!ok) {
+        ZmReceiveError(xf);
+        return;
+    }
+
+    /* ZCRCG and ZCRCQ are followed by another subpacket */
+    xf->parse = (xf->frameend == ZCRCG || xf->frameend == ZCRCQ)
+            ? kZpData : kZpSync;
+
+    if (xf->direction == kXferReceive) {
+        ZmReceiverData(xf, xf->frameend);
+    }
+
+    xf->inlen = 0;
+}
+
+/**
+ * Gets the value of a hex digit.
+ *
+ * @param BYTE c    The character.
+ * @returns The value, or -1 if c is not a hex digit.
+ */
+static int ZmHexValue(BYTE c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+/**
+ * Starts a ZMODEM receive by telling the sender we are ready.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+void ZmReceiveStart(Transfer* xf) {
+    xf->state = kZmReceiving;
+    xf->parse = kZpSync;
+    ZmSendRinit(xf);
+}
+
+/**
+ * Starts a ZMODEM send. The "rz" starts a receiver on a shell at the other
+ * end; a terminal that auto-starts on ZRQINIT will ignore it.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+void ZmSendStart(Transfer* xf) {
+    BYTE p[4] = { 0, 0, 0, 0 };
+    BYTE buf[24];
+
+    xf->state = kZmWaitRinit;
+    xf->parse = kZpSync;
+
+    TransferOut(xf, (const BYTE*)"rz\r", 3);
+    ZmSend(xf, buf, ZmHexHeader(ZRQINIT, p, buf));
+}
+
+/**
+ * Parses ZMODEM input, one byte at a time so frames may be split across
+ * reads in any way.
+ *
+ * @param Transfer* xf      The transfer state.
+ * @param const BYTE* rx    The received data.
+ * @param DWORD len         The number of bytes received.
+ * @returns The number of bytes used; less than len if the transfer ended.
+ */
+DWORD ZmInput(Transfer* xf, const BYTE* rx, DWORD len) {
+    DWORD i = 0;
+
+    for (i = 0; i < len && xf->protocol == kXferZmodem; i++) {
+        BYTE c = rx[i];
+        BYTE b = 0;
+
+        /* Five CANs in a row abort the session */
+        if (c == ZDLE) {
+            if (++xf->cancount >= 5) {
+                TransferEnd(xf, FALSE, TEXT("Cancelled by the other end"));
+                return i + 1;
+            }
+        } else {
+            xf->cancount = 0;
+        }
+
+        switch (xf->parse) {
+        case kZpSync:
+            if (c == ZPAD) {
+                xf->parse = kZpPad;
+            }
+            break;
+        case kZpPad:
+            if (c == ZDLE) {
+                xf->parse = kZpFormat;
+            } else if (c != ZPAD) {
+                xf->parse = kZpSync;
+            }
+            break;
+        case kZpFormat:
+            if (c == ZBIN || c == ZHEX || c == ZBIN32) {
+                xf->format = c;
+                xf->inlen = 0;
+                xf->escape = FALSE;
+                xf->need = (c == ZHEX) ? 14 : ((c == ZBIN32) ? 9 : 7);
+                xf->parse = kZpHeader;
+            } else {
+                xf->parse = kZpSync;
+            }
+            break;
+        case kZpHeader:
+            if (xf->format == ZHEX) {
+                int v = ZmHexValue(c);
+
+                if (v < 0) {
+                    ZmReceiveError(xf);
+                    break;
+                }
+
+                /* Two digits per byte, collected in place */
+                if (xf->inlen & 1) {
+                    xf->in[xf->inlen / 2] |= (BYTE)v;
+                } else {
+                    xf->in[xf->inlen / 2] = (BYTE)(v << 4);
+                }
+
+                if (++xf->inlen == xf->need) {
+                    ZmHeaderDone(xf);
+                }
+            } else {
+                switch (ZmUnescape(xf, c, &b)) {
+                case kZuByte:
+                    xf->in[xf->inlen++] = b;
+                    if (xf->inlen == xf->need) {
+                        ZmHeaderDone(xf);
+                    }
+                    break;
+                case kZuEnd:
+                case kZuError:
+                    ZmReceiveError(xf);
+                    break;
+                }
+            }
+            break;
+        case kZpData:
+            switch (ZmUnescape(xf, c, &b)) {
+            case kZuByte:
+                if (xf->inlen >= XFER_ZMAX) {
+                    ZmReceiveError(xf);
+                    break;
+                }
+                xf->in[xf->inlen++] = b;
+                break;
+            case kZuEnd:
+                xf->frameend = b;
+                xf->got = 0;
+                xf->need = (xf->format == ZBIN32) ? 4 : 2;
+                xf->parse = kZpCrc;
+                break;
+            case kZuError:
+                ZmReceiveError(xf);
+                break;
+            }
+            break;
+        case kZpCrc:
+            switch (ZmUnescape(xf, c, &b)) {
+            case kZuByte:
+                xf->in[xf->inlen + xf->got++] = b;
+                if (xf->got == xf->need) {
+                    ZmDataDone(xf);
+                }
+                break;
+            case kZuEnd:
+            case kZuError:
+                ZmReceiveError(xf);
+                break;
+            }
+            break;
+        }
+    }
+
+    return i;
+}
+
+/**
+ * Queues more of the file while the receiver's window allows it. Nothing
+ * new is made until the previous subpacket has been queued.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+void ZmPump(Transfer* xf) {
+    BYTE data[XFER_BLOCK];
+    BYTE buf[XFER_OUT];
+    DWORD window = XFER_ZWINDOW;
+    DWORD step = 0;
+
+    if (xf->window != 0 && xf->window < window) {
+        window = xf->window;
+    }
+    step = (window / 4 > XFER_BLOCK) ? window / 4 : XFER_BLOCK;
+
+    while (xf->protocol == kXferZmodem && xf->state == kZmStreaming &&
+            xf->outlen == 0 && xf->offset - xf->acked < window) {
+        DWORD len = (xf->size - xf->offset > XFER_BLOCK)
+                ? XFER_BLOCK : (DWORD)(xf->size - xf->offset);
+        BYTE end = ZCRCG;
+
+        if (len > 0 && TransferRead(xf, data, len) != len) {
+            TransferFail(xf, TEXT("Could not read the file"));
+            return;
+        }
+
+        if (xf->offset + len >= xf->size) {
+            end = ZCRCE;
+        } else if (xf->window != 0 && xf->offset + len - xf->acked >= window) {
+            /* The receiver can't buffer more; wait for it to catch up */
+            end = ZCRCW;
+        } else if ((xf->offset + len) / step != xf->offset / step) {
+            end = ZCRCQ;
+        }
+
+        TransferOut(xf, buf, ZmSubpacket(xf, data, len, end, buf));
+        xf->offset += len;
+
+        if (end == ZCRCE) {
+            BYTE p[4];
+
+            ZmPosition(p, xf->offset);
+            ZmSend(xf, buf, ZmBinHeader(xf, ZEOF, p, buf));
+            xf->state = kZmWaitEof;
+        } else if (end == ZCRCW) {
+            xf->state = kZmWaitAck;
+        }
+    }
+
+    TransferReport(xf, FALSE);
+}
+
+/**
+ * Retries the last step after the other end has been silent too long.
+ *
+ * @param Transfer* xf  The transfer state.
+ * @returns none
+ */
+void ZmTimeout(Transfer* xf) {
+    DWORD window = XFER_ZWINDOW;
+
+    if (xf->window != 0 && xf->window < window) {
+        window = xf->window;
+    }
+
+    if (xf->state == kZmStreaming &&
+            (xf->outlen > 0 || xf->offset - xf->acked < window)) {
+        /* Still sending; the receiver has nothing to say */
+        return;
+    }
+
+    if (++xf->retries > XFER_RETRIES) {
+        TransferFail(xf, TEXT("Timed out"));
+        return;
+    }
+
+    if (xf->direction == kXferReceive) {
+        if (xf->hFile == INVALID_HANDLE_VALUE) {
+            ZmSendRinit(xf);
+        } else {
+            xf->discard = TRUE;
+            ZmSendPosition(xf, ZRPOS, xf->offset);
+        }
+        return;
+    }
+
+    switch (xf->state) {
+    case kZmStreaming:
+    case kZmWaitAck:
+        /* The acknowledgements were lost; go back to the last one */
+        ZmRestart(xf, xf->acked);
+        break;
+    default:
+        TransferOut(xf, xf->last, xf->lastlen);
+        break;
+    }
+}